@@ -179,6 +179,7 @@ APP_MODS_SRC_C = $(addprefix mods/,\
 	machwdt.c \
 	machrmt.c \
 	lwipsocket.c \
+	lwipsocket_rxring.c \
 	machtouch.c \
 	modmdns.c \
 	)
@@ -252,6 +253,8 @@ APP_LORA_SRC_C = $(addprefix lora/,\
 	sx1276-board.c \
 	sx1272-board.c \
 	board.c \
+	rxring.c \
+	txagg.c \
 	)
 
 APP_LORA_OPENTHREAD_SRC_C = $(addprefix lora/,\
@@ -280,8 +283,7 @@ APP_LIB_LORA_SRC_C = $(addprefix lib/lora/,\
 	system/delay.c \
 	system/gpio.c \
 	system/timer.c \
-	system/crypto/aes.c \
-	system/crypto/cmac.c \
+	system/crypto/aes32.c \
 	)
 
 APP_SX1308_SRC_C = $(addprefix drivers/sx1308/,\
@@ -304,7 +306,9 @@ APP_PYGATE_SRC_C = $(addprefix pygate/,\
 	lora_pkt_fwd/jitqueue.c \
 	lora_pkt_fwd/lora_pkt_fwd.c \
 	lora_pkt_fwd/parson.c \
+	lora_pkt_fwd/rxpk_json.c \
 	lora_pkt_fwd/timersync.c \
+	lora_pkt_fwd/txpk_json.c \
 	)
 
 APP_ETHERNET_SRC_C = $(addprefix mods/,\
@@ -4,6 +4,7 @@
 
 #include "py/mpconfig.h"
 #include "py/obj.h"
+#include "py/mphal.h"
 #include "lib/oofatfs/ff.h"
 #include "lib/oofatfs/diskio.h"
 #include "littlefs/lfs.h"
@@ -26,9 +27,19 @@ static bool sflash_init_done = false;
 static uint32_t sflash_start_address;
 static uint32_t sflash_fs_sector_count;
 
+#if MICROPY_VFS_STATS
+static mp_vfs_stats_t *sflash_stats;
+
+void sflash_disk_set_stats(mp_vfs_stats_t *stats) {
+    sflash_stats = stats;
+}
+#endif
 
 static bool sflash_write (void) {
     esp_err_t wr_result = ESP_FAIL;
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
 
     // erase the block first
     if (ESP_OK == spi_flash_erase_sector(sflash_prev_block_addr / SFLASH_BLOCK_SIZE)) {
@@ -40,6 +51,11 @@ static bool sflash_write (void) {
                 wr_result = spi_flash_write(sflash_prev_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE);
             }
     }
+    #if MICROPY_VFS_STATS
+    // every write-back costs a full block erase and program
+    mp_vfs_stats_record(sflash_stats, MP_VFS_STATS_ERASE, (sflash_prev_block_addr - sflash_start_address) / SFLASH_BLOCK_SIZE,
+                        SFLASH_BLOCK_SIZE, start, wr_result != ESP_OK);
+    #endif
     return (wr_result == ESP_OK);
 }
 
@@ -83,6 +99,9 @@ DRESULT sflash_disk_read(BYTE *buff, DWORD sector, UINT count) {
     for (int index = 0; index < count; index++) {
         secindex = (sector + index) % SFLASH_SECTORS_PER_BLOCK;
         uint32_t sflash_block_addr = sflash_start_address + (((sector + index) / SFLASH_SECTORS_PER_BLOCK) * SFLASH_BLOCK_SIZE);
+        #if MICROPY_VFS_STATS
+        MP_VFS_STATS_CACHE(sflash_stats, sflash_prev_block_addr == sflash_block_addr);
+        #endif
         // Check if it's a different block than last time
         if (sflash_prev_block_addr != sflash_block_addr) {
             if (sflash_disk_flush() != RES_OK) {
@@ -119,6 +138,9 @@ DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count) {
     do {
         secindex = (sector + index) % SFLASH_SECTORS_PER_BLOCK;
         uint32_t sflash_block_addr = sflash_start_address + (((sector + index) / SFLASH_SECTORS_PER_BLOCK) * SFLASH_BLOCK_SIZE);
+        #if MICROPY_VFS_STATS
+        MP_VFS_STATS_CACHE(sflash_stats, sflash_prev_block_addr == sflash_block_addr);
+        #endif
         // Check if it's a different block than last time
         if (sflash_prev_block_addr != sflash_block_addr) {
             if (sflash_disk_flush() != RES_OK) {
@@ -145,6 +167,9 @@ int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint3
 {
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
 
     if(block >= lfscfg->block_count) {
         ret = LFS_ERR_IO;
@@ -153,6 +178,10 @@ int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint3
         ret = LFS_ERR_IO;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_record(sflash_stats, MP_VFS_STATS_READ, block, size, start, ret != LFS_ERR_OK);
+    #endif
+
     // TODO sl_LockObjUnlock (&flash_LockObj);
     return ret;
 }
@@ -161,6 +190,9 @@ int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block)
 
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
 
     if(block >= lfscfg->block_count) {
         ret = LFS_ERR_IO;
@@ -169,6 +201,10 @@ int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block)
         ret = LFS_ERR_IO;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_record(sflash_stats, MP_VFS_STATS_ERASE, block, SFLASH_BLOCK_SIZE, start, ret != LFS_ERR_OK);
+    #endif
+
     // TODO sl_LockObjUnlock (&flash_LockObj);
     return ret;
 }
@@ -177,6 +213,9 @@ int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff
 
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
 
     if(block >= lfscfg->block_count) {
         ret = LFS_ERR_IO;
@@ -185,6 +224,10 @@ int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff
         ret = LFS_ERR_IO;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_record(sflash_stats, MP_VFS_STATS_WRITE, block, size, start, ret != LFS_ERR_OK);
+    #endif
+
     // TODO sl_LockObjUnlock (&flash_LockObj);
     return ret;
 }
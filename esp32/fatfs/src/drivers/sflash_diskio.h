@@ -10,6 +10,7 @@
 #include "littlefs/lfs.h"
 
 #include "mpconfigport.h"
+#include "extmod/vfs_stats.h"
 
 #define SFLASH_BLOCK_SIZE               SPI_FLASH_SEC_SIZE
 #define SFLASH_FS_SECTOR_SIZE           512
@@ -33,6 +34,9 @@ DRESULT sflash_disk_read(BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_flush(void);
 uint32_t sflash_get_sector_count(void);
+#if MICROPY_VFS_STATS
+void sflash_disk_set_stats(mp_vfs_stats_t *stats);
+#endif
 
 extern int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t size);
 extern int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void* buff, uint32_t block, uint32_t size);
@@ -62,11 +62,16 @@
 #define FTP_CMD_PORT                        21
 #define FTP_ACTIVE_DATA_PORT                20
 #define FTP_PASIVE_DATA_PORT                2024
-#define FTP_BUFFER_SIZE                     512
-#define FTP_TX_RETRIES_MAX                  50
+#ifndef FTP_BUFFER_SIZE
+#define FTP_BUFFER_SIZE                     4096            // per session, allocated while a client is connected
+#endif
+#define FTP_TX_RETRIES_MAX                  (FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS)  // cycles a send may make no progress
 #define FTP_CMD_SIZE_MAX                    6
-#define FTP_CMD_CLIENTS_MAX                 1
-#define FTP_DATA_CLIENTS_MAX                1
+#ifndef FTP_CMD_CLIENTS_MAX
+#define FTP_CMD_CLIENTS_MAX                 3
+#endif
+#define FTP_DATA_CLIENTS_MAX                1               // per session
+#define FTP_TRANSFER_BURST_MAX              (8 * 1024)      // bytes moved per session in one cycle
 #define FTP_MAX_PARAM_SIZE                  (MICROPY_ALLOC_PATH_MAX + 1)
 #define FTP_UNIX_TIME_20000101              946684800ll
 #define FTP_UNIX_TIME_20150101              1420070400ll
@@ -140,30 +145,44 @@ typedef struct {
 
 typedef struct {
     uint8_t             *dBuffer;
+    char                *path;
+    char                *scratch;
+    char                *cmd_buffer;
+    FIFO_t              fifo;
+    SocketFifoElement_t fifoelements[FTP_SOCKETFIFO_ELEMENTS_MAX];
     uint32_t            ctimeout;
     union {
         ftp_file_t fp;
         ftp_dir_t  dp;
     }u;
-    int32_t             lc_sd;
     int32_t             ld_sd;
     int32_t             c_sd;
     int32_t             d_sd;
     int32_t             dtimeout;
     uint32_t            volcount;
     uint32_t            ip_addr;
+    uint32_t            last_dir_idx;
+    uint32_t            moved;
+    uint16_t            data_port;
     uint8_t             state;
     uint8_t             substate;
-    uint8_t             txRetries;
+    uint16_t            txOffset;       // bytes of the FIFO head already sent
+    uint16_t            txRetries;
     uint8_t             logginRetries;
     ftp_loggin_t        loggin;
     uint8_t             e_open;
     bool                closechild;
-    bool                enabled;
     bool                special_file;
     bool                listroot;
 } ftp_data_t;
 
+typedef struct {
+    ftp_data_t          session[FTP_CMD_CLIENTS_MAX];
+    int32_t             lc_sd;
+    uint8_t             state;
+    bool                enabled;
+} ftp_server_t;
+
 typedef struct {
     char * cmd;
 } ftp_cmd_t;
@@ -202,10 +221,8 @@ typedef enum {
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
-static ftp_data_t ftp_data;
-static char *ftp_path;
-static char *ftp_scratch_buffer;
-static char *ftp_cmd_buffer;
+static ftp_server_t ftp_server;
+static ftp_data_t *ftp_data;        // the session being served
 static const ftp_cmd_t ftp_cmd_table[] = { { "FEAT" }, { "SYST" }, { "CDUP" }, { "CWD"  },
                                            { "PWD"  }, { "XPWD" }, { "SIZE" }, { "MDTM" },
                                            { "TYPE" }, { "USER" }, { "PASS" }, { "PASV" },
@@ -217,9 +234,6 @@ static const ftp_month_t ftp_month[] = { { "Jan" }, { "Feb" }, { "Mar" }, { "Apr
                                          { "May" }, { "Jun" }, { "Jul" }, { "Ago" },
                                          { "Sep" }, { "Oct" }, { "Nov" }, { "Dec" } };
 
-static SocketFifoElement_t ftp_fifoelements[FTP_SOCKETFIFO_ELEMENTS_MAX];
-static FIFO_t ftp_socketfifo;
-static uint32_t ftp_last_dir_idx;
 static const TCHAR *path_relative;
 
 /******************************************************************************
@@ -260,9 +274,9 @@ STATIC FRESULT f_open_helper(ftp_file_t *fp, const TCHAR *path, BYTE mode) {
 
 STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize ) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
@@ -275,7 +289,7 @@ STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, u
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -285,9 +299,9 @@ STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, u
 
 STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
@@ -304,7 +318,7 @@ STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize,
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -314,10 +328,10 @@ STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize,
 
 STATIC FRESULT f_readdir_helper(ftp_dir_t *dp, ftp_fileinfo_t *fno ) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
 
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
@@ -372,7 +386,7 @@ STATIC FRESULT f_readdir_helper(ftp_dir_t *dp, ftp_fileinfo_t *fno ) {
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -409,9 +423,9 @@ STATIC FRESULT f_opendir_helper(ftp_dir_t *dp, const TCHAR *path) {
 
 STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
@@ -424,7 +438,7 @@ STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -434,9 +448,9 @@ STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
 
 STATIC FRESULT f_closedir_helper(ftp_dir_t *dp) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
@@ -449,7 +463,7 @@ STATIC FRESULT f_closedir_helper(ftp_dir_t *dp) {
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -588,6 +602,10 @@ STATIC FRESULT f_rename_helper(const TCHAR *path_old, const TCHAR *path_new) {
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
 static void ftp_wait_for_enabled (void);
+static void ftp_accept_session (void);
+static bool ftp_open_session (void);
+static void ftp_close_session (void);
+static void ftp_run_session (void);
 static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t backlog);
 static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr);
 static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len);
@@ -611,59 +629,169 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
 static void ftp_open_child (char *pwd, char *dir);
 static void ftp_close_child (char *pwd);
 static void ftp_return_to_previous_path (char *pwd, char *dir);
+static bool ftp_updater_busy (void);
 
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
 void ftp_init (void) {
-    // allocate memory for the data buffer, and the file system structs (from the RTOS heap)
-    ftp_data.dBuffer = malloc(FTP_BUFFER_SIZE);
-    ftp_path = malloc(FTP_MAX_PARAM_SIZE);
-    ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
-    ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    SOCKETFIFO_Init (&ftp_socketfifo, (void *)ftp_fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
-    ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
-    ftp_data.state = E_FTP_STE_DISABLED;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.special_file = false;
-    ftp_data.volcount = 0;
-    ftp_last_dir_idx = 0;
+    ftp_server.lc_sd = -1;
+    ftp_server.state = E_FTP_STE_DISABLED;
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_data_t *session = &ftp_server.session[i];
+        SOCKETFIFO_Init (&session->fifo, (void *)session->fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
+        session->c_sd  = -1;
+        session->d_sd  = -1;
+        session->ld_sd = -1;
+        session->e_open = E_FTP_NOTHING_OPEN;
+        session->state = E_FTP_STE_READY;
+        session->substate = E_FTP_STE_SUB_DISCONNECTED;
+        session->special_file = false;
+        session->volcount = 0;
+        session->last_dir_idx = 0;
+        // every session gets its own passive data port
+        session->data_port = FTP_PASIVE_DATA_PORT + i;
+    }
+    ftp_data = &ftp_server.session[0];
 }
 
 void ftp_run (void) {
-    switch (ftp_data.state) {
+    switch (ftp_server.state) {
         case E_FTP_STE_DISABLED:
             ftp_wait_for_enabled();
-            break;
+            return;
         case E_FTP_STE_START:
-            if (/*wlan_is_connected() && */ ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
-                ftp_data.state = E_FTP_STE_READY;
+            if (/*wlan_is_connected() && */ ftp_create_listening_socket(&ftp_server.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
+                ftp_server.state = E_FTP_STE_READY;
             }
+            return;
+        default:
             break;
-        case E_FTP_STE_READY:
-            if (ftp_data.c_sd < 0 && ftp_data.substate == E_FTP_STE_SUB_DISCONNECTED) {
-                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.lc_sd, &ftp_data.c_sd, &ftp_data.ip_addr)) {
-                    ftp_data.txRetries = 0;
-                    ftp_data.logginRetries = 0;
-                    ftp_data.ctimeout = 0;
-                    ftp_data.loggin.uservalid = false;
-                    ftp_data.loggin.passvalid = false;
-                    strcpy (ftp_path, "/");
-                    ftp_send_reply (220, "Micropython FTP Server");
-                    break;
-                }
+    }
+
+    ftp_accept_session();
+
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX && ftp_server.state == E_FTP_STE_READY; i++) {
+        ftp_data = &ftp_server.session[i];
+        if (ftp_data->c_sd < 0) {
+            continue;
+        }
+        // while a transfer keeps moving data, step it again right away (up to a
+        // budget) instead of waiting for the next server cycle
+        uint32_t moved;
+        ftp_data->moved = 0;
+        do {
+            moved = ftp_data->moved;
+            ftp_run_session();
+        } while (ftp_data->state > E_FTP_STE_END_TRANSFER && ftp_data->moved > moved &&
+                 ftp_data->moved < FTP_TRANSFER_BURST_MAX);
+        if (ftp_data->c_sd < 0) {
+            ftp_close_session();
+        }
+    }
+}
+
+void ftp_enable (void) {
+    ftp_server.enabled = true;
+}
+
+void ftp_disable (void) {
+    ftp_reset();
+    ftp_server.enabled = false;
+    ftp_server.state = E_FTP_STE_DISABLED;
+}
+
+void ftp_reset (void) {
+    // close all connections and start all over again
+    ftp_data_t *current = ftp_data;
+    servers_close_socket(&ftp_server.lc_sd);
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_data = &ftp_server.session[i];
+        ftp_close_session();
+    }
+    ftp_data = current;
+    ftp_server.state = E_FTP_STE_START;
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void ftp_wait_for_enabled (void) {
+    // Check if the telnet service has been enabled
+    if (ftp_server.enabled) {
+        ftp_server.state = E_FTP_STE_START;
+    }
+}
+
+static void ftp_accept_session (void) {
+    int32_t sd;
+    uint32_t ip_addr;
+
+    if (E_FTP_RESULT_OK != ftp_wait_for_connection(ftp_server.lc_sd, &sd, &ip_addr)) {
+        return;
+    }
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_data = &ftp_server.session[i];
+        if (ftp_data->c_sd < 0) {
+            if (!ftp_open_session()) {
+                break;
             }
-            if (SOCKETFIFO_IsEmpty()) {
-                if (ftp_data.c_sd > 0 && ftp_data.substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+            ftp_data->c_sd = sd;
+            ftp_data->ip_addr = ip_addr;
+            ftp_data->txRetries = 0;
+            ftp_data->logginRetries = 0;
+            ftp_data->ctimeout = 0;
+            ftp_data->loggin.uservalid = false;
+            ftp_data->loggin.passvalid = false;
+            strcpy (ftp_data->path, "/");
+            ftp_send_reply (220, "Micropython FTP Server");
+            return;
+        }
+    }
+    // all sessions are taken, or there's no memory for another one
+    send(sd, "421 Too many users\r\n", 20, 0);
+    servers_close_socket(&sd);
+}
+
+static bool ftp_open_session (void) {
+    // the buffers are only held while a client is connected
+    ftp_data->dBuffer = malloc(FTP_BUFFER_SIZE);
+    ftp_data->path = malloc(FTP_MAX_PARAM_SIZE);
+    ftp_data->scratch = malloc(FTP_MAX_PARAM_SIZE);
+    ftp_data->cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
+    if (!ftp_data->dBuffer || !ftp_data->path || !ftp_data->scratch || !ftp_data->cmd_buffer) {
+        ftp_close_session();
+        return false;
+    }
+    return true;
+}
+
+static void ftp_close_session (void) {
+    servers_close_socket(&ftp_data->ld_sd);
+    ftp_close_cmd_data();
+    SOCKETFIFO_Flush(&ftp_data->fifo);
+    ftp_data->txOffset = 0;
+    free(ftp_data->dBuffer);
+    free(ftp_data->path);
+    free(ftp_data->scratch);
+    free(ftp_data->cmd_buffer);
+    ftp_data->dBuffer = NULL;
+    ftp_data->path = NULL;
+    ftp_data->scratch = NULL;
+    ftp_data->cmd_buffer = NULL;
+    ftp_data->state = E_FTP_STE_READY;
+    ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
+    ftp_data->volcount = 0;
+    ftp_data->last_dir_idx = 0;
+}
+
+static void ftp_run_session (void) {
+    switch (ftp_data->state) {
+        case E_FTP_STE_READY:
+            if (SOCKETFIFO_IsEmpty(&ftp_data->fifo)) {
+                if (ftp_data->c_sd > 0 && ftp_data->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
                     ftp_process_cmd();
-                    if (ftp_data.state != E_FTP_STE_READY) {
-                        break;
-                    }
                 }
             }
             break;
@@ -671,72 +799,75 @@ void ftp_run (void) {
             break;
         case E_FTP_STE_CONTINUE_LISTING:
             // go on with listing only if the transmit buffer is empty
-            if (SOCKETFIFO_IsEmpty()) {
+            if (SOCKETFIFO_IsEmpty(&ftp_data->fifo)) {
                 uint32_t listsize;
-                ftp_list_dir((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &listsize);
+                ftp_list_dir((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, &listsize);
                 if (listsize > 0) {
                     ftp_send_data(listsize);
+                    ftp_data->moved += listsize;
                 } else {
                     ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 }
-                ftp_data.ctimeout = 0;
+                ftp_data->ctimeout = 0;
             }
             break;
         case E_FTP_STE_CONTINUE_FILE_TX:
             // read the next block from the file only if the previous one has been sent
-            if (SOCKETFIFO_IsEmpty()) {
+            if (SOCKETFIFO_IsEmpty(&ftp_data->fifo)) {
                 uint32_t readsize;
                 ftp_result_t result;
-                ftp_data.ctimeout = 0;
-                result = ftp_read_file ((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &readsize);
+                ftp_data->ctimeout = 0;
+                result = ftp_read_file ((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, &readsize);
                 if (result == E_FTP_RESULT_FAILED) {
                     ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 } else {
                     if (readsize > 0) {
                         ftp_send_data(readsize);
+                        ftp_data->moved += readsize;
                     }
                     if (result == E_FTP_RESULT_OK) {
                         ftp_send_reply(226, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
+                        ftp_data->state = E_FTP_STE_END_TRANSFER;
                     }
                 }
             }
             break;
         case E_FTP_STE_CONTINUE_FILE_RX:
-            if (SOCKETFIFO_IsEmpty()) {
+            if (SOCKETFIFO_IsEmpty(&ftp_data->fifo)) {
                 int32_t len;
                 ftp_result_t result;
-                if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.d_sd, ftp_data.dBuffer, FTP_BUFFER_SIZE, &len))) {
-                    ftp_data.dtimeout = 0;
-                    ftp_data.ctimeout = 0;
+                if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data->d_sd, ftp_data->dBuffer, FTP_BUFFER_SIZE, &len))) {
+                    ftp_data->dtimeout = 0;
+                    ftp_data->ctimeout = 0;
+                    ftp_data->moved += len;
                     // its a software update
-                    if (ftp_data.special_file) {
-                        if (updater_write(ftp_data.dBuffer, len)) {
+                    if (ftp_data->special_file) {
+                        if (updater_write(ftp_data->dBuffer, len)) {
                             break;
                         }
                     }
                     // user file being received
-                    else if (E_FTP_RESULT_OK == ftp_write_file ((char *)ftp_data.dBuffer, len)) {
+                    else if (E_FTP_RESULT_OK == ftp_write_file ((char *)ftp_data->dBuffer, len)) {
                         break;
                     }
                     ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 } else if (result == E_FTP_RESULT_CONTINUE) {
-                    if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
+                    if (ftp_data->dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
                         ftp_close_files();
                         ftp_send_reply(426, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
+                        ftp_data->state = E_FTP_STE_END_TRANSFER;
                     }
                 } else {
-                    if (ftp_data.special_file) {
-                        ftp_data.special_file = false;
+                    if (ftp_data->special_file) {
+                        ftp_data->special_file = false;
                         updater_finish();
                     }
                     ftp_close_files();
                     ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 }
             }
             break;
@@ -744,27 +875,27 @@ void ftp_run (void) {
             break;
     }
 
-    switch (ftp_data.substate) {
+    switch (ftp_data->substate) {
     case E_FTP_STE_SUB_DISCONNECTED:
         break;
     case E_FTP_STE_SUB_LISTEN_FOR_DATA:
-        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.ld_sd, &ftp_data.d_sd, NULL)) {
-            ftp_data.dtimeout = 0;
-            ftp_data.substate = E_FTP_STE_SUB_DATA_CONNECTED;
-        } else if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
-            ftp_data.dtimeout = 0;
+        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data->ld_sd, &ftp_data->d_sd, NULL)) {
+            ftp_data->dtimeout = 0;
+            ftp_data->substate = E_FTP_STE_SUB_DATA_CONNECTED;
+        } else if (ftp_data->dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
+            ftp_data->dtimeout = 0;
             // close the listening socket
-            servers_close_socket(&ftp_data.ld_sd);
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+            servers_close_socket(&ftp_data->ld_sd);
+            ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
         }
         break;
     case E_FTP_STE_SUB_DATA_CONNECTED:
-        if (ftp_data.state == E_FTP_STE_READY && ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
+        if (ftp_data->state == E_FTP_STE_READY && ftp_data->dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
             // close the listening and the data socket
-            servers_close_socket(&ftp_data.ld_sd);
-            servers_close_socket(&ftp_data.d_sd);
+            servers_close_socket(&ftp_data->ld_sd);
+            servers_close_socket(&ftp_data->d_sd);
             ftp_close_filesystem_on_error ();
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+            ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
         }
         break;
     default:
@@ -775,42 +906,12 @@ void ftp_run (void) {
     ftp_send_from_fifo();
 
     // check the state of the data sockets
-    if (ftp_data.d_sd < 0 && (ftp_data.state > E_FTP_STE_READY)) {
-        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        ftp_data.state = E_FTP_STE_READY;
+    if (ftp_data->d_sd < 0 && (ftp_data->state > E_FTP_STE_READY)) {
+        ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
+        ftp_data->state = E_FTP_STE_READY;
     }
 }
 
-void ftp_enable (void) {
-    ftp_data.enabled = true;
-}
-
-void ftp_disable (void) {
-    ftp_reset();
-    ftp_data.enabled = false;
-    ftp_data.state = E_FTP_STE_DISABLED;
-}
-
-void ftp_reset (void) {
-    // close all connections and start all over again
-    servers_close_socket(&ftp_data.lc_sd);
-    servers_close_socket(&ftp_data.ld_sd);
-    ftp_close_cmd_data();
-    ftp_data.state = E_FTP_STE_START;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.volcount = 0;
-    SOCKETFIFO_Flush();
-}
-
-/******************************************************************************
- DEFINE PRIVATE FUNCTIONS
- ******************************************************************************/
-static void ftp_wait_for_enabled (void) {
-    // Check if the telnet service has been enabled
-    if (ftp_data.enabled) {
-        ftp_data.state = E_FTP_STE_START;
-    }
-}
 
 static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t backlog) {
     struct sockaddr_in sServerAddress;
@@ -907,24 +1008,25 @@ static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32
     return E_FTP_RESULT_OK;
 }
 
+// The sockets are non-blocking: what doesn't fit in the send buffer now goes
+// on a later cycle, from txOffset, and the session is dropped once the peer
+// hasn't taken anything for FTP_TX_RETRIES_MAX cycles.
 static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len) {
-    // make it blocking
-    uint32_t option = fcntl(sd, F_GETFL, 0);
-    option &= ~O_NONBLOCK;
-    fcntl(sd, F_SETFL, option);
-    int32_t result = send(sd, data, Len, 0);
-    // make it non-blocking again
-    option |= O_NONBLOCK;
-    fcntl(sd, F_SETFL, option);
+    int32_t result = send(sd, (uint8_t *)data + ftp_data->txOffset, Len - ftp_data->txOffset, 0);
 
     if (result > 0) {
-        ftp_data.txRetries = 0;
+        ftp_data->txRetries = 0;
+        ftp_data->txOffset += result;
+        if (ftp_data->txOffset < Len) {
+            return E_FTP_RESULT_CONTINUE;
+        }
+        ftp_data->txOffset = 0;
         return E_FTP_RESULT_OK;
-    } else if ((FTP_TX_RETRIES_MAX >= ++ftp_data.txRetries) && (errno == EAGAIN)) {
+    } else if ((result < 0) && (errno == EAGAIN) && (FTP_TX_RETRIES_MAX >= ++ftp_data->txRetries)) {
         return E_FTP_RESULT_CONTINUE;
     } else {
-        // error
-        ftp_reset();
+        // error, drop this session only
+        ftp_close_cmd_data();
         return E_FTP_RESULT_FAILED;
     }
 }
@@ -934,12 +1036,12 @@ static void ftp_send_reply (uint32_t status, char *message) {
     if (!message) {
         message = "";
     }
-    snprintf((char *)ftp_cmd_buffer, 4, "%u", status);
-    strcat ((char *)ftp_cmd_buffer, " ");
-    strcat ((char *)ftp_cmd_buffer, message);
-    strcat ((char *)ftp_cmd_buffer, "\r\n");
-    fifoelement.sd = &ftp_data.c_sd;
-    fifoelement.datasize = strlen((char *)ftp_cmd_buffer);
+    snprintf((char *)ftp_data->cmd_buffer, 4, "%u", status);
+    strcat ((char *)ftp_data->cmd_buffer, " ");
+    strcat ((char *)ftp_data->cmd_buffer, message);
+    strcat ((char *)ftp_data->cmd_buffer, "\r\n");
+    fifoelement.sd = &ftp_data->c_sd;
+    fifoelement.datasize = strlen((char *)ftp_data->cmd_buffer);
     fifoelement.data = malloc(fifoelement.datasize);
     if (status == 221) {
         fifoelement.closesockets = E_FTP_CLOSE_CMD_AND_DATA;
@@ -950,8 +1052,8 @@ static void ftp_send_reply (uint32_t status, char *message) {
     }
     fifoelement.freedata = true;
     if (fifoelement.data) {
-        memcpy (fifoelement.data, ftp_cmd_buffer, fifoelement.datasize);
-        if (!SOCKETFIFO_Push (&fifoelement)) {
+        memcpy (fifoelement.data, ftp_data->cmd_buffer, fifoelement.datasize);
+        if (!SOCKETFIFO_Push(&ftp_data->fifo, &fifoelement)) {
             free(fifoelement.data);
         }
     }
@@ -960,28 +1062,28 @@ static void ftp_send_reply (uint32_t status, char *message) {
 static void ftp_send_data (uint32_t datasize) {
     SocketFifoElement_t fifoelement;
 
-    fifoelement.data = ftp_data.dBuffer;
+    fifoelement.data = ftp_data->dBuffer;
     fifoelement.datasize = datasize;
-    fifoelement.sd = &ftp_data.d_sd;
+    fifoelement.sd = &ftp_data->d_sd;
     fifoelement.closesockets = E_FTP_CLOSE_NONE;
     fifoelement.freedata = false;
-    SOCKETFIFO_Push (&fifoelement);
+    SOCKETFIFO_Push(&ftp_data->fifo, &fifoelement);
 }
 
 static void ftp_send_from_fifo (void) {
     SocketFifoElement_t fifoelement;
-    if (SOCKETFIFO_Peek (&fifoelement)) {
+    if (SOCKETFIFO_Peek(&ftp_data->fifo, &fifoelement)) {
         int32_t _sd = *fifoelement.sd;
         if (_sd > 0) {
             if (E_FTP_RESULT_OK == ftp_send_non_blocking (_sd, fifoelement.data, fifoelement.datasize)) {
-                SOCKETFIFO_Pop (&fifoelement);
+                SOCKETFIFO_Pop(&ftp_data->fifo, &fifoelement);
                 if (fifoelement.closesockets != E_FTP_CLOSE_NONE) {
-                    servers_close_socket(&ftp_data.d_sd);
+                    servers_close_socket(&ftp_data->d_sd);
                     if (fifoelement.closesockets == E_FTP_CLOSE_CMD_AND_DATA) {
-                        servers_close_socket(&ftp_data.ld_sd);
+                        servers_close_socket(&ftp_data->ld_sd);
                         // this one is the command socket
                         servers_close_socket(fifoelement.sd);
-                        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                        ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
                     }
                     ftp_close_filesystem_on_error();
                 }
@@ -990,17 +1092,18 @@ static void ftp_send_from_fifo (void) {
                 }
             }
         } else { // socket closed, remove it from the queue
-            SOCKETFIFO_Pop (&fifoelement);
+            SOCKETFIFO_Pop(&ftp_data->fifo, &fifoelement);
+            ftp_data->txOffset = 0;
             if (fifoelement.freedata) {
                 free(fifoelement.data);
             }
         }
-    } else if (ftp_data.state == E_FTP_STE_END_TRANSFER && (ftp_data.d_sd > 0)) {
+    } else if (ftp_data->state == E_FTP_STE_END_TRANSFER && (ftp_data->d_sd > 0)) {
         // close the listening and the data sockets
-        servers_close_socket(&ftp_data.ld_sd);
-        servers_close_socket(&ftp_data.d_sd);
-        if (ftp_data.special_file) {
-            ftp_data.special_file = false;
+        servers_close_socket(&ftp_data->ld_sd);
+        servers_close_socket(&ftp_data->d_sd);
+        if (ftp_data->special_file) {
+            ftp_data->special_file = false;
         }
     }
 }
@@ -1018,24 +1121,24 @@ static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxle
 }
 
 static void ftp_get_param_and_open_child (char **bufptr) {
-    ftp_pop_param (bufptr, ftp_scratch_buffer, false);
-    ftp_open_child (ftp_path, ftp_scratch_buffer);
-    ftp_data.closechild = true;
+    ftp_pop_param (bufptr, ftp_data->scratch, false);
+    ftp_open_child (ftp_data->path, ftp_data->scratch);
+    ftp_data->closechild = true;
 }
 
 static void ftp_process_cmd (void) {
     int32_t len;
-    char *bufptr = (char *)ftp_cmd_buffer;
+    char *bufptr = (char *)ftp_data->cmd_buffer;
     ftp_result_t result;
     FRESULT fres;
     ftp_fileinfo_t fno;
 
-    ftp_data.closechild = false;
+    ftp_data->closechild = false;
     // also use the reply buffer to receive new commands
-    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len))) {
+    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data->c_sd, ftp_data->cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len))) {
         // bufptr is moved as commands are being popped
         ftp_cmd_index_t cmd = ftp_pop_command(&bufptr);
-        if (!ftp_data.loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
+        if (!ftp_data->loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
             ftp_send_reply(332, NULL);
             return;
         }
@@ -1047,44 +1150,44 @@ static void ftp_process_cmd (void) {
             ftp_send_reply(215, "UNIX Type: L8");
             break;
         case E_FTP_CMD_CDUP:
-            ftp_close_child(ftp_path);
+            ftp_close_child(ftp_data->path);
             ftp_send_reply(250, NULL);
             break;
         case E_FTP_CMD_CWD:
             {
                 fres = FR_NO_PATH;
-                ftp_pop_param (&bufptr, ftp_scratch_buffer, false);
-                ftp_open_child (ftp_path, ftp_scratch_buffer);
-                if ((ftp_path[0] == '/' && ftp_path[1] == '\0') || ((fres = f_opendir_helper (&ftp_data.u.dp, ftp_path)) == FR_OK)) {
+                ftp_pop_param (&bufptr, ftp_data->scratch, false);
+                ftp_open_child (ftp_data->path, ftp_data->scratch);
+                if ((ftp_data->path[0] == '/' && ftp_data->path[1] == '\0') || ((fres = f_opendir_helper (&ftp_data->u.dp, ftp_data->path)) == FR_OK)) {
                     if (fres == FR_OK) {
-                        f_closedir_helper(&ftp_data.u.dp);
+                        f_closedir_helper(&ftp_data->u.dp);
                     }
                     ftp_send_reply(250, NULL);
                 } else {
-                    ftp_close_child (ftp_path);
+                    ftp_close_child (ftp_data->path);
                     ftp_send_reply(550, NULL);
                 }
             }
             break;
         case E_FTP_CMD_PWD:
         case E_FTP_CMD_XPWD:
-            ftp_send_reply(257, ftp_path);
+            ftp_send_reply(257, ftp_data->path);
             break;
         case E_FTP_CMD_SIZE:
             {
                 ftp_get_param_and_open_child (&bufptr);
-                if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+                if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                     // send the size
-                    if(isLittleFs(ftp_path))
+                    if(isLittleFs(ftp_data->path))
                     {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_lfs.info.size);
+                        snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_lfs.info.size);
                     }
                     else
                     {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_fat.fsize);
+                        snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_fat.fsize);
                     }
 
-                    ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                    ftp_send_reply(213, (char *)ftp_data->dBuffer);
                 } else {
                     ftp_send_reply(550, NULL);
                 }
@@ -1092,24 +1195,24 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_MDTM:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+            if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                 // send the last modified time
-                if(isLittleFs(ftp_path))
+                if(isLittleFs(ftp_data->path))
                 {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
                             1980 + ((fno.u.fpinfo_lfs.timestamp.fdate >> 9) & 0x7f), (fno.u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f,
                             fno.u.fpinfo_lfs.timestamp.fdate & 0x1f, (fno.u.fpinfo_lfs.timestamp.ftime >> 11) & 0x1f,
                             (fno.u.fpinfo_lfs.timestamp.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_lfs.timestamp.ftime & 0x1f));
                 }
                 else
                 {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
                                              1980 + ((fno.u.fpinfo_fat.fdate >> 9) & 0x7f), (fno.u.fpinfo_fat.fdate >> 5) & 0x0f,
                                              fno.u.fpinfo_fat.fdate & 0x1f, (fno.u.fpinfo_fat.ftime >> 11) & 0x1f,
                                              (fno.u.fpinfo_fat.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_fat.ftime & 0x1f));
                 }
 
-                ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                ftp_send_reply(213, (char *)ftp_data->dBuffer);
             } else {
                 ftp_send_reply(550, NULL);
             }
@@ -1118,18 +1221,18 @@ static void ftp_process_cmd (void) {
             ftp_send_reply(200, NULL);
             break;
         case E_FTP_CMD_USER:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
-            if (!memcmp(ftp_scratch_buffer, servers_user, MAX(strlen(ftp_scratch_buffer), strlen(servers_user)))) {
-                ftp_data.loggin.uservalid = true && (strlen(servers_user) == strlen(ftp_scratch_buffer));
+            ftp_pop_param (&bufptr, ftp_data->scratch, true);
+            if (!memcmp(ftp_data->scratch, servers_user, MAX(strlen(ftp_data->scratch), strlen(servers_user)))) {
+                ftp_data->loggin.uservalid = true && (strlen(servers_user) == strlen(ftp_data->scratch));
             }
             ftp_send_reply(331, NULL);
             break;
         case E_FTP_CMD_PASS:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
-            if (!memcmp(ftp_scratch_buffer, servers_pass, MAX(strlen(ftp_scratch_buffer), strlen(servers_pass))) &&
-                    ftp_data.loggin.uservalid) {
-                ftp_data.loggin.passvalid = true && (strlen(servers_pass) == strlen(ftp_scratch_buffer));
-                if (ftp_data.loggin.passvalid) {
+            ftp_pop_param (&bufptr, ftp_data->scratch, true);
+            if (!memcmp(ftp_data->scratch, servers_pass, MAX(strlen(ftp_data->scratch), strlen(servers_pass))) &&
+                    ftp_data->loggin.uservalid) {
+                ftp_data->loggin.passvalid = true && (strlen(servers_pass) == strlen(ftp_data->scratch));
+                if (ftp_data->loggin.passvalid) {
                     ftp_send_reply(230, NULL);
                     break;
                 }
@@ -1139,27 +1242,27 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_PASV:
             {
                 // some servers (e.g. google chrome) send PASV several times very quickly
-                servers_close_socket(&ftp_data.d_sd);
-                ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                servers_close_socket(&ftp_data->d_sd);
+                ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
                 bool socketcreated = true;
-                if (ftp_data.ld_sd < 0) {
-                    socketcreated = ftp_create_listening_socket(&ftp_data.ld_sd, FTP_PASIVE_DATA_PORT, FTP_DATA_CLIENTS_MAX - 1);
+                if (ftp_data->ld_sd < 0) {
+                    socketcreated = ftp_create_listening_socket(&ftp_data->ld_sd, ftp_data->data_port, FTP_DATA_CLIENTS_MAX - 1);
                 }
                 if (socketcreated) {
-                    uint8_t *pip = (uint8_t *)&ftp_data.ip_addr;
-                    ftp_data.dtimeout = 0;
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
-                             pip[0], pip[1], pip[2], pip[3], (FTP_PASIVE_DATA_PORT >> 8), (FTP_PASIVE_DATA_PORT & 0xFF));
-                    ftp_data.substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
-                    ftp_send_reply(227, (char *)ftp_data.dBuffer);
+                    uint8_t *pip = (uint8_t *)&ftp_data->ip_addr;
+                    ftp_data->dtimeout = 0;
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
+                             pip[0], pip[1], pip[2], pip[3], (ftp_data->data_port >> 8), (ftp_data->data_port & 0xFF));
+                    ftp_data->substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
+                    ftp_send_reply(227, (char *)ftp_data->dBuffer);
                 } else {
                     ftp_send_reply(425, NULL);
                 }
             }
             break;
         case E_FTP_CMD_LIST:
-            if (ftp_open_dir_for_listing(ftp_path) == E_FTP_RESULT_CONTINUE) {
-                ftp_data.state = E_FTP_STE_CONTINUE_LISTING;
+            if (ftp_open_dir_for_listing(ftp_data->path) == E_FTP_RESULT_CONTINUE) {
+                ftp_data->state = E_FTP_STE_CONTINUE_LISTING;
                 ftp_send_reply(150, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1167,34 +1270,38 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_RETR:
             ftp_get_param_and_open_child (&bufptr);
-            if (ftp_open_file (ftp_path, FA_READ)) {
-                ftp_data.state = E_FTP_STE_CONTINUE_FILE_TX;
+            if (ftp_open_file (ftp_data->path, FA_READ)) {
+                ftp_data->state = E_FTP_STE_CONTINUE_FILE_TX;
                 ftp_send_reply(150, NULL);
             } else {
-                ftp_data.state = E_FTP_STE_END_TRANSFER;
+                ftp_data->state = E_FTP_STE_END_TRANSFER;
                 ftp_send_reply(550, NULL);
             }
             break;
         case E_FTP_CMD_STOR:
             ftp_get_param_and_open_child (&bufptr);
             // first check if a software update is being requested
-            if (updater_check_path (ftp_path)) {
-                if (updater_start()) {
-                    ftp_data.special_file = true;
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
+            if (updater_check_path (ftp_data->path)) {
+                if (ftp_updater_busy()) {
+                    // the updater has a single image being written, another session owns it
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_reply(450, NULL);
+                } else if (updater_start()) {
+                    ftp_data->special_file = true;
+                    ftp_data->state = E_FTP_STE_CONTINUE_FILE_RX;
                     ftp_send_reply(150, NULL);
                 } else {
                     // to unlock the updater
                     updater_finish();
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                     ftp_send_reply(550, NULL);
                 }
             } else {
-                if (ftp_open_file (ftp_path, FA_WRITE | FA_CREATE_ALWAYS)) {
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
+                if (ftp_open_file (ftp_data->path, FA_WRITE | FA_CREATE_ALWAYS)) {
+                    ftp_data->state = E_FTP_STE_CONTINUE_FILE_RX;
                     ftp_send_reply(150, NULL);
                 } else {
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                     ftp_send_reply(550, NULL);
                 }
             }
@@ -1202,7 +1309,7 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_DELE:
         case E_FTP_CMD_RMD:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_unlink_helper(ftp_path)) {
+            if (FR_OK == f_unlink_helper(ftp_data->path)) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1210,7 +1317,7 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_MKD:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_mkdir_helper(ftp_path)) {
+            if (FR_OK == f_mkdir_helper(ftp_data->path)) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1218,10 +1325,10 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_RNFR:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+            if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                 ftp_send_reply(350, NULL);
                 // save the current path
-                strcpy ((char *)ftp_data.dBuffer, ftp_path);
+                strcpy ((char *)ftp_data->dBuffer, ftp_data->path);
             } else {
                 ftp_send_reply(550, NULL);
             }
@@ -1229,7 +1336,7 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_RNTO:
             ftp_get_param_and_open_child (&bufptr);
             // old path was saved in the data buffer
-            if (FR_OK == (fres = f_rename_helper ((char *)ftp_data.dBuffer, ftp_path))) {
+            if (FR_OK == (fres = f_rename_helper ((char *)ftp_data->dBuffer, ftp_data->path))) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1248,11 +1355,11 @@ static void ftp_process_cmd (void) {
             break;
         }
 
-        if (ftp_data.closechild) {
-            ftp_return_to_previous_path(ftp_path, ftp_scratch_buffer);
+        if (ftp_data->closechild) {
+            ftp_return_to_previous_path(ftp_data->path, ftp_data->scratch);
         }
     } else if (result == E_FTP_RESULT_CONTINUE) {
-        if (ftp_data.ctimeout++ > (servers_get_timeout() / FTP_CYCLE_TIME_MS)) {
+        if (ftp_data->ctimeout++ > (servers_get_timeout() / FTP_CYCLE_TIME_MS)) {
             ftp_send_reply(221, NULL);
         }
     } else {
@@ -1261,25 +1368,36 @@ static void ftp_process_cmd (void) {
 }
 
 static void ftp_close_files (void) {
-    if (ftp_data.e_open == E_FTP_FILE_OPEN) {
-        f_closefile_helper(&ftp_data.u.fp);
-    } else if (ftp_data.e_open == E_FTP_DIR_OPEN) {
-        f_closedir_helper(&ftp_data.u.dp);
+    if (ftp_data->e_open == E_FTP_FILE_OPEN) {
+        f_closefile_helper(&ftp_data->u.fp);
+    } else if (ftp_data->e_open == E_FTP_DIR_OPEN) {
+        f_closedir_helper(&ftp_data->u.dp);
     }
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
+    ftp_data->e_open = E_FTP_NOTHING_OPEN;
 }
 
 static void ftp_close_filesystem_on_error (void) {
     ftp_close_files();
-    if (ftp_data.special_file) {
+    if (ftp_data->special_file) {
         updater_finish ();
-        ftp_data.special_file = false;
+        ftp_data->special_file = false;
     }
 }
 
+// whether a session other than the current one is writing a software update
+static bool ftp_updater_busy (void) {
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_data_t *session = &ftp_server.session[i];
+        if (session != ftp_data && session->special_file) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void ftp_close_cmd_data (void) {
-    servers_close_socket(&ftp_data.c_sd);
-    servers_close_socket(&ftp_data.d_sd);
+    servers_close_socket(&ftp_data->c_sd);
+    servers_close_socket(&ftp_data->d_sd);
     ftp_close_filesystem_on_error ();
 }
 
@@ -1319,7 +1437,7 @@ static int ftp_print_eplf_item (char *dest, uint32_t destsize, ftp_fileinfo_t *f
     uint day = 1;
     uint64_t fseconds = 0;
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
         type = (fno->u.fpinfo_lfs.info.type == LFS_TYPE_DIR) ? "d" : "-";
 
@@ -1399,11 +1517,11 @@ static int ftp_print_eplf_drive (char *dest, uint32_t destsize, const char *name
 }
 
 static bool ftp_open_file (const char *path, int mode) {
-    FRESULT res = f_open_helper(&ftp_data.u.fp, path, mode);
+    FRESULT res = f_open_helper(&ftp_data->u.fp, path, mode);
     if (res != FR_OK) {
         return false;
     }
-    ftp_data.e_open = E_FTP_FILE_OPEN;
+    ftp_data->e_open = E_FTP_FILE_OPEN;
     return true;
 }
 
@@ -1411,7 +1529,7 @@ static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
 
 
-    FRESULT res = f_read_helper(&ftp_data.u.fp, filebuf, desiredsize, (UINT *)actualsize);
+    FRESULT res = f_read_helper(&ftp_data->u.fp, filebuf, desiredsize, (UINT *)actualsize);
     if (res != FR_OK) {
         ftp_close_files();
         result = E_FTP_RESULT_FAILED;
@@ -1426,7 +1544,7 @@ static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t
 static ftp_result_t ftp_write_file (char *filebuf, uint32_t size) {
     ftp_result_t result = E_FTP_RESULT_FAILED;
     uint32_t actualsize;
-    FRESULT res = f_write_helper(&ftp_data.u.fp, filebuf, size, (UINT *)&actualsize);
+    FRESULT res = f_write_helper(&ftp_data->u.fp, filebuf, size, (UINT *)&actualsize);
     if ((actualsize == size) && (FR_OK == res)) {
         result = E_FTP_RESULT_OK;
     } else {
@@ -1439,15 +1557,15 @@ static ftp_result_t ftp_open_dir_for_listing (const char *path) {
 
     // "hack" to detect the root directory
     if (path[0] == '/' && path[1] == '\0') {
-        ftp_data.listroot = true;
+        ftp_data->listroot = true;
     } else {
         FRESULT res;
-        res = f_opendir_helper(&ftp_data.u.dp, path);                       /* Open the directory */
+        res = f_opendir_helper(&ftp_data->u.dp, path);                       /* Open the directory */
         if (res != FR_OK) {
             return E_FTP_RESULT_FAILED;
         }
-        ftp_data.e_open = E_FTP_DIR_OPEN;
-        ftp_data.listroot = false;
+        ftp_data->e_open = E_FTP_DIR_OPEN;
+        ftp_data->listroot = false;
     }
     return E_FTP_RESULT_CONTINUE;
 }
@@ -1460,18 +1578,18 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
     ftp_fileinfo_t fno;
 
     // if we are resuming an incomplete list operation, go back to the item we left behind
-    if (!ftp_data.listroot) {
-        for (int i = 0; i < ftp_last_dir_idx; i++) {
-            f_readdir_helper(&ftp_data.u.dp, &fno);
+    if (!ftp_data->listroot) {
+        for (int i = 0; i < ftp_data->last_dir_idx; i++) {
+            f_readdir_helper(&ftp_data->u.dp, &fno);
         }
     }
 
     // read until we get all items or there's no more space in the buffer
     while (true) {
-        if (ftp_data.listroot) {
+        if (ftp_data->listroot) {
             // root directory "hack"
             mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table);
-            int i = ftp_data.volcount;
+            int i = ftp_data->volcount;
             while (vfs != NULL && i != 0) {
                 vfs = vfs->next;
                 i -= 1;
@@ -1479,17 +1597,17 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
             if (vfs == NULL) {
                 if (!next) {
                     // no volume found this time, we are done
-                    ftp_data.volcount = 0;
+                    ftp_data->volcount = 0;
                 }
                 break;
             } else {
                 next += ftp_print_eplf_drive((list + next), (maxlistsize - next), vfs->str + 1);
             }
-            ftp_data.volcount++;
+            ftp_data->volcount++;
         } else {
             // a "normal" directory
-            res = f_readdir_helper(&ftp_data.u.dp, &fno);                                                       /* Read a directory item */
-            if(isLittleFs(ftp_path))
+            res = f_readdir_helper(&ftp_data->u.dp, &fno);                                                       /* Read a directory item */
+            if(isLittleFs(ftp_data->path))
             {
                 if (res != FR_OK || fno.u.fpinfo_lfs.info.name[0] == 0) {
                     result = E_FTP_RESULT_OK;
@@ -1497,12 +1615,12 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
                 }
                 if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == 0)
                 {
-                    ftp_last_dir_idx++;
+                    ftp_data->last_dir_idx++;
                     continue;            /* Ignore . entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
                 }
                 if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == '.' && fno.u.fpinfo_lfs.info.name[2] == 0)
                 {
-                    ftp_last_dir_idx++;
+                    ftp_data->last_dir_idx++;
                     continue;            /* Ignore .. entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
                 }
             }
@@ -1521,17 +1639,17 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
             if (!_len) {
                 // close and open again, we will resume in the next iteration
                 ftp_close_files();
-                ftp_open_dir_for_listing(ftp_path);
+                ftp_open_dir_for_listing(ftp_data->path);
                 break;
             }
             next += _len;
-            ftp_last_dir_idx++;
+            ftp_data->last_dir_idx++;
         }
     }
 
     if (result == E_FTP_RESULT_OK) {
         ftp_close_files();
-        ftp_last_dir_idx = 0;
+        ftp_data->last_dir_idx = 0;
     }
     *listsize = next;
     return result;
@@ -17,6 +17,23 @@ int lfs_statvfs_count(void *p, lfs_block_t b)
     return 0;
 }
 
+/* Take the lock of the mount from a Python thread.
+ * The GIL is released before waiting on the lock, so other Python threads keep running while this one
+ * waits for the FTP server or the updater and while it performs the (potentially slow) flash operation.
+ * Nothing which touches the Python heap may be called between littlefs_lock() and littlefs_unlock().
+ * Tasks not holding the GIL (FTP server, updater) must use the mutex directly. */
+void littlefs_lock(vfs_lfs_struct_t* littlefs)
+{
+    MP_THREAD_GIL_EXIT();
+    xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+}
+
+void littlefs_unlock(vfs_lfs_struct_t* littlefs)
+{
+    xSemaphoreGive(littlefs->mutex);
+    MP_THREAD_GIL_ENTER();
+}
+
 // After this function free() must be called on the returned address after usage!!
 const char* concat_with_cwd(vfs_lfs_struct_t* littlefs, const char* path)
 {
@@ -73,7 +90,11 @@ static mp_import_stat_t lfs_vfs_import_stat(void *self, const char *path)
     fs_user_mount_t *vfs = (fs_user_mount_t*) self;
     assert(vfs != NULL);
     /* check if path exists */
-    if((int)LFS_ERR_OK == lfs_stat(&(vfs->fs.littlefs.lfs), path, &lfs_info_stat))
+    littlefs_lock(&vfs->fs.littlefs);
+        int res = lfs_stat(&(vfs->fs.littlefs.lfs), path, &lfs_info_stat);
+    littlefs_unlock(&vfs->fs.littlefs);
+
+    if((int)LFS_ERR_OK == res)
     {
         if(lfs_info_stat.type == LFS_TYPE_DIR)
         {
@@ -411,9 +432,9 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
     for (;;) {
         struct lfs_info fno;
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             int res = lfs_dir_read(&self->littlefs->lfs, &self->dir, &fno);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         char *fn = fno.name;
         if (res < LFS_ERR_OK || fn[0] == 0) {
@@ -446,9 +467,9 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
     }
 
     // ignore error because we may be closing a second time
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    littlefs_lock(self->littlefs);
         lfs_dir_close(&self->littlefs->lfs, &self->dir);
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(self->littlefs);
 
     return MP_OBJ_STOP_ITERATION;
 }
@@ -476,14 +497,14 @@ STATIC mp_obj_t littlefs_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args)
     iter->iternext = mp_vfs_littlefs_ilistdir_it_iternext;
     iter->is_str = is_str_type;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_dir_open(&self->fs.littlefs.lfs, &iter->dir, path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -501,7 +522,7 @@ STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
@@ -511,7 +532,7 @@ STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
                 littlefs_update_timestamp(&self->fs.littlefs.lfs, path);
             }
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -530,14 +551,14 @@ STATIC mp_obj_t littlefs_vfs_remove(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_remove(&self->fs.littlefs.lfs, path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -557,7 +578,7 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
     const char *path_in = mp_obj_str_get_str(path_param_in);
     const char *path_out = mp_obj_str_get_str(path_param_out);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *old_path = concat_with_cwd(&self->fs.littlefs, path_in);
         const char *new_path = concat_with_cwd(&self->fs.littlefs, path_out);
 
@@ -566,7 +587,7 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
         } else {
             res = lfs_rename(&self->fs.littlefs.lfs, old_path, new_path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)old_path);
     free((void*)new_path);
@@ -586,9 +607,9 @@ STATIC mp_obj_t littlefs_vfs_chdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         res = parse_and_append_to_cwd(&self->fs.littlefs, path_in);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     if (res != LFS_ERR_OK) {
         mp_raise_OSError(littleFsErrorToErrno(res));
@@ -602,9 +623,17 @@ STATIC mp_obj_t littlefs_vfs_getcwd(mp_obj_t vfs_in) {
 
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
-        mp_obj_t ret = mp_obj_new_str(self->fs.littlefs.cwd, strlen(self->fs.littlefs.cwd));
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    // Copy the cwd under the lock, the string object can only be created once the GIL is held again
+    littlefs_lock(&self->fs.littlefs);
+        char *cwd = strdup(self->fs.littlefs.cwd);
+    littlefs_unlock(&self->fs.littlefs);
+
+    if (cwd == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    mp_obj_t ret = mp_obj_new_str(cwd, strlen(cwd));
+    free(cwd);
 
     return ret;
 }
@@ -619,7 +648,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
     lfs_timestamp_attribute_t ts;
 
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
@@ -631,7 +660,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
             res = littlefs_stat_common_helper(&self->fs.littlefs.lfs, path, &fno, &ts);
         }
 
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -687,9 +716,9 @@ STATIC mp_obj_t littlefs_vfs_statvfs(mp_obj_t vfs_in, mp_obj_t path_in) {
 
     mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(10, NULL));
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -717,9 +746,9 @@ STATIC mp_obj_t littlefs_vfs_getfree(mp_obj_t vfs_in) {
 
     lfs_t* lfs = &self->fs.littlefs.lfs;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -742,12 +771,22 @@ STATIC mp_obj_t littlefs_vfs_fsformat(mp_obj_t vfs_in)
 {
     fs_user_mount_t * vfs = MP_OBJ_TO_PTR(vfs_in);
 
-    lfs_format(&vfs->fs.littlefs.lfs, &lfscfg);
+    littlefs_lock(&vfs->fs.littlefs);
+        lfs_format(&vfs->fs.littlefs.lfs, &lfscfg);
+    littlefs_unlock(&vfs->fs.littlefs);
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(littlefs_vfs_fsformat_obj, littlefs_vfs_fsformat);
 
+#if MICROPY_VFS_STATS
+STATIC mp_obj_t littlefs_vfs_stats(size_t n_args, const mp_obj_t *args) {
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
+    return mp_vfs_stats_to_dict(&self->stats, n_args > 1 && mp_obj_is_true(args[1]));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_stats_obj, 1, 2, littlefs_vfs_stats);
+#endif
+
 STATIC const mp_rom_map_elem_t littlefs_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_open),        MP_ROM_PTR(&littlefs_vfs_open_obj) },
     { MP_ROM_QSTR(MP_QSTR_ilistdir),    MP_ROM_PTR(&littlefs_vfs_ilistdir_obj) },
@@ -761,7 +800,10 @@ STATIC const mp_rom_map_elem_t littlefs_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_statvfs),     MP_ROM_PTR(&littlefs_vfs_statvfs_obj) },
     { MP_ROM_QSTR(MP_QSTR_getfree),     MP_ROM_PTR(&littlefs_vfs_getfree_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount),      MP_ROM_PTR(&littlefs_vfs_umount_obj) },
-    { MP_ROM_QSTR(MP_QSTR_fsformat),    MP_ROM_PTR(&littlefs_vfs_fsformat_obj) }
+    { MP_ROM_QSTR(MP_QSTR_fsformat),    MP_ROM_PTR(&littlefs_vfs_fsformat_obj) },
+    #if MICROPY_VFS_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats),       MP_ROM_PTR(&littlefs_vfs_stats_obj) },
+    #endif
 
 };
 STATIC MP_DEFINE_CONST_DICT(littlefs_vfs_locals_dict, littlefs_vfs_locals_dict_table);
@@ -34,6 +34,8 @@ typedef struct lfs_ftp_file_stat_s
     lfs_timestamp_attribute_t timestamp;
 }lfs_ftp_file_stat_t;
 
+extern void littlefs_lock(vfs_lfs_struct_t* littlefs);
+extern void littlefs_unlock(vfs_lfs_struct_t* littlefs);
 extern byte littleFsErrorToErrno(enum lfs_error littleFsError);
 extern FRESULT lfsErrorToFatFsError(int lfs_error);
 extern int fatFsModetoLittleFsMode(int FatFsMode);
@@ -31,9 +31,9 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    littlefs_lock(self->littlefs);
         lfs_ssize_t sz_out = lfs_file_read(&self->littlefs->lfs ,&self->fp, buf, size);
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(self->littlefs);
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -46,13 +46,13 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    littlefs_lock(self->littlefs);
         lfs_ssize_t sz_out = lfs_file_write(&self->littlefs->lfs, &self->fp, buf, size);
         // Request timestamp update if file has been written successfully
         if(sz_out > 0) {
             self->timestamp_update = true;
         }
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(self->littlefs);
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -80,18 +80,18 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
         struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             lfs_file_seek(&self->littlefs->lfs, &self->fp, s->offset, s->whence);
             s->offset = lfs_file_tell(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         return 0;
 
     } else if (request == MP_STREAM_FLUSH) {
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             int res = lfs_file_sync(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         if (res < 0) {
             *errcode = littleFsErrorToErrno(res);
@@ -101,6 +101,8 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
     } else if (request == MP_STREAM_CLOSE) {
 
+        // Close is also called from the finaliser while the GC is sweeping the heap,
+        // so the GIL must not be released here
         xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
             int res = littlefs_close_common_helper(&self->littlefs->lfs, &self->fp, &self->cfg, &self->timestamp_update);
         xSemaphoreGive(self->littlefs->mutex);
@@ -166,10 +168,12 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
     o->base.type = type;
     o->timestamp_update = false;
 
-    xSemaphoreTake(vfs->fs.littlefs.mutex, portMAX_DELAY);
-        const char *fname = concat_with_cwd(&vfs->fs.littlefs, mp_obj_str_get_str(args[0].u_obj));
+    const char *path_in = mp_obj_str_get_str(args[0].u_obj);
+
+    littlefs_lock(&vfs->fs.littlefs);
+        const char *fname = concat_with_cwd(&vfs->fs.littlefs, path_in);
         int res = littlefs_open_common_helper(&vfs->fs.littlefs.lfs, fname, &o->fp, mode, &o->cfg, &o->timestamp_update);
-    xSemaphoreGive(vfs->fs.littlefs.mutex);
+    littlefs_unlock(&vfs->fs.littlefs);
 
     free((void*)fname);
     if (res < LFS_ERR_OK) {
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "rxring.h"
+
+/******************************************************************************
+ DEFINE PRIVATE MACROS
+ ******************************************************************************/
+// the other side's index is read with acquire and ours published with release,
+// so a frame is complete before the consumer sees it and free before the
+// producer reuses it
+#define RING_LOAD(var)          __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define RING_STORE(var, val)    __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void lora_rx_ring_init(lora_rx_ring_t *ring, lora_rx_frame_t *frames, uint32_t size) {
+    memset(ring, 0, sizeof(*ring));
+    ring->frames = frames;
+    ring->mask = size - 1;
+}
+
+lora_rx_frame_t *lora_rx_ring_reserve(lora_rx_ring_t *ring, uint32_t len) {
+    if (len > LORA_RX_RING_PAYLOAD_MAX) {
+        ring->oversize++;
+        return NULL;
+    }
+    if (ring->head - RING_LOAD(ring->tail) > ring->mask) {
+        ring->overflows++;
+        return NULL;
+    }
+    return &ring->frames[ring->head & ring->mask];
+}
+
+void lora_rx_ring_commit(lora_rx_ring_t *ring) {
+    uint32_t head = ring->head + 1;
+    uint32_t depth = head - RING_LOAD(ring->tail);
+    RING_STORE(ring->head, head);
+    ring->received++;
+    if (depth > ring->hwm) {
+        ring->hwm = depth;
+    }
+}
+
+void lora_rx_ring_flush(lora_rx_ring_t *ring) {
+    // the consumer drops the frames when it next looks at the ring
+    RING_STORE(ring->flush, ring->head);
+}
+
+lora_rx_frame_t *lora_rx_ring_peek(lora_rx_ring_t *ring) {
+    uint32_t flush = RING_LOAD(ring->flush);
+    if ((int32_t)(flush - ring->tail) > 0) {
+        ring->offset = 0;
+        RING_STORE(ring->tail, flush);
+    }
+    if (RING_LOAD(ring->head) == ring->tail) {
+        return NULL;
+    }
+    return &ring->frames[ring->tail & ring->mask];
+}
+
+uint32_t lora_rx_ring_read(lora_rx_ring_t *ring, uint8_t *buf, uint32_t len) {
+    lora_rx_frame_t *frame = lora_rx_ring_peek(ring);
+    if (frame == NULL) {
+        return 0;
+    }
+    uint32_t available = frame->len - ring->offset;
+    if (len > available) {
+        len = available;
+    }
+    memcpy(buf, &frame->data[ring->offset], len);
+    ring->offset += len;
+    if (ring->offset == frame->len) {
+        ring->offset = 0;
+        RING_STORE(ring->tail, ring->tail + 1);
+    }
+    return len;
+}
+
+uint32_t lora_rx_ring_depth(lora_rx_ring_t *ring) {
+    uint32_t tail = RING_LOAD(ring->tail);
+    uint32_t flush = RING_LOAD(ring->flush);
+    if ((int32_t)(flush - tail) > 0) {
+        tail = flush;
+    }
+    return RING_LOAD(ring->head) - tail;
+}
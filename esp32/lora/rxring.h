@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LORA_RXRING_H_
+#define LORA_RXRING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define LORA_RX_RING_PAYLOAD_MAX                                (255)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// a received frame and how it was received
+typedef struct {
+    uint32_t    timestamp;
+    int16_t     rssi;
+    int8_t      snr;
+    uint8_t     sf;
+    uint8_t     port;
+    uint8_t     len;
+    uint8_t     data[LORA_RX_RING_PAYLOAD_MAX];
+} lora_rx_frame_t;
+
+// Single producer, single consumer ring of received frames. The producer
+// (the radio or MAC callback) only writes head, flush and the counters, the
+// consumer only writes tail and offset, so neither side takes a lock. The
+// indexes run freely and are masked on access.
+typedef struct {
+    lora_rx_frame_t *frames;
+    uint32_t    mask;       // number of frames - 1, a power of two - 1
+    uint32_t    head;       // next frame to fill
+    uint32_t    tail;       // next frame to read
+    uint32_t    flush;      // frames before this one are to be dropped
+    uint32_t    offset;     // bytes of the tail frame already read
+    uint32_t    received;   // frames queued
+    uint32_t    overflows;  // frames dropped because the ring was full
+    uint32_t    oversize;   // frames dropped because they were too long
+    uint32_t    hwm;        // highest number of frames queued
+} lora_rx_ring_t;
+
+/******************************************************************************
+ DECLARE FUNCTIONS
+ ******************************************************************************/
+// size must be a power of two
+extern void lora_rx_ring_init(lora_rx_ring_t *ring, lora_rx_frame_t *frames, uint32_t size);
+
+// producer side: a frame is filled in place between reserve and commit;
+// reserve returns NULL, and counts the loss, if len bytes can't be queued
+extern lora_rx_frame_t *lora_rx_ring_reserve(lora_rx_ring_t *ring, uint32_t len);
+extern void lora_rx_ring_commit(lora_rx_ring_t *ring);
+extern void lora_rx_ring_flush(lora_rx_ring_t *ring);
+
+// consumer side: peek returns the frame being read, or NULL if there's none;
+// read copies the rest of it, or up to len bytes of it, and releases the
+// frame once all of it has been read
+extern lora_rx_frame_t *lora_rx_ring_peek(lora_rx_ring_t *ring);
+extern uint32_t lora_rx_ring_read(lora_rx_ring_t *ring, uint8_t *buf, uint32_t len);
+
+extern uint32_t lora_rx_ring_depth(lora_rx_ring_t *ring);
+
+#endif  // LORA_RXRING_H_
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// Host test of the LoRa RX ring. It isn't part of the firmware build:
+//
+//     cc -O2 -Wall -pthread rxring_test.c rxring.c -o /tmp/rxring_test
+//     /tmp/rxring_test
+//
+// The single threaded cases check the ring's bookkeeping, the threaded one
+// runs a producer and a consumer in two threads and checks that every frame
+// arrives whole, in order, or is counted as an overflow.
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rxring.h"
+
+#ifndef STRESS_FRAMES
+#define STRESS_FRAMES       (1000000)
+#endif
+
+static lora_rx_frame_t frames[64];
+static lora_rx_ring_t ring;
+static bool producer_done;
+
+static void put(uint32_t seq, uint32_t len) {
+    lora_rx_frame_t *frame = lora_rx_ring_reserve(&ring, len);
+    if (frame != NULL) {
+        frame->timestamp = seq;
+        frame->rssi = -(int16_t)(seq & 0x7F);
+        frame->snr = (int8_t)seq;
+        frame->sf = 7 + (seq % 6);
+        frame->port = seq & 0xFF;
+        frame->len = len;
+        for (uint32_t i = 0; i < len; i++) {
+            frame->data[i] = (uint8_t)(seq + i);
+        }
+        lora_rx_ring_commit(&ring);
+    }
+}
+
+static void check(const uint8_t *buf, uint32_t seq, uint32_t from, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        assert(buf[i] == (uint8_t)(seq + from + i));
+    }
+}
+
+static void test_basic(void) {
+    uint8_t buf[LORA_RX_RING_PAYLOAD_MAX];
+
+    lora_rx_ring_init(&ring, frames, 4);
+    assert(lora_rx_ring_peek(&ring) == NULL);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 0);
+
+    // fill it up, the fifth frame is lost
+    for (uint32_t seq = 0; seq < 5; seq++) {
+        put(seq, 10 + seq);
+    }
+    assert(lora_rx_ring_depth(&ring) == 4);
+    assert(ring.received == 4 && ring.overflows == 1 && ring.hwm == 4);
+
+    // whole reads, with the metadata of each frame
+    lora_rx_frame_t *frame = lora_rx_ring_peek(&ring);
+    assert(frame->timestamp == 0 && frame->rssi == 0 && frame->sf == 7 && frame->len == 10);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 10);
+    check(buf, 0, 0, 10);
+    frame = lora_rx_ring_peek(&ring);
+    assert(frame->timestamp == 1 && frame->rssi == -1 && frame->snr == 1 && frame->port == 1);
+
+    // partial reads keep the frame in the ring until it's all read
+    assert(lora_rx_ring_read(&ring, buf, 4) == 4);
+    check(buf, 1, 0, 4);
+    assert(lora_rx_ring_depth(&ring) == 3);
+    put(5, 20);
+    put(6, 1);
+    assert(ring.overflows == 2);
+    assert(lora_rx_ring_read(&ring, buf, 4) == 4);
+    check(buf, 1, 4, 4);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 3);
+    check(buf, 1, 8, 3);
+    assert(lora_rx_ring_depth(&ring) == 3);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 12);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 13);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 20);
+    check(buf, 5, 0, 20);
+
+    // empty frames are queued and read too
+    put(7, 0);
+    assert(lora_rx_ring_depth(&ring) == 1);
+    assert(lora_rx_ring_peek(&ring)->len == 0);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 0);
+    assert(lora_rx_ring_peek(&ring) == NULL);
+
+    // frames that don't fit a frame are counted apart
+    assert(lora_rx_ring_reserve(&ring, LORA_RX_RING_PAYLOAD_MAX + 1) == NULL);
+    assert(ring.oversize == 1 && ring.overflows == 2);
+    put(8, LORA_RX_RING_PAYLOAD_MAX);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == LORA_RX_RING_PAYLOAD_MAX);
+    check(buf, 8, 0, LORA_RX_RING_PAYLOAD_MAX);
+    assert(ring.received == 7 && ring.hwm == 4);
+}
+
+static void test_flush(void) {
+    uint8_t buf[LORA_RX_RING_PAYLOAD_MAX];
+
+    lora_rx_ring_init(&ring, frames, 8);
+    for (uint32_t seq = 0; seq < 3; seq++) {
+        put(seq, 8);
+    }
+    assert(lora_rx_ring_read(&ring, buf, 2) == 2);
+
+    // the producer drops what's queued, including the frame being read
+    lora_rx_ring_flush(&ring);
+    put(3, 8);
+    assert(lora_rx_ring_depth(&ring) == 1);
+    assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 8);
+    check(buf, 3, 0, 8);
+    assert(lora_rx_ring_peek(&ring) == NULL);
+
+    // indexes wrap around
+    lora_rx_ring_init(&ring, frames, 8);
+    ring.head = ring.tail = ring.flush = UINT32_MAX - 2;
+    for (uint32_t seq = 0; seq < 8; seq++) {
+        put(seq, 1 + seq);
+    }
+    assert(lora_rx_ring_depth(&ring) == 8 && ring.overflows == 0);
+    put(8, 1);
+    assert(ring.overflows == 1);
+    for (uint32_t seq = 0; seq < 8; seq++) {
+        assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == 1 + seq);
+        check(buf, seq, 0, 1 + seq);
+    }
+    assert(lora_rx_ring_peek(&ring) == NULL);
+}
+
+static void *producer(void *arg) {
+    (void)arg;
+    for (uint32_t seq = 0; seq < STRESS_FRAMES; seq++) {
+        // keep up with the consumer, except for one frame in 16
+        while ((seq & 15) && (ring.head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) > ring.mask)) {
+            sched_yield();
+        }
+        put(seq, seq % (LORA_RX_RING_PAYLOAD_MAX + 1));
+    }
+    __atomic_store_n(&producer_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void test_threads(uint32_t size) {
+    static uint8_t buf[LORA_RX_RING_PAYLOAD_MAX];
+    pthread_t thread;
+    uint32_t got = 0;
+    uint32_t next = 0;
+
+    lora_rx_ring_init(&ring, frames, size);
+    producer_done = false;
+    pthread_create(&thread, NULL, producer, NULL);
+    while (next < STRESS_FRAMES) {
+        lora_rx_frame_t *frame = lora_rx_ring_peek(&ring);
+        if (frame == NULL) {
+            if (__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE) && lora_rx_ring_peek(&ring) == NULL) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        // frames come in order, with their own data and metadata
+        uint32_t seq = frame->timestamp;
+        assert(seq >= next && seq < STRESS_FRAMES);
+        assert(frame->port == (seq & 0xFF) && frame->rssi == -(int16_t)(seq & 0x7F));
+        uint32_t len = frame->len;
+        assert(len == seq % (LORA_RX_RING_PAYLOAD_MAX + 1));
+        // read odd sized frames in two steps
+        uint32_t first = (seq & 1) ? len / 2 : len;
+        assert(lora_rx_ring_read(&ring, buf, first) == first);
+        check(buf, seq, 0, first);
+        if (first < len) {
+            assert(lora_rx_ring_read(&ring, buf, sizeof(buf)) == len - first);
+            check(buf, seq, first, len - first);
+        }
+        next = seq + 1;
+        got++;
+    }
+    pthread_join(thread, NULL);
+
+    assert(got == ring.received);
+    assert(ring.received + ring.overflows == STRESS_FRAMES);
+    printf("%2u frames: %u received, %u overflows, hwm %u\n", size, ring.received, ring.overflows, ring.hwm);
+}
+
+int main(void) {
+    test_basic();
+    test_flush();
+    test_threads(1);
+    test_threads(8);
+    test_threads(64);
+    printf("rxring: OK\n");
+    return 0;
+}
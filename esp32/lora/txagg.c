@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "txagg.h"
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void lora_tx_agg_reset(lora_tx_agg_t *agg) {
+    agg->len = 0;
+    agg->records = 0;
+}
+
+bool lora_tx_agg_fits(const lora_tx_agg_t *agg, uint32_t len, uint32_t max_len, uint8_t dr, bool confirmed) {
+    if (max_len > LORA_TX_AGG_PAYLOAD_MAX) {
+        max_len = LORA_TX_AGG_PAYLOAD_MAX;
+    }
+    if (agg->records > 0 && (agg->dr != dr || agg->confirmed != confirmed)) {
+        return false;
+    }
+    return agg->len + LORA_TX_AGG_HEADER_SIZE + len <= max_len;
+}
+
+void lora_tx_agg_add(lora_tx_agg_t *agg, uint8_t tag, const uint8_t *data, uint32_t len,
+                     uint8_t dr, bool confirmed, uint32_t deadline) {
+    if (agg->records == 0) {
+        agg->dr = dr;
+        agg->confirmed = confirmed;
+        agg->deadline = deadline;
+    }
+    agg->data[agg->len] = tag;
+    agg->data[agg->len + 1] = len;
+    memcpy(&agg->data[agg->len + LORA_TX_AGG_HEADER_SIZE], data, len);
+    agg->len += LORA_TX_AGG_HEADER_SIZE + len;
+    agg->records++;
+}
+
+int32_t lora_tx_agg_next(const uint8_t *frame, uint32_t len, uint32_t *offset, uint8_t *tag, const uint8_t **data) {
+    uint32_t pos = *offset;
+    if (pos + LORA_TX_AGG_HEADER_SIZE > len) {
+        return -1;
+    }
+    uint32_t rlen = frame[pos + 1];
+    if (pos + LORA_TX_AGG_HEADER_SIZE + rlen > len) {
+        return -1;
+    }
+    *tag = frame[pos];
+    *data = &frame[pos + LORA_TX_AGG_HEADER_SIZE];
+    *offset = pos + LORA_TX_AGG_HEADER_SIZE + rlen;
+    return rlen;
+}
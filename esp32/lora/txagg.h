@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LORA_TXAGG_H_
+#define LORA_TXAGG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define LORA_TX_AGG_PAYLOAD_MAX                                 (255)
+// each record starts with its tag and its length
+#define LORA_TX_AGG_HEADER_SIZE                                 (2)
+#define LORA_TX_AGG_RECORD_MAX                                  (LORA_TX_AGG_PAYLOAD_MAX - LORA_TX_AGG_HEADER_SIZE)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// Application records waiting to go out together in one uplink. All of them
+// are sent with the same datarate and confirmation, the frame is due at
+// deadline, in ticks, counted from the first record.
+typedef struct {
+    uint8_t     data[LORA_TX_AGG_PAYLOAD_MAX];
+    uint8_t     len;
+    uint8_t     dr;
+    bool        confirmed;
+    uint32_t    records;
+    uint32_t    deadline;
+} lora_tx_agg_t;
+
+/******************************************************************************
+ DECLARE FUNCTIONS
+ ******************************************************************************/
+static inline bool lora_tx_agg_empty(const lora_tx_agg_t *agg) {
+    return agg->records == 0;
+}
+
+extern void lora_tx_agg_reset(lora_tx_agg_t *agg);
+
+// true if a record of len bytes can be added to the frame without it growing
+// past max_len bytes, nor mixing datarates or confirmations
+extern bool lora_tx_agg_fits(const lora_tx_agg_t *agg, uint32_t len, uint32_t max_len, uint8_t dr, bool confirmed);
+
+// appends a record, which must fit; the first one sets the frame's datarate,
+// confirmation and deadline
+extern void lora_tx_agg_add(lora_tx_agg_t *agg, uint8_t tag, const uint8_t *data, uint32_t len,
+                            uint8_t dr, bool confirmed, uint32_t deadline);
+
+// decoder: returns the length of the record at *offset, with its tag and data,
+// and moves *offset past it; -1 at the end of the frame or if it's malformed
+extern int32_t lora_tx_agg_next(const uint8_t *frame, uint32_t len, uint32_t *offset, uint8_t *tag, const uint8_t **data);
+
+#endif  // LORA_TXAGG_H_
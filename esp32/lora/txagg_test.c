@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// Host test of the LoRaWAN uplink aggregation. It isn't part of the firmware
+// build:
+//
+//     cc -O2 -Wall txagg_test.c txagg.c -lm -o /tmp/txagg_test
+//     /tmp/txagg_test
+//
+// The first cases check the packing and the decoder. Then a day of small
+// sensor records is simulated, sent one per uplink as before and aggregated
+// with a few flush deadlines, with the airtime of each uplink computed as the
+// SX127x datasheet does, for EU868 DR0, DR3 and DR5.
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "txagg.h"
+
+// MHDR, FHDR without options, FPort and MIC
+#define LORAWAN_OVERHEAD        (13)
+#define SIM_SECONDS             (24 * 3600)
+#define SIM_SENSORS             (6)
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static void check_packing(void) {
+    lora_tx_agg_t agg;
+    uint8_t records[64][LORA_TX_AGG_RECORD_MAX];
+    uint8_t tags[64], lens[64];
+    uint32_t n = 0;
+
+    lora_tx_agg_reset(&agg);
+    assert(lora_tx_agg_empty(&agg));
+    // fill a 222 byte frame with random records until one doesn't fit
+    for (;;) {
+        uint32_t len = rnd() % 20;
+        if (!lora_tx_agg_fits(&agg, len, 222, 5, false)) {
+            assert(agg.len + LORA_TX_AGG_HEADER_SIZE + len > 222);
+            break;
+        }
+        tags[n] = rnd();
+        lens[n] = len;
+        for (uint32_t i = 0; i < len; i++) {
+            records[n][i] = rnd();
+        }
+        lora_tx_agg_add(&agg, tags[n], records[n], len, 5, false, 1000 + n);
+        n++;
+    }
+    assert(agg.records == n && agg.deadline == 1000 && agg.dr == 5);
+
+    // the datarate and the confirmation of the frame are those of the first record
+    assert(!lora_tx_agg_fits(&agg, 0, 255, 4, false));
+    assert(!lora_tx_agg_fits(&agg, 0, 255, 5, true));
+    assert(lora_tx_agg_fits(&agg, 255 - agg.len - LORA_TX_AGG_HEADER_SIZE, 1000, 5, false));
+    assert(!lora_tx_agg_fits(&agg, 256 - agg.len - LORA_TX_AGG_HEADER_SIZE, 1000, 5, false));
+
+    // the decoder gives the records back
+    uint32_t offset = 0, i = 0;
+    const uint8_t *data;
+    uint8_t tag;
+    int32_t len;
+    while ((len = lora_tx_agg_next(agg.data, agg.len, &offset, &tag, &data)) >= 0) {
+        assert(i < n && tag == tags[i] && len == lens[i] && memcmp(data, records[i], len) == 0);
+        i++;
+    }
+    assert(i == n && offset == agg.len);
+
+    // and stops at a truncated record
+    for (uint32_t cut = 1; cut < agg.len; cut++) {
+        offset = 0;
+        i = 0;
+        while (lora_tx_agg_next(agg.data, agg.len - cut, &offset, &tag, &data) >= 0) {
+            i++;
+        }
+        assert(i < n && offset <= agg.len - cut);
+    }
+
+    lora_tx_agg_reset(&agg);
+    assert(lora_tx_agg_empty(&agg) && agg.len == 0);
+    // an empty frame takes any datarate
+    assert(lora_tx_agg_fits(&agg, LORA_TX_AGG_RECORD_MAX, 255, 0, true));
+    assert(!lora_tx_agg_fits(&agg, LORA_TX_AGG_RECORD_MAX + 1, 255, 0, true));
+}
+
+/******************************************************************************
+ Simulation
+ ******************************************************************************/
+typedef struct {
+    const char *name;
+    uint32_t sf;
+    uint32_t max_payload;
+} datarate_t;
+
+// SX127x time on air in ms: 125 kHz, coding rate 4/5, 8 symbols of preamble,
+// explicit header, CRC on, low datarate optimization for SF11 and SF12
+static double time_on_air(const datarate_t *dr, uint32_t payload) {
+    double ts = (1 << dr->sf) / 125.0;
+    int de = dr->sf >= 11;
+    double n = ceil((8.0 * payload - 4.0 * dr->sf + 28 + 16) / (4.0 * (dr->sf - 2 * de))) * 5;
+    return ts * (8 + 4.25 + 8 + (n > 0 ? n : 0));
+}
+
+typedef struct {
+    uint32_t frames;
+    double airtime;
+    double delay;       // seconds the records waited in total
+    uint32_t records;
+} sim_result_t;
+
+// each sensor reports every period, with some jitter, a record of 2 to 12 bytes
+static void simulate(const datarate_t *dr, uint32_t timeout, sim_result_t *res) {
+    lora_tx_agg_t agg;
+    uint32_t next[SIM_SENSORS];
+    uint32_t first[LORA_TX_AGG_PAYLOAD_MAX];
+    uint8_t record[12] = { 0 };
+
+    rnd_state = 1;
+    memset(res, 0, sizeof(*res));
+    lora_tx_agg_reset(&agg);
+    for (int s = 0; s < SIM_SENSORS; s++) {
+        next[s] = rnd() % 60;
+    }
+    for (uint32_t now = 0; now < SIM_SECONDS; now++) {
+        if (!lora_tx_agg_empty(&agg) && (int32_t)(now - agg.deadline) >= 0) {
+            res->frames++;
+            res->airtime += time_on_air(dr, LORAWAN_OVERHEAD + agg.len);
+            for (uint32_t r = 0; r < agg.records; r++) {
+                res->delay += now - first[r];
+            }
+            lora_tx_agg_reset(&agg);
+        }
+        for (int s = 0; s < SIM_SENSORS; s++) {
+            if (now != next[s]) {
+                continue;
+            }
+            uint32_t len = 2 + rnd() % 11;
+            next[s] = now + 60 * (s + 1) + rnd() % 10;
+            res->records++;
+            if (timeout == 0) {
+                // one uplink per record
+                res->frames++;
+                res->airtime += time_on_air(dr, LORAWAN_OVERHEAD + len);
+                continue;
+            }
+            if (!lora_tx_agg_fits(&agg, len, dr->max_payload, 0, false)) {
+                res->frames++;
+                res->airtime += time_on_air(dr, LORAWAN_OVERHEAD + agg.len);
+                for (uint32_t r = 0; r < agg.records; r++) {
+                    res->delay += now - first[r];
+                }
+                lora_tx_agg_reset(&agg);
+            }
+            first[agg.records] = now;
+            lora_tx_agg_add(&agg, s + 1, record, len, 0, false, now + timeout);
+        }
+    }
+}
+
+static void run_simulation(void) {
+    static const datarate_t drs[] = {
+        { "DR0 SF12", 12, 51 },
+        { "DR3 SF9 ", 9, 115 },
+        { "DR5 SF7 ", 7, 222 },
+    };
+    static const uint32_t timeouts[] = { 0, 10, 60, 300 };
+
+    printf("%u sensors, a day of records; deadline 0 is one uplink per record\n", SIM_SENSORS);
+    printf("datarate  deadline  uplinks  airtime s  saved  mean delay s\n");
+    for (size_t d = 0; d < sizeof(drs) / sizeof(drs[0]); d++) {
+        double base = 0;
+        for (size_t t = 0; t < sizeof(timeouts) / sizeof(timeouts[0]); t++) {
+            sim_result_t res;
+            simulate(&drs[d], timeouts[t], &res);
+            if (t == 0) {
+                base = res.airtime;
+            }
+            printf("%s  %7u  %7u  %9.1f  %4.0f%%  %11.1f\n", drs[d].name, timeouts[t], res.frames,
+                   res.airtime / 1000, 100 * (1 - res.airtime / base), res.delay / res.records);
+        }
+    }
+}
+
+int main(void) {
+    datarate_t sf7 = { "", 7, 222 }, sf12 = { "", 12, 51 };
+
+    // the datasheet's examples
+    assert(fabs(time_on_air(&sf7, 13) - 46.336) < 0.01);
+    assert(fabs(time_on_air(&sf12, 13) - 1155.072) < 0.01);
+
+    check_packing();
+    run_simulation();
+    printf("txagg: OK\n");
+    return 0;
+}
@@ -71,7 +71,6 @@ TaskHandle_t xLTETaskHndl = NULL;
 TaskHandle_t xLTEUartEvtTaskHndl;
 TaskHandle_t xLTEUpgradeTaskHndl;
 #endif
-TaskHandle_t xSocketOpsTaskHndl;
 
 extern void machine_init0(void);
 
@@ -34,11 +34,17 @@
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
 #include "lwipsocket.h"
+#include "lwipsocket_rxring.h"
 
 
 #define WLAN_MAX_RX_SIZE                    2048
 #define WLAN_MAX_TX_SIZE                    1476
 
+// limits of the optional receive ring; a datagram ring needs room for two
+// of the largest datagrams so one can be filled while the other is read
+#define LWIPSOCKET_RX_RING_MIN              (1024)
+#define LWIPSOCKET_RX_RING_MAX              (64 * 1024)
+
 #define MAKE_SOCKADDR(addr, ip, port)       struct sockaddr addr; \
                                             addr.sa_family = AF_INET; \
                                             addr.sa_data[0] = port >> 8; \
@@ -106,6 +112,10 @@ void lwipsocket_socket_close(mod_network_socket_obj_t *s) {
     } else {
         lwip_close_r(s->sock_base.u.sd);
     }
+    if (s->sock_base.rx_ring != NULL) {
+        m_del(byte, s->sock_base.rx_ring, sizeof(lwipsocket_rx_ring_t) + s->sock_base.rx_ring->size);
+        s->sock_base.rx_ring = NULL;
+    }
     modusocket_socket_delete(s->sock_base.u.sd);
     s->sock_base.connected = false;
 }
@@ -171,6 +181,57 @@ int lwipsocket_socket_connect(mod_network_socket_obj_t *s, byte *ip, mp_uint_t p
     return ret;
 }
 
+// Connect with a deadline.  The socket is put in non-blocking mode and the
+// calling thread waits in select(), which lwIP wakes from its event callback
+// as soon as the handshake completes or fails, so any number of connects can
+// be in flight at once, each with its own timeout.
+int lwipsocket_socket_connect_timeout(mod_network_socket_obj_t *s, byte *ip, mp_uint_t port, mp_int_t timeout_ms, int *_errno) {
+    int32_t sd = s->sock_base.u.sd;
+    int flags = lwip_fcntl_r(sd, F_GETFL, 0);
+    lwip_fcntl_r(sd, F_SETFL, flags | O_NONBLOCK);
+
+    MAKE_SOCKADDR(addr, ip, port)
+    int ret = lwip_connect_r(sd, &addr, sizeof(addr));
+    if (ret != 0 && errno == EINPROGRESS) {
+        fd_set wfds, xfds;
+        FD_ZERO(&wfds);
+        FD_ZERO(&xfds);
+        FD_SET(sd, &wfds);
+        FD_SET(sd, &xfds);
+        struct timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        ret = lwip_select(sd + 1, NULL, &wfds, &xfds, &tv);
+        if (ret == 0) {
+            errno = ETIMEDOUT;
+            ret = -1;
+        } else if (ret > 0) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            lwip_getsockopt_r(sd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                errno = err;
+                ret = -1;
+            } else {
+                ret = 0;
+            }
+        }
+    }
+    if (ret != 0) {
+        *_errno = errno;
+        lwip_fcntl_r(sd, F_SETFL, flags);
+        return -1;
+    }
+    lwip_fcntl_r(sd, F_SETFL, flags);
+
+    if (s->sock_base.is_ssl) {
+        ret = lwipsocket_socket_setup_ssl(s, _errno);
+    }
+
+    s->sock_base.connected = true;
+    return ret;
+}
+
 int lwipsocket_socket_send(mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, int *_errno) {
     mp_int_t bytes = 0;
     if (len > 0) {
@@ -196,6 +257,75 @@ int lwipsocket_socket_send(mod_network_socket_obj_t *s, const byte *buf, mp_uint
     return bytes;
 }
 
+// lwipsocket_rx_read_t of the receive ring
+STATIC int lwipsocket_rx_read(int sd, uint8_t *buf, uint32_t len, bool dontwait, uint8_t *ip, uint16_t *port, int *_errno) {
+    int flags = dontwait ? MSG_DONTWAIT : 0;
+    int ret;
+    if (ip == NULL) {
+        ret = lwip_recv_r(sd, buf, len, flags);
+    } else {
+        struct sockaddr addr;
+        socklen_t addr_len = sizeof(addr);
+        mp_uint_t _port;
+        ret = lwip_recvfrom_r(sd, buf, len, flags, &addr, &addr_len);
+        if (ret >= 0) {
+            UNPACK_SOCKADDR(addr, ip, _port);
+            *port = _port;
+        }
+    }
+    if (ret < 0) {
+        *_errno = errno;
+    }
+    return ret;
+}
+
+STATIC int lwipsocket_rx_ring_set(mod_network_socket_obj_t *s, mp_int_t size, int *_errno) {
+    bool dgram = (s->sock_base.type == SOCK_DGRAM);
+    if (s->sock_base.is_ssl) {
+        *_errno = MP_EOPNOTSUPP;
+        return -1;
+    }
+    if (size != 0 && (size < (dgram ? 2 * LWIPSOCKET_RX_DGRAM_MAX : LWIPSOCKET_RX_RING_MIN) || size > LWIPSOCKET_RX_RING_MAX)) {
+        *_errno = MP_EINVAL;
+        return -1;
+    }
+    lwipsocket_rx_ring_t *ring = s->sock_base.rx_ring;
+    if (ring != NULL) {
+        if (ring->depth > 0) {
+            // don't lose data already taken from lwIP
+            *_errno = MP_EBUSY;
+            return -1;
+        }
+        m_del(byte, ring, sizeof(lwipsocket_rx_ring_t) + ring->size);
+        s->sock_base.rx_ring = NULL;
+    }
+    if (size > 0) {
+        ring = m_malloc0(sizeof(lwipsocket_rx_ring_t) + size);
+        ring->size = size;
+        s->sock_base.rx_ring = ring;
+    }
+    return 0;
+}
+
+mp_obj_t lwipsocket_socket_rx_stats(mod_network_socket_obj_t *s, bool reset) {
+    lwipsocket_rx_ring_t *ring = s->sock_base.rx_ring;
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+    mp_obj_t dict = mp_obj_new_dict(0);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_size), mp_obj_new_int_from_uint(ring->size));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_depth), mp_obj_new_int_from_uint(ring->depth));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_hwm), mp_obj_new_int_from_uint(ring->hwm));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_fills), mp_obj_new_int_from_uint(ring->fills));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_full), mp_obj_new_int_from_uint(ring->full));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_drops), mp_obj_new_int_from_uint(ring->drops));
+    if (reset) {
+        ring->hwm = ring->depth;
+        ring->fills = ring->full = ring->drops = 0;
+    }
+    return dict;
+}
+
 int lwipsocket_socket_recv(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, int *_errno) {
     int ret;
     if (s->sock_base.is_ssl) {
@@ -236,6 +366,11 @@ int lwipsocket_socket_recv(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len
             *_errno = ret;
             return -1;
         }
+    } else if (s->sock_base.rx_ring != NULL) {
+        if (s->sock_base.type == SOCK_DGRAM) {
+            return lwipsocket_rx_ring_recv_dgram(s->sock_base.rx_ring, lwipsocket_rx_read, s->sock_base.u.sd, buf, len, NULL, NULL, _errno);
+        }
+        return lwipsocket_rx_ring_recv_stream(s->sock_base.rx_ring, lwipsocket_rx_read, s->sock_base.u.sd, buf, len, _errno);
     } else {
         ret = lwip_recv_r(s->sock_base.u.sd, buf, MIN(len, WLAN_MAX_RX_SIZE), 0);
         if (ret < 0) {
@@ -260,6 +395,14 @@ int lwipsocket_socket_sendto( mod_network_socket_obj_t *s, const byte *buf, mp_u
 }
 
 int lwipsocket_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port, int *_errno) {
+    if (s->sock_base.rx_ring != NULL && s->sock_base.type == SOCK_DGRAM) {
+        uint16_t _port;
+        int ret = lwipsocket_rx_ring_recv_dgram(s->sock_base.rx_ring, lwipsocket_rx_read, s->sock_base.u.sd, buf, len, ip, &_port, _errno);
+        if (ret >= 0) {
+            *port = _port;
+        }
+        return ret;
+    }
     struct sockaddr addr;
     socklen_t addr_len = sizeof(addr);
     mp_int_t ret = lwip_recvfrom_r(s->sock_base.u.sd, buf, MIN(len, WLAN_MAX_RX_SIZE), 0, &addr, &addr_len);
@@ -272,6 +415,13 @@ int lwipsocket_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t
 }
 
 int lwipsocket_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno) {
+    if (level == SOL_SOCKET && opt == SO_RXRING) {
+        if (optlen != sizeof(mp_int_t)) {
+            *_errno = MP_EINVAL;
+            return -1;
+        }
+        return lwipsocket_rx_ring_set(s, *(const mp_int_t *)optval, _errno);
+    }
     int ret = lwip_setsockopt_r(s->sock_base.u.sd, level, opt, optval, optlen);
     if (ret < 0) {
         *_errno = errno;
@@ -359,8 +509,9 @@ int lwipsocket_socket_ioctl (mod_network_socket_obj_t *s, mp_uint_t request, mp_
             return MP_STREAM_ERROR;
         }
 
-        // check return of select
-        if (FD_ISSET(sd, &rfds)) {
+        // check return of select; data already in the ring is readable too
+        lwipsocket_rx_ring_t *ring = s->sock_base.rx_ring;
+        if (FD_ISSET(sd, &rfds) || (ring != NULL && ring->depth > 0 && (flags & MP_STREAM_POLL_RD))) {
             ret |= MP_STREAM_POLL_RD;
         }
         if (FD_ISSET(sd, &wfds)) {
@@ -392,11 +543,13 @@ int lwipsocket_socket_setup_ssl(mod_network_socket_obj_t *s, int *_errno)
 
     // printf("Performing the SSL/TLS handshake...\n");
 
+    uint32_t start_us = mp_hal_ticks_us();
     while ((ret = mbedtls_ssl_handshake(&ss->ssl)) != 0)
     {
         if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_TIMEOUT ) || count >= ss->read_timeout)
         {
             // printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
+            modussl_handshake_done(ss, start_us, ret);
             *_errno = ret;
             return -1;
         }
@@ -405,6 +558,7 @@ int lwipsocket_socket_setup_ssl(mod_network_socket_obj_t *s, int *_errno)
             count++;
         }
     }
+    modussl_handshake_done(ss, start_us, 0);
 
     // printf("Verifying peer X.509 certificate...\n");
 
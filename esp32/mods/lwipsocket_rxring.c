@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "lwipsocket_rxring.h"
+
+/******************************************************************************
+ DEFINE PRIVATE MACROS
+ ******************************************************************************/
+#define RX_RING_MIN(a, b)       ((a) < (b) ? (a) : (b))
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void lwipsocket_rx_ring_queued(lwipsocket_rx_ring_t *ring, uint32_t n) {
+    ring->tail = (ring->tail + n) % ring->size;
+    ring->depth += n;
+    if (ring->depth > ring->hwm) {
+        ring->hwm = ring->depth;
+    }
+}
+
+static void lwipsocket_rx_ring_taken(lwipsocket_rx_ring_t *ring, uint32_t n) {
+    ring->head = (ring->head + n) % ring->size;
+    ring->depth -= n;
+    if (ring->depth == 0) {
+        ring->head = ring->tail = 0;
+    }
+}
+
+// Moves what lwIP holds for a stream socket into its empty ring.  Only the
+// first read may block, and returns the error or end of stream as is.
+static int lwipsocket_rx_ring_fill_stream(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, int *_errno) {
+    bool dontwait = false;
+    while (ring->depth < ring->size) {
+        uint32_t room = (ring->tail >= ring->head) ? ring->size - ring->tail : ring->head - ring->tail;
+        int ret = read(sd, ring->buf + ring->tail, room, dontwait, NULL, NULL, _errno);
+        if (ret <= 0) {
+            if (!dontwait) {
+                return ret;
+            }
+            break;
+        }
+        ring->fills++;
+        lwipsocket_rx_ring_queued(ring, ret);
+        dontwait = true;
+    }
+    if (ring->depth == ring->size) {
+        ring->full++;
+    }
+    return ring->depth;
+}
+
+// Queues the datagrams lwIP holds for a datagram socket; as for a stream,
+// only the first read may block.
+static int lwipsocket_rx_ring_fill_dgram(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, int *_errno) {
+    bool dontwait = false;
+    for (;;) {
+        uint32_t room;
+        if (ring->depth == 0 || ring->tail > ring->head) {
+            room = ring->size - ring->tail;
+            if (room < LWIPSOCKET_RX_DGRAM_MAX && ring->depth > 0 && ring->head > LWIPSOCKET_RX_DGRAM_MAX) {
+                // skip the end of the buffer and go on from the start
+                if (room >= 2) {
+                    ring->buf[ring->tail] = LWIPSOCKET_RX_DGRAM_WRAP & 0xFF;
+                    ring->buf[ring->tail + 1] = LWIPSOCKET_RX_DGRAM_WRAP >> 8;
+                }
+                lwipsocket_rx_ring_queued(ring, room);
+                room = ring->head;
+            }
+        } else {
+            room = ring->head - ring->tail;
+        }
+        if (room < LWIPSOCKET_RX_DGRAM_MAX) {
+            ring->full++;
+            break;
+        }
+
+        uint8_t *rec = ring->buf + ring->tail;
+        uint16_t port;
+        int ret = read(sd, rec + LWIPSOCKET_RX_DGRAM_HDR, LWIPSOCKET_RX_DGRAM_DATA_MAX, dontwait, rec + 4, &port, _errno);
+        if (ret < 0) {
+            if (!dontwait) {
+                return -1;
+            }
+            break;
+        }
+        rec[0] = ret & 0xFF;
+        rec[1] = ret >> 8;
+        rec[2] = port & 0xFF;
+        rec[3] = port >> 8;
+        ring->fills++;
+        lwipsocket_rx_ring_queued(ring, LWIPSOCKET_RX_DGRAM_HDR + ret);
+        dontwait = true;
+    }
+    return ring->depth;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+int lwipsocket_rx_ring_recv_stream(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, uint8_t *buf, uint32_t len, int *_errno) {
+    if (ring->depth == 0) {
+        if (len >= ring->size) {
+            // nothing to gain from the ring, read straight into the caller's buffer
+            return read(sd, buf, len, false, NULL, NULL, _errno);
+        }
+        int ret = lwipsocket_rx_ring_fill_stream(ring, read, sd, _errno);
+        if (ret <= 0) {
+            return (ret < 0) ? -1 : 0;
+        }
+    }
+    uint32_t n = RX_RING_MIN(len, ring->depth);
+    uint32_t first = RX_RING_MIN(n, ring->size - ring->head);
+    memcpy(buf, ring->buf + ring->head, first);
+    memcpy(buf + first, ring->buf, n - first);
+    lwipsocket_rx_ring_taken(ring, n);
+    return n;
+}
+
+int lwipsocket_rx_ring_recv_dgram(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, uint8_t *buf, uint32_t len, uint8_t *ip, uint16_t *port, int *_errno) {
+    if (ring->depth == 0 && lwipsocket_rx_ring_fill_dgram(ring, read, sd, _errno) < 0) {
+        return -1;
+    }
+    uint8_t *rec = ring->buf + ring->head;
+    uint32_t rest = ring->size - ring->head;
+    if (rest < LWIPSOCKET_RX_DGRAM_HDR || (rec[0] | (rec[1] << 8)) == LWIPSOCKET_RX_DGRAM_WRAP) {
+        lwipsocket_rx_ring_taken(ring, rest);
+        rec = ring->buf;
+    }
+    uint32_t dlen = rec[0] | (rec[1] << 8);
+    if (ip != NULL) {
+        *port = rec[2] | (rec[3] << 8);
+        memcpy(ip, rec + 4, 4);
+    }
+    uint32_t n = RX_RING_MIN(len, dlen);
+    memcpy(buf, rec + LWIPSOCKET_RX_DGRAM_HDR, n);
+    if (n < dlen) {
+        ring->drops++;
+    }
+    lwipsocket_rx_ring_taken(ring, LWIPSOCKET_RX_DGRAM_HDR + dlen);
+    return n;
+}
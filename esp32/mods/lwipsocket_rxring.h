@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LWIPSOCKET_RXRING_H_
+#define LWIPSOCKET_RXRING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define LWIPSOCKET_RX_DGRAM_DATA_MAX        (2048)  // WLAN_MAX_RX_SIZE of lwipsocket.c
+#define LWIPSOCKET_RX_DGRAM_HDR             (8)     // u16 len | u16 port | ip[4]
+#define LWIPSOCKET_RX_DGRAM_MAX             (LWIPSOCKET_RX_DGRAM_HDR + LWIPSOCKET_RX_DGRAM_DATA_MAX)
+#define LWIPSOCKET_RX_DGRAM_WRAP            (0xFFFF)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// A socket's receive ring.  When it runs empty a recv pulls everything lwIP
+// has queued in one go, then serves the following calls from the ring; when
+// it is full lwIP is left to hold the rest, which closes the TCP window.
+// Datagrams are stored whole behind a small header and never wrap; the
+// bytes skipped at the end of the buffer count towards depth.
+typedef struct _lwipsocket_rx_ring_t {
+    uint32_t size;
+    uint32_t head;      // first byte queued
+    uint32_t tail;      // first byte free
+    uint32_t depth;     // bytes queued, headers included
+    uint32_t hwm;       // largest depth seen
+    uint32_t fills;     // reads from lwIP
+    uint32_t full;      // times the ring filled up and reads from lwIP stopped
+    uint32_t drops;     // datagrams cut short by a buffer smaller than them
+    uint8_t buf[];
+} lwipsocket_rx_ring_t;
+
+// Reads from socket sd as lwip_recv_r does, or as lwip_recvfrom_r when ip
+// isn't NULL.  Returns -1 with *_errno set on error.
+typedef int (*lwipsocket_rx_read_t)(int sd, uint8_t *buf, uint32_t len, bool dontwait, uint8_t *ip, uint16_t *port, int *_errno);
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern int lwipsocket_rx_ring_recv_stream(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, uint8_t *buf, uint32_t len, int *_errno);
+
+extern int lwipsocket_rx_ring_recv_dgram(lwipsocket_rx_ring_t *ring, lwipsocket_rx_read_t read, int sd, uint8_t *buf, uint32_t len, uint8_t *ip, uint16_t *port, int *_errno);
+
+#endif      // LWIPSOCKET_RXRING_H_
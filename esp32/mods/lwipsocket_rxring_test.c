@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// Host test of the socket receive ring. It isn't part of the firmware build:
+//
+//     cc -O2 -Wall lwipsocket_rxring_test.c lwipsocket_rxring.c -o /tmp/lwipsocket_rxring_test
+//     /tmp/lwipsocket_rxring_test
+//
+// lwIP is replaced by a read function serving a random byte stream, or
+// datagrams of random lengths, in pieces of random sizes. Reads of random
+// lengths must get the stream back unchanged, and every datagram in order
+// with its source, cut short only by a too small buffer.
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwipsocket_rxring.h"
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define STREAM_LEN          (300000)
+#define TCP_MSS             (1460)
+#define DGRAM_ROUNDS        (20000)
+
+static uint8_t stream[STREAM_LEN];
+static uint32_t stream_pos, stream_avail;
+static uint32_t dgram_len[8];
+static uint32_t dgram_head, dgram_count, dgram_seq;
+static uint32_t dgram_sent[DGRAM_ROUNDS + 8];
+
+// what lwIP has queued: stream_avail bytes of the stream, or the datagrams
+// of dgram_len; only the first read of a fill may block, and never on an
+// empty socket, which would wait forever
+static int fake_read(int sd, uint8_t *buf, uint32_t len, bool dontwait, uint8_t *ip, uint16_t *port, int *_errno) {
+    (void)sd;
+    if (ip == NULL) {
+        if (stream_avail == 0) {
+            assert(dontwait);
+            *_errno = EAGAIN;
+            return -1;
+        }
+        uint32_t n = MIN(MIN(len, stream_avail), TCP_MSS);
+        memcpy(buf, stream + stream_pos, n);
+        stream_pos += n;
+        stream_avail -= n;
+        return n;
+    }
+    if (dgram_head == dgram_count) {
+        assert(dontwait);
+        *_errno = EAGAIN;
+        return -1;
+    }
+    uint32_t n = MIN(len, dgram_len[dgram_head]);
+    dgram_head++;
+    dgram_sent[dgram_seq] = n;
+    for (uint32_t i = 0; i < n; i++) {
+        buf[i] = (uint8_t)(dgram_seq + i);
+    }
+    *port = (uint16_t)dgram_seq;
+    ip[0] = 192; ip[1] = 168; ip[2] = 4; ip[3] = (uint8_t)dgram_seq;
+    dgram_seq++;
+    return n;
+}
+
+static lwipsocket_rx_ring_t *new_ring(uint32_t size) {
+    lwipsocket_rx_ring_t *ring = calloc(1, sizeof(lwipsocket_rx_ring_t) + size);
+    ring->size = size;
+    return ring;
+}
+
+static void check_stream(uint32_t size) {
+    static uint8_t out[STREAM_LEN];
+    lwipsocket_rx_ring_t *ring = new_ring(size);
+    uint32_t got = 0;
+    int err;
+
+    for (uint32_t i = 0; i < STREAM_LEN; i++) {
+        stream[i] = rand();
+    }
+    stream_pos = stream_avail = 0;
+    while (got < STREAM_LEN) {
+        if (ring->depth == 0 && stream_avail == 0) {
+            uint32_t queued = 1 + rand() % 9000;
+            stream_avail = MIN(STREAM_LEN - stream_pos, queued);
+        }
+        // mostly small reads, and some larger than the ring
+        uint32_t want = 1 + rand() % (rand() % 4 == 0 ? 3 * size : 100);
+        int n = lwipsocket_rx_ring_recv_stream(ring, fake_read, 0, out + got, MIN(want, STREAM_LEN - got), &err);
+        assert(n > 0);
+        assert(ring->depth <= ring->size && ring->hwm <= ring->size);
+        got += n;
+    }
+    assert(memcmp(out, stream, STREAM_LEN) == 0);
+    printf("stream, ring of %5u: hwm %5u fills %5u full %4u\n", size, ring->hwm, ring->fills, ring->full);
+    free(ring);
+}
+
+static void check_dgram(uint32_t size) {
+    lwipsocket_rx_ring_t *ring = new_ring(size);
+    uint32_t expect = 0, drops = 0;
+    int err;
+
+    dgram_head = dgram_count = dgram_seq = 0;
+    for (int round = 0; round < DGRAM_ROUNDS; round++) {
+        if (dgram_head == dgram_count && ring->depth == 0) {
+            dgram_head = 0;
+            dgram_count = 1 + rand() % 6;
+            for (uint32_t i = 0; i < dgram_count; i++) {
+                dgram_len[i] = rand() % (LWIPSOCKET_RX_DGRAM_DATA_MAX + 1);
+            }
+        }
+        static uint8_t buf[LWIPSOCKET_RX_DGRAM_DATA_MAX + 100];
+        uint8_t ip[4];
+        uint16_t port;
+        uint32_t want = rand() % sizeof(buf);
+        int n = lwipsocket_rx_ring_recv_dgram(ring, fake_read, 0, buf, want, ip, &port, &err);
+        assert(n == (int)MIN(want, dgram_sent[expect]));
+        drops += (want < dgram_sent[expect]);
+        assert(port == (uint16_t)expect && ip[0] == 192 && ip[3] == (uint8_t)expect);
+        for (int i = 0; i < n; i++) {
+            assert(buf[i] == (uint8_t)(expect + i));
+        }
+        assert(ring->depth <= ring->size);
+        expect++;
+    }
+    assert(ring->drops == drops);
+    printf("dgram, ring of %5u: hwm %5u fills %5u full %4u drops %u\n", size, ring->hwm, ring->fills, ring->full, ring->drops);
+    free(ring);
+}
+
+int main(void) {
+    for (uint32_t size = 1024; size <= 8192; size *= 2) {
+        check_stream(size);
+    }
+    // the smallest datagram ring, and one that ends in a piece too short for a datagram
+    check_dgram(2 * LWIPSOCKET_RX_DGRAM_MAX);
+    check_dgram(2 * LWIPSOCKET_RX_DGRAM_MAX + 777);
+    check_dgram(5 * LWIPSOCKET_RX_DGRAM_MAX + 3);
+    printf("lwipsocket_rxring: OK\n");
+    return 0;
+}
@@ -11,9 +11,10 @@
 #include "py/mpconfig.h"
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/stream.h"
+#include "py/builtin.h"
 
 #include "coap.h"
-#include "coap_list.h"
 
 #include "modcoap.h"
 #include "modnetwork.h"
@@ -34,6 +35,12 @@
 #define MODCOAP_REQUEST_PUT     (0x02)
 #define MODCOAP_REQUEST_POST    (0x04)
 #define MODCOAP_REQUEST_DELETE  (0x08)
+// Resources are found by their Uri hash key, spread over this many buckets
+#define MODCOAP_RESOURCE_BUCKETS    (16)
+// Largest block served by block-wise (RFC 7959) transfers: 2^(4+6) = 1024 bytes
+#define MODCOAP_BLOCK_SZX_MAX       (6)
+#define MODCOAP_OPTIONS_MAX         (16)
+#define MODCOAP_PATH_LEN_MAX        (300)
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -41,7 +48,8 @@
 typedef struct mod_coap_resource_obj_s {
     mp_obj_base_t base;
     coap_resource_t* coap_resource;
-    struct mod_coap_resource_obj_s* next;
+    struct mod_coap_resource_obj_s* next;   // next in the same index bucket
+    mp_obj_t file;                          // path of the file served, or MP_OBJ_NULL
     uint8_t* value;
     uint32_t max_age;
     uint16_t etag_value;
@@ -54,12 +62,18 @@ typedef struct mod_coap_obj_s {
     mp_obj_base_t base;
     coap_context_t* context;
     mod_network_socket_obj_t* socket;
-    mod_coap_resource_obj_t* resources;
+    mod_coap_resource_obj_t* resources[MODCOAP_RESOURCE_BUCKETS];
     SemaphoreHandle_t semphr;
     mp_obj_t callback;
-    coap_list_t *optlist;
 }mod_coap_obj_t;
 
+// An option of an outgoing request, pointing at its value
+typedef struct {
+    uint16_t key;
+    uint16_t length;
+    const unsigned char* data;
+}modcoap_option_t;
+
 
 
 /******************************************************************************
@@ -67,7 +81,7 @@ typedef struct mod_coap_obj_s {
  ******************************************************************************/
 STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource);
 STATIC mod_coap_resource_obj_t* find_resource_by_key(coap_key_t key);
-STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag);
+STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag, mp_obj_t file, bool observable);
 STATIC void remove_resource_by_key(coap_key_t key);
 STATIC void remove_resource(const char* uri);
 STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t new_value);
@@ -118,15 +132,14 @@ STATIC void coap_response_handler(struct coap_context_t * context,
                                     coap_pdu_t *received,
                                     const coap_tid_t id);
 
-STATIC int modcoap_order_opts(void *a, void *b);
 STATIC coap_pdu_t * modcoap_new_request(coap_context_t *ctx,
                                         unsigned int m,
-                                        coap_list_t **options,
+                                        modcoap_option_t *options,
+                                        size_t options_count,
                                         const char* token,
                                         size_t token_length,
                                         const char *data,
                                         size_t length);
-STATIC coap_list_t * modcoap_new_option_node(unsigned short key, unsigned int length, unsigned char *data);
 /******************************************************************************
  DEFINE PRIVATE VARIABLES
  ******************************************************************************/
@@ -138,39 +151,41 @@ STATIC bool initialized = false;
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
-// Get the resource if exists
-STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource) {
+// Get the index bucket of a resource, the key is already a hash of the Uri
+STATIC mod_coap_resource_obj_t** resource_bucket(const coap_key_t key) {
+    return &coap_obj_ptr->resources[(key[0] ^ key[3]) % MODCOAP_RESOURCE_BUCKETS];
+}
 
-    if(coap_obj_ptr->resources != NULL) {
-        mod_coap_resource_obj_t* current = coap_obj_ptr->resources;
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, resource->key, sizeof(current->coap_resource->key)) == 0) {
-                return current;
-            }
+// Get the resource if exists by its key, NULL otherwise
+STATIC mod_coap_resource_obj_t* lookup_resource(const coap_key_t key) {
+
+    mod_coap_resource_obj_t* current = *resource_bucket(key);
+    for(; current != NULL; current = current->next) {
+        if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
+            return current;
         }
     }
     return NULL;
 }
 
+// Get the resource if exists
+STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource) {
+    return lookup_resource(resource->key);
+}
+
 // Get the resource if exists by its key
 STATIC mod_coap_resource_obj_t* find_resource_by_key(coap_key_t key) {
 
-    if(coap_obj_ptr->resources != NULL) {
-        mod_coap_resource_obj_t* current = coap_obj_ptr->resources;
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, key, sizeof(current->coap_resource->key)) == 0) {
-                return current;
-            }
-        }
+    mod_coap_resource_obj_t* resource = lookup_resource(key);
+    if(resource == NULL) {
+        return mp_const_none;
     }
-    return mp_const_none;
+    return resource;
 }
 
 
 // Create a new resource in the scope of the only context
-STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag) {
+STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag, mp_obj_t file, bool observable) {
 
     // Currently only 1 context is supported
     mod_coap_obj_t* context = coap_obj_ptr;
@@ -178,17 +193,10 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     coap_key_t key;
     (void)coap_hash_path((const unsigned char*)uri, strlen(uri), key);
 
-    // Check if there is at least 1 resource
-    if(context->resources != NULL) {
-        mod_coap_resource_obj_t* current = context->resources;
-        // Iterate through the resources and check whether the new one exists
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(key, current->coap_resource->key, sizeof(key)) == 0) {
-                // Resource already exists
-                return NULL;
-            }
-        }
+    // Check whether the new one exists
+    if(lookup_resource(key) != NULL) {
+        // Resource already exists
+        return NULL;
     }
 
     // Resource does not exist, create a new resource object
@@ -203,8 +211,8 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     resource->etag = etag; // by default it is false
     resource->etag_value = 0; // start with 0, resource_update_value() will update it (0 is incorrect for E-Tag value)
 
-    // No next elem
-    resource->next = NULL;
+    // Get the file to serve instead of the value, if any
+    resource->file = file;
 
     // uri parameter pointer will be destroyed, pass a pointer to a permanent location
     unsigned char* uri_ptr = (unsigned char*)malloc(strlen(uri));
@@ -212,6 +220,9 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     // Pass COAP_RESOURCE_FLAGS_RELEASE_URI so Coap Library will free up the memory allocated to store the URI when the Resource is deleted
     resource->coap_resource = coap_resource_init(uri_ptr, strlen(uri), COAP_RESOURCE_FLAGS_RELEASE_URI);
     if(resource->coap_resource != NULL) {
+        // Notifications of an observable resource go out from mod_coap_read()
+        resource->coap_resource->observable = observable;
+
         // Add the resource to the Coap context
         coap_add_resource(context->context, resource->coap_resource);
 
@@ -223,17 +234,9 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
         resource_update_value(resource, value);
 
         // Add the resource to our context
-        if(context->resources == NULL) {
-            // No resource exists, add as first element
-            context->resources = resource;
-        }
-        else {
-            mod_coap_resource_obj_t* current = context->resources;
-            // Find the last resource
-            for(; current->next != NULL; current = current->next) {}
-            // Append the new resource to the end of the list
-            current->next = resource;
-        }
+        mod_coap_resource_obj_t** bucket = resource_bucket(key);
+        resource->next = *bucket;
+        *bucket = resource;
 
         return resource;
     }
@@ -254,42 +257,23 @@ STATIC void remove_resource_by_key(coap_key_t key) {
     // Currently only 1 context is supported
     mod_coap_obj_t* context = coap_obj_ptr;
 
-    if(context->resources != NULL) {
-        mod_coap_resource_obj_t* current = context->resources;
-        mod_coap_resource_obj_t* previous = context->resources;
-        for(; current != NULL; current = current->next) {
-
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
-                // Resource found, remove from the list
-                // Check if it is the first element in the list
-                if(context->resources == current) {
-                    // If no more element in the list then invalidate the list
-                    if(current->next == NULL) {
-                        context->resources = NULL;
-                    }
-                    // Other elements are in the list
-                    else {
-                        context->resources = current->next;
-                    }
-                }
-                else {
-                    // It is not the first element
-                    previous->next = current->next;
-                }
+    mod_coap_resource_obj_t** link = resource_bucket(key);
+    for(; *link != NULL; link = &(*link)->next) {
 
-                // Free the resource in coap's scope
-                coap_delete_resource(context->context, key);
-                // Free the element in MP scope
-                free(current->value);
-                // Free the resource itself
-                m_del_obj(mod_coap_resource_obj_t, current);
+        mod_coap_resource_obj_t* current = *link;
+        // The hash key is generated from Uri
+        if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
+            // Resource found, remove from its bucket
+            *link = current->next;
 
-                return;
-            }
+            // Free the resource in coap's scope
+            coap_delete_resource(context->context, key);
+            // Free the element in MP scope
+            free(current->value);
+            // Free the resource itself
+            m_del_obj(mod_coap_resource_obj_t, current);
 
-            // Mark the current element as previous, needed when removing the actual current element from the list
-            previous = current;
+            return;
         }
     }
 }
@@ -345,6 +329,50 @@ STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t ne
         resource->value = malloc(resource->value_len);
         memcpy(resource->value, value_bufinfo.buf, resource->value_len);
     }
+
+    // Observers get the new value at the next mod_coap_read(), however many
+    // times it changes until then
+    if(resource->coap_resource->observable) {
+        resource->coap_resource->dirty = 1;
+    }
+}
+
+// Read a part of the file served by a resource, returns the bytes read or -1 on error
+STATIC int resource_read_file(mod_coap_resource_obj_t* resource, size_t offset, uint8_t* buf, size_t len, size_t* total) {
+
+    int ret = -1;
+    nlr_buf_t nlr;
+    // This runs inside coap_read(), an exception must not unwind through libcoap
+    if(nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { resource->file, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        mp_obj_t file = mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+        // Once open, the file is closed whether or not reading it raises
+        nlr_buf_t nlr_file;
+        if(nlr_push(&nlr_file) == 0) {
+            const mp_stream_p_t* stream_p = mp_get_stream_raise(file, MP_STREAM_OP_READ | MP_STREAM_OP_IOCTL);
+            int errcode;
+            struct mp_stream_seek_t seek = { .offset = 0, .whence = MP_SEEK_END };
+            if(stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode) != MP_STREAM_ERROR) {
+                *total = seek.offset;
+                seek.offset = offset;
+                seek.whence = MP_SEEK_SET;
+                if(offset >= *total) {
+                    ret = 0;
+                }
+                else if(stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode) != MP_STREAM_ERROR) {
+                    mp_uint_t n = mp_stream_rw(file, buf, MIN(len, *total - offset), &errcode, MP_STREAM_RW_READ);
+                    ret = (errcode == 0) ? (int)n : -1;
+                }
+            }
+            nlr_pop();
+        }
+        else {
+            ret = -1;
+        }
+        mp_stream_close(file);
+        nlr_pop();
+    }
+    return ret;
 }
 
 
@@ -361,10 +389,11 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
     mod_coap_resource_obj_t* resource_obj = find_resource(resource);
 
     // Check if the resource exists. (e.g.: has not been removed in the background before we got the semaphore in mod_coap_read())
+    // The request is NULL when libcoap asks for a notification to an observer
     if(resource_obj != NULL) {
 
         // Check if media type of the resource is given
-        if(resource_obj->mediatype != -1) {
+        if(resource_obj->mediatype != -1 && request != NULL) {
             coap_opt_iterator_t opt_it;
             // Need to check if ACCEPT option is specified and we can serve it
             coap_opt_t *opt = coap_check_option(request, COAP_OPTION_ACCEPT, &opt_it);
@@ -392,7 +421,7 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
         response->hdr->code = COAP_RESPONSE_CODE(205);
 
         // Check if ETAG value is maintained for the resource
-        if(resource_obj->etag == true) {
+        if(resource_obj->etag == true && request != NULL) {
 
             coap_opt_iterator_t opt_it;
             // Need to check if E-TAG option is specified and we can serve it
@@ -415,13 +444,53 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
             }
         }
 
-        // Add the options if configured
-        unsigned char buf[3];
+        // The block asked for, the whole value fits in the first one unless it is too large
+        coap_block_t block = { .num = 0, .m = 0, .szx = MODCOAP_BLOCK_SZX_MAX };
+        bool blockwise = (request != NULL) && coap_get_block(request, COAP_OPTION_BLOCK2, &block);
+        block.szx = MIN(block.szx, MODCOAP_BLOCK_SZX_MAX);
+        size_t block_size = 1 << (block.szx + 4);
+        size_t offset = block.num * block_size;
+
+        // Get the block of the data itself if updated
+        uint8_t* data = NULL;
+        int data_len = 0;
+        size_t total = resource_obj->value_len;
+        if(response->hdr->code == COAP_RESPONSE_CODE(205)) {
+            if(resource_obj->file != MP_OBJ_NULL) {
+                data = m_new(uint8_t, block_size);
+                data_len = resource_read_file(resource_obj, offset, data, block_size, &total);
+                if(data_len < 0) {
+                    m_del(uint8_t, data, block_size);
+                    response->hdr->code = COAP_RESPONSE_CODE(500);
+                    return;
+                }
+            }
+            else if(offset < total) {
+                data = resource_obj->value + offset;
+                data_len = MIN(block_size, total - offset);
+            }
+            if(offset > 0 && offset >= total) {
+                // 4.02 Bad Option: the block is past the end of the data
+                response->hdr->code = COAP_RESPONSE_CODE(402);
+                if(resource_obj->file != MP_OBJ_NULL) {
+                    m_del(uint8_t, data, block_size);
+                }
+                return;
+            }
+            blockwise = blockwise || total > block_size;
+        }
+
+        // Add the options if configured, in the order of their numbers
+        unsigned char buf[4];
 
         if(resource_obj->etag == true) {
             coap_add_option(response, COAP_OPTION_ETAG, coap_encode_var_bytes(buf, resource_obj->etag_value), buf);
         }
 
+        if(coap_find_observer(resource, address, token) != NULL) {
+            coap_add_option(response, COAP_OPTION_OBSERVE, coap_encode_var_bytes(buf, context->observe), buf);
+        }
+
         if(resource_obj->mediatype != -1) {
             coap_add_option(response, COAP_OPTION_CONTENT_TYPE, coap_encode_var_bytes(buf, resource_obj->mediatype), buf);
         }
@@ -430,9 +499,17 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
             coap_add_option(response, COAP_OPTION_MAXAGE, coap_encode_var_bytes(buf, resource_obj->max_age), buf);
         }
 
-        // Add the data itself if updated
         if(response->hdr->code == COAP_RESPONSE_CODE(205)) {
-            coap_add_data(response, resource_obj->value_len, (unsigned char *)resource_obj->value);
+            if(blockwise) {
+                // RFC 7959: block number, whether more blocks follow and the size exponent
+                unsigned int more = (offset + data_len < total) ? 1 : 0;
+                unsigned int value = (block.num << 4) | (more << 3) | block.szx;
+                coap_add_option(response, COAP_OPTION_BLOCK2, coap_encode_var_bytes(buf, value), buf);
+            }
+            coap_add_data(response, data_len, (unsigned char *)data);
+            if(resource_obj->file != MP_OBJ_NULL) {
+                m_del(uint8_t, data, block_size);
+            }
         }
     }
     else {
@@ -682,34 +759,19 @@ STATIC void coap_response_handler(struct coap_context_t * context,
 
 }
 
-// Helper function to order the options in a request as per delta encoding
-STATIC int modcoap_order_opts(void *a, void *b) {
-
-    coap_option *o1, *o2;
-
-    if (!a || !b) {
-        return a < b ? -1 : 1;
-    }
-
-    o1 = (coap_option *)(((coap_list_t *)a)->data);
-    o2 = (coap_option *)(((coap_list_t *)b)->data);
-
-    return (COAP_OPTION_KEY(*o1) < COAP_OPTION_KEY(*o2)) ? -1 : (COAP_OPTION_KEY(*o1) != COAP_OPTION_KEY(*o2));
-}
-
 // Helper function to create a new request message
 STATIC coap_pdu_t * modcoap_new_request
 (
     coap_context_t *ctx,
     unsigned int method,
-    coap_list_t **options,
+    modcoap_option_t *options,
+    size_t options_count,
     const char* token,
     size_t token_length,
     const char *data,
     size_t length
 )
 {
-    coap_list_t *opt;
     // TODO: get the type of the PDU as a parameter
     // TODO: calculate somehow the proper length
     coap_pdu_t *pdu = coap_pdu_init(COAP_MESSAGE_CON, method, htons(++(ctx->message_id)), COAP_MAX_PDU_SIZE);
@@ -723,17 +785,19 @@ STATIC coap_pdu_t * modcoap_new_request
         return NULL;
     }
 
-    if (options) {
-        /* sort options for delta encoding */
-        LL_SORT((*options), modcoap_order_opts);
-
-        LL_FOREACH((*options), opt) {
-            coap_option *o = (coap_option *)(opt->data);
-            coap_add_option(pdu,
-                            COAP_OPTION_KEY(*o),
-                            COAP_OPTION_LENGTH(*o),
-                            COAP_OPTION_DATA(*o));
+    // Sort the options for delta encoding, keeping repeated ones (e.g.: Uri-Path) in their order
+    for (size_t i = 1; i < options_count; i++) {
+        modcoap_option_t option = options[i];
+        size_t j = i;
+        while (j > 0 && options[j - 1].key > option.key) {
+            options[j] = options[j - 1];
+            j--;
         }
+        options[j] = option;
+    }
+
+    for (size_t i = 0; i < options_count; i++) {
+        coap_add_option(pdu, options[i].key, options[i].length, options[i].data);
     }
 
     if (length) {
@@ -743,21 +807,6 @@ STATIC coap_pdu_t * modcoap_new_request
     return pdu;
 }
 
-// Helper function to create a new option for a request message
-STATIC coap_list_t * modcoap_new_option_node(unsigned short key, unsigned int length, unsigned char *data) {
-
-    coap_list_t *node = malloc(sizeof(coap_list_t) + sizeof(coap_option) + length);
-    if (node) {
-        coap_option *option;
-        option = (coap_option *)(node->data);
-        COAP_OPTION_KEY(*option) = key;
-        COAP_OPTION_LENGTH(*option) = length;
-        memcpy(COAP_OPTION_DATA(*option), data, length);
-    }
-
-    return node;
-}
-
 /******************************************************************************
  DEFINE COAP RESOURCE CLASS FUNCTIONS
  ******************************************************************************/
@@ -892,6 +941,7 @@ STATIC void mod_coap_init_helper(mp_obj_t address, bool service_discovery) {
     coap_obj_ptr->socket->sock_base.timeout = 0;
     coap_obj_ptr->socket->sock_base.is_ssl = false;
     coap_obj_ptr->socket->sock_base.connected = false;
+    coap_obj_ptr->socket->sock_base.rx_ring = NULL;
 
     // Find and register the NIC
     coap_obj_ptr->socket->sock_base.nic = mod_network_find_nic(coap_obj_ptr->socket, (const byte *)"");
@@ -935,7 +985,7 @@ STATIC mp_obj_t mod_coap_init(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map
         MP_STATE_PORT(coap_ptr) = m_new_obj(mod_coap_obj_t);
         coap_obj_ptr = MP_STATE_PORT(coap_ptr);
         coap_obj_ptr->context = NULL;
-        coap_obj_ptr->resources = NULL;
+        memset(coap_obj_ptr->resources, 0, sizeof(coap_obj_ptr->resources));
         coap_obj_ptr->socket = NULL;
         coap_obj_ptr->semphr = NULL;
 
@@ -988,6 +1038,8 @@ STATIC const mp_arg_t mod_coap_add_resource_args[] = {
         { MP_QSTR_max_age,                  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1}},
         { MP_QSTR_value,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
         { MP_QSTR_etag,                     MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = false}},
+        { MP_QSTR_file,                     MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        { MP_QSTR_observable,               MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = false}},
 };
 
 // Add a new resource to the context if not exists
@@ -1001,7 +1053,7 @@ STATIC mp_obj_t mod_coap_add_resource(mp_uint_t n_args, const mp_obj_t *pos_args
         mp_arg_val_t args[MP_ARRAY_SIZE(mod_coap_add_resource_args)];
         mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), mod_coap_add_resource_args, args);
 
-        mod_coap_resource_obj_t* res = add_resource(mp_obj_str_get_str(args[0].u_obj), args[1].u_int, args[2].u_int, args[3].u_obj, args[4].u_bool);
+        mod_coap_resource_obj_t* res = add_resource(mp_obj_str_get_str(args[0].u_obj), args[1].u_int, args[2].u_int, args[3].u_obj, args[4].u_bool, args[5].u_obj, args[6].u_bool);
 
         xSemaphoreGive(coap_obj_ptr->semphr);
 
@@ -1069,6 +1121,8 @@ STATIC mp_obj_t mod_coap_read(void) {
         // Take the context's semaphore to avoid concurrent access, this will guard the handler functions too
         xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
         coap_read(coap_obj_ptr->context);
+        // Send one notification to the observers of every resource changed since the last read
+        coap_check_notify(coap_obj_ptr->context);
         xSemaphoreGive(coap_obj_ptr->semphr);
     }
     else {
@@ -1208,69 +1262,54 @@ STATIC mp_obj_t mod_coap_send_request(mp_uint_t n_args, const mp_obj_t *pos_args
         // Take the context's semaphore to avoid concurrent access
         xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
 
+        // The options point into these buffers, they must live until the request is built
+        modcoap_option_t options[MODCOAP_OPTIONS_MAX];
+        size_t options_count = 0;
+        unsigned char portbuf[2];
+        unsigned char path[MODCOAP_PATH_LEN_MAX];
+        unsigned char content_format_buf[2];
+
         if(include_options == true) {
 
             // Put the URI-HOST as an option
-            coap_list_t * node = modcoap_new_option_node(COAP_OPTION_URI_HOST, coap_uri.host.length, coap_uri.host.s);
-            if(node != NULL) {
-                LL_APPEND(coap_obj_ptr->optlist, node);
-            }
+            options[options_count++] = (modcoap_option_t){ COAP_OPTION_URI_HOST, coap_uri.host.length, coap_uri.host.s };
 
             // Put the URI-PORT as an option
-            unsigned char portbuf[2];
             // Store it in Big Endian
             portbuf[0] = (coap_uri.port >> 8) & 0xFF;
             portbuf[1] = coap_uri.port & 0xFF;
-            node = modcoap_new_option_node(COAP_OPTION_URI_PORT, sizeof(portbuf), portbuf);
-            if(node != NULL) {
-                LL_APPEND(coap_obj_ptr->optlist, node);
-            }
+            options[options_count++] = (modcoap_option_t){ COAP_OPTION_URI_PORT, sizeof(portbuf), portbuf };
 
             // Split up the URI-PATH into more segments if needed
-            //TODO: allocate the proper length
-            size_t length = 300;
-            unsigned char* path = malloc(length);
+            size_t length = sizeof(path);
             // Need to use a different pointer because when the segments are composed the pointer itself is moved
             unsigned char* path_segment = path;
             int segments = coap_split_path(coap_uri.path.s, coap_uri.path.length, path_segment, &length);
 
+            // Keep a slot free for the Content Format
+            if(segments > MODCOAP_OPTIONS_MAX - 3) {
+                xSemaphoreGive(coap_obj_ptr->semphr);
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Too many segments in \"uri_path\"!"));
+            }
+
             // Insert the segments as separate URI-Path options
             while (segments--) {
-                node = modcoap_new_option_node(COAP_OPTION_URI_PATH, COAP_OPT_LENGTH(path_segment), COAP_OPT_VALUE(path_segment));
-                if(node != NULL) {
-                    LL_APPEND(coap_obj_ptr->optlist, node);
-                }
+                options[options_count++] = (modcoap_option_t){ COAP_OPTION_URI_PATH, COAP_OPT_LENGTH(path_segment), COAP_OPT_VALUE(path_segment) };
                 // Move the path_segment pointer to the next segment
                 path_segment += COAP_OPT_SIZE(path_segment);
             }
 
-            // Free up the memory using the pointer pointing to the beginning of the memory area
-            free(path);
-
             // Put Content Format option if given
             if(content_format != -1) {
-                unsigned char content_format_buf[2];
                 // Store it in Big Endian
                 content_format_buf[0] = (content_format >> 8) & 0xFF;
                 content_format_buf[1] = content_format & 0xFF;
-                node = modcoap_new_option_node(COAP_OPTION_CONTENT_FORMAT, sizeof(content_format_buf), content_format_buf);
-                if(node != NULL) {
-                    LL_APPEND(coap_obj_ptr->optlist, node);
-                }
+                options[options_count++] = (modcoap_option_t){ COAP_OPTION_CONTENT_FORMAT, sizeof(content_format_buf), content_format_buf };
             }
         }
 
         // Create new request
-        coap_pdu_t *pdu = modcoap_new_request(coap_obj_ptr->context, method, &coap_obj_ptr->optlist, token, token_length, payload, payload_length);
-
-        // Clean up optlist, they are already part of the PDU if it has been created
-        struct coap_list_t *next;
-        while(coap_obj_ptr->optlist != NULL) {
-            next = coap_obj_ptr->optlist->next;
-            coap_obj_ptr->optlist->next = NULL;
-            free(coap_obj_ptr->optlist);
-            coap_obj_ptr->optlist = next;
-        }
+        coap_pdu_t *pdu = modcoap_new_request(coap_obj_ptr->context, method, options, options_count, token, token_length, payload, payload_length);
 
         if (pdu == NULL) {
             xSemaphoreGive(coap_obj_ptr->semphr);
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "py/mpconfig.h"
@@ -43,9 +44,11 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 
 #include "lora/mac/LoRaMacTest.h"
 #include "lora/mac/region/Region.h"
+#include "lora/mac/region/RegionCommon.h"
 #include "lora/mac/region/RegionAS923.h"
 #include "lora/mac/region/RegionAU915.h"
 #include "lora/mac/region/RegionUS915.h"
@@ -62,6 +65,8 @@
 #endif  // #ifdef LORA_OPENTHREAD_ENABLED
 
 #include "random.h"
+#include "lora/rxring.h"
+#include "lora/txagg.h"
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
@@ -86,6 +91,9 @@
 
 #define DEF_LORAWAN_NETWORK_ID                      0
 #define DEF_LORAWAN_APP_PORT                        2
+#define DEF_LORAWAN_AGG_PORT                        223         // port of the aggregated uplinks
+
+#define LORA_TX_AGG_RETRY_MS                        (1000)
 
 #define LORA_JOIN_WAIT_MS                           (50)
 
@@ -229,20 +237,15 @@ typedef struct {
     uint8_t           events;
     uint8_t           trigger;
     uint8_t           tx_trials;
+    uint32_t          tx_agg_timeout;   // flush deadline of aggregated uplinks in ms, 0 if off
 } lora_obj_t;
 
-typedef struct {
-    uint32_t    index;
-    uint32_t    size;
-    uint8_t     data[LORA_PAYLOAD_SIZE_MAX];
-    uint8_t     port;
-} lora_partial_rx_packet_t;
-
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static QueueHandle_t xCmdQueue;
-static QueueHandle_t xRxQueue;
+static SemaphoreHandle_t xRxSem;     // given when a frame is queued
+static SemaphoreHandle_t xRxMutex;   // held by the reader of the RX ring
 static QueueHandle_t xCbQueue;
 static EventGroupHandle_t LoRaEvents;
 
@@ -252,8 +255,27 @@ static LoRaMacPrimitives_t LoRaMacPrimitives;
 static LoRaMacCallback_t LoRaMacCallbacks;
 
 static lora_obj_t lora_obj;
-static lora_partial_rx_packet_t lora_partial_rx_packet;
-static lora_rx_data_t rx_data_isr;
+// Received frames wait in lora_rx_ring. It's filled from the LoRa timer task,
+// where the radio and MAC callbacks run, and read by the socket calls under
+// xRxMutex. Resizing and resetting the counters are done by the timer task
+// too, with the mutex held.
+static lora_rx_ring_t lora_rx_ring;
+static lora_rx_frame_t lora_rx_frame_spare;     // the ring if none could be allocated
+static lora_rx_frame_t *lora_rx_resize_frames;
+static uint32_t lora_rx_resize_size;
+static lora_rx_ring_t lora_rx_stats_taken;      // the counters as they were reset
+static lora_rx_frame_t lora_rx_last;    // metadata of the frame last read
+static bool lora_rx_last_valid;
+// Records sent with SO_AGGREGATE wait here for the frame that carries them.
+// Only the LoRa task changes it, under lora_tx_agg_mux, so that airtime_stats
+// can read records and deadline together from another task.
+static lora_tx_agg_t lora_tx_agg;
+static portMUX_TYPE lora_tx_agg_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool lora_tx_agg_retry;          // the last attempt to send them failed
+// Whether a sender waits on LoRaEvents for the uplink in flight. Frames of
+// records flushed on their deadline have no one waiting, and their result
+// mustn't wake a sender waiting for a command still in the queue.
+static bool lorawan_tx_notify;
 
 static TimerEvent_t TxNextActReqTimer;
 
@@ -290,10 +312,19 @@ static void lora_get_config (lora_cmd_data_t *cmd_data);
 static void lora_send_cmd (lora_cmd_data_t *cmd_data);
 static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms);
 static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port);
+static void lora_rx_queue (const uint8_t *data, uint32_t len, uint8_t port, uint32_t timestamp, int16_t rssi, int8_t snr, uint8_t sf);
+static void lora_rx_resize (void);
+static void lora_rx_stats_reset (void);
+static void lora_rx_request (modlora_timerCallback cb);
 static bool lora_rx_any (void);
 static bool lora_tx_space (void);
 static void lora_callback_handler (void *arg);
 static bool lorawan_nvs_open (void);
+static bool lorawan_tx (const uint8_t *data, uint8_t len, uint8_t port, uint8_t dr, bool confirmed, bool notify);
+static uint8_t lorawan_max_payload (uint8_t dr);
+static void lorawan_tx_agg_add (lora_tx_cmd_data_t *tx);
+static bool lorawan_tx_agg_send (bool notify);
+static bool lorawan_tx_agg_due (void);
 
 static int lora_socket_socket (mod_network_socket_obj_t *s, int *_errno);
 static void lora_socket_close (mod_network_socket_obj_t *s);
@@ -321,7 +352,15 @@ SemaphoreHandle_t xLoRaSigfoxSem;
  ******************************************************************************/
 void modlora_init0(void) {
     xCmdQueue = xQueueCreate(LORA_CMD_QUEUE_SIZE_MAX, sizeof(lora_cmd_data_t));
-    xRxQueue = xQueueCreate(LORA_DATA_QUEUE_SIZE_MAX, sizeof(lora_rx_data_t));
+    xRxSem = xSemaphoreCreateBinary();
+    xRxMutex = xSemaphoreCreateMutex();
+    lora_rx_frame_t *frames = heap_caps_malloc(LORA_RX_QUEUE_SIZE_DEFAULT * sizeof(lora_rx_frame_t), MALLOC_CAP_INTERNAL);
+    if (frames != NULL) {
+        lora_rx_ring_init(&lora_rx_ring, frames, LORA_RX_QUEUE_SIZE_DEFAULT);
+    } else {
+        mp_printf(&mp_plat_print, "Error allocating the LoRa RX queue!\n");
+        lora_rx_ring_init(&lora_rx_ring, &lora_rx_frame_spare, 1);
+    }
     xCbQueue = xQueueCreate(LORA_CB_QUEUE_SIZE_MAX, sizeof(modlora_timerCallback));
     LoRaEvents = xEventGroupCreate();
 #if defined(FIPY) || defined(LOPY4)
@@ -416,10 +455,10 @@ int lora_ot_recv(uint8_t *buf, int8_t *rssi) {
     if (len > 0) {
 
         // put rssi on signed 8bit, saturate at -128dB
-        if (lora_obj.rssi < INT8_MIN)
+        if (lora_rx_last.rssi < INT8_MIN)
             *rssi = INT8_MIN;
         else
-            *rssi = lora_obj.rssi;
+            *rssi = lora_rx_last.rssi;
 
         otPlatLog(OT_LOG_LEVEL_INFO, 0, "radio rcv: %d, %d", len, *rssi);
     }
@@ -459,11 +498,13 @@ static bool lorawan_nvs_open (void) {
 
 static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms, bool confirmed, uint32_t dr, uint32_t port) {
     lora_cmd_data_t cmd_data;
+    uint32_t frame_len = len;
 
     cmd_data.cmd = E_LORA_CMD_LORAWAN_TX;
     memcpy (cmd_data.info.tx.data, buf, len);
     cmd_data.info.tx.len = len;
     cmd_data.info.tx.dr = dr;
+    cmd_data.info.tx.aggregate = false;
     if (lora_obj.ComplianceTest.Enabled && lora_obj.ComplianceTest.Running) {
         cmd_data.info.tx.port = 224;  // MAC commands port
         if (lora_obj.ComplianceTest.IsTxConfirmed) {
@@ -473,7 +514,11 @@ static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms,
         }
     } else {
         cmd_data.info.tx.confirmed = confirmed;
-        cmd_data.info.tx.port = port;    // data port
+        cmd_data.info.tx.port = port;    // data port, or the record's tag
+        if (lora_obj.tx_agg_timeout > 0) {
+            cmd_data.info.tx.aggregate = true;
+            frame_len += LORA_TX_AGG_HEADER_SIZE;
+        }
     }
 
     if (timeout_ms < 0) {
@@ -489,7 +534,7 @@ static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms,
     }
 
     // validate the message size with the requested data rate
-    if (false == ValidatePayloadLength(len, dr, 0)) {
+    if (false == ValidatePayloadLength(frame_len, dr, 0)) {
         // message too long
         return -1;
     }
@@ -511,6 +556,155 @@ static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms,
     return len;
 }
 
+// runs in the LoRa task, returns true if the data has been passed to the MAC
+static bool lorawan_tx (const uint8_t *data, uint8_t len, uint8_t port, uint8_t dr, bool confirmed, bool notify) {
+    MibRequestConfirm_t mibReq;
+    McpsReq_t mcpsReq;
+    LoRaMacTxInfo_t txInfo;
+    EventBits_t status = 0;
+    bool empty_frame = false;
+    int8_t mac_datarate = 0;
+
+    // set the new data rate before checking if Tx is possible, but store the current one
+    if (!lora_obj.adr) {
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        LoRaMacMibGetRequestConfirm( &mibReq );
+        mac_datarate = mibReq.Param.ChannelsDatarate;
+        mibReq.Param.ChannelsDatarate = dr;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+
+    if (LoRaMacQueryTxPossible (len, &txInfo) != LORAMAC_STATUS_OK) {
+        // send an empty frame in order to flush MAC commands
+        mcpsReq.Type = MCPS_UNCONFIRMED;
+        mcpsReq.Req.Unconfirmed.fBuffer = NULL;
+        mcpsReq.Req.Unconfirmed.fBufferSize = 0;
+        mcpsReq.Req.Unconfirmed.Datarate = dr;
+        empty_frame = true;
+        status |= LORA_STATUS_MSG_SIZE;
+    } else {
+        if (confirmed) {
+            mcpsReq.Type = MCPS_CONFIRMED;
+            mcpsReq.Req.Confirmed.fPort = port;
+            mcpsReq.Req.Confirmed.fBuffer = (void *)data;
+            mcpsReq.Req.Confirmed.fBufferSize = len;
+            mcpsReq.Req.Confirmed.NbTrials = lora_obj.tx_retries + 1;
+            mcpsReq.Req.Confirmed.Datarate = dr;
+        } else {
+            mcpsReq.Type = MCPS_UNCONFIRMED;
+            mcpsReq.Req.Unconfirmed.fPort = port;
+            mcpsReq.Req.Unconfirmed.fBuffer = (void *)data;
+            mcpsReq.Req.Unconfirmed.fBufferSize = len;
+            mcpsReq.Req.Unconfirmed.Datarate = dr;
+        }
+    }
+#if defined(FIPY) || defined(LOPY4)
+    xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
+#endif
+
+    // set back the original datarate
+    if (!lora_obj.adr) {
+        mibReq.Param.ChannelsDatarate = mac_datarate;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+
+    lorawan_tx_notify = notify;
+    if (LoRaMacMcpsRequest(&mcpsReq) != LORAMAC_STATUS_OK || empty_frame) {
+        // the command has failed, send the response now
+        lora_obj.state = E_LORA_STATE_IDLE;
+        status |= LORA_STATUS_ERROR;
+        if (notify) {
+            xEventGroupSetBits(LoRaEvents, status);
+        }
+    #if defined(FIPY) || defined(LOPY4)
+        xSemaphoreGive(xLoRaSigfoxSem);
+    #endif
+        return false;
+    }
+    lora_obj.state = E_LORA_STATE_TX;
+    return true;
+}
+
+// the application payload an uplink at dr can carry, besides the MAC commands waiting
+static uint8_t lorawan_max_payload (uint8_t dr) {
+    MibRequestConfirm_t mibReq;
+    LoRaMacTxInfo_t txInfo;
+    int8_t mac_datarate = 0;
+
+    if (!lora_obj.adr) {
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        LoRaMacMibGetRequestConfirm( &mibReq );
+        mac_datarate = mibReq.Param.ChannelsDatarate;
+        mibReq.Param.ChannelsDatarate = dr;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+    txInfo.MaxPossiblePayload = 0;
+    LoRaMacQueryTxPossible (0, &txInfo);
+    if (!lora_obj.adr) {
+        mibReq.Param.ChannelsDatarate = mac_datarate;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+    return txInfo.MaxPossiblePayload;
+}
+
+// A record is added to the frame being filled and the sender released at
+// once, unless the frame is full: then the frame goes out first and the
+// sender waits for it, as for an ordinary uplink.
+static void lorawan_tx_agg_add (lora_tx_cmd_data_t *tx) {
+    uint8_t max_len = lorawan_max_payload(tx->dr);
+    EventBits_t status = LORA_STATUS_COMPLETED;
+
+    if (LORA_TX_AGG_HEADER_SIZE + tx->len > max_len) {
+        // too long for a frame of its own
+        xEventGroupSetBits(LoRaEvents, LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE);
+        return;
+    }
+    if (!lora_tx_agg_fits(&lora_tx_agg, tx->len, max_len, tx->dr, tx->confirmed)) {
+        if (!lorawan_tx_agg_send(true)) {
+            // the record is dropped, the error has been reported
+            return;
+        }
+        status = 0;
+    }
+    uint32_t deadline = xTaskGetTickCount() + lora_obj.tx_agg_timeout / portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&lora_tx_agg_mux);
+    lora_tx_agg_add(&lora_tx_agg, tx->port, tx->data, tx->len, tx->dr, tx->confirmed, deadline);
+    portEXIT_CRITICAL(&lora_tx_agg_mux);
+    if (status) {
+        xEventGroupSetBits(LoRaEvents, status);
+    }
+}
+
+// notify is false when no sender waits for the frame
+static bool lorawan_tx_agg_send (bool notify) {
+    if (lorawan_tx(lora_tx_agg.data, lora_tx_agg.len, DEF_LORAWAN_AGG_PORT, lora_tx_agg.dr, lora_tx_agg.confirmed, notify)) {
+        portENTER_CRITICAL(&lora_tx_agg_mux);
+        lora_tx_agg_reset(&lora_tx_agg);
+        portEXIT_CRITICAL(&lora_tx_agg_mux);
+        lora_tx_agg_retry = false;
+        return true;
+    }
+    // keep the records for a later attempt
+    uint32_t deadline = xTaskGetTickCount() + LORA_TX_AGG_RETRY_MS / portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&lora_tx_agg_mux);
+    lora_tx_agg.deadline = deadline;
+    portEXIT_CRITICAL(&lora_tx_agg_mux);
+    lora_tx_agg_retry = true;
+    return false;
+}
+
+static bool lorawan_tx_agg_due (void) {
+    if (lora_tx_agg_empty(&lora_tx_agg) || !lora_obj.joined || lora_obj.stack_mode != E_LORA_STACK_MODE_LORAWAN ||
+        (lora_obj.state != E_LORA_STATE_IDLE && lora_obj.state != E_LORA_STATE_RX)) {
+        return false;
+    }
+    // when aggregation is switched off, what's left goes out right away
+    if (lora_obj.tx_agg_timeout == 0 && !lora_tx_agg_retry) {
+        return true;
+    }
+    return (int32_t)(xTaskGetTickCount() - lora_tx_agg.deadline) >= 0;
+}
+
 static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
     uint32_t status = LORA_STATUS_COMPLETED;
     if (McpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK) {
@@ -529,7 +723,9 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
                     mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
                 }
                 lora_obj.state = E_LORA_STATE_IDLE;
-                xEventGroupSetBits(LoRaEvents, status);
+                if (lorawan_tx_notify) {
+                    xEventGroupSetBits(LoRaEvents, status);
+                }
                 break;
             }
             case MCPS_CONFIRMED:
@@ -540,7 +736,9 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
                         mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
                     }
                     lora_obj.state = E_LORA_STATE_IDLE;
-                    xEventGroupSetBits(LoRaEvents, status);
+                    if (lorawan_tx_notify) {
+                        xEventGroupSetBits(LoRaEvents, status);
+                    }
                 } else {
                     // the ack wasn't received, so the stack will re-transmit
                 }
@@ -557,7 +755,9 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
         }
         lora_obj.state = E_LORA_STATE_IDLE;
         status |= LORA_STATUS_ERROR;
-        xEventGroupSetBits(LoRaEvents, status);
+        if (lorawan_tx_notify) {
+            xEventGroupSetBits(LoRaEvents, status);
+        }
     }
 #if defined(FIPY) || defined(LOPY4)
     xSemaphoreGive(xLoRaSigfoxSem);
@@ -622,10 +822,8 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
     if (mcpsIndication->RxData && mcpsIndication->BufferSize > 0) {
         if (mcpsIndication->Port > 0 && mcpsIndication->Port < 224) {
             if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                rx_data_isr.len = mcpsIndication->BufferSize;
-                rx_data_isr.port = mcpsIndication->Port;
-                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+                lora_rx_queue(mcpsIndication->Buffer, mcpsIndication->BufferSize, mcpsIndication->Port,
+                              mcpsIndication->TimeStamp, mcpsIndication->Rssi, mcpsIndication->Snr, mcpsIndication->RxDatarate);
                 lora_obj.events |= MODLORA_RX_EVENT;
                 if (lora_obj.trigger & MODLORA_RX_EVENT) {
                     mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
@@ -652,7 +850,7 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         lora_obj.ComplianceTest.State = 1;
 
                         // flush the rx queue
-                        xQueueReset(xRxQueue);
+                        lora_rx_ring_flush(&lora_rx_ring);
 
                         // enable ADR during test mode
                         MibRequestConfirm_t mibReq;
@@ -699,9 +897,8 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         // return the payload
                         if (bDoEcho) {
                             if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                                rx_data_isr.len = mcpsIndication->BufferSize;
-                                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+                                lora_rx_queue(mcpsIndication->Buffer, mcpsIndication->BufferSize, mcpsIndication->Port,
+                                              mcpsIndication->TimeStamp, mcpsIndication->Rssi, mcpsIndication->Snr, mcpsIndication->RxDatarate);
                             }
                         } else {
                             // set the state back to 1
@@ -795,7 +992,6 @@ static void MlmeIndication( MlmeIndication_t *mlmeIndication )
 static void TASK_LoRa (void *pvParameters) {
     MibRequestConfirm_t mibReq;
     MlmeReq_t mlmeReq;
-    McpsReq_t mcpsReq;
     bool isReset;
 
     lora_obj.state = E_LORA_STATE_NOINIT;
@@ -1006,66 +1202,12 @@ static void TASK_LoRa (void *pvParameters) {
                     }
                     xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
                     break;
-                case E_LORA_CMD_LORAWAN_TX: {
-                        LoRaMacTxInfo_t txInfo;
-                        EventBits_t status = 0;
-                        bool empty_frame = false;
-                        int8_t mac_datarate = 0;
-
-                        // set the new data rate before checking if Tx is possible, but store the current one
-                        if (!lora_obj.adr) {
-                            mibReq.Type = MIB_CHANNELS_DATARATE;
-                            LoRaMacMibGetRequestConfirm( &mibReq );
-                            mac_datarate = mibReq.Param.ChannelsDatarate;
-                            mibReq.Param.ChannelsDatarate = task_cmd_data.info.tx.dr;
-                            LoRaMacMibSetRequestConfirm( &mibReq );
-                        }
-
-                        if (LoRaMacQueryTxPossible (task_cmd_data.info.tx.len, &txInfo) != LORAMAC_STATUS_OK) {
-                            // send an empty frame in order to flush MAC commands
-                            mcpsReq.Type = MCPS_UNCONFIRMED;
-                            mcpsReq.Req.Unconfirmed.fBuffer = NULL;
-                            mcpsReq.Req.Unconfirmed.fBufferSize = 0;
-                            mcpsReq.Req.Unconfirmed.Datarate = task_cmd_data.info.tx.dr;
-                            empty_frame = true;
-                            status |= LORA_STATUS_MSG_SIZE;
-                        } else {
-                            if (task_cmd_data.info.tx.confirmed) {
-                                mcpsReq.Type = MCPS_CONFIRMED;
-                                mcpsReq.Req.Confirmed.fPort = task_cmd_data.info.tx.port;
-                                mcpsReq.Req.Confirmed.fBuffer = task_cmd_data.info.tx.data;
-                                mcpsReq.Req.Confirmed.fBufferSize = task_cmd_data.info.tx.len;
-                                mcpsReq.Req.Confirmed.NbTrials = lora_obj.tx_retries + 1;
-                                mcpsReq.Req.Confirmed.Datarate = task_cmd_data.info.tx.dr;
-                            } else {
-                                mcpsReq.Type = MCPS_UNCONFIRMED;
-                                mcpsReq.Req.Unconfirmed.fPort = task_cmd_data.info.tx.port;
-                                mcpsReq.Req.Unconfirmed.fBuffer = task_cmd_data.info.tx.data;
-                                mcpsReq.Req.Unconfirmed.fBufferSize = task_cmd_data.info.tx.len;
-                                mcpsReq.Req.Unconfirmed.Datarate = task_cmd_data.info.tx.dr;
-                            }
-                        }
-                    #if defined(FIPY) || defined(LOPY4)
-                        xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
-                    #endif
-
-                        // set back the original datarate
-                        if (!lora_obj.adr) {
-                            mibReq.Param.ChannelsDatarate = mac_datarate;
-                            LoRaMacMibSetRequestConfirm( &mibReq );
-                        }
-
-                        if (LoRaMacMcpsRequest(&mcpsReq) != LORAMAC_STATUS_OK || empty_frame) {
-                            // the command has failed, send the response now
-                            lora_obj.state = E_LORA_STATE_IDLE;
-                            status |= LORA_STATUS_ERROR;
-                            xEventGroupSetBits(LoRaEvents, status);
-                        #if defined(FIPY) || defined(LOPY4)
-                            xSemaphoreGive(xLoRaSigfoxSem);
-                        #endif
-                        } else {
-                            lora_obj.state = E_LORA_STATE_TX;
-                        }
+                case E_LORA_CMD_LORAWAN_TX:
+                    if (task_cmd_data.info.tx.aggregate) {
+                        lorawan_tx_agg_add(&task_cmd_data.info.tx);
+                    } else {
+                        lorawan_tx(task_cmd_data.info.tx.data, task_cmd_data.info.tx.len, task_cmd_data.info.tx.port,
+                                   task_cmd_data.info.tx.dr, task_cmd_data.info.tx.confirmed, true);
                     }
                     break;
                 case E_LORA_CMD_SLEEP:
@@ -1088,6 +1230,10 @@ static void TASK_LoRa (void *pvParameters) {
                 default:
                     break;
                 }
+            } else if (lorawan_tx_agg_due()) {
+                // with no command waiting, send the aggregated records once their deadline has passed;
+                // the senders of the records have been released already
+                lorawan_tx_agg_send(false);
 //            } else if (lora_obj.state == E_LORA_STATE_IDLE && lora_obj.stack_mode == E_LORA_STACK_MODE_LORA) {
 //                Radio.Rx(LORA_RX_TIMEOUT);
 //                lora_obj.state = E_LORA_STATE_RX;
@@ -1259,11 +1405,7 @@ static IRAM_ATTR void OnRxDone (uint8_t *payload, uint32_t timestamp, uint16_t s
     lora_obj.rssi = rssi;
     lora_obj.snr = snr;
     lora_obj.sfrx = sf;
-    if (size <= LORA_PAYLOAD_SIZE_MAX) {
-        memcpy((void *)rx_data_isr.data, payload, size);
-        rx_data_isr.len = size;
-        xQueueSendFromISR(xRxQueue, (void *)&rx_data_isr, NULL);
-    }
+    lora_rx_queue(payload, size, 0, timestamp, rssi, snr, sf);
 
     lora_obj.events |= MODLORA_RX_EVENT;
     if (lora_obj.trigger & MODLORA_RX_EVENT) {
@@ -1609,59 +1751,36 @@ static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms) {
 }
 
 static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port) {
-    lora_rx_data_t rx_data;
-
-    if (timeout_ms < 0) {
-        // blocking mode
-        timeout_ms = portMAX_DELAY;
-    }
-
-    // if there's a partial packet pending
-    if (lora_partial_rx_packet.size > 0) {
-        // adjust the len
-        uint32_t available_len = lora_partial_rx_packet.size - lora_partial_rx_packet.index;
-        if (available_len < len) {
-            len = available_len;
-        }
-
-        // get the available data
-        memcpy(buf, (void *)&lora_partial_rx_packet.data[lora_partial_rx_packet.index], len);
-        if (port != NULL) {
-            *port = rx_data.port;
-        }
-
-        // update the index and size values
-        lora_partial_rx_packet.index += len;
-        if (lora_partial_rx_packet.index == lora_partial_rx_packet.size) {
-            // there's no more data left
-            lora_partial_rx_packet.size = 0;
-        }
-        // return the number of bytes received
-        return len;
-    } else if (xQueueReceive(xRxQueue, &rx_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
-        // adjust the len
-        if (rx_data.len < len) {
-            len = rx_data.len;
-        }
-
-        // get the available data
-        memcpy(buf, rx_data.data, len);
-        if (port != NULL) {
-            *port = rx_data.port;
+    TickType_t ticks = (timeout_ms < 0) ? portMAX_DELAY : (TickType_t)(timeout_ms / portTICK_PERIOD_MS);
+    TimeOut_t time_out;
+    lora_rx_frame_t *frame;
+
+    vTaskSetTimeOutState(&time_out);
+    if (!xSemaphoreTake(xRxMutex, ticks)) {
+        goto no_data;
+    }
+    while ((frame = lora_rx_ring_peek(&lora_rx_ring)) == NULL) {
+        if (xTaskCheckForTimeOut(&time_out, &ticks) || !xSemaphoreTake(xRxSem, ticks)) {
+            xSemaphoreGive(xRxMutex);
+            goto no_data;
         }
+    }
 
-        // copy the remainder to the partial data buffer
-        int32_t r_len = rx_data.len - len;
-        if (r_len > 0) {
-            memcpy((void *)lora_partial_rx_packet.data, &rx_data.data[len], r_len);
-            lora_partial_rx_packet.size = r_len;
-            lora_partial_rx_packet.index = 0;
-            lora_partial_rx_packet.port = rx_data.port;
-        }
-        // return the number of bytes received
-        return len;
+    // the frame stays in the ring until all of it has been read
+    if (lora_rx_ring.offset == 0) {
+        memcpy(&lora_rx_last, frame, offsetof(lora_rx_frame_t, data));
+        lora_rx_last_valid = true;
     }
-    // non-blocking sockects do not thrown timeout errors
+    if (port != NULL) {
+        *port = frame->port;
+    }
+    len = lora_rx_ring_read(&lora_rx_ring, buf, len);
+    xSemaphoreGive(xRxMutex);
+    // return the number of bytes received
+    return len;
+
+no_data:
+    // non-blocking sockets do not throw timeout errors
     if (timeout_ms == 0) {
         return 0;
     }
@@ -1670,13 +1789,58 @@ static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t
 }
 
 static bool lora_rx_any (void) {
-    lora_rx_data_t rx_data;
-    if (lora_partial_rx_packet.size > 0) {
-        return true;
-    } else if (xQueuePeek(xRxQueue, &rx_data, (TickType_t)0)) {
-        return true;
+    return lora_rx_ring_depth(&lora_rx_ring) > 0;
+}
+
+// called by the MAC and radio callbacks, in the LoRa timer task
+static void lora_rx_queue (const uint8_t *data, uint32_t len, uint8_t port, uint32_t timestamp, int16_t rssi, int8_t snr, uint8_t sf) {
+    lora_rx_frame_t *frame = lora_rx_ring_reserve(&lora_rx_ring, len);
+    if (frame != NULL) {
+        frame->timestamp = timestamp;
+        frame->rssi = rssi;
+        frame->snr = snr;
+        frame->sf = sf;
+        frame->port = port;
+        frame->len = len;
+        memcpy(frame->data, data, len);
+        lora_rx_ring_commit(&lora_rx_ring);
+        xSemaphoreGive(xRxSem);
     }
-    return false;
+}
+
+// runs in the LoRa timer task, so nothing is queued meanwhile
+static void lora_rx_resize (void) {
+    lora_rx_frame_t *frames = lora_rx_ring.frames;
+    lora_rx_ring_t ring = lora_rx_ring;
+
+    lora_rx_ring_init(&lora_rx_ring, lora_rx_resize_frames, lora_rx_resize_size);
+    // keep the counters, but the frames waiting are dropped
+    lora_rx_ring.received = ring.received;
+    lora_rx_ring.overflows = ring.overflows + lora_rx_ring_depth(&ring);
+    lora_rx_ring.oversize = ring.oversize;
+    if (frames != &lora_rx_frame_spare) {
+        heap_caps_free(frames);
+    }
+    xEventGroupSetBits(LoRaEvents, LORA_STATUS_RX_QUEUE_DONE);
+}
+
+// runs in the LoRa timer task, the only writer of the counters
+static void lora_rx_stats_reset (void) {
+    lora_rx_stats_taken = lora_rx_ring;
+    lora_rx_ring.hwm = lora_rx_ring_depth(&lora_rx_ring);
+    lora_rx_ring.received = lora_rx_ring.overflows = lora_rx_ring.oversize = 0;
+    xEventGroupSetBits(LoRaEvents, LORA_STATUS_RX_QUEUE_DONE);
+}
+
+// has the timer task, which fills the ring, run cb and waits for it; the
+// caller holds xRxMutex, so no one reads the ring meanwhile
+static void lora_rx_request (modlora_timerCallback cb) {
+    xQueueSend(xCbQueue, &cb, portMAX_DELAY);
+    xEventGroupWaitBits(LoRaEvents,
+                        LORA_STATUS_RX_QUEUE_DONE,
+                        pdTRUE,   // clear on exit
+                        pdTRUE,
+                        (TickType_t)portMAX_DELAY);
 }
 
 static bool lora_tx_space (void) {
@@ -2202,9 +2366,21 @@ STATIC mp_obj_t lora_power_mode(mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_power_mode_obj, 1, 2, lora_power_mode);
 
+static mp_obj_t lora_snr_obj(int8_t snr_raw) {
+    float snr;
+    if (snr_raw & 0x80)  { // the SNR sign bit is 1
+        // invert and divide by 4
+        snr = ((~snr_raw + 1 ) & 0xFF) / 4;
+        snr = -snr;
+    } else {
+        // divide by 4
+        snr = (snr_raw & 0xFF) / 4;
+    }
+    return mp_obj_new_float(snr);
+}
+
 STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
     lora_obj_t *self = self_in;
-    float snr;
 
     static const qstr lora_stats_info_fields[] = {
         MP_QSTR_rx_timestamp, MP_QSTR_rssi, MP_QSTR_snr, MP_QSTR_sfrx, MP_QSTR_sftx,
@@ -2212,19 +2388,10 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
         MP_QSTR_tx_frequency
     };
 
-    if (self->snr & 0x80)  { // the SNR sign bit is 1
-        // invert and divide by 4
-        snr = ((~self->snr + 1 ) & 0xFF) / 4;
-        snr = -snr;
-    } else {
-        // divide by 4
-        snr = (self->snr & 0xFF) / 4;
-    }
-
     mp_obj_t stats_tuple[10];
     stats_tuple[0] = mp_obj_new_int_from_uint(self->rx_timestamp);
     stats_tuple[1] = mp_obj_new_int(self->rssi);
-    stats_tuple[2] = mp_obj_new_float(snr);
+    stats_tuple[2] = lora_snr_obj(self->snr);
     stats_tuple[3] = mp_obj_new_int(self->sfrx);
     stats_tuple[4] = mp_obj_new_int(self->sftx);
     stats_tuple[5] = mp_obj_new_int(self->tx_trials);
@@ -2237,6 +2404,83 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_stats_obj, lora_stats);
 
+STATIC mp_obj_t lora_airtime_stats(mp_obj_t self_in) {
+    lora_obj_t *self = self_in;
+    static const qstr lora_airtime_stats_fields[] = {
+        MP_QSTR_bands, MP_QSTR_tx_wait, MP_QSTR_queued, MP_QSTR_queue_wait, MP_QSTR_aggregated,
+        MP_QSTR_aggregated_wait, MP_QSTR_dr_tx_counter, MP_QSTR_dr_time_on_air
+    };
+    static const qstr lora_airtime_band_fields[] = {
+        MP_QSTR_duty_cycle, MP_QSTR_time_on_air, MP_QSTR_hour_time_on_air, MP_QSTR_hour_budget, MP_QSTR_wait
+    };
+    Band_t *bands;
+    uint32_t nb_bands;
+    uint32_t *dr_counts;
+    TimerTime_t *dr_time_on_air;
+    bool duty_cycle = LoRaMacGetDutyCycleOn();
+    TimerTime_t now = TimerGetCurrentTime();
+    // the band to be free first, and the duty cycle of the strictest band
+    uint32_t band_wait = UINT32_MAX;
+    uint32_t dcycle = 1;
+
+    // EU868 has the most bands
+    mp_obj_t band_tuple[EU868_MAX_NB_BANDS];
+    LoRaMacGetBands(&bands, &nb_bands);
+    nb_bands = MIN(nb_bands, EU868_MAX_NB_BANDS);
+    for (uint32_t i = 0; i < nb_bands; i++) {
+        RegionCommonBandStats_t stats;
+        RegionCommonGetBandStats(self->joined, duty_cycle, &bands[i], now, &stats);
+        mp_obj_t band[5];
+        band[0] = mp_obj_new_float(100.0f / MAX(bands[i].DCycle, 1));
+        band[1] = mp_obj_new_int_from_uint(stats.TimeOnAir);
+        band[2] = mp_obj_new_int_from_uint(stats.HourTimeOnAir);
+        band[3] = mp_obj_new_int_from_uint(stats.HourBudget);
+        band[4] = mp_obj_new_int_from_uint(stats.TimeOff);
+        band_tuple[i] = mp_obj_new_attrtuple(lora_airtime_band_fields, 5, band);
+        band_wait = MIN(band_wait, stats.TimeOff);
+        if (duty_cycle && bands[i].DCycle > dcycle) {
+            dcycle = bands[i].DCycle;
+        }
+    }
+    uint32_t tx_wait = MAX(LoRaMacGetAggregatedTimeOff(), (nb_bands > 0) ? band_wait : 0);
+
+    // each queued command is taken as an uplink as long as the last one, after
+    // which its band is off for the rest of its duty cycle
+    uint32_t queued = uxQueueMessagesWaiting(xCmdQueue);
+    uint32_t queue_wait = queued ? tx_wait + (queued - 1) * self->tx_time_on_air * dcycle : 0;
+
+    // the LoRa task may be adding a record or sending the frame meanwhile
+    portENTER_CRITICAL(&lora_tx_agg_mux);
+    uint32_t aggregated = lora_tx_agg.records;
+    uint32_t aggregated_deadline = lora_tx_agg.deadline;
+    portEXIT_CRITICAL(&lora_tx_agg_mux);
+    uint32_t aggregated_wait = 0;
+    if (aggregated > 0) {
+        int32_t ticks = aggregated_deadline - xTaskGetTickCount();
+        aggregated_wait = (ticks > 0) ? ticks * portTICK_PERIOD_MS : 0;
+    }
+
+    LoRaMacGetDatarateStats(&dr_counts, &dr_time_on_air);
+    mp_obj_t dr_tuple[2][16];
+    for (uint32_t i = 0; i < 16; i++) {
+        dr_tuple[0][i] = mp_obj_new_int_from_uint(dr_counts[i]);
+        dr_tuple[1][i] = mp_obj_new_int_from_uint(dr_time_on_air[i]);
+    }
+
+    mp_obj_t stats_tuple[8];
+    stats_tuple[0] = mp_obj_new_tuple(nb_bands, band_tuple);
+    stats_tuple[1] = mp_obj_new_int_from_uint(tx_wait);
+    stats_tuple[2] = mp_obj_new_int_from_uint(queued);
+    stats_tuple[3] = mp_obj_new_int_from_uint(queue_wait);
+    stats_tuple[4] = mp_obj_new_int_from_uint(aggregated);
+    stats_tuple[5] = mp_obj_new_int_from_uint(aggregated_wait);
+    stats_tuple[6] = mp_obj_new_tuple(16, dr_tuple[0]);
+    stats_tuple[7] = mp_obj_new_tuple(16, dr_tuple[1]);
+
+    return mp_obj_new_attrtuple(lora_airtime_stats_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_airtime_stats_obj, lora_airtime_stats);
+
 STATIC mp_obj_t lora_has_joined(mp_obj_t self_in) {
     lora_obj_t *self = self_in;
     return self->joined ? mp_const_true : mp_const_false;
@@ -2425,6 +2669,86 @@ STATIC mp_obj_t lora_airtime (mp_obj_t self_in, mp_obj_t pack_len_obj) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(lora_airtime_obj, lora_airtime);
 
+// get or set the number of received frames that can wait to be read,
+// rounded up to a power of two; frames waiting when it's changed are dropped
+STATIC mp_obj_t lora_rx_queue_size (mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 1) {
+        return mp_obj_new_int_from_uint(lora_rx_ring.mask + 1);
+    }
+    mp_int_t size = mp_obj_get_int(args[1]);
+    if (size < 1 || size > LORA_RX_QUEUE_SIZE_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    uint32_t frames_size = 1;
+    while (frames_size < (uint32_t)size) {
+        frames_size <<= 1;
+    }
+    lora_rx_frame_t *frames = heap_caps_malloc(frames_size * sizeof(lora_rx_frame_t), MALLOC_CAP_INTERNAL);
+    if (frames == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "no memory available for the RX queue"));
+    }
+
+    MP_THREAD_GIL_EXIT();
+    // the ring is swapped by the timer task, which fills it, while no one reads it
+    xSemaphoreTake(xRxMutex, portMAX_DELAY);
+    lora_rx_resize_frames = frames;
+    lora_rx_resize_size = frames_size;
+    lora_rx_request(lora_rx_resize);
+    xSemaphoreGive(xRxMutex);
+    MP_THREAD_GIL_ENTER();
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_rx_queue_size_obj, 1, 2, lora_rx_queue_size);
+
+// counters of the RX queue: size, frames waiting (depth), their high-water
+// mark (hwm), frames queued (received) and frames dropped because the queue
+// was full (overflows) or they were too long (oversize)
+STATIC mp_obj_t lora_rx_stats (mp_uint_t n_args, const mp_obj_t *args) {
+    lora_rx_ring_t *ring = &lora_rx_ring;
+    lora_rx_ring_t taken;
+    if (n_args > 1 && mp_obj_is_true(args[1])) {
+        // the counters are the timer task's to write, have it take and reset them
+        MP_THREAD_GIL_EXIT();
+        xSemaphoreTake(xRxMutex, portMAX_DELAY);
+        lora_rx_request(lora_rx_stats_reset);
+        taken = lora_rx_stats_taken;
+        xSemaphoreGive(xRxMutex);
+        MP_THREAD_GIL_ENTER();
+        ring = &taken;
+    }
+    uint32_t depth = lora_rx_ring_depth(ring);
+    mp_obj_t dict = mp_obj_new_dict(0);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_size), mp_obj_new_int_from_uint(ring->mask + 1));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_depth), mp_obj_new_int_from_uint(depth));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_hwm), mp_obj_new_int_from_uint(ring->hwm));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_received), mp_obj_new_int_from_uint(ring->received));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_overflows), mp_obj_new_int_from_uint(ring->overflows));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_oversize), mp_obj_new_int_from_uint(ring->oversize));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_rx_stats_obj, 1, 2, lora_rx_stats);
+
+// how the frame last returned by the socket was received, None before the first
+STATIC mp_obj_t lora_rx_info (mp_obj_t self_in) {
+    static const qstr lora_rx_info_fields[] = {
+        MP_QSTR_rx_timestamp, MP_QSTR_rssi, MP_QSTR_snr, MP_QSTR_sfrx, MP_QSTR_port
+    };
+
+    if (!lora_rx_last_valid) {
+        return mp_const_none;
+    }
+    mp_obj_t info_tuple[5];
+    info_tuple[0] = mp_obj_new_int_from_uint(lora_rx_last.timestamp);
+    info_tuple[1] = mp_obj_new_int(lora_rx_last.rssi);
+    info_tuple[2] = lora_snr_obj(lora_rx_last.snr);
+    info_tuple[3] = mp_obj_new_int(lora_rx_last.sf);
+    info_tuple[4] = mp_obj_new_int(lora_rx_last.port);
+
+    return mp_obj_new_attrtuple(lora_rx_info_fields, sizeof(info_tuple) / sizeof(info_tuple[0]), info_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_rx_info_obj, lora_rx_info);
+
 STATIC mp_obj_t lora_reset (mp_obj_t self_in) {
 
     lora_obj_t* self = (lora_obj_t*)self_in;
@@ -2471,6 +2795,10 @@ STATIC const mp_map_elem_t lora_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_sf),                    (mp_obj_t)&lora_sf_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_power_mode),            (mp_obj_t)&lora_power_mode_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_stats),                 (mp_obj_t)&lora_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_airtime_stats),         (mp_obj_t)&lora_airtime_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_rx_queue),              (mp_obj_t)&lora_rx_queue_size_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_rx_stats),              (mp_obj_t)&lora_rx_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_rx_info),               (mp_obj_t)&lora_rx_info_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_has_joined),            (mp_obj_t)&lora_has_joined_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_add_channel),           (mp_obj_t)&lora_add_channel_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_remove_channel),        (mp_obj_t)&lora_remove_channel_obj },
@@ -2704,6 +3032,13 @@ static int lora_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level,
             return -1;
         }
         LORAWAN_SOCKET_SET_DR(s->sock_base.u.sd, *(uint8_t *)optval);
+    } else if (opt == SO_LORAWAN_AGGREGATE) {
+        // the flush deadline in ms, 0 sends what's pending and stops aggregating
+        if (optlen < sizeof(uint32_t)) {
+            *_errno = MP_EINVAL;
+            return -1;
+        }
+        lora_obj.tx_agg_timeout = *(uint32_t *)optval;
     } else {
         *_errno = MP_EOPNOTSUPP;
         return -1;
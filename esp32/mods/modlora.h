@@ -18,7 +18,8 @@
  ******************************************************************************/
 #define LORA_PAYLOAD_SIZE_MAX                                   (255)
 #define LORA_CMD_QUEUE_SIZE_MAX                                 (7)
-#define LORA_DATA_QUEUE_SIZE_MAX                                (7)
+#define LORA_RX_QUEUE_SIZE_DEFAULT                              (8)
+#define LORA_RX_QUEUE_SIZE_MAX                                  (256)
 #define LORA_CB_QUEUE_SIZE_MAX                                  (7)
 #define LORA_STACK_SIZE                                         (4096)
 #define LORA_TIMER_STACK_SIZE                                   (3072)
@@ -29,6 +30,7 @@
 #define LORA_STATUS_ERROR                                       (0x02)
 #define LORA_STATUS_MSG_SIZE                                    (0x04)
 #define LORA_STATUS_RESET_DONE                                  (0x08)
+#define LORA_STATUS_RX_QUEUE_DONE                               (0x10)
 
 /******************************************************************************
  DEFINE TYPES
@@ -110,6 +112,7 @@ typedef struct {
     uint8_t     port;
     uint8_t     dr;
     bool        confirmed;
+    bool        aggregate;  // add to the frame being filled, port is the record's tag
 } lora_tx_cmd_data_t;
 
 typedef struct {
@@ -132,14 +135,6 @@ typedef struct {
     lora_cmd_info_u_t           info;
 } lora_cmd_data_t;
 
-///////////////////////////////////////////
-
-typedef struct {
-    uint8_t data[LORA_PAYLOAD_SIZE_MAX + 1];
-    uint8_t len;
-    uint8_t port;
-} lora_rx_data_t;
-
 typedef void ( *modlora_timerCallback )( void );
 /******************************************************************************
  EXPORTED DATA
@@ -49,15 +49,7 @@
  ******************************************************************************/
 // forward declarations
 struct _mod_network_socket_obj_t;
-
-typedef enum {
-    SOCKET_CONN_START = 0,
-    SOCKET_CONNECTED,
-    SOCKET_NOT_CONNECTED,
-    SOCKET_CONN_PENDING,
-    SOCKET_CONN_ERROR,
-    SOCKET_CONN_TIMEDOUT
-}mod_network_sock_conn_status_t;
+struct _lwipsocket_rx_ring_t;
 
 typedef struct _mod_network_nic_type_t {
     mp_obj_type_t base;
@@ -104,9 +96,10 @@ typedef struct _mod_network_socket_base_t {
     bool connected;
     uint8_t ip_addr[MOD_NETWORK_IPV4ADDR_BUF_SIZE];
     mp_uint_t port;
-    mod_network_sock_conn_status_t conn_status;
     int err;
     uint8_t domain;
+    uint8_t type;
+    struct _lwipsocket_rx_ring_t *rx_ring;  // optional, see SO_RXRING
 } mod_network_socket_base_t;
 
 typedef struct _mod_network_socket_obj_t {
@@ -52,6 +52,7 @@
 #include "sflash_diskio.h"
 #include "extmod/vfs.h"
 #include "extmod/vfs_fat.h"
+#include "extmod/vfs_rom.h"
 #include "vfs_littlefs.h"
 #include "random.h"
 #include "mpexception.h"
@@ -152,6 +153,11 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_0(os_uname_obj, os_uname);
 
 STATIC mp_obj_t os_sync(void) {
     for (mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table); vfs != NULL; vfs = vfs->next) {
+        #if MICROPY_VFS_ROM
+        if (mp_obj_is_type(vfs->obj, &mp_type_vfs_rom)) {
+            continue;
+        }
+        #endif
         // this assumes that vfs->obj is fs_user_mount_t with block device functions
         disk_ioctl(MP_OBJ_TO_PTR(vfs->obj), CTRL_SYNC, NULL);
     }
@@ -211,6 +217,10 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_statvfs),         MP_ROM_PTR(&mp_vfs_statvfs_obj) },
     { MP_ROM_QSTR(MP_QSTR_getfree),         MP_ROM_PTR(&mp_vfs_getfree_obj) },
     { MP_ROM_QSTR(MP_QSTR_fsformat),        MP_ROM_PTR(&mp_vfs_fsformat_obj) },
+    #if MICROPY_VFS_STATS
+    { MP_ROM_QSTR(MP_QSTR_fsstats),         MP_ROM_PTR(&mp_vfs_fsstats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fstrace),         MP_ROM_PTR(&mp_vfs_fstrace_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_unlink),          MP_ROM_PTR(&mp_vfs_remove_obj) },
 
     { MP_ROM_QSTR(MP_QSTR_sync),            MP_ROM_PTR(&mod_os_sync_obj) },
@@ -222,6 +232,9 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_mount),           MP_ROM_PTR(&mp_vfs_mount_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount),          MP_ROM_PTR(&mp_vfs_umount_obj) },
     { MP_ROM_QSTR(MP_QSTR_mkfat),          MP_ROM_PTR(&mp_fat_vfs_type) },
+    #if MICROPY_VFS_ROM
+    { MP_ROM_QSTR(MP_QSTR_VfsRom),          MP_ROM_PTR(&mp_type_vfs_rom) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_dupterm),         MP_ROM_PTR(&os_dupterm_obj) }
 };
 
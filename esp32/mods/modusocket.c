@@ -45,6 +45,7 @@
 #include "py/runtime.h"
 #include "py/stream.h"
 #include "py/mperrno.h"
+#include "py/mphal.h"
 #include "netutils.h"
 #include "modnetwork.h"
 #include "modwlan.h"
@@ -60,20 +61,23 @@
 #include "lwip/sockets.h"
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
+#include "lwip/tcpip.h"
 #include "lwipsocket.h"
 
 #include "mbedtls/ssl.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
 
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
 #define MODUSOCKET_MAX_SOCKETS                      15
-#define MODUSOCKET_CONN_TIMEOUT                     -2
 #define MODUSOCKET_MAX_DNS_SERV                      2
+#define MODUSOCKET_SG_STACK_BUF_LEN                 256     // datagrams up to this size are gathered on the stack
+#define MODUSOCKET_DNS_CACHE_SIZE                   8
+#define MODUSOCKET_DNS_HOST_LEN_MAX                 63
+#define MODUSOCKET_DNS_NEG_TTL_MS                   (5 * 1000)
 /******************************************************************************
  DEFINE PRIVATE TYPES
  ******************************************************************************/
@@ -82,6 +86,35 @@ typedef struct {
     bool    user;
 } modusocket_sock_t;
 
+typedef enum {
+    MODUSOCKET_DNS_FREE = 0,
+    MODUSOCKET_DNS_PENDING,
+    MODUSOCKET_DNS_DONE,
+    MODUSOCKET_DNS_ERROR,       // the lookup couldn't be started, the next one tries again
+    MODUSOCKET_DNS_FAILED,      // the lookup failed, remembered until expires
+} modusocket_dns_state_t;
+
+// Host name lookups.  Positive answers are kept by lwIP's own DNS table for
+// their TTL, so a lookup is re-issued to lwIP every time and comes back at
+// once while the answer is still valid.  Failed lookups are remembered here
+// for MODUSOCKET_DNS_NEG_TTL_MS so a retry loop doesn't cost a DNS timeout
+// each time.  lwIP reports a missing name, a server error and a timeout all
+// the same way, so the TTL is kept short: a name that failed for a passing
+// reason resolves again soon after.
+typedef struct {
+    char host[MODUSOCKET_DNS_HOST_LEN_MAX + 1];
+    ip_addr_t addr;
+    uint32_t expires;
+    volatile uint8_t state;     // written from the lwIP thread while pending
+} modusocket_dns_entry_t;
+
+typedef struct {
+    mp_obj_base_t base;
+    mp_obj_t host;
+    mp_int_t port;
+    uint8_t slot;
+} mod_usocket_dns_query_t;
+
 /******************************************************************************
  DEFINE PRIVATE DATA
  ******************************************************************************/
@@ -91,29 +124,11 @@ STATIC const mp_obj_type_t raw_socket_type;
 STATIC modusocket_sock_t modusocket_sockets[MODUSOCKET_MAX_SOCKETS] = {{.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1},
                                                                        {.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1},
                                                                        {.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1}, {.sd = -1}};
+STATIC modusocket_dns_entry_t modusocket_dns_cache[MODUSOCKET_DNS_CACHE_SIZE];
 
-STATIC mod_network_socket_obj_t* modsocket_sock;
-STATIC TimerHandle_t modsocket_conn_timeout_timer;
-STATIC bool modsocket_istimeout = false;
-
-STATIC void TASK_SOCK_OPS (void *pvParameters) ;
-STATIC void modsocket_timer_callback( TimerHandle_t xTimer );
-/******************************************************************************
- DEFINE PUBLIC DATA
- ******************************************************************************/
-extern TaskHandle_t xSocketOpsTaskHndl;
-SemaphoreHandle_t xSocketOpsSem;
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
-void modusocket_pre_init (void) {
-
-	// Create a Task to handle Socket Async ops
-	xTaskCreatePinnedToCore(TASK_SOCK_OPS, "Socket Operations", 4096 / sizeof(StackType_t), NULL, 5, &xSocketOpsTaskHndl, 1);
-	// Create semaphore
-	xSocketOpsSem = xSemaphoreCreateMutex();
-}
-
 void modusocket_socket_add (int32_t sd, bool user) {
 //    sl_LockObjLock (&modusocket_LockObj, SL_OS_WAIT_FOREVER);
     for (int i = 0; i < MODUSOCKET_MAX_SOCKETS; i++) {
@@ -206,7 +221,6 @@ STATIC mp_obj_t socket_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_
         s->sock_base.u.u_param.domain = AF_INET;
         s->sock_base.u.u_param.type = SOCK_STREAM;
         s->sock_base.u.u_param.proto = IPPROTO_TCP;
-        s->sock_base.conn_status = SOCKET_NOT_CONNECTED;
     }
     s->sock_base.nic = MP_OBJ_NULL;
     s->sock_base.nic_type = NULL;
@@ -214,6 +228,7 @@ STATIC mp_obj_t socket_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_
     s->sock_base.timeout = -1;      // sockets are blocking by default
     s->sock_base.is_ssl = false;
     s->sock_base.connected = false;
+    s->sock_base.rx_ring = NULL;
 
     if (n_args > 0) {
         s->sock_base.u.u_param.domain = mp_obj_get_int(args[0]);
@@ -229,6 +244,7 @@ STATIC mp_obj_t socket_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_
     }
     // Save Domain type
     s->sock_base.domain = s->sock_base.u.u_param.domain;
+    s->sock_base.type = s->sock_base.u.u_param.type;
     // don't forget to select a network card
     if (s->sock_base.u.u_param.domain == AF_INET) {
         socket_select_nic(s, (const byte *)"");
@@ -334,6 +350,8 @@ STATIC mp_obj_t socket_accept(mp_obj_t self_in) {
     mod_network_socket_obj_t *socket2 = m_new_obj_with_finaliser(mod_network_socket_obj_t);
     // the new socket inherits all properties from its parent
     memcpy (socket2, self, sizeof(mod_network_socket_obj_t));
+    // except the receive ring, which has to be asked for per connection
+    socket2->sock_base.rx_ring = NULL;
 
     // accept the incoming connection
     uint8_t ip[MOD_NETWORK_IPV4ADDR_BUF_SIZE];
@@ -359,136 +377,49 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_accept_obj, socket_accept);
 
 // method socket.connect(address)
 STATIC mp_obj_t socket_connect(mp_obj_t self_in, mp_obj_t addr_in) {
+    mod_network_socket_obj_t *self = self_in;
 
-    mod_network_socket_obj_t* self = self_in;
-
-    if (self->sock_base.timeout > 0 && self->sock_base.domain == AF_INET) {
-
-        modsocket_sock = self_in;
-        int timeout_temp = modsocket_sock->sock_base.timeout;
-
-        // get address
-        self->sock_base.port = netutils_parse_inet_addr(addr_in, self->sock_base.ip_addr, NETUTILS_LITTLE);
-
-        // Set socket to Non-Blocking
-        if(modsocket_sock->sock_base.nic_type->n_settimeout(modsocket_sock, 0, &(self->sock_base.err)) != 0)
-        {
-            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(self->sock_base.err)));
-        }
-
-        /* Start socket operation handling task */
-        self->sock_base.conn_status = SOCKET_CONN_START;
-        /*create Timer */
-        modsocket_conn_timeout_timer = xTimerCreate("Socket_conn_Timer", timeout_temp / portTICK_PERIOD_MS, 0, 0, modsocket_timer_callback);
-
-        MP_THREAD_GIL_EXIT();
-        xTaskNotifyGive(xSocketOpsTaskHndl);
-        portYIELD();
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+    // get address
+    self->sock_base.port = netutils_parse_inet_addr(addr_in, self->sock_base.ip_addr, NETUTILS_LITTLE);
 
-        xSemaphoreTake(xSocketOpsSem, portMAX_DELAY);
+    // connect the socket; a TCP/IP socket with a timeout waits for the connect
+    // itself, so connects from different threads proceed in parallel
+    bool timed = self->sock_base.timeout > 0 && self->sock_base.domain == AF_INET;
+    int ret;
+    MP_THREAD_GIL_EXIT();
+    if (timed) {
+        ret = lwipsocket_socket_connect_timeout(self, self->sock_base.ip_addr, self->sock_base.port,
+                                                self->sock_base.timeout, &(self->sock_base.err));
+    } else {
+        ret = self->sock_base.nic_type->n_connect(self, self->sock_base.ip_addr, self->sock_base.port, &(self->sock_base.err));
+    }
+    MP_THREAD_GIL_ENTER();
 
-        switch(self->sock_base.conn_status)
-        {
-        case SOCKET_CONN_TIMEDOUT:
-            // Set socket back to Blocking
-            modsocket_sock->sock_base.nic_type->n_settimeout(modsocket_sock, timeout_temp, &(self->sock_base.err));
-            //Close socket
-            socket_close(modsocket_sock);
-            /* Release Sem */
-            xSemaphoreGive(xSocketOpsSem);
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
-            break;
-        case SOCKET_CONN_ERROR:
-            // Set socket back to Blocking
-            modsocket_sock->sock_base.nic_type->n_settimeout(modsocket_sock, timeout_temp, &(self->sock_base.err));
-            //Close socket
-            socket_close(modsocket_sock);
-            /* Release Sem */
-            xSemaphoreGive(xSocketOpsSem);
-            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, mp_obj_new_int(self->sock_base.err)));
-            break;
-        case SOCKET_CONN_PENDING:
-        case SOCKET_NOT_CONNECTED:
-        case SOCKET_CONN_START:
-            // Do Nothing
-            break;
-        case SOCKET_CONNECTED:
-            /* Release Sem */
-            xSemaphoreGive(xSocketOpsSem);
-            // Set socket back to Blocking
-            modsocket_sock->sock_base.nic_type->n_settimeout(modsocket_sock, timeout_temp, &(self->sock_base.err));
-            // setup ssl if applicable
-            if(modsocket_sock->sock_base.is_ssl)
-            {
-                if(modsocket_sock->sock_base.nic_type->n_setupssl(modsocket_sock, &(self->sock_base.err)) != 0)
-                {
-                    //Close socket
-                    socket_close(modsocket_sock);
-                    nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(self->sock_base.err)));
-                }
+    if (ret != 0) {
+        if (timed) {
+            socket_close(self);
+            if (self->sock_base.err == ETIMEDOUT) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
             }
-            // mark socket as connected to allow ssl handshake if applicable
-            modsocket_sock->sock_base.connected = true;
-            break;
-        default:
-            // Set socket back to Blocking
-            modsocket_sock->sock_base.nic_type->n_settimeout(modsocket_sock, timeout_temp, &(self->sock_base.err));
-            //Close socket
-            socket_close(modsocket_sock);
-            /* Release Sem */
-            xSemaphoreGive(xSocketOpsSem);
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Connection failed"));
-            break;
-        }
-        MP_THREAD_GIL_ENTER();
-    }
-    else
-    {
-        // get address
-        self->sock_base.port = netutils_parse_inet_addr(addr_in, self->sock_base.ip_addr, NETUTILS_LITTLE);
-
-        // connect the socket
-        MP_THREAD_GIL_EXIT();
-        if (self->sock_base.nic_type->n_connect(self, self->sock_base.ip_addr, self->sock_base.port, &(self->sock_base.err)) != 0) {
-            MP_THREAD_GIL_ENTER();
-            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(self->sock_base.err)));
         }
-        MP_THREAD_GIL_ENTER();
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(self->sock_base.err)));
     }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_connect_obj, socket_connect);
 
-// method socket.send(bytes)
-STATIC mp_obj_t socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
-    mod_network_socket_obj_t *self = self_in;
-    mp_buffer_info_t bufinfo;
-    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
-    int _errno;
-    MP_THREAD_GIL_EXIT();
-    mp_int_t ret = self->sock_base.nic_type->n_send(self, bufinfo.buf, bufinfo.len, &_errno);
-    MP_THREAD_GIL_ENTER();
+// raises the error of a failed n_send/n_sendto
+STATIC void socket_check_send(mod_network_socket_obj_t *self, mp_int_t ret, int _errno) {
     if (ret < 0) {
         if (_errno == MP_EAGAIN && self->sock_base.timeout > 0) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
         }
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
     }
-    return mp_obj_new_int_from_uint(ret);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_send_obj, socket_send);
 
-// method socket.recv(bufsize)
-STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
-    mod_network_socket_obj_t *self = self_in;
-    mp_int_t len = mp_obj_get_int(len_in);
-    vstr_t vstr;
-    vstr_init_len(&vstr, len);
-    int _errno;
-    MP_THREAD_GIL_EXIT();
-    mp_int_t ret = self->sock_base.nic_type->n_recv(self, (byte*)vstr.buf, len, &_errno);
-    MP_THREAD_GIL_ENTER();
+// returns the bytes received by n_recv, or 0 if a non-blocking socket had none
+STATIC mp_int_t socket_check_recv(mod_network_socket_obj_t *self, mp_int_t ret, int _errno) {
     if (ret < 0) {
         if (_errno == MP_EAGAIN || _errno == MBEDTLS_ERR_SSL_TIMEOUT ) {
             if (self->sock_base.timeout > 0) {
@@ -500,6 +431,44 @@ STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
             nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
         }
     }
+    return ret;
+}
+
+STATIC mp_int_t socket_recv_buf(mod_network_socket_obj_t *self, byte *buf, mp_uint_t len, int *_errno) {
+    MP_THREAD_GIL_EXIT();
+    mp_int_t ret = self->sock_base.nic_type->n_recv(self, buf, len, _errno);
+    MP_THREAD_GIL_ENTER();
+    return ret;
+}
+
+STATIC mp_int_t socket_send_buf(mod_network_socket_obj_t *self, const byte *buf, mp_uint_t len, int *_errno) {
+    MP_THREAD_GIL_EXIT();
+    mp_int_t ret = self->sock_base.nic_type->n_send(self, buf, len, _errno);
+    MP_THREAD_GIL_ENTER();
+    return ret;
+}
+
+// method socket.send(bytes)
+STATIC mp_obj_t socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
+    mod_network_socket_obj_t *self = self_in;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    int _errno;
+    mp_int_t ret = socket_send_buf(self, bufinfo.buf, bufinfo.len, &_errno);
+    socket_check_send(self, ret, _errno);
+    return mp_obj_new_int_from_uint(ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_send_obj, socket_send);
+
+// method socket.recv(bufsize)
+STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
+    mod_network_socket_obj_t *self = self_in;
+    mp_int_t len = mp_obj_get_int(len_in);
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    int _errno;
+    mp_int_t ret = socket_recv_buf(self, (byte*)vstr.buf, len, &_errno);
+    ret = socket_check_recv(self, ret, _errno);
     if (ret == 0) {
         return mp_const_empty_bytes;
     }
@@ -509,6 +478,157 @@ STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recv_obj, socket_recv);
 
+// gets the writable buffer of recv_into/recvfrom_into, limited to nbytes if given
+STATIC void socket_get_recv_buffer(size_t n_args, const mp_obj_t *args, mp_buffer_info_t *bufinfo) {
+    mp_get_buffer_raise(args[1], bufinfo, MP_BUFFER_WRITE);
+    if (n_args > 2) {
+        mp_int_t nbytes = mp_obj_get_int(args[2]);
+        if (nbytes < 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+        if (nbytes > 0 && (mp_uint_t)nbytes < bufinfo->len) {
+            bufinfo->len = nbytes;
+        }
+    }
+}
+
+// method socket.recv_into(buffer[, nbytes])
+STATIC mp_obj_t socket_recv_into(size_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    mp_buffer_info_t bufinfo;
+    socket_get_recv_buffer(n_args, args, &bufinfo);
+    int _errno;
+    mp_int_t ret = socket_recv_buf(self, bufinfo.buf, bufinfo.len, &_errno);
+    return mp_obj_new_int_from_uint(socket_check_recv(self, ret, _errno));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recv_into_obj, 2, 3, socket_recv_into);
+
+// method socket.sendv(buffers)
+STATIC mp_obj_t socket_sendv(mp_obj_t self_in, mp_obj_t bufs_in) {
+    mod_network_socket_obj_t *self = self_in;
+    size_t n_bufs;
+    mp_obj_t *bufs;
+    mp_obj_get_array(bufs_in, &n_bufs, &bufs);
+    int _errno;
+    mp_int_t ret;
+
+    if (self->sock_base.type == SOCK_STREAM) {
+        // a stream has no message boundaries, so hand each buffer to the nic in
+        // turn and stop at the first short write, like writev() does
+        mp_uint_t total = 0;
+        for (size_t i = 0; i < n_bufs; i++) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len == 0) {
+                continue;
+            }
+            ret = socket_send_buf(self, bufinfo.buf, bufinfo.len, &_errno);
+            if (ret < 0 && total > 0) {
+                // report what was sent; the error shows up on the next call
+                break;
+            }
+            socket_check_send(self, ret, _errno);
+            total += ret;
+            if ((mp_uint_t)ret < bufinfo.len) {
+                break;
+            }
+        }
+        return mp_obj_new_int_from_uint(total);
+    }
+
+    // datagrams must go out whole, so gather them first
+    mp_uint_t total = 0;
+    for (size_t i = 0; i < n_bufs; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_READ);
+        total += bufinfo.len;
+    }
+    byte stack_buf[MODUSOCKET_SG_STACK_BUF_LEN];
+    byte *buf = (total <= sizeof(stack_buf)) ? stack_buf : m_new(byte, total);
+    mp_uint_t pos = 0;
+    for (size_t i = 0; i < n_bufs; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_READ);
+        memcpy(buf + pos, bufinfo.buf, bufinfo.len);
+        pos += bufinfo.len;
+    }
+    ret = socket_send_buf(self, buf, total, &_errno);
+    if (buf != stack_buf) {
+        m_del(byte, buf, total);
+    }
+    socket_check_send(self, ret, _errno);
+    return mp_obj_new_int_from_uint(ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_sendv_obj, socket_sendv);
+
+// method socket.recvv(buffers)
+STATIC mp_obj_t socket_recvv(mp_obj_t self_in, mp_obj_t bufs_in) {
+    mod_network_socket_obj_t *self = self_in;
+    size_t n_bufs;
+    mp_obj_t *bufs;
+    mp_obj_get_array(bufs_in, &n_bufs, &bufs);
+    int _errno;
+    mp_int_t ret;
+
+    if (self->sock_base.type == SOCK_STREAM) {
+        // fill the buffers in order; only move on to the next one if this one
+        // was filled and more data is ready, so the call never blocks once
+        // something has been received
+        mp_uint_t total = 0;
+        for (size_t i = 0; i < n_bufs; i++) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_WRITE);
+            if (bufinfo.len == 0) {
+                continue;
+            }
+            if (total > 0) {
+                if (self->sock_base.nic_type->n_ioctl == NULL) {
+                    break;
+                }
+                int ready = self->sock_base.nic_type->n_ioctl(self, MP_STREAM_POLL, MP_STREAM_POLL_RD, &_errno);
+                if (ready < 0 || !(ready & MP_STREAM_POLL_RD)) {
+                    break;
+                }
+            }
+            ret = socket_recv_buf(self, bufinfo.buf, bufinfo.len, &_errno);
+            if (ret < 0 && total > 0) {
+                break;
+            }
+            ret = socket_check_recv(self, ret, _errno);
+            total += ret;
+            if ((mp_uint_t)ret < bufinfo.len) {
+                break;
+            }
+        }
+        return mp_obj_new_int_from_uint(total);
+    }
+
+    // a datagram has to be read in one go, then scattered over the buffers
+    mp_uint_t total = 0;
+    for (size_t i = 0; i < n_bufs; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_WRITE);
+        total += bufinfo.len;
+    }
+    byte stack_buf[MODUSOCKET_SG_STACK_BUF_LEN];
+    byte *buf = (total <= sizeof(stack_buf)) ? stack_buf : m_new(byte, total);
+    ret = socket_recv_buf(self, buf, total, &_errno);
+    ret = socket_check_recv(self, ret, _errno);
+    mp_uint_t pos = 0;
+    for (size_t i = 0; i < n_bufs && pos < (mp_uint_t)ret; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_WRITE);
+        mp_uint_t n = MIN(bufinfo.len, ret - pos);
+        memcpy(bufinfo.buf, buf + pos, n);
+        pos += n;
+    }
+    if (buf != stack_buf) {
+        m_del(byte, buf, total);
+    }
+    return mp_obj_new_int_from_uint(ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recvv_obj, socket_recvv);
+
 // method socket.sendto(bytes, address)
 STATIC mp_obj_t socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_in) {
     mod_network_socket_obj_t *self = self_in;
@@ -542,28 +662,17 @@ STATIC mp_obj_t socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_
     MP_THREAD_GIL_EXIT();
     mp_int_t ret = self->sock_base.nic_type->n_sendto(self, bufinfo.buf, bufinfo.len, ip, port, &_errno);
     MP_THREAD_GIL_ENTER();
-    if (ret < 0) {
-        if (_errno == MP_EAGAIN && self->sock_base.timeout > 0) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
-        }
-        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
-    }
+    socket_check_send(self, ret, _errno);
     return mp_obj_new_int(ret);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(socket_sendto_obj, socket_sendto);
 
-// method socket.recvfrom(bufsize)
-STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
-    mod_network_socket_obj_t *self = self_in;
-    vstr_t vstr;
-    vstr_init_len(&vstr, mp_obj_get_int(len_in));
-    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
-    mp_uint_t port;
+// receives one datagram into buf and returns its length; ip/port get the sender
+STATIC mp_int_t socket_recvfrom_buf(mod_network_socket_obj_t *self, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port) {
     int _errno;
-
     ip[0] = 0;// init IP with null
     MP_THREAD_GIL_EXIT();
-    mp_int_t ret = self->sock_base.nic_type->n_recvfrom(self, (byte*)vstr.buf, vstr.len, ip, &port, &_errno);
+    mp_int_t ret = self->sock_base.nic_type->n_recvfrom(self, buf, len, ip, port, &_errno);
     MP_THREAD_GIL_ENTER();
     if (ret < 0) {
         if ((_errno == MP_EAGAIN || _errno == MBEDTLS_ERR_SSL_TIMEOUT ) && self->sock_base.timeout > 0) {
@@ -571,37 +680,67 @@ STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
         }
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
     }
-    mp_obj_t tuple[2];
-    if (ret == 0) {
-        tuple[0] = mp_const_empty_bytes;
-    } else {
-        vstr.len = ret;
-        vstr.buf[vstr.len] = '\0';
-        tuple[0] = mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
-    }
+    return ret;
+}
+
+STATIC mp_obj_t socket_format_addr(mod_network_socket_obj_t *self, byte *ip, mp_uint_t port) {
 #ifdef MOD_LORA_ENABLED
     // check if lora NIC and IP is not set (so Lora Raw or LoraWAN, but no Lora Mesh)
     if (self->sock_base.nic_type == &mod_network_nic_type_lora) {
             if (ip[0] == 0) {
-            tuple[1] = mp_obj_new_int(port);
+            return mp_obj_new_int(port);
             } else {
                 // Lora Mesh
                 mp_obj_t addr[2] = {
                 addr[0] = mp_obj_new_str((char*)ip, strlen((char*)ip)),
                 addr[1] = mp_obj_new_int(port),
                 };
-                tuple[1] = mp_obj_new_tuple(2, addr);
+                return mp_obj_new_tuple(2, addr);
             }
-    } else {
-        tuple[1] = netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
     }
-#else
-    tuple[1] = netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
 #endif
+    return netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
+}
+
+// method socket.recvfrom(bufsize)
+STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
+    mod_network_socket_obj_t *self = self_in;
+    vstr_t vstr;
+    vstr_init_len(&vstr, mp_obj_get_int(len_in));
+    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
+    mp_uint_t port;
+
+    mp_int_t ret = socket_recvfrom_buf(self, (byte*)vstr.buf, vstr.len, ip, &port);
+    mp_obj_t tuple[2];
+    if (ret == 0) {
+        tuple[0] = mp_const_empty_bytes;
+    } else {
+        vstr.len = ret;
+        vstr.buf[vstr.len] = '\0';
+        tuple[0] = mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+    }
+    tuple[1] = socket_format_addr(self, ip, port);
     return mp_obj_new_tuple(2, tuple);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recvfrom_obj, socket_recvfrom);
 
+// method socket.recvfrom_into(buffer[, nbytes])
+STATIC mp_obj_t socket_recvfrom_into(size_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    mp_buffer_info_t bufinfo;
+    socket_get_recv_buffer(n_args, args, &bufinfo);
+    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
+    mp_uint_t port;
+
+    mp_int_t ret = socket_recvfrom_buf(self, bufinfo.buf, bufinfo.len, ip, &port);
+    mp_obj_t tuple[2] = {
+        MP_OBJ_NEW_SMALL_INT(ret),
+        socket_format_addr(self, ip, port),
+    };
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvfrom_into_obj, 2, 3, socket_recvfrom_into);
+
 // method socket.setsockopt(level, optname, value)
 STATIC mp_obj_t socket_setsockopt(mp_uint_t n_args, const mp_obj_t *args) {
     mod_network_socket_obj_t *self = args[0];
@@ -635,6 +774,15 @@ STATIC mp_obj_t socket_setsockopt(mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_setsockopt_obj, 4, 4, socket_setsockopt);
 
+// method socket.rxstats([reset])
+// counters of the receive ring set up with setsockopt(SOL_SOCKET, SO_RXRING, size),
+// or None without one
+STATIC mp_obj_t socket_rxstats(mp_uint_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    return lwipsocket_socket_rx_stats(self, n_args > 1 && mp_obj_is_true(args[1]));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_rxstats_obj, 1, 2, socket_rxstats);
+
 // method socket.settimeout(value)
 // timeout=0 means non-blocking
 // timeout=None means blocking
@@ -693,97 +841,6 @@ STATIC mp_obj_t socket_do_handshake(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_do_handshake_obj, socket_do_handshake);
 
-static void TASK_SOCK_OPS (void *pvParameters) {
-
-    mp_uint_t flag = MP_STREAM_POLL_WR;
-    int ret;
-    static uint32_t thread_notification;
-
-Conn_start:
-
-    thread_notification = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-
-    if (thread_notification) {
-        for (;;)
-        {
-            if(modsocket_sock->sock_base.conn_status == SOCKET_CONN_START)
-            {
-                xSemaphoreTake(xSocketOpsSem, portMAX_DELAY);
-
-                //connect socket
-                if (modsocket_sock->sock_base.nic_type->n_connect(modsocket_sock, modsocket_sock->sock_base.ip_addr, modsocket_sock->sock_base.port, &(modsocket_sock->sock_base.err)) != 0) {
-
-                    if(modsocket_sock->sock_base.err == EINPROGRESS)
-                    {
-                        /*start Timer */
-                        xTimerStart(modsocket_conn_timeout_timer, 0);
-                        /* Pending */
-                        modsocket_sock->sock_base.conn_status = SOCKET_CONN_PENDING;
-                    }
-                    else
-                    {
-                        modsocket_sock->sock_base.conn_status = SOCKET_CONN_ERROR;
-                        xSemaphoreGive(xSocketOpsSem);
-                        goto Conn_start;
-                    }
-                }
-                else
-                {
-                    // socket already connected
-                    modsocket_sock->sock_base.conn_status = SOCKET_CONNECTED;
-                    xSemaphoreGive(xSocketOpsSem);
-                    goto Conn_start;
-                }
-            }
-            else if (modsocket_sock->sock_base.conn_status == SOCKET_CONN_PENDING)
-            {
-                //start polling
-                ret = lwipsocket_socket_ioctl(modsocket_sock, MP_STREAM_POLL, flag, &(modsocket_sock->sock_base.err));
-                if((ret & MP_STREAM_POLL_WR) == MP_STREAM_POLL_WR)
-                {
-                    // socket connected
-                    modsocket_sock->sock_base.conn_status = SOCKET_CONNECTED;
-                    /* Stop Timer*/
-                    xTimerStop(modsocket_conn_timeout_timer, 0);
-                    xTimerDelete(modsocket_conn_timeout_timer, 0);
-                    xSemaphoreGive(xSocketOpsSem);
-                    goto Conn_start;
-                }
-                else if(ret < 0)
-                {
-                    modsocket_sock->sock_base.conn_status = SOCKET_CONN_ERROR;
-                    xSemaphoreGive(xSocketOpsSem);
-                    goto Conn_start;
-                }
-
-                if(modsocket_istimeout)
-                {
-                    modsocket_sock->sock_base.conn_status = SOCKET_CONN_TIMEDOUT;
-                    modsocket_istimeout = false;
-                    xSemaphoreGive(xSocketOpsSem);
-                    goto Conn_start;
-                }
-            }
-            else
-            {
-                // Nothing
-            }
-
-            vTaskDelay(5/portTICK_PERIOD_MS);
-        }
-    }
-
-    goto Conn_start;
-}
-
-STATIC void modsocket_timer_callback( TimerHandle_t xTimer )
-{
-    modsocket_istimeout = true;
-    /* Stop Timer*/
-    xTimerStop(modsocket_conn_timeout_timer, 0);
-    xTimerDelete(modsocket_conn_timeout_timer, 0);
-}
-
 STATIC const mp_map_elem_t socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___del__),         (mp_obj_t)&socket_close_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_close),           (mp_obj_t)&socket_close_obj },
@@ -794,9 +851,14 @@ STATIC const mp_map_elem_t socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendall),         (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendto),          (mp_obj_t)&socket_sendto_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom),        (mp_obj_t)&socket_recvfrom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom_into),   (mp_obj_t)&socket_recvfrom_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendv),           (mp_obj_t)&socket_sendv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvv),           (mp_obj_t)&socket_recvv_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setsockopt),      (mp_obj_t)&socket_setsockopt_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_rxstats),         (mp_obj_t)&socket_rxstats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_makefile),        (mp_obj_t)&socket_makefile_obj },
@@ -819,7 +881,11 @@ STATIC const mp_map_elem_t raw_socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendto),          (mp_obj_t)&socket_sendto_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom),        (mp_obj_t)&socket_recvfrom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom_into),   (mp_obj_t)&socket_recvfrom_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendv),           (mp_obj_t)&socket_sendv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvv),           (mp_obj_t)&socket_recvv_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_bind),            (mp_obj_t)&socket_bind_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
@@ -831,6 +897,9 @@ STATIC const mp_map_elem_t raw_socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_close),           (mp_obj_t)&socket_close_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendv),           (mp_obj_t)&socket_sendv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvv),           (mp_obj_t)&socket_recvv_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setsockopt),      (mp_obj_t)&socket_setsockopt_obj },
@@ -903,6 +972,105 @@ STATIC const mp_obj_type_t raw_socket_type = {
 ///******************************************************************************/
 //// usocket module
 
+STATIC mp_obj_t modusocket_addrinfo_result(const uint8_t *ip, mp_int_t port) {
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(5, NULL);
+    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(AF_INET);
+    tuple->items[1] = MP_OBJ_NEW_SMALL_INT(SOCK_STREAM);
+    tuple->items[2] = MP_OBJ_NEW_SMALL_INT(0);
+    tuple->items[3] = MP_OBJ_NEW_QSTR(MP_QSTR_);
+    tuple->items[4] = netutils_format_inet_addr((uint8_t *)ip, port, NETUTILS_BIG);
+    return mp_obj_new_list(1, (mp_obj_t*) &tuple);
+}
+
+// The cache is only changed with the GIL held, except for the state of a
+// pending entry and its answer, which the lwIP thread fills in.
+STATIC modusocket_dns_entry_t *modusocket_dns_find(const char *host) {
+    for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+        modusocket_dns_entry_t *e = &modusocket_dns_cache[i];
+        if (e->state != MODUSOCKET_DNS_FREE && !strcmp(e->host, host)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+STATIC bool modusocket_dns_failed(modusocket_dns_entry_t *e) {
+    return e != NULL && e->state == MODUSOCKET_DNS_FAILED && (int32_t)(e->expires - mp_hal_ticks_ms()) > 0;
+}
+
+STATIC modusocket_dns_entry_t *modusocket_dns_alloc(const char *host) {
+    modusocket_dns_entry_t *e = modusocket_dns_find(host);
+    if (e != NULL) {
+        return e;
+    }
+    // take a free entry, else one that isn't pending, oldest failure first
+    modusocket_dns_entry_t *victim = NULL;
+    for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+        e = &modusocket_dns_cache[i];
+        if (e->state == MODUSOCKET_DNS_FREE) {
+            victim = e;
+            break;
+        }
+        if (e->state != MODUSOCKET_DNS_PENDING &&
+            (victim == NULL || (int32_t)(e->expires - victim->expires) < 0)) {
+            victim = e;
+        }
+    }
+    if (victim != NULL) {
+        strcpy(victim->host, host);
+        victim->expires = mp_hal_ticks_ms();
+        victim->state = MODUSOCKET_DNS_DONE;
+        ip_addr_set_zero(&victim->addr);
+    }
+    return victim;
+}
+
+// answered is false when the lookup couldn't even be started
+STATIC void modusocket_dns_fail(modusocket_dns_entry_t *e, bool answered) {
+    if (answered) {
+        e->expires = mp_hal_ticks_ms() + MODUSOCKET_DNS_NEG_TTL_MS;
+        e->state = MODUSOCKET_DNS_FAILED;
+    } else {
+        e->expires = mp_hal_ticks_ms();
+        e->state = MODUSOCKET_DNS_ERROR;
+    }
+}
+
+// runs in the lwIP thread
+STATIC void modusocket_dns_found(const char *name, const ip_addr_t *ipaddr, void *arg) {
+    modusocket_dns_entry_t *e = arg;
+    if (ipaddr != NULL) {
+        ip_addr_copy(e->addr, *ipaddr);
+        e->state = MODUSOCKET_DNS_DONE;
+    } else {
+        // a name error or a timeout, lwIP doesn't say which
+        modusocket_dns_fail(e, true);
+    }
+}
+
+// runs in the lwIP thread
+STATIC void modusocket_dns_start(void *arg) {
+    modusocket_dns_entry_t *e = arg;
+    err_t err = dns_gethostbyname(e->host, &e->addr, modusocket_dns_found, e);
+    if (err == ERR_OK) {
+        // a literal address, or still valid in lwIP's table
+        e->state = MODUSOCKET_DNS_DONE;
+    } else if (err != ERR_INPROGRESS) {
+        // no DNS server, or out of memory
+        modusocket_dns_fail(e, false);
+    }
+}
+
+STATIC void modusocket_dns_lookup(modusocket_dns_entry_t *e) {
+    if (e->state == MODUSOCKET_DNS_PENDING || modusocket_dns_failed(e)) {
+        return;
+    }
+    e->state = MODUSOCKET_DNS_PENDING;
+    if (tcpip_callback(modusocket_dns_start, e) != ERR_OK) {
+        modusocket_dns_fail(e, false);
+    }
+}
+
 // function usocket.getaddrinfo(host, port)
 /// \function getaddrinfo(host, port)
 STATIC mp_obj_t mod_usocket_getaddrinfo(size_t n_args, const mp_obj_t *args) {
@@ -913,6 +1081,11 @@ STATIC mp_obj_t mod_usocket_getaddrinfo(size_t n_args, const mp_obj_t *args) {
     const char *host = mp_obj_str_get_data(args[0], &hlen);
     mp_int_t port = mp_obj_get_int(args[1]);
 
+    // a name that failed to resolve a moment ago fails again straight away
+    if (modusocket_dns_failed(modusocket_dns_find(host))) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EAI_FAIL)));
+    }
+
     const struct addrinfo hints = {
         .ai_family = AF_INET,
         .ai_socktype = SOCK_STREAM,
@@ -922,25 +1095,120 @@ STATIC mp_obj_t mod_usocket_getaddrinfo(size_t n_args, const mp_obj_t *args) {
 
     char port_s[6];
     sprintf(port_s, "%d", port);
+    MP_THREAD_GIL_EXIT();
     int32_t result = getaddrinfo(host, port_s, &hints, &res);
+    MP_THREAD_GIL_ENTER();
     if(result != 0 || res == NULL) {
+        if ((result == EAI_FAIL || result == EAI_NONAME) && hlen <= MODUSOCKET_DNS_HOST_LEN_MAX) {
+            modusocket_dns_entry_t *e = modusocket_dns_alloc(host);
+            if (e != NULL && e->state != MODUSOCKET_DNS_PENDING) {
+                modusocket_dns_fail(e, true);
+            }
+        }
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(result)));
     }
     addr = &((struct sockaddr_in *)res->ai_addr)->sin_addr;
-    mp_obj_tuple_t *tuple = mp_obj_new_tuple(5, NULL);
-    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(res->ai_family);
-    tuple->items[1] = MP_OBJ_NEW_SMALL_INT(res->ai_socktype);
-    tuple->items[2] = MP_OBJ_NEW_SMALL_INT(0);
-    tuple->items[3] = MP_OBJ_NEW_QSTR(MP_QSTR_);
-    tuple->items[4] = netutils_format_inet_addr((uint8_t *) &addr->s_addr, port, NETUTILS_BIG);
+    mp_obj_t list = modusocket_addrinfo_result((uint8_t *) &addr->s_addr, port);
 
     //getaddrinfo() allocates memory, needs to be freed
     freeaddrinfo(res);
 
-    return mp_obj_new_list(1, (mp_obj_t*) &tuple);
+    return list;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_getaddrinfo_obj, 2, 6, mod_usocket_getaddrinfo);
 
+STATIC const mp_obj_type_t mod_usocket_dns_query_type;
+
+// the cache entry of a query, restarting the lookup if the entry was taken
+// over; NULL if every entry is busy with a pending lookup
+STATIC modusocket_dns_entry_t *mod_usocket_dns_query_entry(mod_usocket_dns_query_t *self) {
+    const char *host = mp_obj_str_get_str(self->host);
+    modusocket_dns_entry_t *e = &modusocket_dns_cache[self->slot];
+    if (e->state == MODUSOCKET_DNS_FREE || strcmp(e->host, host)) {
+        e = modusocket_dns_alloc(host);
+        if (e == NULL) {
+            return NULL;
+        }
+        self->slot = e - modusocket_dns_cache;
+        modusocket_dns_lookup(e);
+    }
+    return e;
+}
+
+// function usocket.getaddrinfo_async(host, port)
+// Starts a lookup without waiting for it.  The returned query polls readable
+// with uselect once it has finished, and its result() then gives what
+// getaddrinfo(host, port) would.
+STATIC mp_obj_t mod_usocket_getaddrinfo_async(mp_obj_t host_in, mp_obj_t port_in) {
+    mp_uint_t hlen;
+    const char *host = mp_obj_str_get_data(host_in, &hlen);
+    if (hlen > MODUSOCKET_DNS_HOST_LEN_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    modusocket_dns_entry_t *e = modusocket_dns_alloc(host);
+    if (e == NULL) {
+        mp_raise_OSError(MP_ENOBUFS);
+    }
+    modusocket_dns_lookup(e);
+
+    mod_usocket_dns_query_t *q = m_new_obj(mod_usocket_dns_query_t);
+    q->base.type = &mod_usocket_dns_query_type;
+    q->host = host_in;
+    q->port = mp_obj_get_int(port_in);
+    q->slot = e - modusocket_dns_cache;
+    return q;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_usocket_getaddrinfo_async_obj, mod_usocket_getaddrinfo_async);
+
+STATIC mp_obj_t mod_usocket_dns_query_result(mp_obj_t self_in) {
+    mod_usocket_dns_query_t *self = self_in;
+    modusocket_dns_entry_t *e = mod_usocket_dns_query_entry(self);
+    if (e == NULL) {
+        mp_raise_OSError(MP_ENOBUFS);
+    }
+    switch (e->state) {
+        case MODUSOCKET_DNS_PENDING:
+            mp_raise_OSError(MP_EINPROGRESS);
+        case MODUSOCKET_DNS_ERROR:
+        case MODUSOCKET_DNS_FAILED:
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EAI_FAIL)));
+        default:
+            return modusocket_addrinfo_result((const uint8_t *)&ip_2_ip4(&e->addr)->addr, self->port);
+    }
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_usocket_dns_query_result_obj, mod_usocket_dns_query_result);
+
+STATIC mp_uint_t mod_usocket_dns_query_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint_t arg, int *errcode) {
+    mod_usocket_dns_query_t *self = self_in;
+    if (request == MP_STREAM_POLL) {
+        modusocket_dns_entry_t *e = mod_usocket_dns_query_entry(self);
+        if (e == NULL) {
+            // stream ioctls report errors through errcode, never raise
+            *errcode = MP_ENOBUFS;
+            return MP_STREAM_ERROR;
+        }
+        return (e->state != MODUSOCKET_DNS_PENDING) ? (arg & MP_STREAM_POLL_RD) : 0;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+STATIC const mp_map_elem_t mod_usocket_dns_query_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_result),          (mp_obj_t)&mod_usocket_dns_query_result_obj },
+};
+STATIC MP_DEFINE_CONST_DICT(mod_usocket_dns_query_locals_dict, mod_usocket_dns_query_locals_dict_table);
+
+STATIC const mp_stream_p_t mod_usocket_dns_query_stream_p = {
+    .ioctl = mod_usocket_dns_query_ioctl,
+};
+
+STATIC const mp_obj_type_t mod_usocket_dns_query_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_DNSQuery,
+    .protocol = &mod_usocket_dns_query_stream_p,
+    .locals_dict = (mp_obj_t)&mod_usocket_dns_query_locals_dict,
+};
+
 STATIC mp_obj_t mod_usocket_dnsserver(size_t n_args, const mp_obj_t *args)
 {
     if(n_args == 1)
@@ -996,6 +1264,7 @@ STATIC const mp_map_elem_t mp_module_usocket_globals_table[] = {
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_socket),          (mp_obj_t)&socket_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_getaddrinfo),     (mp_obj_t)&mod_usocket_getaddrinfo_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_getaddrinfo_async), (mp_obj_t)&mod_usocket_getaddrinfo_async_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_dnsserver),       (mp_obj_t)&mod_usocket_dnsserver_obj },
 
     // class exceptions
@@ -1037,10 +1306,12 @@ STATIC const mp_map_elem_t mp_module_usocket_globals_table[] = {
 #endif
     { MP_OBJ_NEW_QSTR(MP_QSTR_SOL_SOCKET),      MP_OBJ_NEW_SMALL_INT(SOL_SOCKET) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_REUSEADDR),    MP_OBJ_NEW_SMALL_INT(SO_REUSEADDR) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_RXRING),       MP_OBJ_NEW_SMALL_INT(SO_RXRING) },
 
 #if defined(LOPY) || defined (LOPY4) || defined(FIPY)
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_CONFIRMED),    MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_CONFIRMED) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_DR),           MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_DR) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_AGGREGATE),    MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_AGGREGATE) },
 #endif
 #if defined(SIPY) || defined (LOPY4) || defined(FIPY)
      { MP_OBJ_NEW_QSTR(MP_QSTR_SO_RX),          MP_OBJ_NEW_SMALL_INT(SO_SIGFOX_RX) },
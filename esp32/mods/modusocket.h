@@ -53,6 +53,8 @@
 #define SO_SIGFOX_TX_REPEAT                 (0xF0005)
 #define SO_SIGFOX_OOB                       (0xF0006)
 #define SO_SIGFOX_BIT                       (0xF0007)
+#define SO_RXRING                           (0xF0008)
+#define SO_LORAWAN_AGGREGATE                (0xF0009)
 
 /* chars for storing an IPv6 address 39 chars + zero end string
 * ex: ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD 4*8+7=39 chars */
@@ -63,7 +65,6 @@ extern const mp_stream_p_t socket_stream_p;
 
 extern const mp_obj_type_t socket_type;
 
-extern void modusocket_pre_init (void);
 extern void modusocket_socket_add (int32_t sd, bool user);
 extern void modusocket_socket_delete (int32_t sd);
 extern void modusocket_enter_sleep (void);
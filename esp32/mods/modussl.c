@@ -12,6 +12,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
@@ -22,6 +23,8 @@
 #include "py/obj.h"
 #include "py/objstr.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mperrno.h"
 #include "mpexception.h"
 #include "modnetwork.h"
 #include "modusocket.h"
@@ -33,6 +36,30 @@
  DEFINE CONSTANTS
  ******************************************************************************/
 #define DEFAULT_SSL_READ_TIMEOUT                    10 //sec
+#define MODUSSL_SESSION_CACHE_SIZE                  4
+#define MODUSSL_SESSION_HOST_LEN_MAX                63
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// client sessions are cached by server host name, so that reconnecting to a
+// host resumes the previous session (by id or ticket) instead of running a
+// full handshake
+typedef struct {
+    mbedtls_ssl_session session;
+    uint32_t used;
+    bool valid;
+    char host[MODUSSL_SESSION_HOST_LEN_MAX + 1];
+} modussl_cache_entry_t;
+
+typedef struct {
+    uint32_t full;
+    uint32_t resumed;
+    uint32_t failed;
+    uint64_t full_us;
+    uint64_t resumed_us;
+    uint32_t last_us;
+} modussl_stats_t;
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
@@ -41,6 +68,21 @@
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
+STATIC SemaphoreHandle_t modussl_cache_mutex;
+STATIC modussl_cache_entry_t modussl_cache[MODUSSL_SESSION_CACHE_SIZE];
+STATIC uint32_t modussl_cache_clock;
+STATIC modussl_stats_t modussl_stats;
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modussl_init0 (void) {
+    // called again on every soft reset, the cached sessions are kept
+    if (!modussl_cache_mutex) {
+        modussl_cache_mutex = xSemaphoreCreateMutex();
+    }
+}
+
 // tiny object for storing ssl sessions
 STATIC mp_obj_t ssl_session_free(mp_obj_t self_in) {
     mp_obj_ssl_session_t *self = self_in;
@@ -71,9 +113,99 @@ STATIC const mp_obj_type_t ssl_socket_type = {
     .locals_dict = (mp_obj_t)&socket_locals_dict,
 };
 
+// the cache is used from handshakes running with the GIL released, so it has
+// a lock of its own
+STATIC void modussl_cache_resume (mp_obj_ssl_socket_t *ssl_sock, const char *host_name) {
+    xSemaphoreTake(modussl_cache_mutex, portMAX_DELAY);
+    for (int i = 0; i < MODUSSL_SESSION_CACHE_SIZE; i++) {
+        modussl_cache_entry_t *e = &modussl_cache[i];
+        if (e->valid && !strcmp(e->host, host_name)) {
+            if (mbedtls_ssl_set_session(&ssl_sock->ssl, &e->session) == 0) {
+                ssl_sock->cache_slot = i;
+                e->used = ++modussl_cache_clock;
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(modussl_cache_mutex);
+}
+
+STATIC void modussl_cache_store (mp_obj_ssl_socket_t *ssl_sock) {
+    const char *host_name = ssl_sock->ssl.hostname;
+    if (host_name == NULL || strlen(host_name) > MODUSSL_SESSION_HOST_LEN_MAX) {
+        return;
+    }
+    // reuse the host's entry, else a free one, else the least recently used
+    modussl_cache_entry_t *e = &modussl_cache[0];
+    for (int i = 0; i < MODUSSL_SESSION_CACHE_SIZE; i++) {
+        modussl_cache_entry_t *c = &modussl_cache[i];
+        if (c->valid && !strcmp(c->host, host_name)) {
+            e = c;
+            break;
+        }
+        if (!c->valid) {
+            if (e->valid) {
+                e = c;
+            }
+        } else if (e->valid && c->used < e->used) {
+            e = c;
+        }
+    }
+    mbedtls_ssl_session_free(&e->session);
+    e->valid = (mbedtls_ssl_get_session(&ssl_sock->ssl, &e->session) == 0);
+    if (e->valid) {
+        strcpy(e->host, host_name);
+        e->used = ++modussl_cache_clock;
+    }
+}
+
+// Called once the handshake of an ssl socket has finished, with its result.
+// Updates the timing counters and, for client sockets, the session cache.
+void modussl_handshake_done (mp_obj_ssl_socket_t *ssl_sock, uint32_t start_us, int ret) {
+    uint32_t elapsed = mp_hal_ticks_us() - start_us;
+    xSemaphoreTake(modussl_cache_mutex, portMAX_DELAY);
+    bool resumed = false;
+    if (ssl_sock->cache_slot >= 0) {
+        modussl_cache_entry_t *e = &modussl_cache[ssl_sock->cache_slot];
+        // another handshake may have given the entry to another host meanwhile
+        if (!e->valid || ssl_sock->ssl.hostname == NULL || strcmp(e->host, ssl_sock->ssl.hostname)) {
+            e = NULL;
+        }
+        if (e == NULL) {
+            // nothing to check against, nor to drop
+        } else if (ret != 0) {
+            // the cached session may be what the server choked on
+            mbedtls_ssl_session_free(&e->session);
+            e->valid = false;
+        } else {
+            // the server resumes by echoing the session id we offered
+            resumed = e->session.id_len > 0 && ssl_sock->ssl.session != NULL &&
+                      ssl_sock->ssl.session->id_len == e->session.id_len &&
+                      !memcmp(ssl_sock->ssl.session->id, e->session.id, e->session.id_len);
+        }
+        ssl_sock->cache_slot = -1;
+    }
+    if (ret != 0) {
+        modussl_stats.failed++;
+    } else {
+        if (resumed) {
+            modussl_stats.resumed++;
+            modussl_stats.resumed_us += elapsed;
+        } else {
+            modussl_stats.full++;
+            modussl_stats.full_us += elapsed;
+        }
+        modussl_stats.last_us = elapsed;
+        if (ssl_sock->session_cache) {
+            modussl_cache_store(ssl_sock);
+        }
+    }
+    xSemaphoreGive(modussl_cache_mutex);
+}
+
 static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtls_ssl_session *saved_session, const char *host_name,
                                      const char *ca_cert, const char *client_cert, const char *client_key,
-                                     uint32_t ssl_verify, uint32_t client_or_server) {
+                                     uint32_t ssl_verify, uint32_t client_or_server, uint32_t max_frag_len) {
 
     int32_t ret;
     mbedtls_ssl_init(&ssl_sock->ssl);
@@ -126,6 +258,14 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
     mbedtls_ssl_conf_authmode(&ssl_sock->conf, ssl_verify);
     mbedtls_ssl_conf_rng(&ssl_sock->conf, mbedtls_ctr_drbg_random, &ssl_sock->ctr_drbg);
     mbedtls_ssl_conf_ca_chain(&ssl_sock->conf, &ssl_sock->cacert, NULL);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    if (max_frag_len != MBEDTLS_SSL_MAX_FRAG_LEN_NONE) {
+        // ask the server to keep its records small; ours are limited to the same
+        if ((ret = mbedtls_ssl_conf_max_frag_len(&ssl_sock->conf, max_frag_len)) != 0) {
+            return ret;
+        }
+    }
+#endif
     if (client_cert && client_key) {
         if ((ret = mbedtls_ssl_conf_own_cert(&ssl_sock->conf,
                                              &ssl_sock->own_cert,
@@ -153,6 +293,9 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
             // printf("mbedtls_ssl_set_hostname returned -0x%x\n", -ret);
             return ret;
         }
+        if (ssl_sock->session_cache && saved_session == NULL) {
+            modussl_cache_resume(ssl_sock, host_name);
+        }
     }
 
     ssl_sock->context_fd.fd = ssl_sock->sock_base.u.sd;
@@ -170,10 +313,12 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
 
         //printf("Performing the SSL/TLS handshake...\n");
         int count = 0;
+        uint32_t start_us = mp_hal_ticks_us();
         while ((ret = mbedtls_ssl_handshake(&ssl_sock->ssl)) != 0)
         {
             if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_TIMEOUT) || count >= ssl_sock->read_timeout) {
                  //printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
+                modussl_handshake_done(ssl_sock, start_us, ret);
                 return ret;
             }
             if(ret == MBEDTLS_ERR_SSL_TIMEOUT)
@@ -181,6 +326,7 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
                 count++;
             }
         }
+        modussl_handshake_done(ssl_sock, start_us, 0);
 
         //printf("Verifying peer X.509 certificate...\n");
         ret = mbedtls_ssl_get_verify_result(&ssl_sock->ssl);
@@ -219,6 +365,8 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
         { MP_QSTR_server_hostname,              MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
         { MP_QSTR_saved_session,                MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
         { MP_QSTR_timeout,                      MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_session_cache,                MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_max_fragment_length,          MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
     };
 
     int32_t _error;
@@ -258,15 +406,38 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
         }
     }
 
+    // max_fragment_length is given in bytes, as one of the sizes the extension allows
+    uint32_t max_frag_len;
+    switch (args[11].u_int) {
+        case 0:    max_frag_len = MBEDTLS_SSL_MAX_FRAG_LEN_NONE; break;
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        case 512:  max_frag_len = MBEDTLS_SSL_MAX_FRAG_LEN_512;  break;
+        case 1024: max_frag_len = MBEDTLS_SSL_MAX_FRAG_LEN_1024; break;
+        case 2048: max_frag_len = MBEDTLS_SSL_MAX_FRAG_LEN_2048; break;
+        case 4096: max_frag_len = MBEDTLS_SSL_MAX_FRAG_LEN_4096; break;
+#endif
+        default:
+            goto arg_error;
+    }
+
     // Retrieve previously saved session
     const mbedtls_ssl_session *saved_session  = (args[8].u_obj == mp_const_none) ? NULL : &((mp_obj_ssl_session_t *)args[8].u_obj)->saved_session;
 
+    // the TLS records already taken into a receive ring would be lost, and the
+    // ring can't be shared with the copy of the socket made below
+    if (((mod_network_socket_obj_t *)args[0].u_obj)->sock_base.rx_ring != NULL) {
+        mp_raise_OSError(MP_EBUSY);
+    }
+
     // create the ssl socket
     mp_obj_ssl_socket_t *ssl_sock = m_new_obj_with_finaliser(mp_obj_ssl_socket_t);
     // ssl sockets inherit all properties from the original socket
     memcpy (&ssl_sock->sock_base, &((mod_network_socket_obj_t *)args[0].u_obj)->sock_base, sizeof(mod_network_socket_base_t));
     ssl_sock->base.type = &ssl_socket_type;
     ssl_sock->o_sock = args[0].u_obj;       // this is needed so that the GC doesnt collect the socket
+    // only client sockets that name their server can use the session cache
+    ssl_sock->session_cache = args[10].u_bool && !server_side && host_name != NULL;
+    ssl_sock->cache_slot = -1;
 
     //Read timeout
     if(args[9].u_obj == mp_const_none)
@@ -303,7 +474,7 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
     MP_THREAD_GIL_EXIT();
 
     _error = mod_ssl_setup_socket(ssl_sock, saved_session, host_name, ca_cert, client_cert, client_key,
-                                  verify_type, server_side ? MBEDTLS_SSL_IS_SERVER : MBEDTLS_SSL_IS_CLIENT);
+                                  verify_type, server_side ? MBEDTLS_SSL_IS_SERVER : MBEDTLS_SSL_IS_CLIENT, max_frag_len);
 
     MP_THREAD_GIL_ENTER();
 
@@ -350,10 +521,43 @@ STATIC mp_obj_t mod_ssl_save_session(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ssl_save_session_obj, 0, mod_ssl_save_session);
 
+STATIC mp_obj_t mod_ssl_clear_sessions(void) {
+    xSemaphoreTake(modussl_cache_mutex, portMAX_DELAY);
+    for (int i = 0; i < MODUSSL_SESSION_CACHE_SIZE; i++) {
+        mbedtls_ssl_session_free(&modussl_cache[i].session);
+        modussl_cache[i].valid = false;
+    }
+    xSemaphoreGive(modussl_cache_mutex);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_ssl_clear_sessions_obj, mod_ssl_clear_sessions);
+
+STATIC mp_obj_t mod_ssl_stats(mp_uint_t n_args, const mp_obj_t *args) {
+    bool reset = n_args > 0 && mp_obj_is_true(args[0]);
+    // handshakes update the counters with the GIL released
+    xSemaphoreTake(modussl_cache_mutex, portMAX_DELAY);
+    modussl_stats_t st = modussl_stats;
+    if (reset) {
+        memset(&modussl_stats, 0, sizeof(modussl_stats));
+    }
+    xSemaphoreGive(modussl_cache_mutex);
+    mp_obj_t dict = mp_obj_new_dict(6);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_full), mp_obj_new_int_from_uint(st.full));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_resumed), mp_obj_new_int_from_uint(st.resumed));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_failed), mp_obj_new_int_from_uint(st.failed));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_full_us), mp_obj_new_int_from_ull(st.full_us));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_resumed_us), mp_obj_new_int_from_ull(st.resumed_us));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_last_us), mp_obj_new_int_from_uint(st.last_us));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_ssl_stats_obj, 0, 1, mod_ssl_stats);
+
 STATIC const mp_map_elem_t mp_module_ussl_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),            MP_OBJ_NEW_QSTR(MP_QSTR_ussl) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_wrap_socket),         (mp_obj_t)&mod_ssl_wrap_socket_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_save_session),        (mp_obj_t)&mod_ssl_save_session_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_clear_sessions),      (mp_obj_t)&mod_ssl_clear_sessions_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),               (mp_obj_t)&mod_ssl_stats_obj },
 
     // class exceptions
     { MP_OBJ_NEW_QSTR(MP_QSTR_SSLError),            (mp_obj_t)&mp_type_OSError },
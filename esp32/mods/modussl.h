@@ -43,6 +43,8 @@ typedef struct _mp_obj_ssl_socket_t {
     mbedtls_x509_crt own_cert;
     mbedtls_pk_context pk_key;
     uint8_t read_timeout;
+    int8_t cache_slot;          // session cache entry offered in the handshake, or -1
+    bool session_cache;
 } mp_obj_ssl_socket_t;
 
 typedef struct _mp_obj_ssl_session_t {
@@ -50,4 +52,10 @@ typedef struct _mp_obj_ssl_session_t {
     mbedtls_ssl_session saved_session;
 } mp_obj_ssl_session_t;
 
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern void modussl_init0 (void);
+extern void modussl_handshake_done (mp_obj_ssl_socket_t *ssl_sock, uint32_t start_us, int ret);
+
 #endif /* MODUSSL_H_ */
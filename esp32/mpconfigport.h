@@ -69,7 +69,9 @@
 #define MICROPY_PY_BUILTINS_SLICE                   (1)
 #define MICROPY_PY_BUILTINS_PROPERTY                (1)
 #define MICROPY_PY_BUILTINS_EXECFILE                (1)
-#define MICROPY_PY_WEBSOCKET                        (1)
+#define MICROPY_PY_UWEBSOCKET                       (1)
+#define MICROPY_PY_UMQTT                            (1)
+#define MICROPY_PY_UHTTPD                           (1)
 #define MICROPY_PY___FILE__                         (1)
 #define MICROPY_PY_GC                               (1)
 #define MICROPY_PY_ARRAY                            (1)
@@ -99,6 +101,8 @@
 #define MICROPY_PY_MACHINE                          (1)
 #define MICROPY_PY_MICROPYTHON_MEM_INFO             (1)
 #define MICROPY_PY_UTIMEQ                           (1)
+#define MICROPY_PY_ULOG                             (1)
+#define MICROPY_PY_UKV                              (1)
 #define MICROPY_CPYTHON_COMPAT                      (1)
 #define MICROPY_LONGINT_IMPL                        (MICROPY_LONGINT_IMPL_MPZ)
 #ifndef MICROPY_FLOAT_IMPL   // can be configured by make option
@@ -144,6 +148,8 @@
 
 #define MICROPY_VFS                                 (1)
 #define MICROPY_VFS_FAT                             (1)
+#define MICROPY_VFS_ROM                             (1)
+#define MICROPY_VFS_STATS                           (1)
 
 #define MICROPY_READER_VFS                          (1)
 #define MICROPY_PY_BUILTINS_INPUT                   (1)
@@ -47,6 +47,7 @@
 #include "modeth.h"
 #endif
 #include "modusocket.h"
+#include "modussl.h"
 #include "antenna.h"
 #include "modled.h"
 #include "esp_log.h"
@@ -186,8 +187,6 @@ void TASK_Micropython (void *pvParameters) {
     mp_thread_preinit(mpTaskStack, stack_len, chip_rev);
     mp_irq_preinit();
 #endif
-    /* Creat Socket Operation task */
-    modusocket_pre_init();
 
     // initialise the stack pointer for the main thread (must be done after mp_thread_preinit)
     mp_stack_set_top((void *)sp);
@@ -241,6 +240,7 @@ soft_reset:
     mp_hal_init(soft_reset);
     readline_init0();
     mod_network_init0();
+    modussl_init0();
     modbt_init0();
     machtimer_init0();
     modpycom_init0();
@@ -424,6 +424,10 @@ STATIC void mptask_init_sflash_filesystem_fatfs(void) {
     fs_user_mount_t *vfs_fat = &sflash_vfs_flash;
     vfs_fat->flags = 0;
     pyb_flash_init_vfs(vfs_fat);
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_init(&vfs_fat->stats);
+    sflash_disk_set_stats(&vfs_fat->stats);
+    #endif
 
     FILINFO fno;
 
@@ -508,6 +512,10 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
     sflash_disk_init();
     //Initialize the VFS object with the block device's functions
     pyb_flash_init_vfs_littlefs(vfs_littlefs);
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_init(&vfs_littlefs->stats);
+    sflash_disk_set_stats(&vfs_littlefs->stats);
+    #endif
 
     if(spi_flash_get_chip_size() > (4* 1024 * 1024))
     {
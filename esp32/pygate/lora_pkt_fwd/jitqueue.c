@@ -24,10 +24,9 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
-#define _GNU_SOURCE     /* needed for qsort_r to be defined */
-#include <stdlib.h>     /* qsort_r */
+#include <stdlib.h>
 #include <stdio.h>      /* printf, fprintf, snprintf, fopen, fputs */
-#include <string.h>     /* memset, memcpy */
+#include <string.h>     /* memset, memcpy, memmove */
 #include <pthread.h>
 #include <assert.h>
 #include <math.h>
@@ -38,6 +37,10 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
+/* Timestamps roll over, but queued packets are all within a few minutes of
+   the current time, so comparing their signed difference orders them */
+#define TIME_BEFORE(a, b)       ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 #define TX_START_DELAY          1500    /* microseconds */
@@ -51,6 +54,8 @@ Maintainer: Michael Coracin
                                             to ensure beacon can be sent */
 #define BEACON_RESERVED         2120000 /* Time on air of the beacon, with some margin */
 
+#define BLOCK_NONE              0xFF    /* End of a payload block list */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
@@ -58,6 +63,121 @@ static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control acce
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* Position in queue->order of the first packet not sent before count_us */
+static int jit_search(struct jit_queue_s *queue, uint32_t count_us) {
+    int lo = 0;
+    int hi = queue->num_pkt;
+    int mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (TIME_BEFORE(queue->nodes[queue->order[mid]].count_us, count_us)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Remove the packet at position pos of queue->order, and free its node */
+static void jit_remove(struct jit_queue_s *queue, int pos) {
+    int index = queue->order[pos];
+    struct jit_node_s *node = &queue->nodes[index];
+    uint8_t block;
+
+    if (node->pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon--;
+    }
+
+    /* return the payload blocks to the pool */
+    while (node->first_block != BLOCK_NONE) {
+        block = node->first_block;
+        node->first_block = queue->next_block[block];
+        queue->next_block[block] = queue->free_block;
+        queue->free_block = block;
+        queue->num_free_block++;
+    }
+
+    queue->num_pkt--;
+    memmove(&queue->order[pos], &queue->order[pos + 1], queue->num_pkt - pos);
+    queue->free_node[JIT_QUEUE_MAX - queue->num_pkt - 1] = index;
+}
+
+/* Drop the packet at position pos of queue->order if it is outdated */
+static bool jit_drop_outdated(struct jit_queue_s *queue, int pos, uint32_t time_us) {
+    struct jit_node_s *node = &queue->nodes[queue->order[pos]];
+
+    if ((node->count_us - time_us) < (uint32_t)TX_MAX_ADVANCE_DELAY) {
+        return false;
+    }
+
+    /* We drop the packet to avoid lock-up */
+    if (node->pkt_type == JIT_PKT_TYPE_BEACON) {
+        MSG_WARN("jitqueue: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, node->count_us);
+    } else {
+        MSG_WARN("jitqueue: --- Packet dropped (current_time=%u, packet_time=%u, p-c=%u(%f)) ---\n", time_us, node->count_us, (node->count_us-time_us),(node->count_us-(double)time_us) );
+    }
+    jit_remove(queue, pos);
+    return true;
+}
+
+bool jit_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
+    if (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
+            ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY))) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/* Look for a queued packet colliding with a new one. Returns its node index or -1.
+ *
+ *  Packets are only queued if they don't collide with any other, taking at
+ *  least TX_START_DELAY before the timestamp of a beacon, so the queued time
+ *  frames don't overlap and end in the same order as they start. The packet
+ *  before the new one is then the only one before that can collide. After
+ *  it, only the packets that start soon enough for their pre_delay to reach
+ *  the new packet need to be tested.
+ */
+static int jit_find_collision(struct jit_queue_s *queue, uint32_t count_us, uint32_t pre_delay, uint32_t post_delay, enum jit_pkt_type_e pkt_type) {
+    struct jit_node_s *node;
+    uint32_t target_pre_delay;
+    uint32_t max_pre_delay;
+    int pos = jit_search(queue, count_us);
+    int i;
+
+    /* We ignore Beacon Guard for Class A/C downlinks */
+    if ((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) {
+        max_pre_delay = TX_START_DELAY + TX_JIT_DELAY;
+    } else {
+        max_pre_delay = TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY;
+    }
+
+    for (i = (pos > 0) ? pos - 1 : 0; i < queue->num_pkt; i++) {
+        node = &queue->nodes[queue->order[i]];
+        if ((i >= pos) && ((node->count_us - count_us) > (max_pre_delay + post_delay + TX_MARGIN_DELAY))) {
+            break;
+        }
+
+        if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (node->pkt_type == JIT_PKT_TYPE_BEACON)) {
+            target_pre_delay = TX_START_DELAY;
+        } else {
+            target_pre_delay = node->pre_delay;
+        }
+
+        /* Check if there is a collision
+         *  Warning: unsigned arithmetic (handle roll-over)
+         *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
+         *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
+         */
+        if (jit_collision_test(count_us, pre_delay, post_delay, node->count_us, target_pre_delay, node->post_delay) == true) {
+            return queue->order[i];
+        }
+    }
+    return -1;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -92,64 +212,41 @@ void jit_queue_init(struct jit_queue_s *queue) {
 
     memset(queue, 0, sizeof(*queue));
     for (i = 0; i < JIT_QUEUE_MAX; i++) {
-        queue->nodes[i].pre_delay = 0;
-        queue->nodes[i].post_delay = 0;
+        queue->free_node[i] = JIT_QUEUE_MAX - 1 - i;
+        queue->nodes[i].first_block = BLOCK_NONE;
     }
-
-    pthread_mutex_unlock(&mx_jit_queue);
-}
-
-int compare(const void *a, const void *b, void *arg) {
-    struct jit_node_s *p = (struct jit_node_s *)a;
-    struct jit_node_s *q = (struct jit_node_s *)b;
-    int *counter = (int *)arg;
-    int p_count, q_count;
-
-    p_count = p->pkt.count_us;
-    q_count = q->pkt.count_us;
-
-    if (p_count > q_count) {
-        *counter = *counter + 1;
+    for (i = 0; i < JIT_PAYLOAD_BLOCKS; i++) {
+        queue->next_block[i] = (i + 1 < JIT_PAYLOAD_BLOCKS) ? i + 1 : BLOCK_NONE;
     }
+    queue->free_block = 0;
+    queue->num_free_block = JIT_PAYLOAD_BLOCKS;
 
-    return p_count - q_count;
-}
-
-void jit_sort_queue(struct jit_queue_s *queue) {
-    int counter = 0;
-
-    if (queue->num_pkt == 0) {
-        return;
-    }
-
-    //MSG_DEBUG("jit: sorting queue in ascending order packet timestamp - queue size:%u\n", queue->num_pkt);
-    qsort_r(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), compare, &counter);
-    //MSG_DEBUG("jit: sorting queue done - swapped:%d\n", counter);
-}
-
-bool jit_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
-    if (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
-            ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY))) {
-        return true;
-    } else {
-        return false;
-    }
+    pthread_mutex_unlock(&mx_jit_queue);
 }
 
 enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
     int i = 0;
+    int index;
     uint32_t time_us = time->tv_sec * 1000000UL + time->tv_usec; /* convert time in µs */
     uint32_t packet_post_delay = 0;
     uint32_t packet_pre_delay = 0;
-    uint32_t target_pre_delay = 0;
     enum jit_error_e err_collision = JIT_ERROR_OK;
     uint32_t asap_count_us;
+    struct jit_node_s *node;
+    uint8_t *block_link;
+    int num_block;
 
     if (packet == NULL) {
         MSG_ERROR("jitqueue: invalid parameter\n");
         return JIT_ERROR_INVALID;
     }
 
+    /* only size bytes of payload are queued, and copied back on dequeue */
+    if (packet->size > sizeof packet->payload) {
+        MSG_ERROR("jitqueue: invalid packet size %u\n", packet->size);
+        return JIT_ERROR_INVALID;
+    }
+
     MSG_INFO("jitqueue: Current concentrator tv_sec=%ld time_us=%u, pkt_type=%d, packet->count_us=%u, (c-t)=%u/%d us = %u/%d s\n", time->tv_sec, time_us, pkt_type, packet->count_us, (packet->count_us - time_us), (packet->count_us - time_us), (packet->count_us - time_us)/1000000U, (packet->count_us - time_us) /1000000U);
 
     if (jit_queue_is_full(queue)) {
@@ -187,40 +284,29 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
         if (queue->num_pkt == 0) {
             /* If the jit queue is empty, we can insert this packet */
             MSG_DEBUG("insert IMMEDIATE downlink, first in JiT queue (count_us=%u)\n", asap_count_us);
+        } else if (jit_find_collision(queue, asap_count_us, packet_pre_delay, packet_post_delay, pkt_type) < 0) {
+            /* No collision with ASAP time, we can insert it */
+            MSG_DEBUG("insert IMMEDIATE downlink ASAP at asap_count_us=%u (no collision)\n", asap_count_us);
         } else {
-            /* Else we can try to insert it:
-                - ASAP meaning NOW + MARGIN
-                - at the last index of the queue
-                - between 2 downlinks in the queue
-            */
-
-            /* First, try if the ASAP time collides with an already enqueued downlink */
-            for (i = 0; i < queue->num_pkt; i++) {
-                if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, queue->nodes[i].pre_delay, queue->nodes[i].post_delay) == true) {
-                    MSG_DEBUG("cannot insert IMMEDIATE downlink at asap_count_us=%u, collides with pkt.count_us=%u (index=%d)\n", asap_count_us, queue->nodes[i].pkt.count_us, i);
-                    break;
-                }
-            }
-            if (i == queue->num_pkt) {
-                /* No collision with ASAP time, we can insert it */
-                MSG_DEBUG("insert IMMEDIATE downlink ASAP at asap_count_us=%u (no collision)\n", asap_count_us);
-            } else {
-                /* Search for the best slot then */
-                for (i = 0; i < queue->num_pkt; i++) {
-                    asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
-                    if (i == (queue->num_pkt - 1)) {
-                        /* Last packet index, we can insert after this one */
-                        MSG_DEBUG("insert IMMEDIATE downlink, last in JiT queue (count_us=%u)\n", asap_count_us);
+            /* Else try to insert it after the packet it collides with, or
+               between 2 downlinks after it, or after the last one */
+            i = jit_search(queue, asap_count_us);
+            for (i = (i > 0) ? i - 1 : 0; i < queue->num_pkt; i++) {
+                node = &queue->nodes[queue->order[i]];
+                asap_count_us = node->count_us + node->post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
+                if (i == (queue->num_pkt - 1)) {
+                    /* Last packet index, we can insert after this one */
+                    MSG_DEBUG("insert IMMEDIATE downlink, last in JiT queue (count_us=%u)\n", asap_count_us);
+                } else {
+                    /* Check if packet can be inserted between this index and the next one */
+                    MSG_DEBUG("try to insert IMMEDIATE downlink (count_us=%u) between index %d and index %d?\n", asap_count_us, i, i + 1);
+                    node = &queue->nodes[queue->order[i + 1]];
+                    if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, node->count_us, node->pre_delay, node->post_delay) == true) {
+                        MSG_DEBUG("failed to insert IMMEDIATE downlink (asap_count_us=%u), continue...\n", asap_count_us);
+                        continue;
                     } else {
-                        /* Check if packet can be inserted between this index and the next one */
-                        MSG_DEBUG("try to insert IMMEDIATE downlink (count_us=%u) between index %d and index %d?\n", asap_count_us, i, i + 1);
-                        if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i + 1].pkt.count_us, queue->nodes[i + 1].pre_delay, queue->nodes[i + 1].post_delay) == true) {
-                            MSG_DEBUG("failed to insert IMMEDIATE downlink (asap_count_us=%u), continue...\n", asap_count_us);
-                            continue;
-                        } else {
-                            MSG_DEBUG("insert IMMEDIATE downlink (asap_count_us=%u)\n", asap_count_us);
-                            break;
-                        }
+                        MSG_DEBUG("insert IMMEDIATE downlink (asap_count_us=%u)\n", asap_count_us);
+                        break;
                     }
                 }
             }
@@ -265,56 +351,68 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
      *        - Valid for both Downlinks and beacon packets
      *        - Beacon guard can be ignored if we try to queue a Class A downlink
      */
-    for (i = 0; i < queue->num_pkt; i++) {
-        /* We ignore Beacon Guard for Class A/C downlinks */
-        if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON)) {
-            target_pre_delay = TX_START_DELAY;
-        } else {
-            target_pre_delay = queue->nodes[i].pre_delay;
+    index = jit_find_collision(queue, packet->count_us, packet_pre_delay, packet_post_delay, pkt_type);
+    if (index >= 0) {
+        switch (queue->nodes[index].pkt_type) {
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
+                MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with packet already programmed at %u (%u)\n", pkt_type, queue->nodes[index].count_us, packet->count_us);
+                err_collision = JIT_ERROR_COLLISION_PACKET;
+                break;
+            case JIT_PKT_TYPE_BEACON:
+                if (pkt_type != JIT_PKT_TYPE_BEACON) {
+                    /* do not overload logs for beacon/beacon collision, as it is expected to happen with beacon pre-scheduling algorith used */
+                    MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with beacon already programmed at %u (%u)\n", pkt_type, queue->nodes[index].count_us, packet->count_us);
+                }
+                err_collision = JIT_ERROR_COLLISION_BEACON;
+                break;
+            default:
+                MSG_ERROR("jitqueue: Unknown packet type, should not occur, BUG?\n");
+                assert(0);
+                break;
         }
+        pthread_mutex_unlock(&mx_jit_queue);
+        return err_collision;
+    }
 
-        /* Check if there is a collision
-         *  Warning: unsigned arithmetic (handle roll-over)
-         *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
-         *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
-         */
-        if (jit_collision_test(packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, target_pre_delay, queue->nodes[i].post_delay) == true) {
-            switch (queue->nodes[i].pkt_type) {
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
-                    MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with packet already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
-                    err_collision = JIT_ERROR_COLLISION_PACKET;
-                    break;
-                case JIT_PKT_TYPE_BEACON:
-                    if (pkt_type != JIT_PKT_TYPE_BEACON) {
-                        /* do not overload logs for beacon/beacon collision, as it is expected to happen with beacon pre-scheduling algorith used */
-                        MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with beacon already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
-                    }
-                    err_collision = JIT_ERROR_COLLISION_BEACON;
-                    break;
-                default:
-                    MSG_ERROR("jitqueue: Unknown packet type, should not occur, BUG?\n");
-                    assert(0);
-                    break;
-            }
-            pthread_mutex_unlock(&mx_jit_queue);
-            return err_collision;
-        }
+    /* Check there is room left in the payload pool */
+    num_block = (packet->size + JIT_PAYLOAD_BLOCK_SIZE - 1) / JIT_PAYLOAD_BLOCK_SIZE;
+    if (num_block > queue->num_free_block) {
+        MSG_ERROR("jitqueue: cannot enqueue packet, JIT payload pool is full\n");
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_FULL;
     }
 
     /* Finally enqueue it */
-    /* Insert packet at the end of the queue */
-    memcpy(&(queue->nodes[queue->num_pkt].pkt), packet, sizeof(struct lgw_pkt_tx_s));
-    queue->nodes[queue->num_pkt].pre_delay = packet_pre_delay;
-    queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
-    queue->nodes[queue->num_pkt].pkt_type = pkt_type;
+    /* Take a free node, and insert it in the queue order after the packets sent before it */
+    index = queue->free_node[JIT_QUEUE_MAX - queue->num_pkt - 1];
+    node = &queue->nodes[index];
+    memcpy(node->pkt, packet, JIT_PKT_META_SIZE);
+    node->count_us = packet->count_us;
+    node->pre_delay = packet_pre_delay;
+    node->post_delay = packet_post_delay;
+    node->pkt_type = pkt_type;
+
+    /* Copy the payload in blocks taken from the pool */
+    block_link = &node->first_block;
+    for (i = 0; i < num_block; i++) {
+        *block_link = queue->free_block;
+        queue->free_block = queue->next_block[*block_link];
+        memcpy(queue->payload[*block_link], packet->payload + i * JIT_PAYLOAD_BLOCK_SIZE,
+               (i == num_block - 1) ? packet->size - i * JIT_PAYLOAD_BLOCK_SIZE : JIT_PAYLOAD_BLOCK_SIZE);
+        block_link = &queue->next_block[*block_link];
+    }
+    *block_link = BLOCK_NONE;
+    queue->num_free_block -= num_block;
+
+    i = jit_search(queue, packet->count_us);
+    memmove(&queue->order[i + 1], &queue->order[i], queue->num_pkt - i);
+    queue->order[i] = index;
     if (pkt_type == JIT_PKT_TYPE_BEACON) {
         queue->num_beacon++;
     }
     queue->num_pkt++;
-    /* Sort the queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -327,6 +425,11 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 }
 
 enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e *pkt_type) {
+    struct jit_node_s *node;
+    uint8_t block;
+    int pos;
+    int i;
+
     if (packet == NULL) {
         MSG_ERROR("jitqueue: invalid parameter\n");
         return JIT_ERROR_INVALID;
@@ -344,21 +447,23 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 
     pthread_mutex_lock(&mx_jit_queue);
 
-    /* Dequeue requested packet */
-    memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
-    queue->num_pkt--;
-    *pkt_type = queue->nodes[index].pkt_type;
-    if (*pkt_type == JIT_PKT_TYPE_BEACON) {
-        queue->num_beacon--;
-        //MSG_DEBUG("jitqueue: --- Beacon dequeued ---\n");
+    /* Find the requested packet in the queue order */
+    node = &queue->nodes[index];
+    pos = jit_search(queue, node->count_us);
+    if ((pos == queue->num_pkt) || (queue->order[pos] != index)) {
+        MSG_ERROR("jitqueue: invalid parameter\n");
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_INVALID;
     }
 
-    /* Replace dequeued packet with last packet of the queue */
-    memcpy(&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-    memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
-
-    /* Sort queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
+    /* Dequeue requested packet */
+    memcpy(packet, node->pkt, JIT_PKT_META_SIZE);
+    for (i = 0, block = node->first_block; block != BLOCK_NONE; i += JIT_PAYLOAD_BLOCK_SIZE, block = queue->next_block[block]) {
+        memcpy(packet->payload + i, queue->payload[block],
+               (packet->size - i < JIT_PAYLOAD_BLOCK_SIZE) ? packet->size - i : JIT_PAYLOAD_BLOCK_SIZE);
+    }
+    *pkt_type = node->pkt_type;
+    jit_remove(queue, pos);
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -372,8 +477,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 
 enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx) {
     /* Return index of node containing a packet inline with given time */
-    int i = 0;
-    int idx_highest_priority = -1;
+    struct jit_node_s *node;
     uint32_t time_us;
 
     if ((time == NULL) || (pkt_idx == NULL)) {
@@ -389,56 +493,33 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
 
     pthread_mutex_lock(&mx_jit_queue);
 
-    /* Search for highest priority packet to be sent */
-    for (i = 0; i < queue->num_pkt; i++) {
-        /* First check if that packet is outdated:
-         *  If a packet seems too much in advance, and was not rejected at enqueue time,
-         *  it means that we missed it for peeking, we need to drop it
-         *
-         *  Warning: unsigned arithmetic
-         *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
-         */
-        if (queue->nodes[i].pkt.count_us >= time_us + TX_MAX_ADVANCE_DELAY) {
-            /* We drop the packet to avoid lock-up */
-            queue->num_pkt--;
-            if (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON) {
-                queue->num_beacon--;
-                MSG_WARN("jitqueue: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[i].pkt.count_us);
-            } else {
-                MSG_WARN("jitqueue: --- Packet dropped (current_time=%u, packet_time=%u, p-c=%u(%f)) ---\n", time_us, queue->nodes[i].pkt.count_us, (queue->nodes[i].pkt.count_us-time_us),(queue->nodes[i].pkt.count_us-(double)time_us) );
-            }
-
-            /* Replace dropped packet with last packet of the queue */
-            memcpy(&(queue->nodes[i]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-            memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
-
-            /* Sort queue in ascending order of packet timestamp */
-            jit_sort_queue(queue);
-
-            /* restart loop  after purge to find packet to be sent */
-            i = 0;
-            continue;
-        }
-
-        /* Then look for highest priority packet to be sent:
-         *  Warning: unsigned arithmetic (handle roll-over)
-         *      t_packet < t_highest
-         */
-        if ((idx_highest_priority == -1) || (((queue->nodes[i].pkt.count_us - time_us) < (queue->nodes[idx_highest_priority].pkt.count_us - time_us)))) {
-            idx_highest_priority = i;
-        }
+    /* First drop the outdated packets:
+     *  If a packet seems too much in advance, and was not rejected at enqueue time,
+     *  it means that we missed it for peeking, we need to drop it
+     *
+     *  Warning: unsigned arithmetic
+     *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
+     */
+    while ((queue->num_pkt > 0) && jit_drop_outdated(queue, 0, time_us)) {
+        /* missed packets are at the start of the queue */
+    }
+    while ((queue->num_pkt > 0) && jit_drop_outdated(queue, queue->num_pkt - 1, time_us)) {
+        /* packets really too much in advance at its end */
     }
 
     /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+     *  The highest priority packet is the first one of the queue.
      *  Warning: unsigned arithmetic (handle roll-over)
      *      t_packet < t_current + TX_JIT_DELAY
      */
-    if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY) {
-        *pkt_idx = idx_highest_priority;
-        //MSG_DEBUG("jit: peek packet with count_us=%u at index %d\n",
-        //          queue->nodes[idx_highest_priority].pkt.count_us, idx_highest_priority);
-    } else {
-        *pkt_idx = -1;
+    *pkt_idx = -1;
+    if (queue->num_pkt > 0) {
+        node = &queue->nodes[queue->order[0]];
+        if ((node->count_us - time_us) < TX_JIT_DELAY) {
+            *pkt_idx = queue->order[0];
+            //MSG_DEBUG("jit: peek packet with count_us=%u at index %d\n",
+            //          node->count_us, *pkt_idx);
+        }
     }
 
     pthread_mutex_unlock(&mx_jit_queue);
@@ -448,7 +529,6 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
 
 void jit_print_queue(struct jit_queue_s *queue, bool show_all) {
     int i = 0;
-    int loop_end;
 
     if (jit_queue_is_empty(queue)) {
         mp_printf(&mp_plat_print,"[jit] queue is empty\n");
@@ -457,15 +537,19 @@ void jit_print_queue(struct jit_queue_s *queue, bool show_all) {
 
         mp_printf(&mp_plat_print,"[jit] queue contains %d packets:\n", queue->num_pkt);
         mp_printf(&mp_plat_print,"[jit] queue contains %d beacons:\n", queue->num_beacon);
-        loop_end = (show_all == true) ? JIT_QUEUE_MAX : queue->num_pkt;
-        for (i = 0; i < loop_end; i++) {
+        mp_printf(&mp_plat_print,"[jit] payload pool has %d free blocks\n", queue->num_free_block);
+        for (i = 0; i < queue->num_pkt; i++) {
             mp_printf(&mp_plat_print," - node[%d]: count_us=%u - type=%d\n",
-                      i,
-                      queue->nodes[i].pkt.count_us,
-                      queue->nodes[i].pkt_type);
+                      queue->order[i],
+                      queue->nodes[queue->order[i]].count_us,
+                      queue->nodes[queue->order[i]].pkt_type);
+        }
+        if (show_all == true) {
+            for (i = queue->num_pkt; i < JIT_QUEUE_MAX; i++) {
+                mp_printf(&mp_plat_print," - node[%d]: free\n", queue->free_node[JIT_QUEUE_MAX - i - 1]);
+            }
         }
 
         pthread_mutex_unlock(&mx_jit_queue);
     }
 }
-
@@ -30,6 +30,7 @@ Maintainer: Michael Coracin
 
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* offsetof */
 #include <sys/time.h>   /* timeval */
 
 #include "loragw_hal.h"
@@ -37,8 +38,12 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
-#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
+#define JIT_QUEUE_MAX           64  /* Maximum number of packets to be stored in JiT queue */
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
+#define JIT_PAYLOAD_BLOCK_SIZE  64  /* Payloads are stored out of line, in blocks of this size */
+#define JIT_PAYLOAD_BLOCKS      128 /* Size of the payload pool, 32 packets of 256 bytes or more shorter ones */
+
+#define JIT_PKT_META_SIZE       offsetof(struct lgw_pkt_tx_s, payload) /* TX packet fields before the payload */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
@@ -66,18 +71,29 @@ enum jit_error_e {
 
 struct jit_node_s {
     /* API fields */
-    struct lgw_pkt_tx_s pkt;        /* TX packet */
+    uint8_t pkt[JIT_PKT_META_SIZE]; /* TX packet, without its payload */
     enum jit_pkt_type_e pkt_type;   /* Packet type: Downlink, Beacon... */
 
     /* Internal fields */
+    uint32_t count_us;              /* Packet timestamp, the key the queue is ordered by */
     uint32_t pre_delay;             /* Amount of time before packet timestamp to be reserved */
     uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
+    uint8_t first_block;            /* First block of the payload in the pool */
 };
 
+/* Nodes don't move once queued: the queue order is kept in an array of node
+   indexes, and the index of a node is what jit_peek and jit_dequeue use. */
 struct jit_queue_s {
     uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, beacons...) */
     uint8_t num_beacon;             /* Number of beacons in the queue */
+    uint8_t order[JIT_QUEUE_MAX];   /* Indexes of the queued nodes, in ascending order of timestamp */
+    uint8_t free_node[JIT_QUEUE_MAX]; /* Indexes of the unused nodes, JIT_QUEUE_MAX - num_pkt of them */
     struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+
+    uint8_t num_free_block;         /* Number of unused payload blocks */
+    uint8_t free_block;             /* First unused payload block */
+    uint8_t next_block[JIT_PAYLOAD_BLOCKS]; /* Next block of the same payload, or of the free list */
+    uint8_t payload[JIT_PAYLOAD_BLOCKS][JIT_PAYLOAD_BLOCK_SIZE]; /* Payload pool */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -127,7 +143,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 @brief Dequeue a packet from a Just-in-Time queue
 
 @param queue[in/out] Just in Time queue from which the packet should be removed
-@param index[in] in the queue where to get the packet to be removed
+@param index[in] node of the queue holding the packet to be removed
 @param packet[out] that was at index
 @param pkt_type[out] Type of packet dequeued: Downlink, Beacon
 @return success if the function was able to dequeue the packet
@@ -142,7 +158,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 
 @param queue[in] Just in Time queue to parse for peeking a packet
 @param time[in] Current concentrator time
-@param pkt_idx[out] Packet index which is soon to be dequeued.
+@param pkt_idx[out] Node index of the packet which is soon to be dequeued.
 @return success if the function was able to parse the queue. pkt_idx is set to -1 if no packet found.
 
 This function is typically used to check in JiT queue if there is a packet soon to be sent.
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host benchmark of the JiT queue: replays a generated trace of Class A
+    (RX1 then RX2 retry), Class B (ping slots and beacons) and Class C
+    downlinks, and reports the enqueue time and rejection rates.
+
+    The trace is replayed against jitqueue.c and against a reference queue
+    with the former layout (nodes holding whole packets, sorted with qsort
+    after every change, scanned linearly). Both must take the same
+    decisions and send the same packets in the same order. The reference
+    is then replayed with the former depth of 32 packets. Beforehand, a
+    packet whose size exceeds its payload buffer must be rejected.
+
+    jitqueue.c is included here, with the trace helpers replaced by host
+    ones. See README for how to build and run it.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* host replacements of trace.h */
+#define _LORA_PKTFWD_TRACE_H
+#define MSG_DEBUG(...)  (void)0
+#define MSG_INFO(...)   (void)0
+#define MSG_WARN(...)   (void)0
+#define MSG_ERROR(...)  (void)0
+#define mp_printf(p, ...) ((void)(p), printf(__VA_ARGS__))
+static int mp_plat_print;
+
+#include "jitqueue.c"
+
+#define TRACE_SECONDS   1800
+#define STEP_US         10000   /* the JiT thread polls the queue every 10 ms */
+#define UPLINK_RATE     2.0     /* uplinks per second */
+#define CLASS_A_RATIO   0.2     /* uplinks answered by a Class A downlink */
+#define CLASS_B_RATE    0.15    /* ping slot downlinks per second */
+#define CLASS_C_RATE    0.1     /* immediate downlinks per second */
+#define BEACON_PERIOD   128000000U
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST HAL ------------------------------------------------------------- */
+
+uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
+    int sf = 0;
+    double bw = (packet->bandwidth == BW_500KHZ) ? 500e3 : ((packet->bandwidth == BW_250KHZ) ? 250e3 : 125e3);
+    double tsym, nsym;
+
+    while (((uint32_t)DR_LORA_SF7 << sf) != packet->datarate) {
+        ++sf;
+    }
+    sf += 7;
+    tsym = (1 << sf) / bw * 1e3;
+    nsym = ceil((8.0 * packet->size - 4 * sf + 28 + 16) / (4 * (sf - ((sf >= 11) ? 2 : 0))));
+    return (uint32_t)(tsym * (packet->preamble + 4.25 + 8 + ((nsym > 0) ? nsym * 5 : 0)));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- REFERENCE QUEUE ------------------------------------------------------ */
+
+struct ref_node_s {
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e pkt_type;
+    uint32_t pre_delay;
+    uint32_t post_delay;
+};
+
+struct ref_queue_s {
+    int max;
+    int num_pkt;
+    struct ref_node_s nodes[JIT_QUEUE_MAX];
+};
+
+static int ref_compare(const void *a, const void *b) {
+    const struct ref_node_s *p = a;
+    const struct ref_node_s *q = b;
+    return (int32_t)(p->pkt.count_us - q->pkt.count_us);
+}
+
+static int ref_find_collision(struct ref_queue_s *queue, uint32_t count_us, uint32_t pre_delay, uint32_t post_delay, enum jit_pkt_type_e pkt_type) {
+    uint32_t target_pre_delay;
+    int i;
+
+    for (i = 0; i < queue->num_pkt; i++) {
+        if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON)) {
+            target_pre_delay = TX_START_DELAY;
+        } else {
+            target_pre_delay = queue->nodes[i].pre_delay;
+        }
+        if (jit_collision_test(count_us, pre_delay, post_delay, queue->nodes[i].pkt.count_us, target_pre_delay, queue->nodes[i].post_delay)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static enum jit_error_e ref_enqueue(struct ref_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
+    uint32_t pre_delay, post_delay;
+    int i;
+
+    if (queue->num_pkt == queue->max) {
+        return JIT_ERROR_FULL;
+    }
+    if (pkt_type == JIT_PKT_TYPE_BEACON) {
+        pre_delay = TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY;
+        post_delay = BEACON_RESERVED;
+    } else {
+        pre_delay = TX_START_DELAY + TX_JIT_DELAY;
+        post_delay = lgw_time_on_air(packet) * 1000UL;
+    }
+
+    if (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C) {
+        packet->tx_mode = TIMESTAMPED;
+        packet->count_us = time_us + 1000000;
+        if ((queue->num_pkt > 0) && (ref_find_collision(queue, packet->count_us, pre_delay, post_delay, pkt_type) >= 0)) {
+            for (i = 0; (i < queue->num_pkt) && (int32_t)(queue->nodes[i].pkt.count_us - packet->count_us) < 0; i++) {
+            }
+            for (i = (i > 0) ? i - 1 : 0; i < queue->num_pkt; i++) {
+                packet->count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
+                if ((i == queue->num_pkt - 1) || !jit_collision_test(packet->count_us, pre_delay, post_delay, queue->nodes[i + 1].pkt.count_us, queue->nodes[i + 1].pre_delay, queue->nodes[i + 1].post_delay)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if ((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_B)) {
+        if (packet->count_us > time_us + TX_MAX_ADVANCE_DELAY) {
+            return JIT_ERROR_TOO_EARLY;
+        }
+    }
+
+    i = ref_find_collision(queue, packet->count_us, pre_delay, post_delay, pkt_type);
+    if (i >= 0) {
+        return (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON) ? JIT_ERROR_COLLISION_BEACON : JIT_ERROR_COLLISION_PACKET;
+    }
+
+    queue->nodes[queue->num_pkt].pkt = *packet;
+    queue->nodes[queue->num_pkt].pkt_type = pkt_type;
+    queue->nodes[queue->num_pkt].pre_delay = pre_delay;
+    queue->nodes[queue->num_pkt].post_delay = post_delay;
+    queue->num_pkt++;
+    qsort(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), ref_compare);
+    return JIT_ERROR_OK;
+}
+
+/* peek and dequeue in one go, returns false if there's nothing to send */
+static bool ref_dequeue(struct ref_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet) {
+    int i, best = -1;
+
+    for (i = 0; i < queue->num_pkt; i++) {
+        if ((queue->nodes[i].pkt.count_us - time_us) >= (uint32_t)TX_MAX_ADVANCE_DELAY) {
+            queue->nodes[i] = queue->nodes[--queue->num_pkt];
+            qsort(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), ref_compare);
+            i = -1;
+            best = -1;
+            continue;
+        }
+        if ((best == -1) || ((queue->nodes[i].pkt.count_us - time_us) < (queue->nodes[best].pkt.count_us - time_us))) {
+            best = i;
+        }
+    }
+    if ((best == -1) || ((queue->nodes[best].pkt.count_us - time_us) >= TX_JIT_DELAY)) {
+        return false;
+    }
+    *packet = queue->nodes[best].pkt;
+    queue->nodes[best] = queue->nodes[--queue->num_pkt];
+    qsort(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), ref_compare);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- TRACE REPLAY --------------------------------------------------------- */
+
+enum { CLASS_A_RX1, CLASS_A_RX2, CLASS_B, CLASS_C, BEACON, NB_KIND };
+static const char *kind_name[NB_KIND] = { "class A RX1", "class A RX2", "class B", "class C", "beacon" };
+
+struct stats_s {
+    unsigned nb[NB_KIND];
+    unsigned rejected[NB_KIND];
+    unsigned full[NB_KIND];
+    unsigned sent;
+    double enqueue_ns;
+    double enqueue_max_ns;
+    unsigned enqueues;
+};
+
+static struct jit_queue_s jit;
+static struct ref_queue_s ref;
+static uint32_t rnd_state;
+
+static uint32_t rnd(void) {
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+static bool chance(double p) {
+    return (rnd() & 0xFFFF) < p * 65536;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_packet(struct lgw_pkt_tx_s *p, uint32_t count_us) {
+    int i;
+    memset(p, 0, sizeof(*p));
+    p->freq_hz = 869525000;
+    p->tx_mode = TIMESTAMPED;
+    p->count_us = count_us;
+    p->rf_power = 14;
+    p->modulation = MOD_LORA;
+    p->bandwidth = BW_125KHZ;
+    p->datarate = DR_LORA_SF7 << (rnd() % 4);
+    p->coderate = CR_LORA_4_5;
+    p->invert_pol = true;
+    p->preamble = 8;
+    p->size = 12 + rnd() % 40;
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = rnd();
+    }
+}
+
+static int enqueue(bool use_ref, uint32_t time_us, struct lgw_pkt_tx_s *p, enum jit_pkt_type_e type, struct stats_s *st) {
+    struct timeval tv = { time_us / 1000000, time_us % 1000000 };
+    double t = now_ns();
+    int r = use_ref ? ref_enqueue(&ref, time_us, p, type) : jit_enqueue(&jit, &tv, p, type);
+    t = now_ns() - t;
+    st->enqueue_ns += t;
+    st->enqueues++;
+    if (t > st->enqueue_max_ns) {
+        st->enqueue_max_ns = t;
+    }
+    return r;
+}
+
+static void submit(bool use_ref, uint32_t time_us, struct lgw_pkt_tx_s *p, enum jit_pkt_type_e type, int kind, struct stats_s *st, int *log, int *nlog) {
+    int r = enqueue(use_ref, time_us, p, type, st);
+    st->nb[kind]++;
+    if (r != JIT_ERROR_OK) {
+        st->rejected[kind]++;
+    }
+    if (r == JIT_ERROR_FULL) {
+        st->full[kind]++;
+    }
+    log[(*nlog)++] = r;
+}
+
+/* Replays the trace, recording the enqueue results and the sent packets */
+static void replay(bool use_ref, struct stats_s *st, int *log, int *nlog, uint32_t *sent, unsigned *nsent) {
+    struct lgw_pkt_tx_s p, rx2;
+    struct timeval tv;
+    enum jit_pkt_type_e type;
+    uint32_t t, next_beacon = BEACON_PERIOD;
+    int idx, r;
+
+    memset(st, 0, sizeof(*st));
+    *nlog = 0;
+    *nsent = 0;
+    rnd_state = 42;
+    jit_queue_init(&jit);
+    ref.num_pkt = 0;
+
+    for (t = 0; t < TRACE_SECONDS * 1000000U; t += STEP_US) {
+        /* keep the next beacons in the queue */
+        while (next_beacon - t <= JIT_NUM_BEACON_IN_QUEUE * BEACON_PERIOD) {
+            make_packet(&p, next_beacon);
+            p.datarate = DR_LORA_SF9;
+            p.size = 17;
+            submit(use_ref, t, &p, JIT_PKT_TYPE_BEACON, BEACON, st, log, nlog);
+            next_beacon += BEACON_PERIOD;
+        }
+        /* Class A: answer in RX1, the server retries in RX2 on rejection */
+        if (chance(UPLINK_RATE * STEP_US / 1e6 * CLASS_A_RATIO)) {
+            make_packet(&p, t + 1000000 + rnd() % STEP_US);
+            rx2 = p;
+            rx2.count_us += 1000000;
+            rx2.datarate = DR_LORA_SF12;
+            submit(use_ref, t, &p, JIT_PKT_TYPE_DOWNLINK_CLASS_A, CLASS_A_RX1, st, log, nlog);
+            if (log[*nlog - 1] != JIT_ERROR_OK) {
+                submit(use_ref, t, &rx2, JIT_PKT_TYPE_DOWNLINK_CLASS_A, CLASS_A_RX2, st, log, nlog);
+            }
+        }
+        /* Class B: a ping slot of the current or next beacon period */
+        if (chance(CLASS_B_RATE * STEP_US / 1e6)) {
+            make_packet(&p, next_beacon - BEACON_PERIOD + BEACON_RESERVED + (rnd() % 4096) * 30000);
+            if ((int32_t)(p.count_us - t) < 2000000) {
+                p.count_us += BEACON_PERIOD;
+            }
+            submit(use_ref, t, &p, JIT_PKT_TYPE_DOWNLINK_CLASS_B, CLASS_B, st, log, nlog);
+        }
+        /* Class C */
+        if (chance(CLASS_C_RATE * STEP_US / 1e6)) {
+            make_packet(&p, 0);
+            p.tx_mode = IMMEDIATE;
+            submit(use_ref, t, &p, JIT_PKT_TYPE_DOWNLINK_CLASS_C, CLASS_C, st, log, nlog);
+        }
+
+        /* JiT thread */
+        for (;;) {
+            if (use_ref) {
+                if (!ref_dequeue(&ref, t, &p)) {
+                    break;
+                }
+            } else {
+                tv.tv_sec = t / 1000000;
+                tv.tv_usec = t % 1000000;
+                if ((jit_peek(&jit, &tv, &idx) != JIT_ERROR_OK) || (idx < 0)) {
+                    break;
+                }
+                r = jit_dequeue(&jit, idx, &p, &type);
+                if (r != JIT_ERROR_OK) {
+                    printf("dequeue failed: %d\n", r);
+                    exit(1);
+                }
+            }
+            sent[(*nsent)++] = p.count_us ^ (p.size << 24) ^ (p.payload[p.size - 1] << 16);
+            st->sent++;
+        }
+    }
+}
+
+/* a size larger than the payload buffer, as a server can send, is rejected
+   rather than copied past it; the largest valid one goes through whole */
+static int check_sizes(void) {
+    struct lgw_pkt_tx_s p, out;
+    struct timeval tv = { 0, 0 };
+    enum jit_pkt_type_e type;
+    uint32_t t;
+    int idx = -1;
+    unsigned i;
+
+    jit_queue_init(&jit);
+    make_packet(&p, 1000000);
+    p.size = 1000;
+    if ((jit_enqueue(&jit, &tv, &p, JIT_PKT_TYPE_DOWNLINK_CLASS_A) != JIT_ERROR_INVALID) || !jit_queue_is_empty(&jit)) {
+        printf("oversized packet not rejected\n");
+        return 1;
+    }
+    p.size = sizeof p.payload;
+    for (i = 0; i < p.size; i++) {
+        p.payload[i] = i;
+    }
+    if (jit_enqueue(&jit, &tv, &p, JIT_PKT_TYPE_DOWNLINK_CLASS_A) != JIT_ERROR_OK) {
+        printf("largest packet rejected\n");
+        return 1;
+    }
+    for (t = 0; (idx < 0) && (t < 1000000); t += STEP_US) {
+        tv.tv_sec = t / 1000000;
+        tv.tv_usec = t % 1000000;
+        jit_peek(&jit, &tv, &idx);
+    }
+    if ((idx < 0) || (jit_dequeue(&jit, idx, &out, &type) != JIT_ERROR_OK) ||
+        (out.size != p.size) || (memcmp(out.payload, p.payload, p.size) != 0)) {
+        printf("largest packet not dequeued whole\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void report(const char *name, struct stats_s *st) {
+    int k;
+    printf("%s: enqueue %.0f ns avg, %.0f ns max, %u packets sent\n", name, st->enqueue_ns / st->enqueues, st->enqueue_max_ns, st->sent);
+    for (k = 0; k < NB_KIND; k++) {
+        printf("    %-12s %6u, %5.1f%% rejected, %5.1f%% as the queue was full\n", kind_name[k], st->nb[k],
+               st->nb[k] ? 100.0 * st->rejected[k] / st->nb[k] : 0.0, st->nb[k] ? 100.0 * st->full[k] / st->nb[k] : 0.0);
+    }
+}
+
+int main(void) {
+    static int log_jit[1000000], log_ref[1000000];
+    static uint32_t sent_jit[1000000], sent_ref[1000000];
+    struct stats_s st_jit, st_ref;
+    int nlog_jit, nlog_ref, i;
+    unsigned nsent_jit, nsent_ref;
+
+    if (check_sizes() != 0) {
+        return 1;
+    }
+    replay(false, &st_jit, log_jit, &nlog_jit, sent_jit, &nsent_jit);
+    ref.max = JIT_QUEUE_MAX;
+    replay(true, &st_ref, log_ref, &nlog_ref, sent_ref, &nsent_ref);
+    if ((nlog_jit != nlog_ref) || (nsent_jit != nsent_ref)) {
+        printf("traces differ: %d/%d enqueues, %u/%u sent\n", nlog_jit, nlog_ref, nsent_jit, nsent_ref);
+        return 1;
+    }
+    for (i = 0; i < nlog_jit; i++) {
+        if (log_jit[i] != log_ref[i]) {
+            printf("enqueue %d: %d instead of %d\n", i, log_jit[i], log_ref[i]);
+            return 1;
+        }
+    }
+    for (i = 0; i < (int)nsent_jit; i++) {
+        if (sent_jit[i] != sent_ref[i]) {
+            printf("sent packet %d differs\n", i);
+            return 1;
+        }
+    }
+    printf("%d s trace, same decisions and packets sent by both queues\n\n", TRACE_SECONDS);
+    report("jitqueue, depth " "64", &st_jit);
+    report("reference, depth 64", &st_ref);
+    ref.max = 32;
+    replay(true, &st_ref, log_ref, &nlog_ref, sent_ref, &nsent_ref);
+    report("reference, depth 32", &st_ref);
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -57,6 +57,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "timersync.h"
 #include "parson.h"
 #include "base64.h"
+#include "rxpk_json.h"
+#include "txpk_json.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
@@ -97,6 +99,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PUSH_TIMEOUT_MS     100
 #define PULL_TIMEOUT_MS     200
 #define FETCH_SLEEP_MS      50          /* nb of ms waited when a fetch return no packets */
+#define DEFAULT_FETCH_BATCH 8           /* default nb of packets fetched from the concentrator at once */
+#define DEFAULT_PUSH_LATENCY 20         /* default max time (in ms) a packet waits for others to share its datagram */
 
 #define PROTOCOL_VERSION    2           /* v1.3 */
 
@@ -107,7 +111,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PKT_PULL_ACK    4
 #define PKT_TX_ACK      5
 
-#define NB_PKT_MAX      2 /* max number of packets per fetch/send cycle */
+#define NB_PKT_MAX      LGW_PKT_FIFO_SIZE /* max number of packets per fetch cycle */
 
 #define MIN_LORA_PREAMB 6 /* minimum Lora preamble length for this application */
 #define STD_LORA_PREAMB 8
@@ -115,7 +119,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define STD_FSK_PREAMB  5
 
 #define STATUS_SIZE     200
-#define TX_BUFF_SIZE    ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
+#define TX_BUFF_SIZE    1460 /* PUSH_DATA datagrams are kept under the usual path MTU */
+#define DGRAM_RXPK_START (12 + 9) /* header and {"rxpk":[ */
+#define DGRAM_RXPK_END  (TX_BUFF_SIZE - STATUS_SIZE - 4) /* room left for ], the report, } and terminator */
+#define PUSH_ACK_WINDOW 4 /* nb of PUSH_DATA datagrams waiting for their acknowledge */
 
 #define NI_NUMERICHOST	1	/* return the host address, not the name */
 
@@ -176,6 +183,15 @@ static int sock_down; /* socket for downstream traffic */
 /* network protocol variables */
 static struct timeval push_timeout_half = {0, (PUSH_TIMEOUT_MS * 500)}; /* cut in half, critical for throughput */
 static struct timeval pull_timeout = {0, (PULL_TIMEOUT_MS * 1000)}; /* non critical for throughput */
+static unsigned fetch_batch = DEFAULT_FETCH_BATCH; /* nb of packets fetched from the concentrator at once */
+static unsigned push_latency_ms = DEFAULT_PUSH_LATENCY; /* max time a packet waits for others to share its datagram */
+
+/* PUSH_DATA datagrams sent and not acknowledged yet, indexed by token */
+static struct push_ack_s {
+    uint16_t token;
+    bool pending;
+    struct timeval send_time;
+} push_ack[PUSH_ACK_WINDOW];
 
 /* hardware access control and correction */
 pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the concentrator */
@@ -704,6 +720,23 @@ static int parse_gateway_configuration(const char * conf_file) {
         MSG_INFO("[main] upstream PUSH_DATA time-out is configured to %u ms\n", (unsigned)(push_timeout_half.tv_usec / 500));
     }
 
+    /* get nb of packets fetched from the concentrator at once (optional) */
+    val = json_object_get_value(conf_obj, "fetch_batch");
+    if (val != NULL) {
+        fetch_batch = (unsigned)json_value_get_number(val);
+        if ((fetch_batch == 0) || (fetch_batch > NB_PKT_MAX)) {
+            fetch_batch = NB_PKT_MAX;
+        }
+        MSG_INFO("[main] upstream fetch batch is configured to %u packets\n", fetch_batch);
+    }
+
+    /* get max time (in ms) a received packet waits before being sent upstream (optional) */
+    val = json_object_get_value(conf_obj, "push_latency_ms");
+    if (val != NULL) {
+        push_latency_ms = (unsigned)json_value_get_number(val);
+        MSG_INFO("[main] upstream PUSH_DATA latency is configured to %u ms\n", push_latency_ms);
+    }
+
     /* packet filtering parameters */
     val = json_object_get_value(conf_obj, "forward_crc_valid");
     if (json_value_get_type(val) == JSONBoolean) {
@@ -1014,6 +1047,9 @@ void TASK_lora_gw(void *pvParameters) {
     /* GPS coordinates variables */
     struct coord_s cp_gps_coord = {0.0, 0.0, 0};
 
+    /* concentrator clock model */
+    struct timersync_stats_s cp_timersync;
+
     /* statistics variable */
     time_t t;
     char stat_timestamp[24];
@@ -1380,6 +1416,12 @@ void TASK_lora_gw(void *pvParameters) {
         }
         mp_printf(&mp_plat_print, "### [JIT] ###\n");
         jit_print_queue (&jit_queue, false);
+        timersync_get_stats(&cp_timersync);
+        if (cp_timersync.drift_valid) {
+            mp_printf(&mp_plat_print, "# Concentrator clock drift: %.2f ppm, jitter: %u us rms, %u us max (%u samples, %u resets)\n", cp_timersync.drift_ppm, cp_timersync.jitter_rms_us, cp_timersync.jitter_max_us, cp_timersync.nb_samples, cp_timersync.nb_resets);
+        } else {
+            mp_printf(&mp_plat_print, "# Concentrator clock drift: not estimated yet (%u samples, %u resets)\n", cp_timersync.nb_samples, cp_timersync.nb_resets);
+        }
         mp_printf(&mp_plat_print, "### [GPS] ###\n");
         if (gps_fake_enable == true) {
             mp_printf(&mp_plat_print, "# GPS *FAKE* coordinates: latitude %.5f, longitude %.5f, altitude %i m\n", cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt);
@@ -1425,28 +1467,85 @@ void TASK_lora_gw(void *pvParameters) {
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
 
+/* Close the PUSH_DATA datagram composed in buff, adding the status report
+   when send_report is set, send it and register it in the window of
+   datagrams waiting for their PUSH_ACK */
+static void push_data_send(uint8_t *buff, int buff_index, unsigned pkt_in_dgram, bool send_report) {
+    static uint16_t token = 0;
+    struct push_ack_s *a = &push_ack[token % PUSH_ACK_WINDOW];
+    int j;
+
+    if (pkt_in_dgram == 0) {
+        /* report only, need to clean up the beginning of the payload */
+        buff_index -= 8; /* removes "rxpk":[ */
+    } else {
+        /* end of packet array, add separator if needed */
+        buff[buff_index++] = ']';
+        if (send_report == true) {
+            buff[buff_index++] = ',';
+        }
+    }
+
+    /* add status report if a new one is available */
+    if (send_report == true) {
+        pthread_mutex_lock(&mx_stat_rep);
+        report_ready = false;
+        j = strlen(status_report);
+        memcpy(buff + buff_index, status_report, j);
+        pthread_mutex_unlock(&mx_stat_rep);
+        buff_index += j;
+    }
+
+    /* end of JSON datagram payload */
+    buff[buff_index++] = '}';
+    buff[buff_index] = 0; /* add string terminator, for safety */
+
+    buff[1] = (uint8_t)(token >> 8);
+    buff[2] = (uint8_t)(token & 0x00FF);
+    MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u] with %u packets: %s\n", buff[1], buff[2], pkt_in_dgram, (char *)(buff + 12)); /* DEBUG: display JSON payload */
+
+    /* send datagram to server */
+    send(sock_up, (void *)buff, buff_index, 0);
+
+    if (a->pending) {
+        MSG_WARN("[up  ] PUSH_ACK recieve timeout [%u:%u]\n", a->token >> 8, a->token & 0x00FF);
+    }
+    a->token = token++;
+    a->pending = true;
+    gettimeofday(&a->send_time, NULL);
+
+    pthread_mutex_lock(&mx_meas_up);
+    meas_up_dgram_sent += 1;
+    meas_up_network_byte += buff_index;
+    pthread_mutex_unlock(&mx_meas_up);
+}
+
 void thread_up(void) {
     MSG_INFO("[up  ] start\n");
     int i, j; /* loop variables */
-    unsigned pkt_in_dgram; /* nb on Lora packet in the current datagram */
+    unsigned pkt_in_dgram = 0; /* nb on Lora packet in the current datagram */
+    int sep; /* inter-packet separator length */
 
-    /* allocate memory for packet fetching and processing */
-    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
+    /* allocate memory for packet fetching and processing, static as it
+       doesn't fit the thread stack with a full FIFO worth of packets */
+    static struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
     int nb_pkt;
 
     /* data buffers */
-    uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
-    int buff_index;
+    static uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
+    int buff_index = DGRAM_RXPK_START;
     uint8_t buff_ack[32]; /* buffer to receive acknowledges */
 
     /* protocol variables */
-    uint8_t token_h = 0; /* random token for acknowledgement matching */
-    uint8_t token_l = 0; /* random token for acknowledgement matching */
-    static uint16_t token = 0;
-    /* ping measurement variables */
-    struct timeval send_time;
-    struct timeval recv_time;
+    struct push_ack_s *a;
+    uint16_t ack_token;
+    long ack_timeout_ms = push_timeout_half.tv_usec / 500; /* twice the half timeout, in ms */
+
+    /* ping measurement and coalescing variables */
+    struct timeval now;
+    struct timeval dgram_time; /* reception time of the first packet of the datagram */
+    long elapsed_ms = 0;
 
     /* report management variable */
     bool send_report = false;
@@ -1455,55 +1554,56 @@ void thread_up(void) {
     uint32_t mote_addr = 0;
     uint16_t mote_fcnt = 0;
 
-    /* set upstream socket RX timeout */
-    i = setsockopt(sock_up, SOL_SOCKET, SO_RCVTIMEO, (void *)&push_timeout_half, sizeof push_timeout_half);
-    if (i != 0) {
-        MSG_ERROR("[up  ] setsockopt returned %s\n", strerror(errno));
-        quit_sig = true;
-        machine_pygate_set_status(PYGATE_ERROR);
-    }
-
     /* pre-fill the data buffer with fixed fields */
     buff_up[0] = PROTOCOL_VERSION;
     buff_up[3] = PKT_PUSH_DATA;
     *(uint32_t *)(buff_up + 4) = net_mac_h;
     *(uint32_t *)(buff_up + 8) = net_mac_l;
+    memcpy((void *)(buff_up + 12), (void *)"{\"rxpk\":[", 9);
 
     while (!exit_sig && !quit_sig) {
+        /* collect the acknowledges that have arrived, without waiting for them */
+        while ((j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, MSG_DONTWAIT)) != -1) {
+            if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK)) {
+                MSG_WARN("[up  ] ignored invalid non-ACL packet\n");
+                continue;
+            }
+            ack_token = ((uint16_t)buff_ack[1] << 8) | buff_ack[2];
+            a = &push_ack[ack_token % PUSH_ACK_WINDOW];
+            if (!a->pending || (a->token != ack_token)) {
+                MSG_WARN("[up  ] ignored out-of sync PUSH_ACK packet [%u:%u]\n", buff_ack[1], buff_ack[2]);
+                continue;
+            }
+            gettimeofday(&now, NULL);
+            MSG_DEBUG("[up  ] received PUSH_ACK [%u:%u] in %i ms\n", buff_ack[1], buff_ack[2], (int)(1000 * time_diff(a->send_time, now)));
+            a->pending = false;
+            pthread_mutex_lock(&mx_meas_up);
+            meas_up_ack_rcv += 1;
+            pthread_mutex_unlock(&mx_meas_up);
+        }
+        gettimeofday(&now, NULL);
+        for (a = push_ack; a < push_ack + PUSH_ACK_WINDOW; ++a) {
+            if (a->pending && (1000 * time_diff(a->send_time, now) > ack_timeout_ms)) {
+                MSG_WARN("[up  ] PUSH_ACK recieve timeout [%u:%u]\n", a->token >> 8, a->token & 0x00FF);
+                a->pending = false;
+            }
+        }
+
         /* fetch packets */
         pthread_mutex_lock(&mx_concent);
-        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);  // Crashing here
+        nb_pkt = lgw_receive(fetch_batch, rxpkt);
         pthread_mutex_unlock(&mx_concent);
         if (nb_pkt == LGW_HAL_ERROR) {
             MSG_ERROR("[up  ] failed packet fetch, exiting\n");
             //exit(EXIT_FAILURE);
+            nb_pkt = 0;
         }
 
         /* check if there are status report to send */
         send_report = report_ready; /* copy the variable so it doesn't change mid-function */
         /* no mutex, we're only reading */
 
-        /* wait a short time if no packets, nor status report */
-        if ((nb_pkt == 0) && (send_report == false)) {
-            wait_ms ((FETCH_SLEEP_MS));
-            continue;
-        }
-
-        /* start composing datagram with the header */
-        token_h = (uint8_t)(token >> 8); // (uint8_t)rand(); /* random token */
-        token_l =  (uint8_t)(token & 0x00FF); //(uint8_t)rand(); /* random token */
-
-        buff_up[1] = token_h;
-        buff_up[2] = token_l;
-        token++;
-        buff_index = 12; /* 12-byte header */
-
-        /* start of JSON structure */
-        memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-        buff_index += 9;
-
         /* serialize Lora packets metadata and payload */
-        pkt_in_dgram = 0;
         for (i = 0; i < nb_pkt; ++i) {
             p = &rxpkt[i];
 
@@ -1524,7 +1624,6 @@ void thread_up(void) {
                 case STAT_CRC_OK:
                     meas_nb_rx_ok += 1;
                     MSG_INFO("[up  ] received pkt from mote: %08X (fcnt=%u/%X), RSSI %.1f\n", mote_addr, mote_fcnt, mote_fcnt, p->rssi);
-                    //printf("RSSI %.1f\n", p->rssi);
                     if (!fwd_valid_pkt) {
                         pthread_mutex_unlock(&mx_meas_up);
                         continue; /* skip that packet */
@@ -1554,281 +1653,58 @@ void thread_up(void) {
             meas_up_payload_byte += p->size;
             pthread_mutex_unlock(&mx_meas_up);
 
-            /* Start of packet, add inter-packet separator if necessary */
-            if (pkt_in_dgram == 0) {
-                buff_up[buff_index] = '{';
-                ++buff_index;
-            } else {
-                buff_up[buff_index] = ',';
-                buff_up[buff_index + 1] = '{';
-                buff_index += 2;
-            }
-
-            /* RAW timestamp, 8-17 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "\"tmst\":%u", p->count_us);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-            }
-
-            /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6));
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet status, 9-10 useful chars */
-            switch (p->status) {
-                case STAT_CRC_OK:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":1", 9);
-                    buff_index += 9;
-                    break;
-                case STAT_CRC_BAD:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":-1", 10);
-                    buff_index += 10;
-                    break;
-                case STAT_NO_CRC:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":0", 9);
-                    buff_index += 9;
-                    break;
-                default:
-                    MSG_ERROR("[up  ] received packet with unknown status\n");
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":?", 9);
-                    buff_index += 9;
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet modulation, 13-14 useful chars */
-            if (p->modulation == MOD_LORA) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-                buff_index += 14;
-
-                /* Lora datarate & bandwidth, 16-19 useful chars */
-                switch (p->datarate) {
-                    case DR_LORA_SF7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF7", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF8", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF9:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF9", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF10:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF10", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF11:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF11", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF12:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF12", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown datarate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF?", 12);
-                        buff_index += 12;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-                switch (p->bandwidth) {
-                    case BW_125KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW125\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_250KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW250\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_500KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW500\"", 6);
-                        buff_index += 6;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown bandwidth\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW?\"", 4);
-                        buff_index += 4;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Packet ECC coding rate, 11-13 useful chars */
-                switch (p->coderate) {
-                    case CR_LORA_4_5:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_6:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/6\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/7\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/8\"", 13);
-                        buff_index += 13;
-                        break;
-                    case 0: /* treat the CR0 case (mostly false sync) */
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"OFF\"", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown coderate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"?\"", 11);
-                        buff_index += 11;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Lora SNR, 11-13 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"lsnr\":%.1f", p->snr);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-                }
-            } else if (p->modulation == MOD_FSK) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"FSK\"", 13);
-                buff_index += 13;
-
-                /* FSK datarate, 11-14 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"datr\":%u", p->datarate);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-                }
-            } else {
-                MSG_ERROR("[up  ] received packet with unknown modulation\n");
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
+            /* serialize the packet after the previous one, sending the
+               datagram first if it is full */
+            sep = (pkt_in_dgram == 0) ? 0 : 1;
+            j = rxpk_json(p, (char *)(buff_up + buff_index + sep), DGRAM_RXPK_END - buff_index - sep);
+            if (j == 0) {
+                push_data_send(buff_up, buff_index, pkt_in_dgram, false);
+                buff_index = DGRAM_RXPK_START;
+                pkt_in_dgram = 0;
+                sep = 0;
+                j = rxpk_json(p, (char *)(buff_up + buff_index), DGRAM_RXPK_END - buff_index);
             }
-
-            /* Packet RSSI, payload size, 18-23 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"rssi\":%.0f,\"size\":%u", p->rssi, p->size);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
+            if (j < 0) {
+                MSG_ERROR("[up  ] received packet with unknown modulation, datarate, bandwidth or coderate\n");
                 quit_sig = true;
                 machine_pygate_set_status(PYGATE_ERROR);
+                continue;
             }
-
-            /* Packet base64-encoded payload, 14-350 useful chars */
-            memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-            buff_index += 9;
-            j = bin_to_b64(p->payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-            if (j >= 0) {
-                buff_index += j;
+            if (pkt_in_dgram == 0) {
+                gettimeofday(&dgram_time, NULL);
             } else {
-                MSG_ERROR("[up  ] bin_to_b64 failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
+                buff_up[buff_index] = ',';
             }
-            buff_up[buff_index] = '"';
-            ++buff_index;
-
-            /* End of packet serialization */
-            buff_up[buff_index] = '}';
-            ++buff_index;
+            buff_index += sep + j;
             ++pkt_in_dgram;
         }
 
-        /* restart fetch sequence without sending empty JSON if all packets have been filtered out */
-        if (pkt_in_dgram == 0) {
-            if (send_report == true) {
-                /* need to clean up the beginning of the payload */
-                buff_index -= 8; /* removes "rxpk":[ */
-            } else {
-                /* all packet have been filtered out and no report, restart loop */
-                continue;
-            }
-        } else {
-            /* end of packet array */
-            buff_up[buff_index] = ']';
-            ++buff_index;
-            /* add separator if needed */
-            if (send_report == true) {
-                buff_up[buff_index] = ',';
-                ++buff_index;
-            }
+        /* send the datagram when its oldest packet has waited long enough
+           for others to join it, or when there is a report to send */
+        gettimeofday(&now, NULL);
+        if (pkt_in_dgram > 0) {
+            elapsed_ms = (long)(1000 * time_diff(dgram_time, now));
         }
-
-        /* add status report if a new one is available */
-        if (send_report == true) {
-            pthread_mutex_lock(&mx_stat_rep);
-            report_ready = false;
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "%s", status_report);
-            pthread_mutex_unlock(&mx_stat_rep);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
+        if (send_report || ((pkt_in_dgram > 0) && (elapsed_ms >= (long)push_latency_ms))) {
+            push_data_send(buff_up, buff_index, pkt_in_dgram, send_report);
+            buff_index = DGRAM_RXPK_START;
+            pkt_in_dgram = 0;
         }
 
-        /* end of JSON datagram payload */
-        buff_up[buff_index] = '}';
-        ++buff_index;
-        buff_up[buff_index] = 0; /* add string terminator, for safety */
-
-        MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u]: %s\n", token_h, token_l, (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
-
-        /* send datagram to server */
-        send(sock_up, (void *)buff_up, buff_index, 0);
-        
-        gettimeofday(&send_time, NULL);
-        //clock_gettime(CLOCK_MONOTONIC, &send_time);
-        pthread_mutex_lock(&mx_meas_up);
-        meas_up_dgram_sent += 1;
-        meas_up_network_byte += buff_index;
-
-        /* wait for acknowledge (in 2 times, to catch extra packets) */
-        for (i = 0; i < 2; ++i) {
-            j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
-            gettimeofday(&recv_time, NULL);
-            //clock_gettime(CLOCK_MONOTONIC, &recv_time);
-            if (j == -1) {
-                if (errno == EAGAIN) { /* timeout */
-                    MSG_WARN("[up  ] PUSH_ACK recieve timeout %d\n", i);
-                    continue;
-                } else { /* server connection error */
-                    break;
-                }
-            } else if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK)) {
-                MSG_WARN("[up  ] ignored invalid non-ACL packet\n");
-                continue;
-            } else if ((buff_ack[1] != token_h) || (buff_ack[2] != token_l)) {
-                MSG_WARN("[up  ] ignored out-of sync PUSH_ACK packet buff_ack[%u:%u] != token[%u:%u]\n", buff_ack[1], buff_ack[2], token_h, token_l);
-                continue;
+        /* fetch again right away if the FIFO may not be empty, otherwise
+           wait a short time, not past the datagram deadline */
+        if (nb_pkt < (int)fetch_batch) {
+            if ((pkt_in_dgram > 0) && (push_latency_ms - elapsed_ms < FETCH_SLEEP_MS)) {
+                wait_ms (push_latency_ms - elapsed_ms);
             } else {
-                MSG_DEBUG("[up  ] received PUSH_ACK [%u:%u] in %i ms\n", buff_ack[1], buff_ack[2], (int)(1000 * time_diff(send_time, recv_time)));
-                meas_up_ack_rcv += 1;
-                break;
+                wait_ms ((FETCH_SLEEP_MS));
             }
         }
-        pthread_mutex_unlock(&mx_meas_up);
-        wait_ms (5);
+    }
+
+    /* don't leave packets behind in a datagram waiting for others */
+    if (pkt_in_dgram > 0) {
+        push_data_send(buff_up, buff_index, pkt_in_dgram, false);
     }
     MSG_INFO("[up  ] End of upstream thread\n\n");
 }
@@ -1859,10 +1735,9 @@ void thread_down(void) {
     bool req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
 
     /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *txpk_obj = NULL;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
+    struct txpk_json_s txpk; /* fields of the txpk object, in buff_down */
+    int64_t num;
+    struct timeval utc_tx; /* UTC time of the TX, when it's given instead of a timestamp */
     short x0, x1;
 
     /* auto-quit variable */
@@ -1965,22 +1840,20 @@ void thread_down(void) {
 
             /* initialize TX struct and try to parse JSON */
             memset(&txpkt, 0, sizeof txpkt);
-            root_val = json_parse_string_with_comments((const char *)(buff_down + 4)); /* JSON offset */
-            if (root_val == NULL) {
+            i = txpk_json_parse((const char *)(buff_down + 4), msg_len - 4, &txpk); /* JSON offset */
+            if (i == TXPK_JSON_INVALID) {
                 MSG_WARN("[down] invalid JSON, TX aborted\n");
                 continue;
             }
 
             /* look for JSON sub-object 'txpk' */
-            txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
-            if (txpk_obj == NULL) {
+            if (i == TXPK_JSON_NO_TXPK) {
                 MSG_WARN("[down] no \"txpk\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse "immediate" tag, or target timestamp */
-            i = json_object_get_boolean(txpk_obj, "imme"); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
+            i = txpk_json_get_boolean(&txpk, TXPK_IMME); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
             if (i == 1) {
                 /* TX procedure: send immediately */
                 sent_immediate = true;
@@ -1988,80 +1861,78 @@ void thread_down(void) {
                 MSG_INFO("[down] a packet will be sent in \"immediate\" mode\n");
             } else {
                 sent_immediate = false;
-                val = json_object_get_value(txpk_obj, "tmst");
-                if (val != NULL) {
+                if (txpk_json_get_number(&txpk, TXPK_TMST, 0, &num)) {
                     /* TX procedure: send on timestamp value */
-                    txpkt.count_us = (uint32_t)json_value_get_number(val);
+                    txpkt.count_us = (uint32_t)num;
 
                     /* Concentrator timestamp is given, we consider it is a Class A downlink */
                     downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
                 } else {
                     /* TX procedure: send on UTC time (converted to timestamp value) */
-                    str = json_object_get_string(txpk_obj, "time");
-                    if (str == NULL) {
+                    if (txpk.type[TXPK_TIME] != TXPK_TYPE_STRING) {
                         MSG_WARN("[down] no mandatory \"txpk.tmst\" or \"txpk.time\" objects in JSON, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                     }
-                    MSG_WARN("[down] GPS disabled, impossible to send packet on specific UTC time, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
+                    if (!txpk_json_get_time(&txpk, TXPK_TIME, &utc_tx)) {
+                        MSG_WARN("[down] invalid \"txpk.time\" object in JSON, TX aborted\n");
+                        continue;
+                    }
+
+                    /* There is no GPS, the host clock is taken as UTC, the drift compensated
+                       model of the concentrator clock converts it to a timestamp */
+                    if (get_concentrator_count(utc_tx, &txpkt.count_us) != 0) {
+                        MSG_WARN("[down] concentrator clock not synchronized yet, TX aborted\n");
+                        continue;
+                    }
+
+                    /* UTC time is given, we consider it is a Class B downlink */
+                    downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_B;
                 }
             }
 
             /* Parse "No CRC" flag (optional field) */
-            val = json_object_get_value(txpk_obj, "ncrc");
-            if (val != NULL) {
-                txpkt.no_crc = (bool)json_value_get_boolean(val);
+            i = txpk_json_get_boolean(&txpk, TXPK_NCRC);
+            if (i >= 0) {
+                txpkt.no_crc = (bool)i;
             }
 
             /* parse target frequency (mandatory) */
-            val = json_object_get_value(txpk_obj, "freq");
-            if (val == NULL) {
+            if (!txpk_json_get_number(&txpk, TXPK_FREQ, 6, &num)) {
                 MSG_WARN("[down] no mandatory \"txpk.freq\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+            txpkt.freq_hz = (uint32_t)num; /* JSON value in MHz */
 
             /* parse RF chain used for TX (mandatory) */
-            val = json_object_get_value(txpk_obj, "rfch");
-            if (val == NULL) {
+            if (!txpk_json_get_number(&txpk, TXPK_RFCH, 0, &num)) {
                 MSG_WARN("[down] no mandatory \"txpk.rfch\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.rf_chain = (uint8_t)json_value_get_number(val);
+            txpkt.rf_chain = (uint8_t)num;
 
             /* parse TX power (optional field) */
-            val = json_object_get_value(txpk_obj, "powe");
-            if (val != NULL) {
-                txpkt.rf_power = (int8_t)json_value_get_number(val) - antenna_gain;
+            if (txpk_json_get_number(&txpk, TXPK_POWE, 0, &num)) {
+                txpkt.rf_power = (int8_t)num - antenna_gain;
             }
 
             /* Parse modulation (mandatory) */
-            str = json_object_get_string(txpk_obj, "modu");
-            if (str == NULL) {
+            if (txpk.type[TXPK_MODU] != TXPK_TYPE_STRING) {
                 MSG_WARN("[down] no mandatory \"txpk.modu\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
-            if (strcmp(str, "LORA") == 0) {
+            if (txpk_json_string_is(&txpk, TXPK_MODU, "LORA")) {
                 /* Lora modulation */
                 txpkt.modulation = MOD_LORA;
 
                 /* Parse Lora spreading-factor and modulation bandwidth (mandatory) */
-                str = json_object_get_string(txpk_obj, "datr");
-                if (str == NULL) {
+                if (txpk.type[TXPK_DATR] != TXPK_TYPE_STRING) {
                     MSG_WARN("[down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                i = sscanf(str, "SF%2hdBW%3hd", &x0, &x1);
+                i = sscanf(txpk.val[TXPK_DATR], "SF%2hdBW%3hd", &x0, &x1); /* the closing quote ends the string */
                 if (i != 2) {
                     MSG_WARN("[down] format error in \"txpk.datr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
                 switch (x0) {
@@ -2085,7 +1956,6 @@ void thread_down(void) {
                         break;
                     default:
                         MSG_WARN("[down] format error in \"txpk.datr\", invalid SF, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
                 switch (x1) {
@@ -2100,47 +1970,41 @@ void thread_down(void) {
                         break;
                     default:
                         MSG_WARN("[down] format error in \"txpk.datr\", invalid BW, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
               
                 /* Parse ECC coding rate (optional field) */
-                str = json_object_get_string(txpk_obj, "codr");
-                if (str == NULL) {
+                if (txpk.type[TXPK_CODR] != TXPK_TYPE_STRING) {
                     MSG_WARN("[down] no mandatory \"txpk.codr\" object in json, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                if      (strcmp(str, "4/5") == 0) {
+                if      (txpk_json_string_is(&txpk, TXPK_CODR, "4/5")) {
                     txpkt.coderate = CR_LORA_4_5;
-                } else if (strcmp(str, "4/6") == 0) {
+                } else if (txpk_json_string_is(&txpk, TXPK_CODR, "4/6")) {
                     txpkt.coderate = CR_LORA_4_6;
-                } else if (strcmp(str, "2/3") == 0) {
+                } else if (txpk_json_string_is(&txpk, TXPK_CODR, "2/3")) {
                     txpkt.coderate = CR_LORA_4_6;
-                } else if (strcmp(str, "4/7") == 0) {
+                } else if (txpk_json_string_is(&txpk, TXPK_CODR, "4/7")) {
                     txpkt.coderate = CR_LORA_4_7;
-                } else if (strcmp(str, "4/8") == 0) {
+                } else if (txpk_json_string_is(&txpk, TXPK_CODR, "4/8")) {
                     txpkt.coderate = CR_LORA_4_8;
-                } else if (strcmp(str, "1/2") == 0) {
+                } else if (txpk_json_string_is(&txpk, TXPK_CODR, "1/2")) {
                     txpkt.coderate = CR_LORA_4_8;
                 } else {
                     MSG_WARN("[down] format error in \"txpk.codr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
 
                 /* Parse signal polarity switch (optional field) */
-                val = json_object_get_value(txpk_obj, "ipol");
-                if (val != NULL) {
-                    txpkt.invert_pol = (bool)json_value_get_boolean(val);
+                i = txpk_json_get_boolean(&txpk, TXPK_IPOL);
+                if (i >= 0) {
+                    txpkt.invert_pol = (bool)i;
                 }
 
                 /* parse Lora preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj, "prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
-                    if (i >= MIN_LORA_PREAMB) {
-                        txpkt.preamble = (uint16_t)i;
+                if (txpk_json_get_number(&txpk, TXPK_PREA, 0, &num)) {
+                    if (num >= MIN_LORA_PREAMB) {
+                        txpkt.preamble = (uint16_t)num;
                     } else {
                         txpkt.preamble = (uint16_t)MIN_LORA_PREAMB;
                     }
@@ -2148,35 +2012,29 @@ void thread_down(void) {
                     txpkt.preamble = (uint16_t)STD_LORA_PREAMB;
                 }
 
-            } else if (strcmp(str, "FSK") == 0) {
+            } else if (txpk_json_string_is(&txpk, TXPK_MODU, "FSK")) {
 
                 /* FSK modulation */
                 txpkt.modulation = MOD_FSK;
 
                 /* parse FSK bitrate (mandatory) */
-                val = json_object_get_value(txpk_obj, "datr");
-                if (val == NULL) {
+                if (!txpk_json_get_number(&txpk, TXPK_DATR, 0, &num)) {
                     MSG_WARN("[down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.datarate = (uint32_t)(json_value_get_number(val));
+                txpkt.datarate = (uint32_t)num;
 
                 /* parse frequency deviation (mandatory) */
-                val = json_object_get_value(txpk_obj, "fdev");
-                if (val == NULL) {
+                if (!txpk_json_get_number(&txpk, TXPK_FDEV, -3, &num)) {
                     MSG_WARN("[down] no mandatory \"txpk.fdev\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.f_dev = (uint8_t)(json_value_get_number(val) / 1000.0); /* JSON value in Hz, txpkt.f_dev in kHz */
+                txpkt.f_dev = (uint8_t)num; /* JSON value in Hz, txpkt.f_dev in kHz */
 
                 /* parse FSK preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj, "prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
-                    if (i >= MIN_FSK_PREAMB) {
-                        txpkt.preamble = (uint16_t)i;
+                if (txpk_json_get_number(&txpk, TXPK_PREA, 0, &num)) {
+                    if (num >= MIN_FSK_PREAMB) {
+                        txpkt.preamble = (uint16_t)num;
                     } else {
                         txpkt.preamble = (uint16_t)MIN_FSK_PREAMB;
                     }
@@ -2186,34 +2044,28 @@ void thread_down(void) {
 
             } else {
                 MSG_WARN("[down] invalid modulation in \"txpk.modu\", TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse payload length (mandatory) */
-            val = json_object_get_value(txpk_obj, "size");
-            if (val == NULL) {
+            if (!txpk_json_get_number(&txpk, TXPK_SIZE, 0, &num)) {
                 MSG_WARN("[down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.size = (uint16_t)json_value_get_number(val);
+            txpkt.size = (uint16_t)num;
 
-            /* Parse payload data (mandatory) */
-            str = json_object_get_string(txpk_obj, "data");
-            if (str == NULL) {
+            /* Parse payload data (mandatory), decoded straight from the datagram */
+            if (txpk.type[TXPK_DATA] != TXPK_TYPE_STRING) {
                 MSG_WARN("[down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
+            i = txpk_json_get_data(&txpk, txpkt.payload, sizeof txpkt.payload);
             if (i != txpkt.size) {
-                MSG_WARN("[down] mismatch between .size and .data size once converter to binary\n");
+                /* the JiT queue copies .size bytes of payload, they must all be there */
+                MSG_WARN("[down] mismatch between .size and .data size once converter to binary, TX aborted\n");
+                continue;
             }
 
-            /* free the JSON parse tree from memory */
-            json_value_free(root_val);
-
             /* select TX mode */
             if (sent_immediate) {
                 txpkt.tx_mode = IMMEDIATE;
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    LoRa concentrator : serialization of received packets as "rxpk" JSON
+    objects of the Semtech UDP protocol, without printf formatting
+
+    The output is the same as the snprintf based serialization it replaces:
+    the frequency is printed from its integer value in Hz, the SNR and RSSI
+    are rounded to the nearest tenth and unit like %.1f and %.0f do.
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "rxpk_json.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+static const char b64_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static char *put_str(char *out, const char *s, int len) {
+    memcpy(out, s, len);
+    return out + len;
+}
+
+#define PUT_LIT(out, s) put_str((out), (s), sizeof(s) - 1)
+
+static char *put_uint(char *out, uint32_t v) {
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) {
+        *out++ = tmp[--n];
+    }
+    return out;
+}
+
+/* v rounded like %.1f (tenths) or %.0f does, half to even */
+static char *put_fixed(char *out, float v, bool tenths) {
+    int32_t t = (int32_t)rintf(tenths ? v * 10.0f : v);
+    if (v < 0) {
+        *out++ = '-';
+        t = -t;
+    }
+    if (!tenths) {
+        return put_uint(out, t);
+    }
+    out = put_uint(out, t / 10);
+    *out++ = '.';
+    *out++ = '0' + (t % 10);
+    return out;
+}
+
+/* frequency in MHz with 6 decimals, from its value in Hz */
+static char *put_mhz(char *out, uint32_t hz) {
+    uint32_t frac = hz % 1000000;
+    int i;
+    out = put_uint(out, hz / 1000000);
+    *out++ = '.';
+    for (i = 5; i >= 0; --i) {
+        out[i] = '0' + (frac % 10);
+        frac /= 10;
+    }
+    return out + 6;
+}
+
+/* padded base64, 4 characters for each 3 bytes */
+static char *put_b64(char *out, const uint8_t *in, int size) {
+    uint32_t b;
+    for (; size >= 3; size -= 3, in += 3) {
+        b = (in[0] << 16) | (in[1] << 8) | in[2];
+        out[0] = b64_table[b >> 18];
+        out[1] = b64_table[(b >> 12) & 0x3F];
+        out[2] = b64_table[(b >> 6) & 0x3F];
+        out[3] = b64_table[b & 0x3F];
+        out += 4;
+    }
+    if (size > 0) {
+        b = (in[0] << 16) | ((size == 2) ? (in[1] << 8) : 0);
+        out[0] = b64_table[b >> 18];
+        out[1] = b64_table[(b >> 12) & 0x3F];
+        out[2] = (size == 2) ? b64_table[(b >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int rxpk_json(const struct lgw_pkt_rx_s *p, char *out, int max_len) {
+    char *o = out;
+
+    if (max_len < RXPK_JSON_META_MAX + 4 * ((p->size + 2) / 3)) {
+        return 0;
+    }
+
+    /* RAW timestamp, concentrator channel, RF chain & RX frequency */
+    o = PUT_LIT(o, "{\"tmst\":");
+    o = put_uint(o, p->count_us);
+    o = PUT_LIT(o, ",\"chan\":");
+    o = put_uint(o, p->if_chain);
+    o = PUT_LIT(o, ",\"rfch\":");
+    o = put_uint(o, p->rf_chain);
+    o = PUT_LIT(o, ",\"freq\":");
+    o = put_mhz(o, p->freq_hz);
+
+    /* packet status */
+    switch (p->status) {
+        case STAT_CRC_OK:   o = PUT_LIT(o, ",\"stat\":1"); break;
+        case STAT_CRC_BAD:  o = PUT_LIT(o, ",\"stat\":-1"); break;
+        case STAT_NO_CRC:   o = PUT_LIT(o, ",\"stat\":0"); break;
+        default:            return -1;
+    }
+
+    /* modulation, datarate, bandwidth, coding rate and SNR */
+    if (p->modulation == MOD_LORA) {
+        o = PUT_LIT(o, ",\"modu\":\"LORA\",\"datr\":\"");
+        switch (p->datarate) {
+            case DR_LORA_SF7:   o = PUT_LIT(o, "SF7"); break;
+            case DR_LORA_SF8:   o = PUT_LIT(o, "SF8"); break;
+            case DR_LORA_SF9:   o = PUT_LIT(o, "SF9"); break;
+            case DR_LORA_SF10:  o = PUT_LIT(o, "SF10"); break;
+            case DR_LORA_SF11:  o = PUT_LIT(o, "SF11"); break;
+            case DR_LORA_SF12:  o = PUT_LIT(o, "SF12"); break;
+            default:            return -1;
+        }
+        switch (p->bandwidth) {
+            case BW_125KHZ:     o = PUT_LIT(o, "BW125\""); break;
+            case BW_250KHZ:     o = PUT_LIT(o, "BW250\""); break;
+            case BW_500KHZ:     o = PUT_LIT(o, "BW500\""); break;
+            default:            return -1;
+        }
+        switch (p->coderate) {
+            case CR_LORA_4_5:   o = PUT_LIT(o, ",\"codr\":\"4/5\""); break;
+            case CR_LORA_4_6:   o = PUT_LIT(o, ",\"codr\":\"4/6\""); break;
+            case CR_LORA_4_7:   o = PUT_LIT(o, ",\"codr\":\"4/7\""); break;
+            case CR_LORA_4_8:   o = PUT_LIT(o, ",\"codr\":\"4/8\""); break;
+            case 0:             o = PUT_LIT(o, ",\"codr\":\"OFF\""); break; /* mostly false sync */
+            default:            return -1;
+        }
+        o = PUT_LIT(o, ",\"lsnr\":");
+        o = put_fixed(o, p->snr, true);
+    } else if (p->modulation == MOD_FSK) {
+        o = PUT_LIT(o, ",\"modu\":\"FSK\",\"datr\":");
+        o = put_uint(o, p->datarate);
+    } else {
+        return -1;
+    }
+
+    /* RSSI, payload size and base64-encoded payload */
+    o = PUT_LIT(o, ",\"rssi\":");
+    o = put_fixed(o, p->rssi, false);
+    o = PUT_LIT(o, ",\"size\":");
+    o = put_uint(o, p->size);
+    o = PUT_LIT(o, ",\"data\":\"");
+    o = put_b64(o, p->payload, p->size);
+    o = PUT_LIT(o, "\"}");
+
+    return o - out;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
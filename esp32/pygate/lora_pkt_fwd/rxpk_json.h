@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    LoRa concentrator : serialization of received packets as "rxpk" JSON
+    objects of the Semtech UDP protocol, without printf formatting
+*/
+
+
+#ifndef _LORA_PKTFWD_RXPK_JSON_H
+#define _LORA_PKTFWD_RXPK_JSON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define RXPK_JSON_META_MAX  200 /* longest JSON object of a packet, without its payload */
+#define RXPK_JSON_MAX       (RXPK_JSON_META_MAX + 344) /* with 255 payload bytes in base64 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Write the JSON object describing a received packet
+@param p packet with its metadata
+@param out buffer where the object is written, not null terminated
+@param max_len room left in the buffer
+@return >0 length of the object, 0 if it does not fit in max_len, -1 if the
+packet metadata has a value that can't be represented
+*/
+int rxpk_json(const struct lgw_pkt_rx_s *p, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host benchmark of the upstream serialization: the snprintf based code
+    thread_up used to have against rxpk_json(), on the same packets.  Both
+    outputs are compared, so it doubles as a check of rxpk_json(). See
+    README for how to build and run it.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "base64.h"
+#include "rxpk_json.h"
+
+#define NB_PKT      64
+#define ROUNDS      20000
+
+static struct lgw_pkt_rx_s pkts[NB_PKT];
+
+/* the fields the forwarder used to print with snprintf */
+static int rxpk_snprintf(const struct lgw_pkt_rx_s *p, char *out, int max_len) {
+    static const char *sf[] = { "", "SF7", "SF8", "SF9", "SF10", "SF11", "SF12", "" };
+    static const char *cr[] = { "OFF", "4/5", "4/6", "4/7", "4/8" };
+    int i = 0;
+    int j;
+
+    i += snprintf(out + i, max_len - i, "{\"tmst\":%u", p->count_us);
+    i += snprintf(out + i, max_len - i, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6));
+    i += snprintf(out + i, max_len - i, ",\"stat\":%d", p->status == STAT_CRC_OK ? 1 : (p->status == STAT_CRC_BAD ? -1 : 0));
+    if (p->modulation == MOD_LORA) {
+        int k = 0;
+        while ((1u << k) != p->datarate) {
+            ++k;
+        }
+        i += snprintf(out + i, max_len - i, ",\"modu\":\"LORA\",\"datr\":\"%sBW%u\"", sf[k],
+            p->bandwidth == BW_125KHZ ? 125 : (p->bandwidth == BW_250KHZ ? 250 : 500));
+        i += snprintf(out + i, max_len - i, ",\"codr\":\"%s\"", cr[p->coderate]);
+        i += snprintf(out + i, max_len - i, ",\"lsnr\":%.1f", p->snr);
+    } else {
+        i += snprintf(out + i, max_len - i, ",\"modu\":\"FSK\",\"datr\":%u", p->datarate);
+    }
+    i += snprintf(out + i, max_len - i, ",\"rssi\":%.0f,\"size\":%u", p->rssi, p->size);
+    memcpy(out + i, ",\"data\":\"", 9);
+    i += 9;
+    j = bin_to_b64(p->payload, p->size, out + i, 341);
+    i += j;
+    out[i++] = '"';
+    out[i++] = '}';
+    return i;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    static const uint8_t crs[] = { CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8, 0 };
+    static const uint8_t bws[] = { BW_125KHZ, BW_250KHZ, BW_500KHZ };
+    static char a[RXPK_JSON_MAX];
+    static char b[RXPK_JSON_MAX];
+    double t;
+    long bytes = 0;
+    int i, r, la, lb;
+
+    srand(1);
+    for (i = 0; i < NB_PKT; ++i) {
+        struct lgw_pkt_rx_s *p = &pkts[i];
+        p->freq_hz = 863000000 + (rand() % 7000) * 1000 + (i % 4) * 125;
+        p->if_chain = i % 10;
+        p->rf_chain = i % 2;
+        p->count_us = (uint32_t)rand() * 7u;
+        p->status = (i % 11 == 0) ? STAT_CRC_BAD : STAT_CRC_OK;
+        p->modulation = (i % 16 == 15) ? MOD_FSK : MOD_LORA;
+        p->datarate = (p->modulation == MOD_LORA) ? (DR_LORA_SF7 << (i % 6)) : 50000;
+        p->bandwidth = bws[i % 3];
+        p->coderate = crs[i % 5];
+        p->rssi = -130.0f + (rand() % 1200) / 10.0f;
+        p->snr = -20.0f + (rand() % 120) / 4.0f;
+        p->size = (i * 37) % 256;
+        for (r = 0; r < p->size; ++r) {
+            p->payload[r] = rand();
+        }
+    }
+
+    for (i = 0; i < NB_PKT; ++i) {
+        la = rxpk_snprintf(&pkts[i], a, sizeof(a));
+        lb = rxpk_json(&pkts[i], b, sizeof(b));
+        if (la != lb || memcmp(a, b, la) != 0) {
+            printf("packet %d differs:\n%.*s\n%.*s\n", i, la, a, lb, b);
+            return 1;
+        }
+        bytes += la;
+    }
+
+    t = now();
+    for (r = 0; r < ROUNDS; ++r) {
+        for (i = 0; i < NB_PKT; ++i) {
+            rxpk_snprintf(&pkts[i], a, sizeof(a));
+        }
+    }
+    t = now() - t;
+    printf("snprintf:   %.0f ns/packet\n", t * 1e9 / (ROUNDS * NB_PKT));
+
+    t = now();
+    for (r = 0; r < ROUNDS; ++r) {
+        for (i = 0; i < NB_PKT; ++i) {
+            rxpk_json(&pkts[i], b, sizeof(b));
+        }
+    }
+    t = now() - t;
+    printf("rxpk_json:  %.0f ns/packet\n", t * 1e9 / (ROUNDS * NB_PKT));
+    printf("%d packets, %ld bytes of JSON, identical output\n", NB_PKT, bytes);
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
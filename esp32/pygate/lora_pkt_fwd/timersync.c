@@ -27,6 +27,8 @@ Maintainer: Michael Coracin
 
 #include <stdio.h>        /* printf, fprintf, snprintf, fopen, fputs */
 #include <stdint.h>        /* C99 types */
+#include <stdlib.h>        /* llabs */
+#include <math.h>          /* llround, sqrt */
 #include <pthread.h>
 
 #include "trace.h"
@@ -38,24 +40,33 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE MACROS ------------------------------------------------------- */
-
-#define timersub(a, b, result)                                                \
-  do {                                                                        \
-    (result)->tv_sec = (a)->tv_sec - (b)->tv_sec;                             \
-    (result)->tv_usec = (a)->tv_usec - (b)->tv_usec;                          \
-    if ((result)->tv_usec < 0) {                                              \
-      --(result)->tv_sec;                                                     \
-      (result)->tv_usec += 1000000;                                           \
-    }                                                                         \
-  } while (0)
+#define TS_NB_SAMPLES       128     /* samples the model is fitted on, 96 s of them */
+#define TS_MIN_SAMPLES      8       /* below, the drift isn't estimated, only the offset */
+#define TS_OUTLIER_US       1000    /* farther from the model, a sample is an outlier... */
+#define TS_STEP_SAMPLES     3       /* ...unless there are that many in a row: a clock stepped */
+
+/* Linear model of the concentrator counter against the host clock, fitted by
+   least squares on the last samples. The counter is unwrapped to 64 bits, the
+   model is relative to the last sample:
+       count = last_count_us + d + offset + drift * d, with d = unix - ref_unix_us */
+struct ts_model_s {
+    int64_t unix_us[TS_NB_SAMPLES];
+    int64_t count_us[TS_NB_SAMPLES];
+    int head;                   /* slot of the next sample */
+    int nb_outliers;            /* outliers in a row */
+    uint32_t last_count;        /* counter of the last sample, as read */
+    int64_t last_count_us;      /* and unwrapped */
+    int64_t ref_unix_us;        /* host time of the last sample */
+    double offset;              /* counter the model gives at ref_unix_us, from last_count_us */
+    double drift;               /* counter rate against the host clock, minus one */
+    struct timersync_stats_s stats;
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
-static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to timer sync offsets */
-static struct timeval offset_unix_concent = {0, 0}; /* timer offset between unix host and concentrator */
+static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to the clock model */
+static struct ts_model_s ts_model; /* concentrator clock against unix host clock */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE SHARED VARIABLES (GLOBAL) ------------------------------------ */
@@ -63,30 +74,120 @@ extern bool exit_sig;
 extern bool quit_sig;
 extern pthread_mutex_t mx_concent;
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int64_t ts_model_predict(const struct ts_model_s *model, int64_t unix_us) {
+    int64_t d = unix_us - model->ref_unix_us;
+    return model->last_count_us + d + llround(model->offset + model->drift * d);
+}
+
+static void ts_model_fit(struct ts_model_s *model) {
+    int n = model->stats.nb_samples;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double x, y, r, r2 = 0, rmax = 0;
+    int i;
+
+    /* x is the host time and y the counter less the host time, from the last sample */
+    for (i = 0; i < n; i++) {
+        x = model->unix_us[i] - model->ref_unix_us;
+        y = (model->count_us[i] - model->last_count_us) - x;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    model->drift = 0;
+    if (n >= TS_MIN_SAMPLES && (n * sxx - sx * sx) > 0) {
+        model->drift = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    }
+    model->offset = (sy - model->drift * sx) / n;
+
+    for (i = 0; i < n; i++) {
+        x = model->unix_us[i] - model->ref_unix_us;
+        y = (model->count_us[i] - model->last_count_us) - x;
+        r = fabs(y - model->offset - model->drift * x);
+        r2 += r * r;
+        rmax = (r > rmax) ? r : rmax;
+    }
+    model->stats.drift_valid = (n >= TS_MIN_SAMPLES);
+    model->stats.drift_ppm = model->drift * 1E6;
+    model->stats.jitter_rms_us = (uint32_t)lround(sqrt(r2 / n));
+    model->stats.jitter_max_us = (uint32_t)lround(rmax);
+}
+
+static void ts_model_add(struct ts_model_s *model, int64_t unix_us, uint32_t count) {
+    /* the samples are much less than a counter period apart, it wraps at most once */
+    int64_t count_us = model->last_count_us + (int32_t)(count - model->last_count);
+
+    if (model->stats.nb_samples > 0 && llabs(count_us - ts_model_predict(model, unix_us)) > TS_OUTLIER_US) {
+        /* a late read of the counter, or a step of the host clock (NTP) or of the
+           counter (concentrator restart): the model restarts if it lasts */
+        if (++model->nb_outliers < TS_STEP_SAMPLES) {
+            return;
+        }
+        model->stats.nb_samples = 0;
+        model->stats.nb_resets += 1;
+    }
+    if (model->stats.nb_samples == 0) {
+        model->head = 0;
+        count_us = count;
+    }
+    model->nb_outliers = 0;
+
+    model->unix_us[model->head] = unix_us;
+    model->count_us[model->head] = count_us;
+    model->head = (model->head + 1) % TS_NB_SAMPLES;
+    if (model->stats.nb_samples < TS_NB_SAMPLES) {
+        model->stats.nb_samples += 1;
+    }
+    model->last_count = count;
+    model->last_count_us = count_us;
+    model->ref_unix_us = unix_us;
+    ts_model_fit(model);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
-int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time) {
-    struct timeval local_timeval;
+int get_concentrator_count(struct timeval utc_time, uint32_t *count_us) {
+    int64_t unix_us = (int64_t)utc_time.tv_sec * 1000000 + utc_time.tv_usec;
+    int result;
 
-    if (concent_time == NULL) {
+    if (count_us == NULL) {
         MSG_ERROR("[ts  ] %s invalid parameter\n", __FUNCTION__);
         return -1;
     }
 
     pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-    timersub(&unix_time, &offset_unix_concent, &local_timeval);
+    /* without a sample, the counter is taken as the host clock */
+    *count_us = (uint32_t)ts_model_predict(&ts_model, unix_us);
+    result = (ts_model.stats.nb_samples > 0) ? 0 : -1;
     pthread_mutex_unlock(&mx_timersync);
 
-    /* TODO: handle sx1301 coutner wrap-up !! */
-    concent_time->tv_sec = local_timeval.tv_sec;
-    concent_time->tv_usec = local_timeval.tv_usec;
-    /*
-    MSG_DEBUG("[ts  ] --> TIME: unix current time is    (%ld,%ld)[s,us]\n", unix_time.tv_sec, unix_time.tv_usec);
-    MSG_DEBUG("[ts  ]           concent current time is (%ld,%ld)[s,us]\n", local_timeval.tv_sec, local_timeval.tv_usec);
-    MSG_DEBUG("[ts  ]           offset is               (%ld,%ld)[s,us]\n", offset_unix_concent.tv_sec, offset_unix_concent.tv_usec);
-    */
-    return 0;
+    return result;
+}
+
+int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time) {
+    uint32_t count_us;
+    int result;
+
+    if (concent_time == NULL) {
+        MSG_ERROR("[ts  ] %s invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    /* the counter wraps, the time is its 32 bits, as jitqueue takes it */
+    result = get_concentrator_count(unix_time, &count_us);
+    concent_time->tv_sec = count_us / 1000000UL;
+    concent_time->tv_usec = count_us % 1000000UL;
+    return result;
+}
+
+void timersync_get_stats(struct timersync_stats_s *stats) {
+    pthread_mutex_lock(&mx_timersync);
+    *stats = ts_model.stats;
+    pthread_mutex_unlock(&mx_timersync);
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -95,10 +196,7 @@ int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time
 void thread_timersync(void) {
     MSG_INFO("[ts  ] start\n");
     struct timeval unix_timeval;
-    struct timeval concentrator_timeval;
     uint32_t sx1301_timecount = 0;
-    struct timeval offset_previous = {0, 0};
-    struct timeval offset_drift = {0, 0}; /* delta between current and previous offset */
 
     while (!exit_sig && !quit_sig) {
         /* Get current unix time */
@@ -107,40 +205,22 @@ void thread_timersync(void) {
         /* Get current concentrator counter value (1MHz) */
         lgw_get_trigcnt(&sx1301_timecount);
 
-        concentrator_timeval.tv_sec = sx1301_timecount / 1000000UL;
-        concentrator_timeval.tv_usec = sx1301_timecount - (concentrator_timeval.tv_sec * 1000000UL);
-
-        /* Compute offset between unix and concentrator timers, with microsecond precision */
-        offset_previous.tv_sec = offset_unix_concent.tv_sec;
-        offset_previous.tv_usec = offset_unix_concent.tv_usec;
-
         pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-        timersub(&unix_timeval, &concentrator_timeval, &offset_unix_concent);
+        ts_model_add(&ts_model, (int64_t)unix_timeval.tv_sec * 1000000 + unix_timeval.tv_usec, sx1301_timecount);
         pthread_mutex_unlock(&mx_timersync);
 
-        timersub(&offset_unix_concent, &offset_previous, &offset_drift);
-
-/*
-        MSG_DEBUG("[ts  ] unix_timeval (%ld,%ld)[s,us]\n",
-                  unix_timeval.tv_sec,
-                  unix_timeval.tv_usec);
-        MSG_DEBUG("[ts  ] concentrator (%ld,%ld)[s,us] = %u [us]\n",
-                  concentrator_timeval.tv_sec,
-                  concentrator_timeval.tv_usec,
-                  sx1301_timecount);
-
-        MSG_DEBUG("[ts  ] offset       (%ld,%ld)[s,us], drift=%ld [us]\n",
-            offset_unix_concent.tv_sec,
-            offset_unix_concent.tv_usec,
-            offset_drift.tv_sec * 1000000UL + offset_drift.tv_usec);
-*/
+        /*
+        MSG_DEBUG("[ts  ] concentrator %u [us], drift=%.2f [ppm], jitter=%u/%u [us]\n",
+                  sx1301_timecount,
+                  ts_model.stats.drift_ppm,
+                  ts_model.stats.jitter_rms_us,
+                  ts_model.stats.jitter_max_us);
+        */
 
         /* delay next sync */
-        /* If we consider a crystal oscillator precision of about 20ppm worst case, and a clock
-            running at 1MHz, this would mean 1µs drift every 50000µs (10000000/20).
-            As here the time precision is not critical, we should be able to cope with at least 1ms drift,
-            which should occur after 50s (50000µs * 1000).
-            Let's set the thread sleep to 1 minute for now */
+        /* A crystal oscillator drifts by up to about 20ppm, 2.5ms over the 128s a Class B
+            downlink can be scheduled ahead. The drift is estimated over the samples of the
+            last 96s, which also averages out the latency of reading the counter */
         wait_ms(750);
     }
     MSG_INFO("[ts  ] end exit=%u quit=%u\n", exit_sig, quit_sig);
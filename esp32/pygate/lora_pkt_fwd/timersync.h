@@ -28,13 +28,44 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#include <stdint.h>      /* C99 types */
+#include <stdbool.h>     /* bool type */
 #include <sys/time.h>    /* timeval */
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* State of the model of the concentrator clock against the host clock */
+struct timersync_stats_s {
+    uint32_t nb_samples;    /* samples the model is fitted on */
+    bool drift_valid;       /* enough samples for the drift to be estimated */
+    double drift_ppm;       /* concentrator counter rate against the host clock, in ppm */
+    uint32_t jitter_rms_us; /* distance of the samples to the model, rms */
+    uint32_t jitter_max_us; /* distance of the samples to the model, worst */
+    uint32_t nb_resets;     /* model restarts, after a step of the host clock or of the counter */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Convert a host time to the concentrator time, drift compensated
+@param concent_time[out] the concentrator counter, as a timeval
+@param unix_time host time, now or in the near future
+@return 0 on success, -1 if there is no sample yet
+*/
 int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time);
 
+/**
+@brief Convert a UTC time, taken from the host clock, to a concentrator counter value
+@param utc_time the time to convert
+@param count_us[out] the concentrator counter at that time
+@return 0 on success, -1 if there is no sample yet
+*/
+int get_concentrator_count(struct timeval utc_time, uint32_t *count_us);
+
+void timersync_get_stats(struct timersync_stats_s *stats);
+
 void thread_timersync(void);
 
 #endif
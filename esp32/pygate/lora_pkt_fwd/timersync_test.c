@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host test of the concentrator clock model. A concentrator counter with
+    a crystal drifting with the temperature is sampled as thread_timersync
+    does, every 750 ms, with the latency of the counter read and the odd
+    late read. Then a host time up to 128 s ahead, as far as a Class B
+    downlink can be scheduled, is converted to a counter value. The error
+    is compared with the former single offset, refreshed at every sample.
+    The host clock is stepped, as NTP does, and the concentrator is
+    restarted in the middle of the run; the counter wraps several times.
+    The mean latency of the read is in both errors: no sample can tell it
+    from the offset of the clocks.
+
+    timersync.c is included here, with the trace helpers and the HAL
+    replaced by host ones. See README for how to build and run it.
+
+    The last part checks the UTC times of txpk_json_get_time, which is
+    built in with -DTEST_TXPK_TIME and txpk_json.c.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/* host replacements of trace.h */
+#define _LORA_PKTFWD_TRACE_H
+#define MSG_DEBUG(...)  (void)0
+#define MSG_INFO(...)   (void)0
+#define MSG_WARN(...)   (void)0
+#define MSG_ERROR(...)  (void)0
+
+#include "timersync.c"
+
+#ifdef TEST_TXPK_TIME
+#include "txpk_json.h"
+#endif
+
+#define SIM_HOURS           (6)
+#define SAMPLE_US           (750000)
+#define HORIZON_US          (128000000) /* Class B ping slots and beacons */
+#define SETTLE_US           (60000000)  /* errors aren't counted for a minute after a step */
+
+/* -------------------------------------------------------------------------- */
+/* --- HOST HAL ------------------------------------------------------------- */
+
+bool exit_sig = false;
+bool quit_sig = false;
+pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER;
+
+int lgw_get_trigcnt(uint32_t *trig_cnt_us) {
+    (void)trig_cnt_us;
+    return LGW_HAL_ERROR;
+}
+
+void wait_ms(unsigned long t) {
+    (void)t;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- SIMULATION ----------------------------------------------------------- */
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static double rnd_unit(void) {
+    return (rnd() + 0.5) / 4294967296.0;
+}
+
+/* The concentrator crystal runs 12 ppm fast, and 6 ppm more or less as the
+   temperature goes up and down every 2 hours. The counter is the integral of
+   its rate, since the concentrator started. */
+static double sim_drift(double t_us) {
+    return 12E-6 + 6E-6 * sin(2 * M_PI * t_us / 7200E6);
+}
+
+static double sim_counter(double t_us, double start_us, double start_count) {
+    double phase = 2 * M_PI / 7200E6;
+    double integral = 12E-6 * (t_us - start_us) - 6E-6 / phase * (cos(phase * t_us) - cos(phase * start_us));
+    return start_count + (t_us - start_us) + integral;
+}
+
+struct sim_errors_s {
+    uint32_t n;
+    double sum;
+    double max;
+    double hist[8]; /* errors of 0-10, 10-30, 30-100, 100-300, 300-1000, 1000-3000, 3000-10000 and more us */
+};
+
+static void count_error(struct sim_errors_s *e, int32_t err) {
+    static const double bounds[7] = { 10, 30, 100, 300, 1000, 3000, 10000 };
+    double a = fabs((double)err);
+    int i;
+
+    e->n++;
+    e->sum += a;
+    e->max = (a > e->max) ? a : e->max;
+    for (i = 0; (i < 7) && (a >= bounds[i]); i++);
+    e->hist[i]++;
+}
+
+static double percentile(const struct sim_errors_s *e, double p) {
+    static const double bounds[8] = { 10, 30, 100, 300, 1000, 3000, 10000, INFINITY };
+    double acc = 0;
+
+    for (int i = 0; i < 8; i++) {
+        acc += e->hist[i];
+        if (acc >= p * e->n) {
+            return bounds[i];
+        }
+    }
+    return INFINITY;
+}
+
+static void run_simulation(void) {
+    struct sim_errors_s err_model = { 0 }, err_offset = { 0 };
+    double host_offset_us = 1.6E15; /* the host clock is Unix time */
+    double start_us = 0, start_count = 3.9E9; /* the counter wraps a minute in */
+    double settle_until_us = 0;
+    int64_t offset_us = 0; /* the former model: host time less counter */
+    double drift_err = 0;
+    uint32_t drift_n = 0;
+    int step = 0;
+
+    memset(&ts_model, 0, sizeof(ts_model));
+    for (double t = 0; t < SIM_HOURS * 3600E6; t += SAMPLE_US) {
+        if (step == 0 && t >= 2 * 3600E6) {
+            /* NTP steps the host clock */
+            host_offset_us += 250000;
+            settle_until_us = t + SETTLE_US;
+            step++;
+        } else if (step == 1 && t >= 4 * 3600E6) {
+            /* the concentrator is restarted */
+            start_us = t;
+            start_count = 0;
+            settle_until_us = t + SETTLE_US;
+            step++;
+        }
+
+        /* the counter is read 50 to 250 us after the host time, and 1% of the
+           reads are late by up to 20 ms, the thread being preempted */
+        double latency = 50 + 200 * rnd_unit();
+        if (rnd() % 100 == 0) {
+            latency += 20000 * rnd_unit();
+        }
+        int64_t unix_us = (int64_t)(t + host_offset_us);
+        uint32_t count = (uint32_t)(uint64_t)llround(sim_counter(t + latency, start_us, start_count));
+
+        pthread_mutex_lock(&mx_timersync);
+        ts_model_add(&ts_model, unix_us, count);
+        pthread_mutex_unlock(&mx_timersync);
+        offset_us = unix_us - (int64_t)count;
+
+        if (t < settle_until_us || t < SETTLE_US) {
+            continue;
+        }
+        if (ts_model.stats.drift_valid) {
+            drift_err += fabs(ts_model.stats.drift_ppm - 1E6 * sim_drift(t));
+            drift_n++;
+        }
+
+        /* a host time now or up to 128 s ahead, to a counter value */
+        double ahead = (rnd() & 1) ? 0 : HORIZON_US * rnd_unit();
+        struct timeval tv;
+        uint32_t count_us;
+        int64_t target_us = unix_us + (int64_t)ahead;
+        tv.tv_sec = target_us / 1000000;
+        tv.tv_usec = target_us % 1000000;
+        assert(get_concentrator_count(tv, &count_us) == 0);
+
+        uint32_t truth = (uint32_t)(uint64_t)llround(sim_counter(t + ahead, start_us, start_count));
+        count_error(&err_model, (int32_t)(count_us - truth));
+        count_error(&err_offset, (int32_t)((uint32_t)(target_us - offset_us) - truth));
+    }
+
+    printf("%u hours, a sample every %u ms, host times up to %u s ahead converted to the counter\n",
+           SIM_HOURS, SAMPLE_US / 1000, HORIZON_US / 1000000);
+    printf("                  mean us   p90 us <   p99 us <   max us\n");
+    printf("single offset  %10.1f %10.0f %10.0f %10.0f\n", err_offset.sum / err_offset.n,
+           percentile(&err_offset, 0.9), percentile(&err_offset, 0.99), err_offset.max);
+    printf("drift model    %10.1f %10.0f %10.0f %10.0f\n", err_model.sum / err_model.n,
+           percentile(&err_model, 0.9), percentile(&err_model, 0.99), err_model.max);
+    printf("drift estimate off by %.3f ppm on average, jitter %u us rms, %u us max, %u resets\n",
+           drift_err / drift_n, ts_model.stats.jitter_rms_us, ts_model.stats.jitter_max_us, ts_model.stats.nb_resets);
+
+    /* the step of the host clock and the restart, nothing else */
+    assert(ts_model.stats.nb_resets == 2);
+    assert(drift_err / drift_n < 0.5);
+    /* the mean latency of the read, 150 us, is in both errors, nothing can tell it */
+    assert(percentile(&err_model, 0.99) <= 300);
+    assert(err_model.max < 1000);
+}
+
+static void check_model(void) {
+    struct timeval tv, ct;
+    uint32_t count_us;
+
+    /* without a sample, the counter is the host clock */
+    memset(&ts_model, 0, sizeof(ts_model));
+    tv.tv_sec = 4000;
+    tv.tv_usec = 123456;
+    assert(get_concentrator_count(tv, &count_us) == -1);
+    assert(count_us == 4000123456U);
+
+    /* a counter 100 ppm fast, exactly read: the model is exact */
+    for (int i = 0; i < TS_NB_SAMPLES * 2; i++) {
+        int64_t t = 1000000000LL + i * SAMPLE_US;
+        ts_model_add(&ts_model, t, (uint32_t)(t * 10001 / 10000 + 17));
+    }
+    assert(ts_model.stats.nb_samples == TS_NB_SAMPLES && ts_model.stats.drift_valid);
+    assert(fabs(ts_model.stats.drift_ppm - 100) < 0.01 && ts_model.stats.jitter_max_us <= 1);
+    tv.tv_sec = 1200;
+    tv.tv_usec = 0;
+    assert(get_concentrator_count(tv, &count_us) == 0);
+    assert(abs((int32_t)(count_us - (uint32_t)(1200000000LL * 10001 / 10000 + 17))) <= 1);
+    assert(get_concentrator_time(&ct, tv) == 0);
+    assert(ct.tv_sec == count_us / 1000000 && ct.tv_usec == count_us % 1000000);
+
+    /* a single late read is dropped, not a step */
+    int64_t t = 1000000000LL + TS_NB_SAMPLES * 2 * SAMPLE_US;
+    ts_model_add(&ts_model, t, (uint32_t)(t * 10001 / 10000 + 17 + 50000));
+    assert(ts_model.stats.nb_resets == 0 && ts_model.nb_outliers == 1);
+    t += SAMPLE_US;
+    ts_model_add(&ts_model, t, (uint32_t)(t * 10001 / 10000 + 17));
+    assert(ts_model.stats.nb_resets == 0 && ts_model.nb_outliers == 0);
+}
+
+#ifdef TEST_TXPK_TIME
+static void check_txpk_time(void) {
+    static const struct {
+        const char *s;
+        bool ok;
+        int64_t sec;
+        int32_t usec;
+    } cases[] = {
+        { "1970-01-01T00:00:00Z", true, 0, 0 },
+        { "2013-03-31T16:21:17.528002Z", true, 1364746877, 528002 },
+        { "2000-02-29T23:59:59.5Z", true, 951868799, 500000 },
+        { "2021-12-31T23:59:59.1234567Z", true, 1640995199, 123456 },
+        { "2100-03-01T00:00:00Z", true, 4107542400LL, 0 },
+        { "2013-03-31T16:21:17.528002", false, 0, 0 },
+        { "2013-03-31 16:21:17Z", false, 0, 0 },
+        { "2013-13-31T16:21:17Z", false, 0, 0 },
+        { "2013-03-31T16:21Z", false, 0, 0 },
+    };
+    char json[128];
+    struct txpk_json_s txpk;
+    struct timeval tv;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int len = snprintf(json, sizeof(json), "{\"txpk\":{\"time\":\"%s\",\"tmst\":5}}", cases[i].s);
+        assert(txpk_json_parse(json, len, &txpk) == TXPK_JSON_OK);
+        assert(txpk_json_get_time(&txpk, TXPK_TIME, &tv) == cases[i].ok);
+        assert(!cases[i].ok || (tv.tv_sec == cases[i].sec && tv.tv_usec == cases[i].usec));
+    }
+    assert(!txpk_json_get_time(&txpk, TXPK_TMST, &tv));
+}
+#endif
+
+int main(void) {
+    check_model();
+    run_simulation();
+#ifdef TEST_TXPK_TIME
+    check_txpk_time();
+#endif
+    printf("timersync: OK\n");
+    return 0;
+}
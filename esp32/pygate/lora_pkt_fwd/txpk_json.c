@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    LoRa concentrator : parsing of the "txpk" JSON object of the Semtech UDP
+    protocol PULL_RESP datagrams, without memory allocation
+
+    The datagram is scanned once. The values of the known "txpk" fields are
+    recorded as pointers into it, everything else is checked and skipped.
+    Comments are accepted, like json_parse_string_with_comments() does.
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "txpk_json.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define MAX_DEPTH   16  /* deepest nesting of skipped objects and arrays */
+#define NUMBER_MAX  100000000000000000LL /* digits beyond this are only counted */
+
+/* names of the fields, in enum txpk_field_e order */
+static const char field_names[TXPK_NB_FIELDS][4] = {
+    "imme", "tmst", "time", "ncrc", "freq", "rfch", "powe", "modu",
+    "datr", "codr", "ipol", "prea", "fdev", "size", "data"
+};
+
+struct scan_s {
+    const char *p;
+    const char *end;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool is_digit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+/* skip white space and comments, returns the next char or 0 at the end */
+static char skip_ws(struct scan_s *s) {
+    while (s->p < s->end) {
+        switch (*s->p) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                s->p++;
+                break;
+            case '/':
+                if ((s->p + 1 < s->end) && (s->p[1] == '*')) {
+                    for (s->p += 2; (s->p + 1 < s->end) && !((s->p[0] == '*') && (s->p[1] == '/')); s->p++) {
+                    }
+                    s->p += 2;
+                } else if ((s->p + 1 < s->end) && (s->p[1] == '/')) {
+                    while ((s->p < s->end) && (*s->p != '\n')) {
+                        s->p++;
+                    }
+                } else {
+                    return '/';
+                }
+                break;
+            default:
+                return *s->p;
+        }
+    }
+    s->p = s->end;
+    return 0;
+}
+
+/* scan a string, s->p being on its opening quote */
+static bool scan_string(struct scan_s *s, const char **val, int *len) {
+    const char *start = ++s->p;
+    while (s->p < s->end) {
+        if (*s->p == '\\') {
+            s->p += 2;
+        } else if (*s->p == '"') {
+            *val = start;
+            *len = s->p - start;
+            s->p++;
+            return true;
+        } else {
+            s->p++;
+        }
+    }
+    return false;
+}
+
+static bool scan_literal(struct scan_s *s, const char *lit, int len) {
+    if ((s->end - s->p < len) || (memcmp(s->p, lit, len) != 0)) {
+        return false;
+    }
+    s->p += len;
+    return true;
+}
+
+static bool scan_number(struct scan_s *s) {
+    const char *start;
+    if (*s->p == '-') {
+        s->p++;
+    }
+    start = s->p;
+    while ((s->p < s->end) && is_digit(*s->p)) {
+        s->p++;
+    }
+    if (s->p == start) {
+        return false;
+    }
+    if ((s->p < s->end) && (*s->p == '.')) {
+        start = ++s->p;
+        while ((s->p < s->end) && is_digit(*s->p)) {
+            s->p++;
+        }
+        if (s->p == start) {
+            return false;
+        }
+    }
+    if ((s->p < s->end) && ((*s->p == 'e') || (*s->p == 'E'))) {
+        s->p++;
+        if ((s->p < s->end) && ((*s->p == '+') || (*s->p == '-'))) {
+            s->p++;
+        }
+        start = s->p;
+        while ((s->p < s->end) && is_digit(*s->p)) {
+            s->p++;
+        }
+        if (s->p == start) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int scan_value(struct scan_s *s, int depth, const char **val, int *len);
+
+/* scan an object, s->p being on its opening brace. The fields of a "txpk"
+   object found at the top level are recorded in txpk when it's not NULL. */
+static bool scan_object(struct scan_s *s, int depth, struct txpk_json_s *txpk, bool top, bool *found) {
+    const char *key, *val;
+    int key_len, len, type, i;
+
+    if (depth > MAX_DEPTH) {
+        return false;
+    }
+    s->p++;
+    if (skip_ws(s) == '}') {
+        s->p++;
+        return true;
+    }
+    for (;;) {
+        if ((skip_ws(s) != '"') || !scan_string(s, &key, &key_len) || (skip_ws(s) != ':')) {
+            return false;
+        }
+        s->p++;
+        if (skip_ws(s) == 0) {
+            return false;
+        }
+
+        if (top && (key_len == 4) && (memcmp(key, "txpk", 4) == 0) && (*s->p == '{')) {
+            memset(txpk, 0, sizeof(*txpk));
+            *found = true;
+            if (!scan_object(s, depth + 1, txpk, false, found)) {
+                return false;
+            }
+        } else {
+            type = scan_value(s, depth + 1, &val, &len);
+            if (type == TXPK_TYPE_NONE) {
+                return false;
+            }
+            if ((txpk != NULL) && !top && (key_len == 4)) {
+                for (i = 0; i < TXPK_NB_FIELDS; i++) {
+                    if (memcmp(key, field_names[i], 4) == 0) {
+                        txpk->val[i] = val;
+                        txpk->len[i] = len;
+                        txpk->type[i] = type;
+                        break;
+                    }
+                }
+            }
+        }
+
+        switch (skip_ws(s)) {
+            case ',':
+                s->p++;
+                break;
+            case '}':
+                s->p++;
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+static bool scan_array(struct scan_s *s, int depth) {
+    const char *val;
+    int len;
+
+    if (depth > MAX_DEPTH) {
+        return false;
+    }
+    s->p++;
+    if (skip_ws(s) == ']') {
+        s->p++;
+        return true;
+    }
+    for (;;) {
+        if ((skip_ws(s) == 0) || (scan_value(s, depth + 1, &val, &len) == TXPK_TYPE_NONE)) {
+            return false;
+        }
+        switch (skip_ws(s)) {
+            case ',':
+                s->p++;
+                break;
+            case ']':
+                s->p++;
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+/* scan any value, returns its type or TXPK_TYPE_NONE if it's invalid */
+static int scan_value(struct scan_s *s, int depth, const char **val, int *len) {
+    bool found;
+
+    *val = s->p;
+    switch (*s->p) {
+        case '"':
+            return scan_string(s, val, len) ? TXPK_TYPE_STRING : TXPK_TYPE_NONE;
+        case 't':
+            *len = 4;
+            return scan_literal(s, "true", 4) ? TXPK_TYPE_TRUE : TXPK_TYPE_NONE;
+        case 'f':
+            *len = 5;
+            return scan_literal(s, "false", 5) ? TXPK_TYPE_FALSE : TXPK_TYPE_NONE;
+        case 'n':
+            *len = 4;
+            return scan_literal(s, "null", 4) ? TXPK_TYPE_OTHER : TXPK_TYPE_NONE;
+        case '{':
+            return scan_object(s, depth, NULL, false, &found) ? TXPK_TYPE_OTHER : TXPK_TYPE_NONE;
+        case '[':
+            return scan_array(s, depth) ? TXPK_TYPE_OTHER : TXPK_TYPE_NONE;
+        default:
+            if (!scan_number(s)) {
+                return TXPK_TYPE_NONE;
+            }
+            *len = s->p - *val;
+            return TXPK_TYPE_NUMBER;
+    }
+}
+
+static int b64_value(char c) {
+    if ((c >= 'A') && (c <= 'Z')) {
+        return c - 'A';
+    } else if ((c >= 'a') && (c <= 'z')) {
+        return c - 'a' + 26;
+    } else if ((c >= '0') && (c <= '9')) {
+        return c - '0' + 52;
+    } else if (c == '+') {
+        return 62;
+    } else if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int txpk_json_parse(const char *json, int len, struct txpk_json_s *txpk) {
+    struct scan_s s = { json, json + len };
+    bool found = false;
+
+    if ((skip_ws(&s) != '{') || !scan_object(&s, 0, txpk, true, &found)) {
+        return TXPK_JSON_INVALID;
+    }
+    return found ? TXPK_JSON_OK : TXPK_JSON_NO_TXPK;
+}
+
+int txpk_json_get_boolean(const struct txpk_json_s *txpk, enum txpk_field_e field) {
+    switch (txpk->type[field]) {
+        case TXPK_TYPE_TRUE:
+            return 1;
+        case TXPK_TYPE_FALSE:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+bool txpk_json_get_number(const struct txpk_json_s *txpk, enum txpk_field_e field, int decimals, int64_t *value) {
+    const char *p = txpk->val[field];
+    const char *end = p + txpk->len[field];
+    bool neg = false;
+    bool exp_neg = false;
+    int64_t m = 0;
+    int exp = 0;
+
+    if (txpk->type[field] != TXPK_TYPE_NUMBER) {
+        return false;
+    }
+
+    /* the number syntax has been checked when scanning */
+    if (*p == '-') {
+        neg = true;
+        p++;
+    }
+    for (; (p < end) && is_digit(*p); p++) {
+        if (m < NUMBER_MAX) {
+            m = m * 10 + (*p - '0');
+        } else {
+            decimals++;
+        }
+    }
+    if ((p < end) && (*p == '.')) {
+        for (p++; (p < end) && is_digit(*p); p++) {
+            if (m < NUMBER_MAX) {
+                m = m * 10 + (*p - '0');
+                decimals--;
+            }
+        }
+    }
+    if (p < end) {
+        p++; /* e or E */
+        if ((*p == '+') || (*p == '-')) {
+            exp_neg = (*p == '-');
+            p++;
+        }
+        for (; (p < end) && (exp < 1000); p++) {
+            exp = exp * 10 + (*p - '0');
+        }
+        decimals += exp_neg ? -exp : exp;
+    }
+
+    for (; (decimals > 0) && (m != 0); decimals--) {
+        m = (m < INT64_MAX / 10) ? m * 10 : INT64_MAX;
+    }
+    for (; (decimals < 0) && (m != 0); decimals++) {
+        m /= 10;
+    }
+    *value = neg ? -m : m;
+    return true;
+}
+
+bool txpk_json_string_is(const struct txpk_json_s *txpk, enum txpk_field_e field, const char *s) {
+    int len = strlen(s);
+    return (txpk->type[field] == TXPK_TYPE_STRING) && (txpk->len[field] == len) && (memcmp(txpk->val[field], s, len) == 0);
+}
+
+/* n digits at *p, which moves past them, -1 if there aren't as many */
+static int get_digits(const char **p, const char *end, int n) {
+    int v = 0;
+
+    for (; n > 0; n--, (*p)++) {
+        if ((*p >= end) || !is_digit(**p)) {
+            return -1;
+        }
+        v = v * 10 + (**p - '0');
+    }
+    return v;
+}
+
+bool txpk_json_get_time(const struct txpk_json_s *txpk, enum txpk_field_e field, struct timeval *time) {
+    static const char seps[5] = { '-', '-', 'T', ':', ':' };
+    static const int widths[6] = { 4, 2, 2, 2, 2, 2 };
+    const char *p = txpk->val[field];
+    const char *end = p + txpk->len[field];
+    int v[6]; /* year, month, day, hours, minutes, seconds */
+    int32_t usec = 0;
+    int i, y, m, doe;
+
+    if (txpk->type[field] != TXPK_TYPE_STRING) {
+        return false;
+    }
+    for (i = 0; i < 6; i++) {
+        if ((i > 0) && ((p >= end) || (*p++ != seps[i - 1]))) {
+            return false;
+        }
+        if ((v[i] = get_digits(&p, end, widths[i])) < 0) {
+            return false;
+        }
+    }
+    if ((v[1] < 1) || (v[1] > 12) || (v[2] < 1) || (v[2] > 31) || (v[3] > 23) || (v[4] > 59) || (v[5] > 60)) {
+        return false;
+    }
+    if ((p < end) && (*p == '.')) {
+        /* fraction of second, anything past the microseconds is dropped */
+        for (p++, i = 0; (p < end) && is_digit(*p); p++, i++) {
+            if (i < 6) {
+                usec = usec * 10 + (*p - '0');
+            }
+        }
+        for (; i < 6; i++) {
+            usec *= 10;
+        }
+    }
+    if ((p + 1 != end) || (*p != 'Z')) {
+        return false;
+    }
+
+    /* days from the epoch of the proleptic Gregorian calendar date, with the
+       years starting in March so that the leap day comes last */
+    y = v[0] - (v[1] <= 2);
+    m = v[1] + ((v[1] > 2) ? -3 : 9);
+    doe = (y % 400) * 365 + (y % 400) / 4 - (y % 400) / 100 + (153 * m + 2) / 5 + v[2] - 1;
+    time->tv_sec = ((int64_t)(y / 400) * 146097 + doe - 719468) * 86400 + v[3] * 3600 + v[4] * 60 + v[5];
+    time->tv_usec = usec;
+    return true;
+}
+
+int txpk_json_get_data(const struct txpk_json_s *txpk, uint8_t *out, int max_len) {
+    const char *p = txpk->val[TXPK_DATA];
+    const char *end = p + txpk->len[TXPK_DATA];
+    uint32_t acc = 0;
+    int bits = 0;
+    int n = 0;
+    int v;
+
+    if (txpk->type[TXPK_DATA] != TXPK_TYPE_STRING) {
+        return -1;
+    }
+    for (; (p < end) && (*p != '='); p++) {
+        if (*p == '\\') {
+            continue; /* "\/" is a valid JSON escape of '/' */
+        }
+        v = b64_value(*p);
+        if (v < 0) {
+            return -1;
+        }
+        acc = ((acc << 6) | v) & 0xFFFF;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n == max_len) {
+                return -1;
+            }
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return n;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
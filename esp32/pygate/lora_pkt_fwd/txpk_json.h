@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    LoRa concentrator : parsing of the "txpk" JSON object of the Semtech UDP
+    protocol PULL_RESP datagrams, without memory allocation
+*/
+
+
+#ifndef _LORA_PKTFWD_TXPK_JSON_H
+#define _LORA_PKTFWD_TXPK_JSON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <sys/time.h>   /* timeval */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define TXPK_JSON_OK        0
+#define TXPK_JSON_INVALID   -1  /* the datagram is not a JSON object */
+#define TXPK_JSON_NO_TXPK   -2  /* there is no "txpk" object in it */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+enum txpk_field_e {
+    TXPK_IMME,
+    TXPK_TMST,
+    TXPK_TIME,
+    TXPK_NCRC,
+    TXPK_FREQ,
+    TXPK_RFCH,
+    TXPK_POWE,
+    TXPK_MODU,
+    TXPK_DATR,
+    TXPK_CODR,
+    TXPK_IPOL,
+    TXPK_PREA,
+    TXPK_FDEV,
+    TXPK_SIZE,
+    TXPK_DATA,
+    TXPK_NB_FIELDS
+};
+
+enum txpk_type_e {
+    TXPK_TYPE_NONE,     /* field absent */
+    TXPK_TYPE_STRING,
+    TXPK_TYPE_NUMBER,
+    TXPK_TYPE_TRUE,
+    TXPK_TYPE_FALSE,
+    TXPK_TYPE_OTHER     /* null, object or array */
+};
+
+/* The fields of a "txpk" object, pointing into the parsed datagram */
+struct txpk_json_s {
+    const char *val[TXPK_NB_FIELDS]; /* value of each field, strings without their quotes */
+    uint16_t len[TXPK_NB_FIELDS];   /* length of each value */
+    uint8_t type[TXPK_NB_FIELDS];   /* type of each value, TXPK_TYPE_NONE if absent */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Find the fields of the "txpk" object of a PULL_RESP JSON payload
+@param json JSON payload, it must stay in place while the fields are used
+@param len length of the payload
+@param txpk[out] fields of the "txpk" object
+@return TXPK_JSON_OK, TXPK_JSON_INVALID or TXPK_JSON_NO_TXPK
+*/
+int txpk_json_parse(const char *json, int len, struct txpk_json_s *txpk);
+
+/**
+@brief Get a boolean field
+@return 1 if true, 0 if false, -1 if absent or not a boolean
+*/
+int txpk_json_get_boolean(const struct txpk_json_s *txpk, enum txpk_field_e field);
+
+/**
+@brief Get a number field, as an integer
+@param decimals the value is returned multiplied by 10^decimals, truncated
+@param value[out] the field value
+@return false if absent or not a number
+*/
+bool txpk_json_get_number(const struct txpk_json_s *txpk, enum txpk_field_e field, int decimals, int64_t *value);
+
+/**
+@brief Compare a string field to a string
+@return true if the field is a string equal to s
+*/
+bool txpk_json_string_is(const struct txpk_json_s *txpk, enum txpk_field_e field, const char *s);
+
+/**
+@brief Get an ISO 8601 UTC time field, as "2013-03-31T16:21:17.528002Z"
+@param time[out] the time, from the Unix epoch
+@return false if absent or not such a time
+*/
+bool txpk_json_get_time(const struct txpk_json_s *txpk, enum txpk_field_e field, struct timeval *time);
+
+/**
+@brief Decode the base64 "data" field straight from the datagram
+@param out buffer receiving the payload
+@param max_len size of the buffer
+@return length of the payload, -1 if absent, invalid or too long
+*/
+int txpk_json_get_data(const struct txpk_json_s *txpk, uint8_t *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host benchmark of the PULL_RESP parsing: parson, as thread_down used it,
+    against txpk_json, on PULL_RESP samples as sent by the usual network
+    servers. Both must give the same TX packets. Reports the parsing time
+    and the heap used by parson. See README for how to build and run it.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "parson.h"
+#include "base64.h"
+#include "txpk_json.h"
+
+#define ROUNDS      50000
+
+static const char *samples[] = {
+    "{\"txpk\":{\"imme\":false,\"tmst\":1523917044,\"freq\":868.1,\"rfch\":0,\"powe\":14,\"modu"
+    "\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":33,\"ncrc\":true"
+    ",\"data\":\"pU3KGCUwux1tEyze1iN7LtkeP3IfyxlxF0SU1kk8nVw0\"}}",
+    "{\"txpk\":{\"imme\":false,\"rfch\":0,\"powe\":27,\"ant\":0,\"brd\":0,\"tmst\":3651235276,\""
+    "freq\":869.525,\"modu\":\"LORA\",\"datr\":\"SF12BW125\",\"codr\":\"4/5\",\"ipol\":true,\"s"
+    "ize\":17,\"data\":\"YL4xIB5p/tqg7ui5mX9cfCk=\"}}",
+    "{\"txpk\":{\"imme\":false,\"tmst\":40002211,\"freq\":923.3,\"rfch\":0,\"powe\":20,\"modu\""
+    ":\"LORA\",\"datr\":\"SF10BW500\",\"codr\":\"4/5\",\"ipol\":true,\"size\":64,\"data\":\"mf2"
+    "v5ZMlPNZUr0361xQnoK6z/ukjL4ryIR+e5JHFsQvstVY7/B5vk0J+y8j+KVXlzY5G3I7Ut8J2TSpaTXZ3Bg==\"}}",
+    "{\"txpk\":{\"imme\":true,\"freq\":869.525,\"rfch\":0,\"powe\":14,\"modu\":\"LORA\",\"datr\""
+    ":\"SF9BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":12,\"data\":\"+F2GkAJK1r2jQBvp\"}}",
+    "{\"txpk\":{\"imme\":true,\"freq\":868.8,\"rfch\":0,\"powe\":14,\"modu\":\"FSK\",\"datr\":5"
+    "0000,\"fdev\":25000,\"prea\":5,\"size\":20,\"data\":\"yMvMyTX2zR9hImrhUziuGjQATTM=\"}}",
+    "{\n  \"txpk\": {\n    \"imme\": false,\n    \"tmst\": 2001551,\n    \"freq\": 867.9,\n    "
+    "\"rfch\": 0,\n    \"powe\": 14,\n    \"modu\": \"LORA\",\n    \"datr\": \"SF8BW125\",\n   "
+    " \"codr\": \"4/5\",\n    \"ipol\": true,\n    \"prea\": 8,\n    \"size\": 51,\n    \"data\""
+    ": \"ug0kasBMgbG68j47+e71958rSTSvh\\/VSC2m5Sw2YLoW7VbZyqHJjes10Zvy2Dg6P8YRj\",\n    \"brd\""
+    ": 0,\n    \"ant\": 0\n  }\n}",
+    "{\"txpk\":{\"imme\":false,\"tmst\":889123401,\"freq\":868.3,\"rfch\":0,\"powe\":14,\"modu\""
+    ":\"LORA\",\"datr\":\"SF7BW250\",\"codr\":\"4/6\",\"ipol\":true,\"size\":222,\"data\":\"sOS"
+    "yuilwNHTwZKxo9wD1sCs9xmb0W96qLMrtzStRV0EOTe5K8rNPQwoHNEfeY2wOgGyVe6aE1kMfterXQk0J4V0CTFhI8"
+    "j0fpvc2HX9hjRUy5w4g4qZmjef0foRn5UbVPsjioSV72yVsmz5Pu0mBRu9wMMv5U3JS3M6t12S2oy+7Ca3q4QnEqZc"
+    "gOXU1K4eLFFyKQtiEz0z9py2OHV3ZJYkILYUqcSKHPugFrdWJQhZ6OFKGGVxnn5xplORbirEJgBIHCWHzfeQ23f3Jn"
+    "W51r2VHz7EbQgckgtxTHCvD\"}}",
+};
+#define NB_SAMPLES  (int)(sizeof(samples) / sizeof(samples[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- HEAP ACCOUNTING ------------------------------------------------------ */
+
+static size_t heap_in_use;
+static size_t heap_peak;
+static unsigned heap_allocs;
+
+static void *counting_malloc(size_t size) {
+    size_t *p = malloc(sizeof(size_t) + size);
+    *p = size;
+    heap_in_use += size;
+    heap_allocs++;
+    if (heap_in_use > heap_peak) {
+        heap_peak = heap_in_use;
+    }
+    return p + 1;
+}
+
+static void counting_free(void *ptr) {
+    size_t *p = ptr;
+    if (p != NULL) {
+        heap_in_use -= p[-1];
+        free(p - 1);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PARSERS -------------------------------------------------------------- */
+
+static int datr_lora(const char *str, struct lgw_pkt_tx_s *pkt) {
+    short x0, x1;
+    if (sscanf(str, "SF%2hdBW%3hd", &x0, &x1) != 2) {
+        return -1;
+    }
+    pkt->datarate = DR_LORA_SF7 << (x0 - 7);
+    pkt->bandwidth = (x1 == 125) ? BW_125KHZ : ((x1 == 250) ? BW_250KHZ : BW_500KHZ);
+    return 0;
+}
+
+/* the fields thread_down reads, the way it used to */
+static int parse_parson(const char *json, struct lgw_pkt_tx_s *pkt) {
+    JSON_Value *root_val;
+    JSON_Object *txpk_obj;
+    JSON_Value *val;
+    const char *str;
+    int r = -1;
+
+    memset(pkt, 0, sizeof(*pkt));
+    root_val = json_parse_string_with_comments(json);
+    if (root_val == NULL) {
+        return -1;
+    }
+    txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+    if (txpk_obj == NULL) {
+        goto out;
+    }
+    pkt->tx_mode = (json_object_get_boolean(txpk_obj, "imme") == 1) ? IMMEDIATE : TIMESTAMPED;
+    if (pkt->tx_mode == TIMESTAMPED) {
+        pkt->count_us = (uint32_t)json_object_get_number(txpk_obj, "tmst");
+    }
+    if ((val = json_object_get_value(txpk_obj, "ncrc")) != NULL) {
+        pkt->no_crc = (bool)json_value_get_boolean(val);
+    }
+    pkt->freq_hz = (uint32_t)((double)(1.0e6) * json_object_get_number(txpk_obj, "freq"));
+    pkt->rf_chain = (uint8_t)json_object_get_number(txpk_obj, "rfch");
+    pkt->rf_power = (int8_t)json_object_get_number(txpk_obj, "powe");
+    str = json_object_get_string(txpk_obj, "modu");
+    if ((str != NULL) && (strcmp(str, "LORA") == 0)) {
+        pkt->modulation = MOD_LORA;
+        if ((str = json_object_get_string(txpk_obj, "datr")) == NULL || (datr_lora(str, pkt) != 0)) {
+            goto out;
+        }
+        str = json_object_get_string(txpk_obj, "codr");
+        pkt->coderate = (str != NULL) && (strcmp(str, "4/6") == 0) ? CR_LORA_4_6 : CR_LORA_4_5;
+        if ((val = json_object_get_value(txpk_obj, "ipol")) != NULL) {
+            pkt->invert_pol = (bool)json_value_get_boolean(val);
+        }
+    } else {
+        pkt->modulation = MOD_FSK;
+        pkt->datarate = (uint32_t)json_object_get_number(txpk_obj, "datr");
+        pkt->f_dev = (uint8_t)(json_object_get_number(txpk_obj, "fdev") / 1000.0);
+    }
+    if ((val = json_object_get_value(txpk_obj, "prea")) != NULL) {
+        pkt->preamble = (uint16_t)json_value_get_number(val);
+    }
+    pkt->size = (uint16_t)json_object_get_number(txpk_obj, "size");
+    str = json_object_get_string(txpk_obj, "data");
+    if ((str == NULL) || (b64_to_bin(str, strlen(str), pkt->payload, sizeof pkt->payload) != pkt->size)) {
+        goto out;
+    }
+    r = 0;
+out:
+    json_value_free(root_val);
+    return r;
+}
+
+/* the same with txpk_json, the way thread_down does now */
+static int parse_txpk(const char *json, int len, struct lgw_pkt_tx_s *pkt) {
+    struct txpk_json_s txpk;
+    int64_t num;
+    int i;
+
+    memset(pkt, 0, sizeof(*pkt));
+    if (txpk_json_parse(json, len, &txpk) != TXPK_JSON_OK) {
+        return -1;
+    }
+    pkt->tx_mode = (txpk_json_get_boolean(&txpk, TXPK_IMME) == 1) ? IMMEDIATE : TIMESTAMPED;
+    if ((pkt->tx_mode == TIMESTAMPED) && txpk_json_get_number(&txpk, TXPK_TMST, 0, &num)) {
+        pkt->count_us = (uint32_t)num;
+    }
+    if ((i = txpk_json_get_boolean(&txpk, TXPK_NCRC)) >= 0) {
+        pkt->no_crc = (bool)i;
+    }
+    if (txpk_json_get_number(&txpk, TXPK_FREQ, 6, &num)) {
+        pkt->freq_hz = (uint32_t)num;
+    }
+    if (txpk_json_get_number(&txpk, TXPK_RFCH, 0, &num)) {
+        pkt->rf_chain = (uint8_t)num;
+    }
+    if (txpk_json_get_number(&txpk, TXPK_POWE, 0, &num)) {
+        pkt->rf_power = (int8_t)num;
+    }
+    if (txpk_json_string_is(&txpk, TXPK_MODU, "LORA")) {
+        pkt->modulation = MOD_LORA;
+        if ((txpk.type[TXPK_DATR] != TXPK_TYPE_STRING) || (datr_lora(txpk.val[TXPK_DATR], pkt) != 0)) {
+            return -1;
+        }
+        pkt->coderate = txpk_json_string_is(&txpk, TXPK_CODR, "4/6") ? CR_LORA_4_6 : CR_LORA_4_5;
+        if ((i = txpk_json_get_boolean(&txpk, TXPK_IPOL)) >= 0) {
+            pkt->invert_pol = (bool)i;
+        }
+    } else {
+        pkt->modulation = MOD_FSK;
+        if (txpk_json_get_number(&txpk, TXPK_DATR, 0, &num)) {
+            pkt->datarate = (uint32_t)num;
+        }
+        if (txpk_json_get_number(&txpk, TXPK_FDEV, -3, &num)) {
+            pkt->f_dev = (uint8_t)num;
+        }
+    }
+    if (txpk_json_get_number(&txpk, TXPK_PREA, 0, &num)) {
+        pkt->preamble = (uint16_t)num;
+    }
+    if (txpk_json_get_number(&txpk, TXPK_SIZE, 0, &num)) {
+        pkt->size = (uint16_t)num;
+    }
+    if (txpk_json_get_data(&txpk, pkt->payload, sizeof pkt->payload) != pkt->size) {
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN ----------------------------------------------------------------- */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    static int len[NB_SAMPLES];
+    struct lgw_pkt_tx_s a, b;
+    long bytes = 0;
+    double t_parson, t_txpk;
+    int i, r;
+
+    json_set_allocation_functions(counting_malloc, counting_free);
+    for (i = 0; i < NB_SAMPLES; ++i) {
+        len[i] = strlen(samples[i]);
+        bytes += len[i];
+        heap_peak = heap_in_use;
+        heap_allocs = 0;
+        if ((parse_parson(samples[i], &a) != 0) || (parse_txpk(samples[i], len[i], &b) != 0)) {
+            printf("sample %d: parsing failed\n", i);
+            return 1;
+        }
+        if ((memcmp(&a, &b, offsetof(struct lgw_pkt_tx_s, payload)) != 0) || (memcmp(a.payload, b.payload, a.size) != 0)) {
+            printf("sample %d: different TX packets (freq %u/%u)\n", i, a.freq_hz, b.freq_hz);
+            return 1;
+        }
+        printf("sample %d: %3d bytes, parson %2u allocations, %4u bytes of heap at peak\n", i, len[i], heap_allocs, (unsigned)heap_peak);
+    }
+
+    t_parson = now();
+    for (r = 0; r < ROUNDS; ++r) {
+        for (i = 0; i < NB_SAMPLES; ++i) {
+            parse_parson(samples[i], &a);
+        }
+    }
+    t_parson = now() - t_parson;
+
+    t_txpk = now();
+    for (r = 0; r < ROUNDS; ++r) {
+        for (i = 0; i < NB_SAMPLES; ++i) {
+            parse_txpk(samples[i], len[i], &b);
+        }
+    }
+    t_txpk = now() - t_txpk;
+
+    printf("parson:    %5.0f ns/datagram, %5.1f MB/s\n", t_parson * 1e9 / (ROUNDS * NB_SAMPLES), bytes * (double)ROUNDS / t_parson / 1e6);
+    printf("txpk_json: %5.0f ns/datagram, %5.1f MB/s, no heap\n", t_txpk * 1e9 / (ROUNDS * NB_SAMPLES), bytes * (double)ROUNDS / t_txpk / 1e6);
+    printf("%d samples, same TX packets\n", NB_SAMPLES);
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
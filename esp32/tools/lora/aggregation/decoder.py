@@ -0,0 +1,26 @@
+# Splits the uplinks of a node using socket.SO_AGGREGATE back into the
+# records it sent, for the application server side. The aggregated uplinks
+# come on FPort 223, each record is its tag (the port the socket was bound
+# to when it was sent), its length and its data.
+
+AGGREGATED_PORT = 223
+
+def decode(payload):
+    records = []
+    i = 0
+    while i + 2 <= len(payload):
+        tag, length = payload[i], payload[i + 1]
+        if i + 2 + length > len(payload):
+            raise ValueError('truncated record at byte %d' % i)
+        records.append((tag, bytes(payload[i + 2:i + 2 + length])))
+        i += 2 + length
+    if i != len(payload):
+        raise ValueError('trailing byte')
+    return records
+
+if __name__ == '__main__':
+    import binascii
+    import sys
+    for frame in sys.argv[1:]:
+        for tag, data in decode(binascii.unhexlify(frame)):
+            print(tag, binascii.hexlify(data).decode())
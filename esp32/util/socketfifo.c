@@ -23,52 +23,45 @@
 static void socketfifo_Push (void * const pvFifo, const void * const pvElement);
 static void socketfifo_Pop (void * const pvFifo, void * const pvElement);
 
-/*----------------------------------------------------------------------------
- ** Declare private data
- */
-static FIFO_t *socketfifo;
-
 /*----------------------------------------------------------------------------
  ** Define public functions
  */
 void SOCKETFIFO_Init (FIFO_t *fifo, void *elements, uint32_t maxcount) {
-    // Initialize global data
-    socketfifo = fifo;
-    socketfifo->pvElements = elements;
-    FIFO_Init (socketfifo, maxcount, socketfifo_Push, socketfifo_Pop);
+    fifo->pvElements = elements;
+    FIFO_Init (fifo, maxcount, socketfifo_Push, socketfifo_Pop);
 }
 
-bool SOCKETFIFO_Push (const void * const element) {
-    return FIFO_bPushElement (socketfifo, element);
+bool SOCKETFIFO_Push (FIFO_t *fifo, const void * const element) {
+    return FIFO_bPushElement (fifo, element);
 }
 
-bool SOCKETFIFO_Pop (void * const element) {
-    return FIFO_bPopElement (socketfifo, element);
+bool SOCKETFIFO_Pop (FIFO_t *fifo, void * const element) {
+    return FIFO_bPopElement (fifo, element);
 }
 
-bool SOCKETFIFO_Peek (void * const element) {
-    return FIFO_bPeekElement (socketfifo, element);
+bool SOCKETFIFO_Peek (FIFO_t *fifo, void * const element) {
+    return FIFO_bPeekElement (fifo, element);
 }
 
-bool SOCKETFIFO_IsEmpty (void) {
-    return FIFO_IsEmpty (socketfifo);
+bool SOCKETFIFO_IsEmpty (FIFO_t *fifo) {
+    return FIFO_IsEmpty (fifo);
 }
 
-bool SOCKETFIFO_IsFull (void) {
-    return FIFO_IsFull (socketfifo);
+bool SOCKETFIFO_IsFull (FIFO_t *fifo) {
+    return FIFO_IsFull (fifo);
 }
 
-void SOCKETFIFO_Flush (void) {
+void SOCKETFIFO_Flush (FIFO_t *fifo) {
     SocketFifoElement_t element;
-    while (SOCKETFIFO_Pop(&element)) {
+    while (SOCKETFIFO_Pop(fifo, &element)) {
         if (element.freedata) {
             free(element.data);
         }
     }
 }
 
-unsigned int SOCKETFIFO_Count (void) {
-    return socketfifo->uiElementCount;
+unsigned int SOCKETFIFO_Count (FIFO_t *fifo) {
+    return fifo->uiElementCount;
 }
 
 /*----------------------------------------------------------------------------
@@ -35,12 +35,12 @@ typedef struct {
  ** Declare public functions
  */
 extern void SOCKETFIFO_Init (FIFO_t *fifo, void *elements, uint32_t maxcount);
-extern bool SOCKETFIFO_Push (const void * const element);
-extern bool SOCKETFIFO_Pop (void * const element);
-extern bool SOCKETFIFO_Peek (void * const element);
-extern bool SOCKETFIFO_IsEmpty (void);
-extern bool SOCKETFIFO_IsFull (void);
-extern void SOCKETFIFO_Flush (void);
-extern unsigned int SOCKETFIFO_Count (void);
+extern bool SOCKETFIFO_Push (FIFO_t *fifo, const void * const element);
+extern bool SOCKETFIFO_Pop (FIFO_t *fifo, void * const element);
+extern bool SOCKETFIFO_Peek (FIFO_t *fifo, void * const element);
+extern bool SOCKETFIFO_IsEmpty (FIFO_t *fifo);
+extern bool SOCKETFIFO_IsFull (FIFO_t *fifo);
+extern void SOCKETFIFO_Flush (FIFO_t *fifo);
+extern unsigned int SOCKETFIFO_Count (FIFO_t *fifo);
 
 #endif /* SOCKETFIFO_H_ */
@@ -0,0 +1,1044 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/builtin.h"
+#include "py/objstr.h"
+
+#if MICROPY_PY_UHTTPD
+
+// HTTP/1.1 server core over any connected stream, usually a socket returned
+// by accept().  Server.serve(sock) answers requests on the connection until
+// the client closes it, asks to, or sends nothing within the socket's timeout.
+//
+// A request is parsed in a buffer allocated once per server: the request
+// line and headers must fit in it.  The headers that matter to the server
+// (Content-Length, Transfer-Encoding, Connection, Accept-Encoding) are
+// picked out in place; the headers dict of a Request is only built when a
+// handler asks for it.  The same buffer carries static files to the client,
+// so serving them allocates nothing per block.
+//
+// Paths with a handler registered by route() go to it, anything else that
+// is a GET or HEAD is looked up as a file under root.  When the client
+// accepts gzip and a precompressed "<file>.gz" exists, that one is sent as
+// it is with Content-Encoding: gzip.
+
+// the status line and headers of a response are gathered until they fill this
+#define HTTPD_TX_COALESCE   (256)
+// longest file name tried under root, including an appended index.html or .gz
+#define HTTPD_PATH_MAX      (128)
+
+typedef struct _mp_obj_httpd_t {
+    mp_obj_base_t base;
+    mp_obj_t routes;    // dict of path -> handler
+    mp_obj_t root;      // directory of static files, or MP_OBJ_NULL
+    byte *buf;
+    size_t buf_size;
+    size_t max_body;
+    uint16_t max_requests;
+    uint32_t connections;
+    uint32_t requests;
+    uint32_t files;
+    uint32_t gzip;
+    uint32_t errors;
+} mp_obj_httpd_t;
+
+typedef struct _mp_obj_httpd_req_t {
+    mp_obj_base_t base;
+    mp_obj_t method;
+    mp_obj_t path;
+    mp_obj_t query;
+    mp_obj_t body;
+    mp_obj_t headers;   // MP_OBJ_NULL until asked for
+    const byte *hdr;    // raw header lines, only valid while the handler runs
+    size_t hdr_len;
+} mp_obj_httpd_req_t;
+
+// the part of the server's buffer after the headers, where the body and any
+// pipelined requests are read into
+typedef struct _httpd_in_t {
+    mp_obj_t sock;
+    const mp_stream_p_t *stream_p;
+    byte *buf;
+    size_t base;
+    size_t pos;
+    size_t len;
+    size_t cap;
+} httpd_in_t;
+
+typedef struct _httpd_tx_t {
+    mp_obj_t sock;
+    size_t len;
+    byte buf[HTTPD_TX_COALESCE];
+} httpd_tx_t;
+
+// what serve() found out about a request, besides what goes into the Request
+typedef struct _httpd_info_t {
+    size_t content_length;
+    bool has_length;
+    bool chunked;
+    bool keep_alive;
+    bool http11;
+    bool gzip;
+    bool head;
+} httpd_info_t;
+
+STATIC const mp_obj_type_t httpd_request_type;
+
+STATIC const qstr httpd_methods[] = {
+    MP_QSTR_GET, MP_QSTR_HEAD, MP_QSTR_POST, MP_QSTR_PUT, MP_QSTR_DELETE, MP_QSTR_PATCH, MP_QSTR_OPTIONS,
+};
+
+STATIC const struct {
+    uint16_t status;
+    const char *reason;
+} httpd_reasons[] = {
+    { 200, "OK" },
+    { 201, "Created" },
+    { 202, "Accepted" },
+    { 204, "No Content" },
+    { 301, "Moved Permanently" },
+    { 302, "Found" },
+    { 303, "See Other" },
+    { 304, "Not Modified" },
+    { 307, "Temporary Redirect" },
+    { 400, "Bad Request" },
+    { 401, "Unauthorized" },
+    { 403, "Forbidden" },
+    { 404, "Not Found" },
+    { 405, "Method Not Allowed" },
+    { 409, "Conflict" },
+    { 413, "Payload Too Large" },
+    { 415, "Unsupported Media Type" },
+    { 431, "Request Header Fields Too Large" },
+    { 500, "Internal Server Error" },
+    { 501, "Not Implemented" },
+    { 503, "Service Unavailable" },
+};
+
+STATIC const struct {
+    const char *ext;
+    const char *type;
+} httpd_types[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "application/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "ico", "image/x-icon" },
+    { "wasm", "application/wasm" },
+};
+
+/******************************************************************************/
+// reading the request
+
+// Reads what is available, up to len bytes.  Returns 0 at the end of the
+// stream, and when idle is set also when the socket's timeout ran out.
+STATIC mp_uint_t httpd_read(httpd_in_t *in, byte *buf, size_t len, bool idle) {
+    int errcode;
+    mp_uint_t n = in->stream_p->read(in->sock, buf, len, &errcode);
+    if (n == MP_STREAM_ERROR) {
+        if (idle && (mp_is_nonblocking_error(errcode) || errcode == MP_ETIMEDOUT)) {
+            return 0;
+        }
+        mp_raise_OSError(errcode);
+    }
+    return n;
+}
+
+STATIC int httpd_in_getc(httpd_in_t *in) {
+    if (in->pos == in->len) {
+        in->pos = in->len = in->base;
+        mp_uint_t n = httpd_read(in, in->buf + in->base, in->cap - in->base, false);
+        if (n == 0) {
+            return -1;
+        }
+        in->len += n;
+    }
+    return in->buf[in->pos++];
+}
+
+// copies n bytes of body, taking what is buffered first and the rest
+// straight from the stream
+STATIC bool httpd_in_read(httpd_in_t *in, byte *dest, size_t n) {
+    size_t avail = MIN(n, in->len - in->pos);
+    memcpy(dest, in->buf + in->pos, avail);
+    in->pos += avail;
+    dest += avail;
+    n -= avail;
+    while (n > 0) {
+        mp_uint_t got = httpd_read(in, dest, n, false);
+        if (got == 0) {
+            return false;
+        }
+        dest += got;
+        n -= got;
+    }
+    return true;
+}
+
+// reads a chunk-size line, ignoring any extensions; returns -1 if it is bad
+STATIC mp_int_t httpd_in_chunk_size(httpd_in_t *in) {
+    mp_int_t size = 0;
+    int digits = 0;
+    int c;
+    while ((c = httpd_in_getc(in)) >= 0 && unichar_isxdigit(c)) {
+        if (++digits > 7) {
+            return -1;
+        }
+        size = size * 16 + unichar_xdigit_value(c);
+    }
+    while (c >= 0 && c != '\n') {
+        c = httpd_in_getc(in);
+    }
+    return (c < 0 || digits == 0) ? -1 : size;
+}
+
+// skips the rest of a line, true if it was empty
+STATIC bool httpd_in_skip_line(httpd_in_t *in, bool *empty) {
+    size_t n = 0;
+    int c;
+    while ((c = httpd_in_getc(in)) >= 0 && c != '\n') {
+        n += (c != '\r');
+    }
+    *empty = (n == 0);
+    return c >= 0;
+}
+
+// Reads the body of a request into a bytes object.  Returns the HTTP status
+// to answer with instead when it can't be read.
+STATIC int httpd_read_body(mp_obj_httpd_t *self, httpd_in_t *in, const httpd_info_t *info, mp_obj_t *body) {
+    vstr_t vstr;
+    if (info->chunked) {
+        if (in->cap - in->base < 16) {
+            return 431;
+        }
+        vstr_init(&vstr, 64);
+        for (;;) {
+            mp_int_t size = httpd_in_chunk_size(in);
+            if (size < 0) {
+                vstr_clear(&vstr);
+                return 400;
+            }
+            if (size == 0) {
+                break;
+            }
+            if (vstr.len + size > self->max_body) {
+                vstr_clear(&vstr);
+                return 413;
+            }
+            bool empty;
+            if (!httpd_in_read(in, (byte*)vstr_add_len(&vstr, size), size)
+                || !httpd_in_skip_line(in, &empty) || !empty) {
+                vstr_clear(&vstr);
+                return 400;
+            }
+        }
+        // trailer fields up to the final empty line
+        bool empty = false;
+        while (!empty) {
+            if (!httpd_in_skip_line(in, &empty)) {
+                vstr_clear(&vstr);
+                return 400;
+            }
+        }
+    } else if (info->content_length > 0) {
+        if (info->content_length > self->max_body) {
+            return 413;
+        }
+        vstr_init_len(&vstr, info->content_length);
+        if (!httpd_in_read(in, (byte*)vstr.buf, vstr.len)) {
+            vstr_clear(&vstr);
+            return 400;
+        }
+    } else {
+        *body = mp_const_empty_bytes;
+        return 0;
+    }
+    *body = mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+    return 0;
+}
+
+STATIC bool httpd_name_is(const byte *name, size_t len, const char *lower) {
+    for (size_t i = 0; i < len; i++) {
+        if (lower[i] == '\0' || unichar_tolower(name[i]) != (unichar)(unsigned char)lower[i]) {
+            return false;
+        }
+    }
+    return lower[len] == '\0';
+}
+
+// whether a comma separated header value has the given token
+STATIC bool httpd_has_token(const byte *val, size_t len, const char *lower) {
+    size_t tlen = strlen(lower);
+    for (size_t i = 0; i + tlen <= len; i++) {
+        if ((i == 0 || val[i - 1] == ',' || val[i - 1] == ' ')
+            && httpd_name_is(val + i, tlen, lower)
+            && (i + tlen == len || val[i + tlen] == ',' || val[i + tlen] == ' ' || val[i + tlen] == ';')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Calls fun for every "Name: value" line, with the value trimmed.  Returns
+// false if a line is not a header.
+STATIC bool httpd_each_header(const byte *hdr, size_t len,
+    void (*fun)(void *arg, const byte *name, size_t nlen, const byte *val, size_t vlen), void *arg) {
+    const byte *end = hdr + len;
+    while (hdr < end) {
+        const byte *eol = memchr(hdr, '\n', end - hdr);
+        if (eol == NULL) {
+            eol = end;
+        }
+        const byte *line_end = (eol > hdr && eol[-1] == '\r') ? eol - 1 : eol;
+        if (line_end > hdr) {
+            const byte *colon = memchr(hdr, ':', line_end - hdr);
+            if (colon == NULL || colon == hdr) {
+                return false;
+            }
+            const byte *val = colon + 1;
+            while (val < line_end && (*val == ' ' || *val == '\t')) {
+                val++;
+            }
+            const byte *val_end = line_end;
+            while (val_end > val && (val_end[-1] == ' ' || val_end[-1] == '\t')) {
+                val_end--;
+            }
+            fun(arg, hdr, colon - hdr, val, val_end - val);
+        }
+        hdr = eol + 1;
+    }
+    return true;
+}
+
+STATIC void httpd_scan_header(void *arg, const byte *name, size_t nlen, const byte *val, size_t vlen) {
+    httpd_info_t *info = arg;
+    if (httpd_name_is(name, nlen, "content-length")) {
+        size_t n = 0;
+        bool ok = vlen > 0 && vlen < 10;
+        for (size_t i = 0; ok && i < vlen; i++) {
+            ok = unichar_isdigit(val[i]);
+            n = n * 10 + val[i] - '0';
+        }
+        // a bad length can't be skipped over, the connection is closed after the error
+        info->has_length = true;
+        info->content_length = ok ? n : (size_t)-1;
+    } else if (httpd_name_is(name, nlen, "transfer-encoding")) {
+        info->chunked = httpd_has_token(val, vlen, "chunked");
+    } else if (httpd_name_is(name, nlen, "connection")) {
+        if (httpd_has_token(val, vlen, "close")) {
+            info->keep_alive = false;
+        } else if (httpd_has_token(val, vlen, "keep-alive")) {
+            info->keep_alive = true;
+        }
+    } else if (httpd_name_is(name, nlen, "accept-encoding")) {
+        info->gzip = httpd_has_token(val, vlen, "gzip");
+    }
+}
+
+STATIC void httpd_store_header(void *arg, const byte *name, size_t nlen, const byte *val, size_t vlen) {
+    vstr_t vstr;
+    vstr_init_len(&vstr, nlen);
+    for (size_t i = 0; i < nlen; i++) {
+        vstr.buf[i] = unichar_tolower(name[i]);
+    }
+    mp_obj_dict_store(MP_OBJ_FROM_PTR(arg), mp_obj_new_str_from_vstr(&mp_type_str, &vstr),
+        mp_obj_new_str((const char*)val, vlen));
+}
+
+// returns the length of the request line and headers, or 0 if incomplete
+STATIC size_t httpd_find_end(const byte *buf, size_t from, size_t len) {
+    for (size_t i = from; i + 3 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+STATIC int httpd_hex_value(byte c) {
+    if (!unichar_isxdigit(c)) {
+        return -1;
+    }
+    return (int)unichar_xdigit_value(c);
+}
+
+// the path with %XX escapes decoded, reusing an interned string when there is one
+STATIC mp_obj_t httpd_decode_path(const byte *p, size_t len) {
+    if (memchr(p, '%', len) == NULL) {
+        return mp_obj_new_str((const char*)p, len);
+    }
+    vstr_t vstr;
+    vstr_init(&vstr, len);
+    for (size_t i = 0; i < len; i++) {
+        int hi, lo;
+        if (p[i] == '%' && i + 2 < len && (hi = httpd_hex_value(p[i + 1])) >= 0
+            && (lo = httpd_hex_value(p[i + 2])) >= 0) {
+            vstr_add_byte(&vstr, hi << 4 | lo);
+            i += 2;
+        } else {
+            vstr_add_byte(&vstr, p[i]);
+        }
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+
+/******************************************************************************/
+// writing the response
+
+STATIC void httpd_write(mp_obj_t sock, const void *buf, size_t len) {
+    int errcode;
+    mp_stream_write_exactly(sock, buf, len, &errcode);
+    if (errcode != 0) {
+        mp_raise_OSError(errcode);
+    }
+}
+
+STATIC void httpd_tx_flush(httpd_tx_t *tx) {
+    if (tx->len > 0) {
+        httpd_write(tx->sock, tx->buf, tx->len);
+        tx->len = 0;
+    }
+}
+
+STATIC void httpd_tx_add(httpd_tx_t *tx, const void *data, size_t len) {
+    if (tx->len + len > sizeof(tx->buf)) {
+        httpd_tx_flush(tx);
+        if (len > sizeof(tx->buf)) {
+            httpd_write(tx->sock, data, len);
+            return;
+        }
+    }
+    memcpy(tx->buf + tx->len, data, len);
+    tx->len += len;
+}
+
+STATIC void httpd_tx_str(httpd_tx_t *tx, const char *str) {
+    httpd_tx_add(tx, str, strlen(str));
+}
+
+STATIC void httpd_tx_uint(httpd_tx_t *tx, size_t n, int base) {
+    char buf[12];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = "0123456789abcdef"[n % base];
+        n /= base;
+    } while (n);
+    httpd_tx_add(tx, p, buf + sizeof(buf) - p);
+}
+
+STATIC void httpd_tx_header(httpd_tx_t *tx, const char *name, const char *value) {
+    httpd_tx_str(tx, name);
+    httpd_tx_add(tx, ": ", 2);
+    httpd_tx_str(tx, value);
+    httpd_tx_add(tx, "\r\n", 2);
+}
+
+STATIC const char *httpd_reason(int status) {
+    for (size_t i = 0; i < MP_ARRAY_SIZE(httpd_reasons); i++) {
+        if (httpd_reasons[i].status == status) {
+            return httpd_reasons[i].reason;
+        }
+    }
+    return "";
+}
+
+// the status line and the headers every response has
+STATIC void httpd_tx_start(httpd_tx_t *tx, mp_obj_t sock, const httpd_info_t *info, int status) {
+    tx->sock = sock;
+    tx->len = 0;
+    httpd_tx_str(tx, info->http11 ? "HTTP/1.1 " : "HTTP/1.0 ");
+    httpd_tx_uint(tx, status, 10);
+    httpd_tx_add(tx, " ", 1);
+    httpd_tx_str(tx, httpd_reason(status));
+    httpd_tx_add(tx, "\r\n", 2);
+    if (info->keep_alive != info->http11) {
+        httpd_tx_header(tx, "Connection", info->keep_alive ? "keep-alive" : "close");
+    }
+}
+
+STATIC void httpd_tx_length(httpd_tx_t *tx, size_t len) {
+    httpd_tx_str(tx, "Content-Length: ");
+    httpd_tx_uint(tx, len, 10);
+    httpd_tx_add(tx, "\r\n", 2);
+}
+
+// a response of the server's own, with the reason as its body
+STATIC void httpd_send_status(mp_obj_t sock, const httpd_info_t *info, int status) {
+    httpd_tx_t tx;
+    httpd_tx_start(&tx, sock, info, status);
+    httpd_tx_header(&tx, "Content-Type", "text/plain");
+    const char *reason = httpd_reason(status);
+    httpd_tx_length(&tx, strlen(reason));
+    httpd_tx_add(&tx, "\r\n", 2);
+    if (!info->head) {
+        httpd_tx_str(&tx, reason);
+    }
+    httpd_tx_flush(&tx);
+}
+
+STATIC void httpd_tx_user_headers(httpd_tx_t *tx, mp_obj_t headers, bool *has_type) {
+    if (headers == mp_const_none) {
+        return;
+    }
+    mp_obj_t iter = mp_getiter(mp_obj_is_type(headers, &mp_type_dict)
+        ? mp_call_function_0(mp_load_attr(headers, MP_QSTR_items)) : headers, NULL);
+    mp_obj_t item;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        mp_obj_t *kv;
+        mp_obj_get_array_fixed_n(item, 2, &kv);
+        size_t nlen, vlen;
+        const char *name = mp_obj_str_get_data(kv[0], &nlen);
+        const char *val = mp_obj_str_get_data(mp_obj_is_str(kv[1]) ? kv[1] : mp_obj_str_make_new(&mp_type_str, 1, 0, &kv[1]), &vlen);
+        if (httpd_name_is((const byte*)name, nlen, "content-type")) {
+            *has_type = true;
+        }
+        httpd_tx_add(tx, name, nlen);
+        httpd_tx_add(tx, ": ", 2);
+        httpd_tx_add(tx, val, vlen);
+        httpd_tx_add(tx, "\r\n", 2);
+    }
+}
+
+// Sends what a handler returned: a body, or a (status, body[, headers])
+// tuple.  A body that is not a buffer is iterated and sent in chunks.
+// Returns whether the connection can stay open.
+STATIC bool httpd_send_result(mp_obj_t sock, const httpd_info_t *info_in, mp_obj_t result) {
+    httpd_info_t info_copy = *info_in;
+    httpd_info_t *info = &info_copy;
+    int status = 200;
+    mp_obj_t body = result;
+    mp_obj_t headers = mp_const_none;
+    if (mp_obj_is_type(result, &mp_type_tuple)) {
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_get_array(result, &n, &items);
+        if (n < 2 || n > 3) {
+            mp_raise_ValueError("bad response");
+        }
+        status = mp_obj_get_int(items[0]);
+        body = items[1];
+        headers = n == 3 ? items[2] : mp_const_none;
+    } else if (result == mp_const_none) {
+        status = 204;
+    }
+
+    // A generated body: HTTP/1.0 clients get it up to the end of the
+    // connection, since they don't know the chunked encoding.
+    mp_buffer_info_t bufinfo;
+    bool generated = body != mp_const_none && !mp_get_buffer(body, &bufinfo, MP_BUFFER_READ);
+    bool chunked = generated && info->http11;
+    if (generated && !chunked) {
+        info->keep_alive = false;
+    }
+
+    httpd_tx_t tx;
+    httpd_tx_start(&tx, sock, info, status);
+    bool has_type = false;
+    httpd_tx_user_headers(&tx, headers, &has_type);
+    if (!has_type && body != mp_const_none) {
+        httpd_tx_header(&tx, "Content-Type", "text/html; charset=utf-8");
+    }
+
+    if (body == mp_const_none) {
+        if (status != 204 && status != 304) {
+            httpd_tx_length(&tx, 0);
+        }
+        httpd_tx_add(&tx, "\r\n", 2);
+        httpd_tx_flush(&tx);
+        return info->keep_alive;
+    }
+    if (!generated) {
+        httpd_tx_length(&tx, bufinfo.len);
+        httpd_tx_add(&tx, "\r\n", 2);
+        if (!info->head) {
+            httpd_tx_add(&tx, bufinfo.buf, bufinfo.len);
+        }
+        httpd_tx_flush(&tx);
+        return info->keep_alive;
+    }
+
+    if (chunked) {
+        httpd_tx_header(&tx, "Transfer-Encoding", "chunked");
+    }
+    httpd_tx_add(&tx, "\r\n", 2);
+    if (!info->head) {
+        mp_obj_t iter = mp_getiter(body, NULL);
+        mp_obj_t item;
+        while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+            mp_get_buffer_raise(item, &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len == 0) {
+                // an empty chunk would end the body
+                continue;
+            }
+            if (chunked) {
+                httpd_tx_uint(&tx, bufinfo.len, 16);
+                httpd_tx_add(&tx, "\r\n", 2);
+            }
+            httpd_tx_add(&tx, bufinfo.buf, bufinfo.len);
+            if (chunked) {
+                httpd_tx_add(&tx, "\r\n", 2);
+            }
+        }
+        if (chunked) {
+            httpd_tx_add(&tx, "0\r\n\r\n", 5);
+        }
+    } else if (chunked) {
+        httpd_tx_add(&tx, "0\r\n\r\n", 5);
+    }
+    httpd_tx_flush(&tx);
+    return info->keep_alive;
+}
+
+/******************************************************************************/
+// static files
+
+// Opens a file for reading through the VFS, returns MP_OBJ_NULL if it can't be.
+STATIC mp_obj_t httpd_open(const char *path, size_t len) {
+    mp_obj_t file = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { mp_obj_new_str(path, len), MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        file = mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+        nlr_pop();
+    }
+    return file;
+}
+
+STATIC const char *httpd_type_of(const char *path, size_t len) {
+    const char *dot = NULL;
+    for (size_t i = len; i > 0 && path[i - 1] != '/'; i--) {
+        if (path[i - 1] == '.') {
+            dot = path + i;
+            break;
+        }
+    }
+    if (dot != NULL) {
+        size_t ext_len = path + len - dot;
+        for (size_t i = 0; i < MP_ARRAY_SIZE(httpd_types); i++) {
+            if (httpd_name_is((const byte*)dot, ext_len, httpd_types[i].ext)) {
+                return httpd_types[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Sends the file under root for the request's path, through the part of
+// the buffer from free_at on.  Returns the HTTP status to answer with
+// instead, when there is no such file.
+STATIC int httpd_send_file(mp_obj_httpd_t *self, mp_obj_t sock, const httpd_info_t *info, mp_obj_t path_in, size_t free_at) {
+    size_t root_len, path_len;
+    const char *root = mp_obj_str_get_data(self->root, &root_len);
+    const char *path = mp_obj_str_get_data(path_in, &path_len);
+
+    // nothing outside of root
+    for (size_t i = 0; i + 1 < path_len; i++) {
+        if (path[i] == '.' && path[i + 1] == '.' && (i == 0 || path[i - 1] == '/')) {
+            return 403;
+        }
+    }
+
+    char name[HTTPD_PATH_MAX];
+    size_t name_len = root_len + path_len;
+    bool index = path_len == 0 || path[path_len - 1] == '/';
+    if (name_len + (index ? 10 : 0) + 3 >= sizeof(name)) {
+        return 404;
+    }
+    memcpy(name, root, root_len);
+    memcpy(name + root_len, path, path_len);
+    if (index) {
+        memcpy(name + name_len, "index.html", 10);
+        name_len += 10;
+    }
+    const char *type = httpd_type_of(name, name_len);
+
+    mp_obj_t file = MP_OBJ_NULL;
+    bool gzip = false;
+    if (info->gzip) {
+        memcpy(name + name_len, ".gz", 3);
+        file = httpd_open(name, name_len + 3);
+        gzip = file != MP_OBJ_NULL;
+    }
+    if (file == MP_OBJ_NULL) {
+        file = httpd_open(name, name_len);
+        if (file == MP_OBJ_NULL) {
+            return 404;
+        }
+    }
+
+    const mp_stream_p_t *stream_p = mp_get_stream(file);
+    int errcode;
+    struct mp_stream_seek_t seek = { .offset = 0, .whence = MP_SEEK_END };
+    mp_uint_t res = stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode);
+    size_t size = seek.offset;
+    seek.offset = 0;
+    seek.whence = MP_SEEK_SET;
+    if (res == MP_STREAM_ERROR || stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode) == MP_STREAM_ERROR) {
+        mp_stream_close(file);
+        return 404;
+    }
+
+    httpd_tx_t tx;
+    httpd_tx_start(&tx, sock, info, 200);
+    httpd_tx_header(&tx, "Content-Type", type);
+    if (gzip) {
+        httpd_tx_header(&tx, "Content-Encoding", "gzip");
+        httpd_tx_header(&tx, "Vary", "Accept-Encoding");
+    }
+    httpd_tx_length(&tx, size);
+    httpd_tx_add(&tx, "\r\n", 2);
+    httpd_tx_flush(&tx);
+
+    self->files++;
+    self->gzip += gzip;
+    if (info->head) {
+        mp_stream_close(file);
+        return 0;
+    }
+
+    // The length has gone out already, so a failing read can only be
+    // reported by closing the connection early.
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        byte *buf = self->buf + free_at;
+        size_t buf_len = self->buf_size - free_at;
+        while (size > 0) {
+            mp_uint_t n = stream_p->read(file, buf, MIN(buf_len, size), &errcode);
+            if (n == MP_STREAM_ERROR || n == 0) {
+                mp_raise_OSError(n == 0 ? MP_EIO : errcode);
+            }
+            httpd_write(sock, buf, n);
+            size -= n;
+        }
+        nlr_pop();
+        mp_stream_close(file);
+    } else {
+        mp_stream_close(file);
+        nlr_jump(nlr.ret_val);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+// Request objects
+
+STATIC void httpd_request_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    if (dest[0] != MP_OBJ_NULL) {
+        return;
+    }
+    mp_obj_httpd_req_t *self = MP_OBJ_TO_PTR(self_in);
+    switch (attr) {
+        case MP_QSTR_method: dest[0] = self->method; break;
+        case MP_QSTR_path: dest[0] = self->path; break;
+        case MP_QSTR_query: dest[0] = self->query; break;
+        case MP_QSTR_body: dest[0] = self->body; break;
+        case MP_QSTR_headers:
+            if (self->headers == MP_OBJ_NULL) {
+                self->headers = mp_obj_new_dict(0);
+                if (self->hdr != NULL) {
+                    httpd_each_header(self->hdr, self->hdr_len, httpd_store_header, MP_OBJ_TO_PTR(self->headers));
+                }
+            }
+            dest[0] = self->headers;
+            break;
+    }
+}
+
+STATIC void httpd_request_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    (void)kind;
+    mp_obj_httpd_req_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "<Request %s %s>", mp_obj_str_get_str(self->method), mp_obj_str_get_str(self->path));
+}
+
+STATIC const mp_obj_type_t httpd_request_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Request,
+    .print = httpd_request_print,
+    .attr = httpd_request_attr,
+};
+
+/******************************************************************************/
+// Server objects
+
+// Server(*, root=None, buf_size=1024, max_body=4096, max_requests=100)
+STATIC mp_obj_t httpd_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    enum { ARG_root, ARG_buf_size, ARG_max_body, ARG_max_requests };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_root, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_buf_size, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1024} },
+        { MP_QSTR_max_body, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 4096} },
+        { MP_QSTR_max_requests, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 100} },
+    };
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+
+    if (vals[ARG_buf_size].u_int < 128 || vals[ARG_max_body].u_int < 0
+        || vals[ARG_max_requests].u_int < 1 || vals[ARG_max_requests].u_int > 0xffff) {
+        mp_raise_ValueError(NULL);
+    }
+
+    mp_obj_httpd_t *o = m_new_obj(mp_obj_httpd_t);
+    memset(o, 0, sizeof(*o));
+    o->base.type = type;
+    o->routes = mp_obj_new_dict(0);
+    o->root = MP_OBJ_NULL;
+    if (vals[ARG_root].u_obj != mp_const_none) {
+        mp_obj_str_get_str(vals[ARG_root].u_obj);
+        o->root = vals[ARG_root].u_obj;
+    }
+    o->buf_size = vals[ARG_buf_size].u_int;
+    o->buf = m_new(byte, o->buf_size);
+    o->max_body = vals[ARG_max_body].u_int;
+    o->max_requests = vals[ARG_max_requests].u_int;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+// Server.route(path, handler)
+// The handler is called with the Request and returns the response; None
+// removes the route.
+STATIC mp_obj_t httpd_route(mp_obj_t self_in, mp_obj_t path, mp_obj_t handler) {
+    mp_obj_httpd_t *self = MP_OBJ_TO_PTR(self_in);
+    // interned, so the path of a request for it is found without allocating
+    path = mp_obj_str_intern_checked(path);
+    if (handler == mp_const_none) {
+        mp_obj_dict_delete(self->routes, path);
+    } else {
+        mp_obj_dict_store(self->routes, path, handler);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(httpd_route_obj, httpd_route);
+
+// moves what was read past the request, a pipelined one, to the start of the buffer
+STATIC void httpd_in_shift(httpd_in_t *in) {
+    size_t rest = in->len - in->pos;
+    memmove(in->buf, in->buf + in->pos, rest);
+    in->base = in->pos = 0;
+    in->len = rest;
+}
+
+// Handles one request whose request line and headers are the first hdr_end
+// bytes of the buffer.  Returns whether the connection can stay open.
+STATIC bool httpd_handle(mp_obj_httpd_t *self, httpd_in_t *in, size_t hdr_end) {
+    byte *buf = self->buf;
+    httpd_info_t info = { 0 };
+
+    // request line: method, target and version
+    const byte *line_end = memchr(buf, '\r', hdr_end);
+    const byte *sp1 = memchr(buf, ' ', line_end - buf);
+    const byte *sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (sp2 == NULL || sp1 == buf || sp1[1] != '/' || line_end - sp2 != 9
+        || memcmp(sp2 + 1, "HTTP/1.", 7) != 0 || (sp2[8] != '0' && sp2[8] != '1')) {
+        httpd_send_status(in->sock, &info, 400);
+        return false;
+    }
+    info.http11 = sp2[8] == '1';
+    info.keep_alive = info.http11;
+
+    const byte *hdr = line_end + 2;
+    size_t hdr_len = buf + hdr_end - 2 - hdr;
+    if (!httpd_each_header(hdr, hdr_len, httpd_scan_header, &info)
+        || (info.has_length && info.content_length == (size_t)-1)) {
+        info.keep_alive = false;
+        httpd_send_status(in->sock, &info, 400);
+        return false;
+    }
+
+    mp_obj_t method = mp_obj_new_str((const char*)buf, sp1 - buf);
+    bool known = false;
+    for (size_t i = 0; i < MP_ARRAY_SIZE(httpd_methods); i++) {
+        known |= method == MP_OBJ_NEW_QSTR(httpd_methods[i]);
+    }
+    info.head = method == MP_OBJ_NEW_QSTR(MP_QSTR_HEAD);
+
+    // the body, even when it turns out nobody wants it, to get to the next request
+    in->base = in->pos = hdr_end;
+    mp_obj_t body;
+    int status = httpd_read_body(self, in, &info, &body);
+    if (status != 0) {
+        info.keep_alive = false;
+        httpd_send_status(in->sock, &info, status);
+        return false;
+    }
+    if (!known) {
+        httpd_in_shift(in);
+        httpd_send_status(in->sock, &info, 501);
+        return info.keep_alive;
+    }
+
+    const byte *target = sp1 + 1;
+    const byte *query = memchr(target, '?', sp2 - target);
+    const byte *path_end = query ? query : sp2;
+    mp_obj_t path = httpd_decode_path(target, path_end - target);
+
+    mp_map_elem_t *route = mp_map_lookup(mp_obj_dict_get_map(self->routes), path, MP_MAP_LOOKUP);
+    if (route == NULL) {
+        // the headers are no longer needed, so the rest of the buffer is free
+        httpd_in_shift(in);
+        if (self->root == MP_OBJ_NULL || (!info.head && method != MP_OBJ_NEW_QSTR(MP_QSTR_GET))) {
+            status = self->root == MP_OBJ_NULL ? 404 : 405;
+        } else {
+            status = httpd_send_file(self, in->sock, &info, path, in->len);
+        }
+        if (status != 0) {
+            httpd_send_status(in->sock, &info, status);
+        }
+        return info.keep_alive;
+    }
+
+    mp_obj_httpd_req_t *req = m_new_obj(mp_obj_httpd_req_t);
+    req->base.type = &httpd_request_type;
+    req->method = method;
+    req->path = path;
+    req->query = query ? mp_obj_new_str((const char*)query + 1, sp2 - query - 1) : mp_const_none;
+    req->body = body;
+    req->headers = MP_OBJ_NULL;
+    req->hdr = hdr;
+    req->hdr_len = hdr_len;
+
+    bool keep_alive;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t result = mp_call_function_1(route->value, MP_OBJ_FROM_PTR(req));
+        nlr_pop();
+        req->hdr = NULL;
+        keep_alive = httpd_send_result(in->sock, &info, result);
+    } else {
+        req->hdr = NULL;
+        mp_obj_t exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+        if (mp_obj_exception_match(exc, MP_OBJ_FROM_PTR(&mp_type_KeyboardInterrupt))
+            || mp_obj_exception_match(exc, MP_OBJ_FROM_PTR(&mp_type_SystemExit))) {
+            nlr_jump(nlr.ret_val);
+        }
+        // a failing handler gets a 500, and the connection is closed after it;
+        // handlers that want the traceback logged catch the exception themselves
+        self->errors++;
+        info.keep_alive = false;
+        httpd_send_status(in->sock, &info, 500);
+        keep_alive = false;
+    }
+
+    httpd_in_shift(in);
+    return keep_alive;
+}
+
+// Server.serve(sock)
+// Answers the requests on a connection, then returns how many there were.
+// The socket is left open for the caller to close.
+STATIC mp_obj_t httpd_serve(mp_obj_t self_in, mp_obj_t sock) {
+    mp_obj_httpd_t *self = MP_OBJ_TO_PTR(self_in);
+    httpd_in_t in = {
+        .sock = sock,
+        .stream_p = mp_get_stream_raise(sock, MP_STREAM_OP_READ | MP_STREAM_OP_WRITE),
+        .buf = self->buf,
+        .cap = self->buf_size,
+    };
+    self->connections++;
+
+    mp_uint_t served = 0;
+    while (served < self->max_requests) {
+        // collect the request line and headers
+        size_t hdr_end;
+        size_t from = 0;
+        while ((hdr_end = httpd_find_end(self->buf, from, in.len)) == 0) {
+            if (in.len == in.cap) {
+                httpd_info_t info = { .http11 = true };
+                httpd_send_status(sock, &info, 431);
+                return MP_OBJ_NEW_SMALL_INT(served);
+            }
+            from = in.len > 3 ? in.len - 3 : 0;
+            mp_uint_t n = httpd_read(&in, self->buf + in.len, in.cap - in.len, in.len == 0);
+            if (n == 0) {
+                return MP_OBJ_NEW_SMALL_INT(served);
+            }
+            in.len += n;
+        }
+        served++;
+        self->requests++;
+        if (!httpd_handle(self, &in, hdr_end)) {
+            break;
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(served);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(httpd_serve_obj, httpd_serve);
+
+// Server.stats(reset=False)
+STATIC mp_obj_t httpd_stats(size_t n_args, const mp_obj_t *args) {
+    mp_obj_httpd_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t dict = mp_obj_new_dict(0);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_connections), mp_obj_new_int_from_uint(self->connections));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_requests), mp_obj_new_int_from_uint(self->requests));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_files), mp_obj_new_int_from_uint(self->files));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_gzip), mp_obj_new_int_from_uint(self->gzip));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_errors), mp_obj_new_int_from_uint(self->errors));
+    if (n_args > 1 && mp_obj_is_true(args[1])) {
+        self->connections = self->requests = self->files = self->gzip = self->errors = 0;
+    }
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpd_stats_obj, 1, 2, httpd_stats);
+
+STATIC const mp_rom_map_elem_t httpd_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_route), MP_ROM_PTR(&httpd_route_obj) },
+    { MP_ROM_QSTR(MP_QSTR_serve), MP_ROM_PTR(&httpd_serve_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&httpd_stats_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(httpd_locals_dict, httpd_locals_dict_table);
+
+STATIC const mp_obj_type_t httpd_server_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Server,
+    .make_new = httpd_make_new,
+    .locals_dict = (void*)&httpd_locals_dict,
+};
+
+STATIC const mp_rom_map_elem_t uhttpd_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__uhttpd) },
+    { MP_ROM_QSTR(MP_QSTR_Server), MP_ROM_PTR(&httpd_server_type) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(uhttpd_module_globals, uhttpd_module_globals_table);
+
+const mp_obj_module_t mp_module_uhttpd = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&uhttpd_module_globals,
+};
+
+#endif // MICROPY_PY_UHTTPD
@@ -0,0 +1,608 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/builtin.h"
+#include "py/mperrno.h"
+
+#if MICROPY_PY_UKV
+
+#include "uzlib/tinf.h"
+
+// Log-structured key-value store.
+//
+// The database is a single file: a 4 byte magic followed by frames. A frame is
+//   payload length (uint32 LE) | crc32 of payload (uint32 LE) | payload
+// and the payload is a sequence of entries:
+//   UKV_OP_PUT | key length (uint16 LE) | key | value length (uint32 LE) | value
+//   UKV_OP_DEL | key length (uint16 LE) | key
+// Every put, delete or batch appends exactly one frame followed by a flush, so
+// a batch is applied completely or not at all: on open, the log is replayed up
+// to the first incomplete or corrupted frame.
+//
+// An in-RAM hash map indexes each live key to the file offset of its value
+// length field, so a get is one seek and two reads. Overwritten and deleted
+// entries stay in the log until compact() (or an automatic compaction once
+// stale entries outnumber the live ones) rewrites the live set into
+// <path>.tmp and replaces the database with it.
+
+#define UKV_MAGIC               "UKV1"
+#define UKV_MAGIC_LEN           (4)
+#define UKV_FRAME_HDR_LEN       (8)
+#define UKV_COMPACT_FRAME_LEN   (1024)
+#define UKV_COMPACT_MIN_STALE   (32)
+
+#define UKV_OP_PUT              (1)
+#define UKV_OP_DEL              (2)
+
+typedef struct _mp_obj_ukv_t {
+    mp_obj_base_t base;
+    mp_obj_t path;
+    mp_obj_t file;          // MP_OBJ_NULL once closed
+    mp_uint_t size;         // end of the last valid frame
+    mp_uint_t n_stale;      // overwritten/deleted entries still in the log
+    mp_map_t index;         // key (bytes) -> small int offset of the value length
+} mp_obj_ukv_t;
+
+STATIC const mp_obj_type_t ukv_type;
+
+typedef struct _mp_obj_ukv_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_ukv_t *db;
+    size_t pos;
+    qstr kind;
+} mp_obj_ukv_it_t;
+
+STATIC uint32_t ukv_get_u32(const byte *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+STATIC void ukv_put_u32(byte *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+STATIC uint32_t ukv_crc(const byte *buf, size_t len) {
+    return uzlib_crc32(buf, len, 0xffffffff) ^ 0xffffffff;
+}
+
+STATIC mp_obj_t ukv_os_call(qstr name, size_t n_args, const mp_obj_t *args) {
+    mp_obj_t os = mp_import_name(MP_QSTR_uos, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+    return mp_call_function_n_kw(mp_load_attr(os, name), n_args, 0, args);
+}
+
+STATIC bool ukv_exists(mp_obj_t path) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        ukv_os_call(MP_QSTR_stat, 1, &path);
+        nlr_pop();
+        return true;
+    }
+    return false;
+}
+
+STATIC mp_obj_t ukv_tmp_path(mp_obj_ukv_t *self) {
+    vstr_t vstr;
+    vstr_init(&vstr, 32);
+    vstr_printf(&vstr, "%s.tmp", mp_obj_str_get_str(self->path));
+    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+
+STATIC mp_obj_t ukv_open_file(mp_obj_t path, const char *mode) {
+    mp_obj_t args[2] = { path, mp_obj_new_str(mode, strlen(mode)) };
+    return mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+}
+
+STATIC mp_off_t ukv_seek(mp_obj_t file, mp_off_t offset, int whence) {
+    const mp_stream_p_t *stream_p = mp_get_stream(file);
+    struct mp_stream_seek_t seek_s;
+    int errcode;
+    seek_s.offset = offset;
+    seek_s.whence = whence;
+    if (stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek_s, &errcode) == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+    return seek_s.offset;
+}
+
+STATIC mp_uint_t ukv_read(mp_obj_t file, void *buf, mp_uint_t len) {
+    int errcode;
+    mp_uint_t out_sz = mp_stream_read_exactly(file, buf, len, &errcode);
+    if (out_sz == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+    return out_sz;
+}
+
+STATIC void ukv_write(mp_obj_t file, const void *buf, mp_uint_t len) {
+    int errcode;
+    mp_uint_t out_sz = mp_stream_write_exactly(file, buf, len, &errcode);
+    if (out_sz == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    } else if (out_sz != len) {
+        mp_raise_OSError(MP_ENOSPC);
+    }
+}
+
+STATIC void ukv_sync(mp_obj_t file) {
+    int errcode;
+    const mp_stream_p_t *stream_p = mp_get_stream(file);
+    if (stream_p->ioctl(file, MP_STREAM_FLUSH, 0, &errcode) == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+}
+
+// Apply the entries of a verified frame located at file offset base to the index
+STATIC void ukv_apply_frame(mp_obj_ukv_t *self, const byte *payload, size_t len, mp_uint_t base) {
+    size_t pos = 0;
+    while (pos + 3 <= len) {
+        byte op = payload[pos];
+        size_t klen = payload[pos + 1] | (payload[pos + 2] << 8);
+        pos += 3;
+        if (pos + klen > len) {
+            break;
+        }
+        mp_obj_t key = mp_obj_new_bytes(payload + pos, klen);
+        pos += klen;
+        if (op == UKV_OP_PUT) {
+            if (pos + 4 > len) {
+                break;
+            }
+            mp_map_elem_t *elem = mp_map_lookup(&self->index, key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+            if (elem->value != MP_OBJ_NULL) {
+                self->n_stale++;
+            }
+            elem->value = MP_OBJ_NEW_SMALL_INT(base + UKV_FRAME_HDR_LEN + pos);
+            pos += 4 + ukv_get_u32(payload + pos);
+        } else {
+            if (mp_map_lookup(&self->index, key, MP_MAP_LOOKUP_REMOVE_IF_FOUND) != NULL) {
+                self->n_stale++;
+            }
+            // the tombstone itself is stale as well
+            self->n_stale++;
+        }
+    }
+}
+
+// Replay the log, returns true if it ends with garbage (torn or corrupted frame)
+STATIC bool ukv_load(mp_obj_ukv_t *self) {
+    byte hdr[UKV_FRAME_HDR_LEN];
+
+    mp_map_clear(&self->index);
+    self->n_stale = 0;
+
+    mp_off_t file_size = ukv_seek(self->file, 0, MP_SEEK_END);
+    ukv_seek(self->file, 0, MP_SEEK_SET);
+    if (ukv_read(self->file, hdr, UKV_MAGIC_LEN) != UKV_MAGIC_LEN || memcmp(hdr, UKV_MAGIC, UKV_MAGIC_LEN) != 0) {
+        mp_raise_ValueError("not a ukv database");
+    }
+    self->size = UKV_MAGIC_LEN;
+
+    vstr_t vstr;
+    vstr_init(&vstr, 64);
+    for (;;) {
+        if (ukv_read(self->file, hdr, UKV_FRAME_HDR_LEN) != UKV_FRAME_HDR_LEN) {
+            break;
+        }
+        uint32_t len = ukv_get_u32(hdr);
+        if (len > file_size - self->size - UKV_FRAME_HDR_LEN) {
+            break;
+        }
+        vstr_reset(&vstr);
+        byte *payload = (byte*)vstr_add_len(&vstr, len);
+        if (ukv_read(self->file, payload, len) != len || ukv_crc(payload, len) != ukv_get_u32(hdr + 4)) {
+            break;
+        }
+        ukv_apply_frame(self, payload, len, self->size);
+        self->size += UKV_FRAME_HDR_LEN + len;
+    }
+    vstr_clear(&vstr);
+
+    return (mp_uint_t)file_size != self->size;
+}
+
+STATIC mp_obj_t ukv_read_value(mp_obj_ukv_t *self, mp_obj_t offset_in) {
+    byte buf[4];
+    ukv_seek(self->file, MP_OBJ_SMALL_INT_VALUE(offset_in), MP_SEEK_SET);
+    if (ukv_read(self->file, buf, 4) != 4) {
+        mp_raise_OSError(MP_EIO);
+    }
+    uint32_t vlen = ukv_get_u32(buf);
+    vstr_t vstr;
+    vstr_init_len(&vstr, vlen);
+    if (ukv_read(self->file, vstr.buf, vlen) != vlen) {
+        vstr_clear(&vstr);
+        mp_raise_OSError(MP_EIO);
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+// Append one entry to a frame being built in vstr (which starts with the frame header)
+STATIC void ukv_frame_add(vstr_t *vstr, mp_obj_t key_in, mp_obj_t value_in) {
+    mp_buffer_info_t key;
+    mp_get_buffer_raise(key_in, &key, MP_BUFFER_READ);
+    if (key.len > 0xffff) {
+        mp_raise_ValueError("key too long");
+    }
+    byte *p = (byte*)vstr_add_len(vstr, 3);
+    p[0] = value_in == mp_const_none ? UKV_OP_DEL : UKV_OP_PUT;
+    p[1] = key.len;
+    p[2] = key.len >> 8;
+    vstr_add_strn(vstr, key.buf, key.len);
+    if (value_in != mp_const_none) {
+        mp_buffer_info_t value;
+        mp_get_buffer_raise(value_in, &value, MP_BUFFER_READ);
+        ukv_put_u32((byte*)vstr_add_len(vstr, 4), value.len);
+        vstr_add_strn(vstr, value.buf, value.len);
+    }
+}
+
+// Seal the frame held in vstr and append it to the file
+STATIC void ukv_frame_write(mp_obj_t file, vstr_t *vstr) {
+    byte *frame = (byte*)vstr->buf;
+    size_t len = vstr->len - UKV_FRAME_HDR_LEN;
+    ukv_put_u32(frame, len);
+    ukv_put_u32(frame + 4, ukv_crc(frame + UKV_FRAME_HDR_LEN, len));
+    ukv_write(file, frame, vstr->len);
+}
+
+STATIC void ukv_compact_internal(mp_obj_ukv_t *self) {
+    mp_obj_t tmp_path = ukv_tmp_path(self);
+    mp_obj_t tmp = ukv_open_file(tmp_path, "wb");
+    ukv_write(tmp, UKV_MAGIC, UKV_MAGIC_LEN);
+
+    vstr_t vstr;
+    vstr_init(&vstr, UKV_COMPACT_FRAME_LEN + 64);
+    vstr_add_len(&vstr, UKV_FRAME_HDR_LEN);
+    for (size_t i = 0; i < self->index.alloc; ++i) {
+        if (!mp_map_slot_is_filled(&self->index, i)) {
+            continue;
+        }
+        ukv_frame_add(&vstr, self->index.table[i].key, ukv_read_value(self, self->index.table[i].value));
+        if (vstr.len >= UKV_COMPACT_FRAME_LEN) {
+            ukv_frame_write(tmp, &vstr);
+            vstr_cut_tail_bytes(&vstr, vstr.len - UKV_FRAME_HDR_LEN);
+        }
+    }
+    if (vstr.len > UKV_FRAME_HDR_LEN) {
+        ukv_frame_write(tmp, &vstr);
+    }
+    vstr_clear(&vstr);
+    ukv_sync(tmp);
+    mp_stream_close(tmp);
+
+    // <path>.tmp is complete before the database is removed, so if power is
+    // lost in between, opening the database finishes the rename
+    mp_stream_close(self->file);
+    self->file = MP_OBJ_NULL;
+    ukv_os_call(MP_QSTR_unlink, 1, &self->path);
+    mp_obj_t args[2] = { tmp_path, self->path };
+    ukv_os_call(MP_QSTR_rename, 2, args);
+
+    self->file = ukv_open_file(self->path, "r+b");
+    ukv_load(self);
+}
+
+STATIC void ukv_maybe_compact(mp_obj_ukv_t *self) {
+    if (self->n_stale >= UKV_COMPACT_MIN_STALE && self->n_stale > self->index.used) {
+        ukv_compact_internal(self);
+    }
+}
+
+STATIC mp_obj_ukv_t *ukv_get_open(mp_obj_t self_in) {
+    mp_obj_ukv_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->file == MP_OBJ_NULL) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    return self;
+}
+
+// Write a frame of put/delete entries, a value of None means delete
+STATIC void ukv_commit(mp_obj_ukv_t *self, size_t n, const mp_obj_t *keys, const mp_obj_t *values) {
+    vstr_t vstr;
+    vstr_init(&vstr, 64);
+    vstr_add_len(&vstr, UKV_FRAME_HDR_LEN);
+    for (size_t i = 0; i < n; ++i) {
+        ukv_frame_add(&vstr, keys[i], values[i]);
+    }
+
+    mp_uint_t base = self->size;
+    ukv_seek(self->file, base, MP_SEEK_SET);
+    ukv_frame_write(self->file, &vstr);
+    ukv_sync(self->file);
+    self->size += vstr.len;
+
+    // the frame is on the flash, update the index from what was written
+    ukv_apply_frame(self, (byte*)vstr.buf + UKV_FRAME_HDR_LEN, vstr.len - UKV_FRAME_HDR_LEN, base);
+    vstr_clear(&vstr);
+
+    ukv_maybe_compact(self);
+}
+
+STATIC mp_obj_t ukv_lookup(mp_obj_ukv_t *self, mp_obj_t key_in) {
+    mp_buffer_info_t key;
+    mp_get_buffer_raise(key_in, &key, MP_BUFFER_READ);
+    mp_obj_t key_obj = mp_obj_new_bytes(key.buf, key.len);
+    mp_map_elem_t *elem = mp_map_lookup(&self->index, key_obj, MP_MAP_LOOKUP);
+    return elem == NULL ? MP_OBJ_NULL : elem->value;
+}
+
+STATIC mp_obj_t mod_ukv_open(mp_obj_t path) {
+    mp_obj_ukv_t *self = m_new_obj(mp_obj_ukv_t);
+    self->base.type = &ukv_type;
+    self->path = path;
+    self->file = MP_OBJ_NULL;
+    self->size = 0;
+    self->n_stale = 0;
+    mp_map_init(&self->index, 0);
+
+    mp_obj_t tmp_path = ukv_tmp_path(self);
+    if (ukv_exists(path)) {
+        if (ukv_exists(tmp_path)) {
+            // leftover of an interrupted compaction
+            ukv_os_call(MP_QSTR_unlink, 1, &tmp_path);
+        }
+    } else if (ukv_exists(tmp_path)) {
+        // power lost between removing the database and renaming the compacted copy
+        mp_obj_t args[2] = { tmp_path, path };
+        ukv_os_call(MP_QSTR_rename, 2, args);
+    } else {
+        mp_obj_t file = ukv_open_file(path, "wb");
+        ukv_write(file, UKV_MAGIC, UKV_MAGIC_LEN);
+        ukv_sync(file);
+        mp_stream_close(file);
+    }
+
+    self->file = ukv_open_file(path, "r+b");
+    if (ukv_load(self)) {
+        // drop the torn tail so that new frames follow the last valid one
+        ukv_compact_internal(self);
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ukv_open_obj, mod_ukv_open);
+
+STATIC mp_obj_t ukv_get(size_t n_args, const mp_obj_t *args) {
+    mp_obj_ukv_t *self = ukv_get_open(args[0]);
+    mp_obj_t offset = ukv_lookup(self, args[1]);
+    if (offset == MP_OBJ_NULL) {
+        return n_args > 2 ? args[2] : mp_const_none;
+    }
+    return ukv_read_value(self, offset);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ukv_get_obj, 2, 3, ukv_get);
+
+STATIC mp_obj_t ukv_put(mp_obj_t self_in, mp_obj_t key, mp_obj_t value) {
+    if (value == mp_const_none) {
+        mp_raise_TypeError(NULL);
+    }
+    ukv_commit(ukv_get_open(self_in), 1, &key, &value);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(ukv_put_obj, ukv_put);
+
+STATIC mp_obj_t ukv_batch(mp_obj_t self_in, mp_obj_t items_in) {
+    mp_obj_ukv_t *self = ukv_get_open(self_in);
+    if (mp_obj_is_type(items_in, &mp_type_dict)) {
+        mp_obj_t dest[2];
+        mp_load_method(items_in, MP_QSTR_items, dest);
+        items_in = mp_call_method_n_kw(0, 0, dest);
+    }
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    mp_obj_t iter = mp_getiter(items_in, NULL);
+    mp_obj_t item;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        mp_obj_list_append(list, item);
+    }
+    size_t n;
+    mp_obj_t *items;
+    mp_obj_list_get(list, &n, &items);
+    mp_obj_t *keys = m_new(mp_obj_t, 2 * n);
+    mp_obj_t *values = keys + n;
+    for (size_t i = 0; i < n; ++i) {
+        mp_obj_t *pair;
+        mp_obj_get_array_fixed_n(items[i], 2, &pair);
+        keys[i] = pair[0];
+        values[i] = pair[1];
+    }
+    if (n > 0) {
+        ukv_commit(self, n, keys, values);
+    }
+    m_del(mp_obj_t, keys, 2 * n);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(ukv_batch_obj, ukv_batch);
+
+STATIC mp_obj_t ukv_compact(mp_obj_t self_in) {
+    ukv_compact_internal(ukv_get_open(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_compact_obj, ukv_compact);
+
+STATIC mp_obj_t ukv_flush(mp_obj_t self_in) {
+    // every write is already flushed when it returns
+    ukv_get_open(self_in);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_flush_obj, ukv_flush);
+
+STATIC mp_obj_t ukv_close(mp_obj_t self_in) {
+    mp_obj_ukv_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->file != MP_OBJ_NULL) {
+        mp_stream_close(self->file);
+        self->file = MP_OBJ_NULL;
+        mp_map_clear(&self->index);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_close_obj, ukv_close);
+
+STATIC mp_obj_t ukv___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return ukv_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ukv___exit___obj, 4, 4, ukv___exit__);
+
+STATIC mp_obj_t ukv_it_iternext(mp_obj_t self_in) {
+    mp_obj_ukv_it_t *it = MP_OBJ_TO_PTR(self_in);
+    mp_obj_ukv_t *db = ukv_get_open(MP_OBJ_FROM_PTR(it->db));
+    for (; it->pos < db->index.alloc; ++it->pos) {
+        if (!mp_map_slot_is_filled(&db->index, it->pos)) {
+            continue;
+        }
+        mp_map_elem_t *elem = &db->index.table[it->pos++];
+        if (it->kind == MP_QSTR_keys) {
+            return elem->key;
+        }
+        mp_obj_t value = ukv_read_value(db, elem->value);
+        if (it->kind == MP_QSTR_values) {
+            return value;
+        }
+        mp_obj_t tuple[2] = { elem->key, value };
+        return mp_obj_new_tuple(2, tuple);
+    }
+    return MP_OBJ_STOP_ITERATION;
+}
+
+STATIC mp_obj_t ukv_new_it(mp_obj_t self_in, qstr kind) {
+    mp_obj_ukv_it_t *it = m_new_obj(mp_obj_ukv_it_t);
+    it->base.type = &mp_type_polymorph_iter;
+    it->iternext = ukv_it_iternext;
+    it->db = ukv_get_open(self_in);
+    it->pos = 0;
+    it->kind = kind;
+    return MP_OBJ_FROM_PTR(it);
+}
+
+STATIC mp_obj_t ukv_keys(mp_obj_t self_in) {
+    return ukv_new_it(self_in, MP_QSTR_keys);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_keys_obj, ukv_keys);
+
+STATIC mp_obj_t ukv_values(mp_obj_t self_in) {
+    return ukv_new_it(self_in, MP_QSTR_values);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_values_obj, ukv_values);
+
+STATIC mp_obj_t ukv_items(mp_obj_t self_in) {
+    return ukv_new_it(self_in, MP_QSTR_items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ukv_items_obj, ukv_items);
+
+STATIC mp_obj_t ukv_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf) {
+    (void)iter_buf;
+    return ukv_new_it(self_in, MP_QSTR_keys);
+}
+
+STATIC mp_obj_t ukv_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
+    mp_obj_ukv_t *self = ukv_get_open(self_in);
+    if (value == MP_OBJ_NULL) {
+        // delete
+        if (ukv_lookup(self, index) == MP_OBJ_NULL) {
+            nlr_raise(mp_obj_new_exception(&mp_type_KeyError));
+        }
+        mp_obj_t none = mp_const_none;
+        ukv_commit(self, 1, &index, &none);
+        return mp_const_none;
+    } else if (value == MP_OBJ_SENTINEL) {
+        // load
+        mp_obj_t offset = ukv_lookup(self, index);
+        if (offset == MP_OBJ_NULL) {
+            nlr_raise(mp_obj_new_exception(&mp_type_KeyError));
+        }
+        return ukv_read_value(self, offset);
+    } else {
+        // store
+        ukv_put(self_in, index, value);
+        return mp_const_none;
+    }
+}
+
+STATIC mp_obj_t ukv_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    mp_obj_ukv_t *self = MP_OBJ_TO_PTR(self_in);
+    switch (op) {
+        case MP_UNARY_OP_BOOL: return mp_obj_new_bool(self->index.used != 0);
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(self->index.used);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+STATIC mp_obj_t ukv_binary_op(mp_binary_op_t op, mp_obj_t lhs_in, mp_obj_t rhs_in) {
+    switch (op) {
+        case MP_BINARY_OP_CONTAINS:
+            return mp_obj_new_bool(ukv_lookup(ukv_get_open(lhs_in), rhs_in) != MP_OBJ_NULL);
+        default:
+            // op not supported
+            return MP_OBJ_NULL;
+    }
+}
+
+STATIC const mp_rom_map_elem_t ukv_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&ukv_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&ukv_flush_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&ukv_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_put), MP_ROM_PTR(&ukv_put_obj) },
+    { MP_ROM_QSTR(MP_QSTR_batch), MP_ROM_PTR(&ukv_batch_obj) },
+    { MP_ROM_QSTR(MP_QSTR_compact), MP_ROM_PTR(&ukv_compact_obj) },
+    { MP_ROM_QSTR(MP_QSTR_keys), MP_ROM_PTR(&ukv_keys_obj) },
+    { MP_ROM_QSTR(MP_QSTR_values), MP_ROM_PTR(&ukv_values_obj) },
+    { MP_ROM_QSTR(MP_QSTR_items), MP_ROM_PTR(&ukv_items_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&ukv___exit___obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(ukv_locals_dict, ukv_locals_dict_table);
+
+STATIC const mp_obj_type_t ukv_type = {
+    { &mp_type_type },
+    // Save on qstr's, reuse same as for module
+    .name = MP_QSTR_ukv,
+    .getiter = ukv_getiter,
+    .unary_op = ukv_unary_op,
+    .binary_op = ukv_binary_op,
+    .subscr = ukv_subscr,
+    .locals_dict = (void*)&ukv_locals_dict,
+};
+
+STATIC const mp_rom_map_elem_t mp_module_ukv_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ukv) },
+    { MP_ROM_QSTR(MP_QSTR_open), MP_ROM_PTR(&mod_ukv_open_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_ukv_globals, mp_module_ukv_globals_table);
+
+const mp_obj_module_t mp_module_ukv = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_ukv_globals,
+};
+
+#endif // MICROPY_PY_UKV
@@ -0,0 +1,491 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/builtin.h"
+#include "py/mperrno.h"
+
+#if MICROPY_PY_ULOG
+
+#include "uzlib/tinf.h"
+
+// Append-only time-series log made of fixed-size records.
+//
+// A log is a directory holding numbered segment files ("00000000", "00000001", ...).
+// Each record is stored as:
+//   timestamp (uint32 LE) | payload (record_size bytes, zero padded) | crc32 (uint32 LE)
+// where the CRC covers the timestamp and the payload. Timestamps must not
+// decrease, so a range query can binary-search inside a segment and stop at the
+// first record past the end of the range.
+//
+// Records are collected in RAM and written with a single write+flush once a
+// page worth of them is pending, so a stream of small samples costs one flash
+// program per page instead of one filesystem metadata update per sample.
+// Segments are not preallocated: on littlefs overwriting a preallocated file
+// is copy-on-write and would double the flash traffic, so a segment simply
+// stops growing at segment_records and the next one is started.
+//
+// After a power failure the tail of the last segment may hold a partial
+// record; it is left alone and appending continues in a fresh segment.
+// Records whose CRC does not match are skipped by queries.
+
+#define ULOG_REC_OVERHEAD       (8)
+#define ULOG_SEG_NAME_LEN       (8)
+
+typedef struct _mp_obj_ulog_t {
+    mp_obj_base_t base;
+    mp_obj_t path;          // directory holding the segments
+    mp_obj_t file;          // segment being appended to, MP_OBJ_NULL once closed
+    uint32_t first_seq;     // oldest segment still on the filesystem
+    uint32_t last_seq;      // segment being appended to
+    uint32_t seg_len;       // records committed to the last segment
+    uint32_t seg_max;       // records per segment
+    uint32_t last_ts;
+    uint16_t rec_size;      // payload bytes per record
+    uint16_t max_segments;
+    uint16_t batch_len;     // records waiting in buf
+    uint16_t batch_max;
+    byte *buf;
+} mp_obj_ulog_t;
+
+typedef struct _mp_obj_ulog_query_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_ulog_t *log;
+    mp_obj_t file;          // segment being read, MP_OBJ_NULL between segments
+    uint32_t seq;
+    uint32_t t0;
+    uint32_t t1;
+    byte *rec;
+} mp_obj_ulog_query_it_t;
+
+STATIC const mp_obj_type_t ulog_type;
+
+STATIC inline size_t ulog_slot_size(mp_obj_ulog_t *self) {
+    return self->rec_size + ULOG_REC_OVERHEAD;
+}
+
+STATIC uint32_t ulog_get_u32(const byte *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+STATIC void ulog_put_u32(byte *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+STATIC uint32_t ulog_crc(const byte *rec, size_t len) {
+    return uzlib_crc32(rec, len, 0xffffffff) ^ 0xffffffff;
+}
+
+STATIC mp_obj_t ulog_os_call(qstr name, size_t n_args, const mp_obj_t *args) {
+    mp_obj_t os = mp_import_name(MP_QSTR_uos, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+    return mp_call_function_n_kw(mp_load_attr(os, name), n_args, 0, args);
+}
+
+STATIC mp_obj_t ulog_segment_path(mp_obj_ulog_t *self, uint32_t seq) {
+    vstr_t vstr;
+    vstr_init(&vstr, 32);
+    vstr_printf(&vstr, "%s/%08x", mp_obj_str_get_str(self->path), (unsigned int)seq);
+    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+
+STATIC mp_obj_t ulog_open_segment(mp_obj_ulog_t *self, uint32_t seq, qstr mode) {
+    mp_obj_t args[2] = { ulog_segment_path(self, seq), MP_OBJ_NEW_QSTR(mode) };
+    return mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+}
+
+STATIC mp_off_t ulog_seek(mp_obj_t file, mp_off_t offset, int whence) {
+    const mp_stream_p_t *stream_p = mp_get_stream(file);
+    struct mp_stream_seek_t seek_s;
+    int errcode;
+    seek_s.offset = offset;
+    seek_s.whence = whence;
+    if (stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek_s, &errcode) == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+    return seek_s.offset;
+}
+
+// Read the record at index idx of a segment, returns false if it is not complete
+STATIC bool ulog_read_slot(mp_obj_t file, size_t slot, mp_uint_t idx, byte *rec) {
+    int errcode;
+    ulog_seek(file, idx * slot, MP_SEEK_SET);
+    mp_uint_t len = mp_stream_read_exactly(file, rec, slot, &errcode);
+    if (len == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+    return len == slot;
+}
+
+// Set last_ts from the newest complete record of a segment, if it has one
+STATIC bool ulog_load_last_ts(mp_obj_ulog_t *self, uint32_t seq) {
+    size_t slot = ulog_slot_size(self);
+    mp_obj_t rd = ulog_open_segment(self, seq, MP_QSTR_rb);
+    mp_off_t n = ulog_seek(rd, 0, MP_SEEK_END) / slot;
+    bool found = n > 0 && ulog_read_slot(rd, slot, n - 1, self->buf);
+    if (found) {
+        self->last_ts = ulog_get_u32(self->buf);
+    }
+    mp_stream_close(rd);
+    return found;
+}
+
+STATIC void ulog_rotate(mp_obj_ulog_t *self) {
+    mp_stream_close(self->file);
+    self->last_seq++;
+    self->seg_len = 0;
+    self->file = ulog_open_segment(self, self->last_seq, MP_QSTR_wb);
+
+    // drop the oldest segments once over the limit
+    while (self->last_seq - self->first_seq >= self->max_segments) {
+        mp_obj_t path = ulog_segment_path(self, self->first_seq);
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            ulog_os_call(MP_QSTR_unlink, 1, &path);
+            nlr_pop();
+        }
+        self->first_seq++;
+    }
+}
+
+STATIC void ulog_scan(mp_obj_ulog_t *self) {
+    bool found = false;
+    mp_obj_t iter = ulog_os_call(MP_QSTR_ilistdir, 1, &self->path);
+    mp_obj_t entry;
+    while ((entry = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        size_t n_items;
+        mp_obj_t *items;
+        mp_obj_get_array(entry, &n_items, &items);
+        size_t len;
+        const char *name = mp_obj_str_get_data(items[0], &len);
+        if (len != ULOG_SEG_NAME_LEN) {
+            continue;
+        }
+        uint32_t seq = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (!unichar_isxdigit(name[i])) {
+                goto next;
+            }
+            seq = (seq << 4) | unichar_xdigit_value(name[i]);
+        }
+        if (!found || seq < self->first_seq) {
+            self->first_seq = seq;
+        }
+        if (!found || seq > self->last_seq) {
+            self->last_seq = seq;
+        }
+        found = true;
+    next:;
+    }
+
+    if (!found) {
+        self->file = ulog_open_segment(self, 0, MP_QSTR_wb);
+        return;
+    }
+
+    // continue the last segment unless it is full or ends with a partial record
+    size_t slot = ulog_slot_size(self);
+    self->file = ulog_open_segment(self, self->last_seq, MP_QSTR_ab);
+    mp_off_t size = ulog_seek(self->file, 0, MP_SEEK_END);
+    self->seg_len = size / slot;
+    // right after a rotation the last segment is empty, and the newest record
+    // is in the one before it
+    uint32_t seq = self->last_seq;
+    while (!ulog_load_last_ts(self, seq) && seq != self->first_seq) {
+        seq--;
+    }
+    if (size % slot != 0 || self->seg_len >= self->seg_max) {
+        ulog_rotate(self);
+    }
+}
+
+STATIC mp_obj_t ulog_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_path, ARG_record_size, ARG_segment_records, ARG_segments, ARG_page };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_record_size, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_segment_records, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1024} },
+        { MP_QSTR_segments, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 4} },
+        { MP_QSTR_page, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 512} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t rec_size = args[ARG_record_size].u_int;
+    mp_int_t seg_max = args[ARG_segment_records].u_int;
+    mp_int_t max_segments = args[ARG_segments].u_int;
+    if (rec_size <= 0 || rec_size > 0xffff - ULOG_REC_OVERHEAD || seg_max <= 0
+        || max_segments < 2 || max_segments > 0xffff || args[ARG_page].u_int <= 0) {
+        mp_raise_ValueError(NULL);
+    }
+
+    mp_obj_ulog_t *self = m_new_obj(mp_obj_ulog_t);
+    self->base.type = type;
+    self->path = args[ARG_path].u_obj;
+    self->file = MP_OBJ_NULL;
+    self->first_seq = 0;
+    self->last_seq = 0;
+    self->seg_len = 0;
+    self->seg_max = seg_max;
+    self->last_ts = 0;
+    self->rec_size = rec_size;
+    self->max_segments = max_segments;
+    self->batch_len = 0;
+
+    // commit a page worth of records at once, at least one record
+    size_t slot = ulog_slot_size(self);
+    size_t batch_max = args[ARG_page].u_int / slot;
+    if (batch_max == 0) {
+        batch_max = 1;
+    } else if (batch_max > 0xffff) {
+        batch_max = 0xffff;
+    }
+    self->batch_max = batch_max;
+    self->buf = m_new(byte, batch_max * slot);
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        ulog_os_call(MP_QSTR_mkdir, 1, &self->path);
+        nlr_pop();
+    } else {
+        // the directory most likely exists already, if not, the scan below fails
+    }
+    ulog_scan(self);
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC mp_obj_ulog_t *ulog_get_open(mp_obj_t self_in) {
+    mp_obj_ulog_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->file == MP_OBJ_NULL) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    return self;
+}
+
+STATIC void ulog_commit_internal(mp_obj_ulog_t *self) {
+    if (self->batch_len == 0) {
+        return;
+    }
+    int errcode;
+    size_t len = self->batch_len * ulog_slot_size(self);
+    mp_uint_t out_sz = mp_stream_write_exactly(self->file, self->buf, len, &errcode);
+    if (out_sz == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    } else if (out_sz != len) {
+        mp_raise_OSError(MP_ENOSPC);
+    }
+    const mp_stream_p_t *stream_p = mp_get_stream(self->file);
+    if (stream_p->ioctl(self->file, MP_STREAM_FLUSH, 0, &errcode) == MP_STREAM_ERROR) {
+        mp_raise_OSError(errcode);
+    }
+    self->seg_len += self->batch_len;
+    self->batch_len = 0;
+    if (self->seg_len >= self->seg_max) {
+        ulog_rotate(self);
+    }
+}
+
+STATIC mp_obj_t ulog_append(mp_obj_t self_in, mp_obj_t ts_in, mp_obj_t data_in) {
+    mp_obj_ulog_t *self = ulog_get_open(self_in);
+    uint32_t ts = mp_obj_get_int_truncated(ts_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
+
+    if (bufinfo.len > self->rec_size) {
+        mp_raise_ValueError("record too long");
+    }
+    if (ts < self->last_ts) {
+        mp_raise_ValueError("timestamp decreasing");
+    }
+
+    byte *rec = self->buf + self->batch_len * ulog_slot_size(self);
+    ulog_put_u32(rec, ts);
+    memcpy(rec + 4, bufinfo.buf, bufinfo.len);
+    memset(rec + 4 + bufinfo.len, 0, self->rec_size - bufinfo.len);
+    ulog_put_u32(rec + 4 + self->rec_size, ulog_crc(rec, 4 + self->rec_size));
+    self->last_ts = ts;
+
+    // a batch never crosses a segment boundary
+    if (++self->batch_len >= self->batch_max || self->seg_len + self->batch_len >= self->seg_max) {
+        ulog_commit_internal(self);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(ulog_append_obj, ulog_append);
+
+STATIC mp_obj_t ulog_commit(mp_obj_t self_in) {
+    ulog_commit_internal(ulog_get_open(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ulog_commit_obj, ulog_commit);
+
+STATIC mp_obj_t ulog_close(mp_obj_t self_in) {
+    mp_obj_ulog_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->file != MP_OBJ_NULL) {
+        ulog_commit_internal(self);
+        mp_stream_close(self->file);
+        self->file = MP_OBJ_NULL;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ulog_close_obj, ulog_close);
+
+STATIC mp_obj_t ulog___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return ulog_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ulog___exit___obj, 4, 4, ulog___exit__);
+
+STATIC mp_obj_t ulog_query_it_iternext(mp_obj_t self_in) {
+    mp_obj_ulog_query_it_t *it = MP_OBJ_TO_PTR(self_in);
+    mp_obj_ulog_t *log = it->log;
+    size_t slot = ulog_slot_size(log);
+
+    for (;;) {
+        if (it->file == MP_OBJ_NULL) {
+            if (it->seq < log->first_seq) {
+                it->seq = log->first_seq;
+            }
+            if (it->seq > log->last_seq) {
+                return MP_OBJ_STOP_ITERATION;
+            }
+            nlr_buf_t nlr;
+            if (nlr_push(&nlr) == 0) {
+                it->file = ulog_open_segment(log, it->seq, MP_QSTR_rb);
+                nlr_pop();
+            } else {
+                // segment dropped by rotation meanwhile
+                it->seq++;
+                continue;
+            }
+
+            // binary search for the first record at or after t0
+            mp_uint_t lo = 0;
+            mp_uint_t hi = ulog_seek(it->file, 0, MP_SEEK_END) / slot;
+            while (lo < hi) {
+                mp_uint_t mid = lo + (hi - lo) / 2;
+                ulog_read_slot(it->file, slot, mid, it->rec);
+                if (ulog_get_u32(it->rec) < it->t0) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            ulog_seek(it->file, lo * slot, MP_SEEK_SET);
+        }
+
+        int errcode;
+        mp_uint_t len = mp_stream_read_exactly(it->file, it->rec, slot, &errcode);
+        if (len == MP_STREAM_ERROR) {
+            mp_raise_OSError(errcode);
+        }
+        if (len != slot) {
+            // end of this segment, move on to the next one
+            mp_stream_close(it->file);
+            it->file = MP_OBJ_NULL;
+            it->seq++;
+            continue;
+        }
+
+        if (ulog_get_u32(it->rec + 4 + log->rec_size) != ulog_crc(it->rec, 4 + log->rec_size)) {
+            continue;
+        }
+        uint32_t ts = ulog_get_u32(it->rec);
+        if (ts < it->t0) {
+            continue;
+        }
+        if (ts > it->t1) {
+            mp_stream_close(it->file);
+            it->file = MP_OBJ_NULL;
+            it->seq = log->last_seq + 1;
+            return MP_OBJ_STOP_ITERATION;
+        }
+
+        mp_obj_t tuple[2] = {
+            mp_obj_new_int_from_uint(ts),
+            mp_obj_new_bytes(it->rec + 4, log->rec_size),
+        };
+        return mp_obj_new_tuple(2, tuple);
+    }
+}
+
+STATIC mp_obj_t ulog_query(size_t n_args, const mp_obj_t *args) {
+    mp_obj_ulog_t *self = ulog_get_open(args[0]);
+
+    // make pending records visible to the query
+    ulog_commit_internal(self);
+
+    mp_obj_ulog_query_it_t *it = m_new_obj(mp_obj_ulog_query_it_t);
+    it->base.type = &mp_type_polymorph_iter;
+    it->iternext = ulog_query_it_iternext;
+    it->log = self;
+    it->file = MP_OBJ_NULL;
+    it->seq = self->first_seq;
+    it->t0 = n_args > 1 ? mp_obj_get_int_truncated(args[1]) : 0;
+    it->t1 = n_args > 2 ? mp_obj_get_int_truncated(args[2]) : 0xffffffff;
+    it->rec = m_new(byte, ulog_slot_size(self));
+    return MP_OBJ_FROM_PTR(it);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ulog_query_obj, 1, 3, ulog_query);
+
+STATIC const mp_rom_map_elem_t ulog_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_append), MP_ROM_PTR(&ulog_append_obj) },
+    { MP_ROM_QSTR(MP_QSTR_commit), MP_ROM_PTR(&ulog_commit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_query), MP_ROM_PTR(&ulog_query_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&ulog_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&ulog___exit___obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(ulog_locals_dict, ulog_locals_dict_table);
+
+STATIC const mp_obj_type_t ulog_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Log,
+    .make_new = ulog_make_new,
+    .locals_dict = (void*)&ulog_locals_dict,
+};
+
+STATIC const mp_rom_map_elem_t mp_module_ulog_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ulog) },
+    { MP_ROM_QSTR(MP_QSTR_Log), MP_ROM_PTR(&ulog_type) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_ulog_globals, mp_module_ulog_globals_table);
+
+const mp_obj_module_t mp_module_ulog = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_ulog_globals,
+};
+
+#endif // MICROPY_PY_ULOG
@@ -0,0 +1,685 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+
+#if MICROPY_PY_UMQTT
+
+// MQTT 3.1.1 client over any stream, usually a connected usocket or an SSL
+// wrapper of one.
+//
+// Packets are encoded straight from the caller's topic and message buffers:
+// the fixed header and short fields are gathered in a small buffer on the
+// stack, and a message too long to join them is written from where it is.
+// Incoming packets are collected into a buffer kept by the client, so
+// check_msg() can return before a packet is complete and pick it up later.
+//
+// QoS 1 messages wait in a window of in-flight slots until their PUBACK
+// comes in, and are sent again with DUP set when it takes longer than
+// retry_ms.  publish() with the window full handles incoming packets until
+// a slot frees up.  QoS 2 is not supported.
+
+#define MQTT_CONNECT        (0x10)
+#define MQTT_CONNACK        (0x20)
+#define MQTT_PUBLISH        (0x30)
+#define MQTT_PUBACK         (0x40)
+#define MQTT_SUBSCRIBE      (0x80)
+#define MQTT_SUBACK         (0x90)
+#define MQTT_UNSUBSCRIBE    (0xa0)
+#define MQTT_UNSUBACK       (0xb0)
+#define MQTT_PINGREQ        (0xc0)
+#define MQTT_PINGRESP       (0xd0)
+#define MQTT_DISCONNECT     (0xe0)
+
+#define MQTT_FLAG_DUP       (0x08)
+#define MQTT_REM_LEN_MAX    (268435455)
+
+// pieces of an outgoing packet are gathered until they fill this
+#define MQTT_TX_COALESCE    (128)
+
+typedef struct _mqtt_inflight_t {
+    mp_obj_t topic;     // MP_OBJ_NULL when the slot is free
+    mp_obj_t msg;
+    uint32_t sent_ms;
+    uint16_t pid;
+    bool retain;
+} mqtt_inflight_t;
+
+typedef struct _mp_obj_mqtt_t {
+    mp_obj_base_t base;
+    mp_obj_t sock;
+    mp_obj_t client_id;
+    mp_obj_t user;
+    mp_obj_t password;
+    mp_obj_t callback;
+    mqtt_inflight_t *inflight;
+    byte *rx_buf;
+    size_t rx_alloc;
+    size_t rx_len;      // body bytes received so far
+    size_t rx_need;     // body length, once the header is complete
+    uint32_t retry_ms;
+    uint32_t last_tx_ms;
+    uint16_t keepalive; // seconds
+    uint16_t window;
+    uint16_t pending;
+    uint16_t next_pid;
+    uint16_t ack_pid;   // pid of the last SUBACK/UNSUBACK
+    int16_t ack_rc;     // its return code, -1 while none came in
+    int16_t connack_rc;
+    byte rx_hdr[5];
+    byte rx_hdr_len;
+    int8_t blocking;    // last mode set on the socket, -1 if unknown
+} mp_obj_mqtt_t;
+
+typedef struct _mqtt_tx_t {
+    mp_obj_mqtt_t *self;
+    size_t len;
+    byte buf[MQTT_TX_COALESCE];
+} mqtt_tx_t;
+
+STATIC void mqtt_set_blocking(mp_obj_mqtt_t *self, bool blocking) {
+    if (self->blocking == blocking) {
+        return;
+    }
+    // streams without setblocking (such as uio.BytesIO) never block anyway
+    mp_obj_t dest[3];
+    mp_load_method_maybe(self->sock, MP_QSTR_setblocking, dest);
+    if (dest[0] != MP_OBJ_NULL) {
+        dest[2] = mp_obj_new_bool(blocking);
+        mp_call_method_n_kw(1, 0, dest);
+    }
+    self->blocking = blocking;
+}
+
+STATIC void mqtt_write(mp_obj_mqtt_t *self, const void *buf, size_t len) {
+    int errcode;
+    mp_stream_write_exactly(self->sock, buf, len, &errcode);
+    if (errcode != 0) {
+        mp_raise_OSError(errcode);
+    }
+    self->last_tx_ms = mp_hal_ticks_ms();
+}
+
+STATIC void mqtt_tx_flush(mqtt_tx_t *tx) {
+    if (tx->len > 0) {
+        mqtt_write(tx->self, tx->buf, tx->len);
+        tx->len = 0;
+    }
+}
+
+STATIC void mqtt_tx_add(mqtt_tx_t *tx, const void *data, size_t len) {
+    if (tx->len + len > sizeof(tx->buf)) {
+        mqtt_tx_flush(tx);
+        if (len > sizeof(tx->buf)) {
+            mqtt_write(tx->self, data, len);
+            return;
+        }
+    }
+    memcpy(tx->buf + tx->len, data, len);
+    tx->len += len;
+}
+
+STATIC void mqtt_tx_u16(mqtt_tx_t *tx, uint16_t v) {
+    byte b[2] = { v >> 8, v & 0xff };
+    mqtt_tx_add(tx, b, 2);
+}
+
+// starts a packet; the remaining length follows as 1 to 4 bytes, 7 bits each
+STATIC void mqtt_tx_start(mqtt_tx_t *tx, mp_obj_mqtt_t *self, byte type, size_t rem_len) {
+    if (rem_len > MQTT_REM_LEN_MAX) {
+        mp_raise_ValueError("packet too long");
+    }
+    mqtt_set_blocking(self, true);
+    tx->self = self;
+    tx->buf[0] = type;
+    tx->len = 1;
+    do {
+        byte b = rem_len & 0x7f;
+        rem_len >>= 7;
+        tx->buf[tx->len++] = b | (rem_len ? 0x80 : 0);
+    } while (rem_len);
+}
+
+STATIC void mqtt_tx_str(mqtt_tx_t *tx, const mp_buffer_info_t *bufinfo) {
+    mqtt_tx_u16(tx, bufinfo->len);
+    mqtt_tx_add(tx, bufinfo->buf, bufinfo->len);
+}
+
+STATIC void mqtt_get_str(mp_obj_t obj, mp_buffer_info_t *bufinfo) {
+    mp_get_buffer_raise(obj, bufinfo, MP_BUFFER_READ);
+    if (bufinfo->len > 0xffff) {
+        mp_raise_ValueError("string too long");
+    }
+}
+
+STATIC void mqtt_send_publish(mp_obj_mqtt_t *self, mp_obj_t topic, mp_obj_t msg, int qos, bool retain, uint16_t pid, bool dup) {
+    mp_buffer_info_t t, m;
+    mqtt_get_str(topic, &t);
+    mp_get_buffer_raise(msg, &m, MP_BUFFER_READ);
+
+    mqtt_tx_t tx;
+    mqtt_tx_start(&tx, self, MQTT_PUBLISH | (dup ? MQTT_FLAG_DUP : 0) | (qos << 1) | retain,
+        2 + t.len + (qos ? 2 : 0) + m.len);
+    mqtt_tx_str(&tx, &t);
+    if (qos) {
+        mqtt_tx_u16(&tx, pid);
+    }
+    mqtt_tx_add(&tx, m.buf, m.len);
+    mqtt_tx_flush(&tx);
+}
+
+STATIC void mqtt_send_short(mp_obj_mqtt_t *self, byte type, int pid) {
+    byte buf[4] = { type, 0 };
+    size_t len = 2;
+    if (pid >= 0) {
+        buf[1] = 2;
+        buf[2] = pid >> 8;
+        buf[3] = pid & 0xff;
+        len = 4;
+    }
+    mqtt_set_blocking(self, true);
+    mqtt_write(self, buf, len);
+}
+
+STATIC uint16_t mqtt_new_pid(mp_obj_mqtt_t *self) {
+    if (++self->next_pid == 0) {
+        self->next_pid = 1;
+    }
+    return self->next_pid;
+}
+
+// Reads what is available of the next packet.  Returns true once it is
+// complete, with its type in rx_hdr[0] and its body in rx_buf.
+STATIC bool mqtt_recv_packet(mp_obj_mqtt_t *self, bool block) {
+    const mp_stream_p_t *stream_p = mp_get_stream(self->sock);
+    for (;;) {
+        byte *dest;
+        size_t len;
+        bool header = (self->rx_hdr_len == 0 || self->rx_need == (size_t)-1);
+        if (header) {
+            // the header is read a byte at a time, it is 2 to 5 bytes long
+            dest = self->rx_hdr + self->rx_hdr_len;
+            len = 1;
+        } else if (self->rx_len < self->rx_need) {
+            dest = self->rx_buf + self->rx_len;
+            len = self->rx_need - self->rx_len;
+        } else {
+            self->rx_hdr_len = 0;
+            return true;
+        }
+
+        int errcode;
+        mp_uint_t out_sz = stream_p->read(self->sock, dest, len, &errcode);
+        if (out_sz == MP_STREAM_ERROR) {
+            if (mp_is_nonblocking_error(errcode)) {
+                if (!block) {
+                    return false;
+                }
+                errcode = MP_ETIMEDOUT;
+            }
+            mp_raise_OSError(errcode);
+        }
+        if (out_sz == 0) {
+            mp_raise_OSError(MP_ECONNRESET);
+        }
+
+        if (!header) {
+            self->rx_len += out_sz;
+            continue;
+        }
+        if (self->rx_hdr_len++ == 0) {
+            self->rx_need = (size_t)-1;
+            continue;
+        }
+        if (dest[0] & 0x80) {
+            if (self->rx_hdr_len == sizeof(self->rx_hdr)) {
+                mp_raise_OSError(MP_EIO);
+            }
+            continue;
+        }
+        size_t need = 0;
+        for (int i = self->rx_hdr_len - 1; i >= 1; i--) {
+            need = (need << 7) | (self->rx_hdr[i] & 0x7f);
+        }
+        if (need > self->rx_alloc) {
+            self->rx_buf = m_renew(byte, self->rx_buf, self->rx_alloc, need);
+            self->rx_alloc = need;
+        }
+        self->rx_need = need;
+        self->rx_len = 0;
+    }
+}
+
+#if MICROPY_ENABLE_SCHEDULER
+STATIC mp_obj_t mqtt_deliver(mp_obj_t args_in) {
+    mp_obj_t *args;
+    mp_obj_get_array_fixed_n(args_in, 3, &args);
+    return mp_call_function_2(args[0], args[1], args[2]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_deliver_obj, mqtt_deliver);
+#endif
+
+// nested is true when the packet came while another call, such as a
+// publish waiting for a free slot, is in progress: the callback is then
+// deferred to the scheduler if there is one, so that it doesn't run in the
+// middle of that call.  From wait_msg and check_msg it runs before they return.
+STATIC void mqtt_dispatch(mp_obj_mqtt_t *self, mp_obj_t topic, mp_obj_t msg, bool nested) {
+    if (self->callback == mp_const_none) {
+        return;
+    }
+    #if MICROPY_ENABLE_SCHEDULER
+    if (nested) {
+        mp_obj_t args[3] = { self->callback, topic, msg };
+        if (mp_sched_schedule(MP_OBJ_FROM_PTR(&mqtt_deliver_obj), mp_obj_new_tuple(3, args))) {
+            return;
+        }
+    }
+    #else
+    (void)nested;
+    #endif
+    // the packet is fully handled by now, so the callback may safely use
+    // the client
+    mp_call_function_2(self->callback, topic, msg);
+}
+
+STATIC uint16_t mqtt_get_u16(const byte *p) {
+    return (p[0] << 8) | p[1];
+}
+
+// acts on the packet just received and returns its type
+STATIC int mqtt_handle(mp_obj_mqtt_t *self, bool nested) {
+    byte type = self->rx_hdr[0];
+    const byte *p = self->rx_buf;
+    size_t len = self->rx_need;
+
+    switch (type & 0xf0) {
+        case MQTT_CONNACK:
+            if (len < 2) {
+                goto bad;
+            }
+            self->connack_rc = p[1] | (p[0] << 8);
+            break;
+        case MQTT_PUBLISH: {
+            int qos = (type >> 1) & 3;
+            size_t hdr = 2 + (qos ? 2 : 0);
+            if (len < 2 || len < hdr + mqtt_get_u16(p)) {
+                goto bad;
+            }
+            size_t tlen = mqtt_get_u16(p);
+            mp_obj_t topic = mp_obj_new_bytes(p + 2, tlen);
+            hdr += tlen;
+            if (qos) {
+                mqtt_send_short(self, MQTT_PUBACK, mqtt_get_u16(p + 2 + tlen));
+            }
+            mqtt_dispatch(self, topic, mp_obj_new_bytes(p + hdr, len - hdr), nested);
+            break;
+        }
+        case MQTT_PUBACK: {
+            if (len < 2) {
+                goto bad;
+            }
+            uint16_t pid = mqtt_get_u16(p);
+            for (int i = 0; i < self->window; i++) {
+                mqtt_inflight_t *f = &self->inflight[i];
+                if (f->topic != MP_OBJ_NULL && f->pid == pid) {
+                    f->topic = f->msg = MP_OBJ_NULL;
+                    self->pending--;
+                    break;
+                }
+            }
+            break;
+        }
+        case MQTT_SUBACK:
+        case MQTT_UNSUBACK:
+            if (len < 2) {
+                goto bad;
+            }
+            self->ack_pid = mqtt_get_u16(p);
+            self->ack_rc = (len > 2) ? p[2] : 0;
+            break;
+    }
+    return type & 0xf0;
+
+bad:
+    mp_raise_OSError(MP_EIO);
+}
+
+// sends what is due: overdue QoS 1 messages again, and a ping if keepalive
+// is half gone with nothing sent
+STATIC void mqtt_service(mp_obj_mqtt_t *self) {
+    uint32_t now = mp_hal_ticks_ms();
+    for (int i = 0; i < self->window && self->pending > 0; i++) {
+        mqtt_inflight_t *f = &self->inflight[i];
+        if (f->topic != MP_OBJ_NULL && now - f->sent_ms >= self->retry_ms) {
+            mqtt_send_publish(self, f->topic, f->msg, 1, f->retain, f->pid, true);
+            f->sent_ms = now;
+        }
+    }
+    if (self->keepalive && now - self->last_tx_ms >= self->keepalive * 500u) {
+        mqtt_send_short(self, MQTT_PINGREQ, -1);
+    }
+}
+
+// handles the next packet, or returns -1 if none is complete and block is false
+STATIC int mqtt_poll(mp_obj_mqtt_t *self, bool block, bool nested) {
+    mqtt_service(self);
+    mqtt_set_blocking(self, block);
+    if (!mqtt_recv_packet(self, block)) {
+        return -1;
+    }
+    return mqtt_handle(self, nested);
+}
+
+STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    enum { ARG_sock, ARG_client_id, ARG_user, ARG_password, ARG_keepalive, ARG_window, ARG_retry_ms };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_sock, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_client_id, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_user, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_password, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_keepalive, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_window, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 8} },
+        { MP_QSTR_retry_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 5000} },
+    };
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+
+    mp_get_stream_raise(vals[ARG_sock].u_obj, MP_STREAM_OP_READ | MP_STREAM_OP_WRITE);
+    if (vals[ARG_window].u_int < 1 || vals[ARG_window].u_int > 0xffff
+        || vals[ARG_keepalive].u_int < 0 || vals[ARG_keepalive].u_int > 0xffff) {
+        mp_raise_ValueError(NULL);
+    }
+
+    mp_obj_mqtt_t *o = m_new_obj(mp_obj_mqtt_t);
+    memset(o, 0, sizeof(*o));
+    o->base.type = type;
+    o->sock = vals[ARG_sock].u_obj;
+    o->client_id = vals[ARG_client_id].u_obj;
+    o->user = vals[ARG_user].u_obj;
+    o->password = vals[ARG_password].u_obj;
+    o->callback = mp_const_none;
+    o->keepalive = vals[ARG_keepalive].u_int;
+    o->window = vals[ARG_window].u_int;
+    o->retry_ms = vals[ARG_retry_ms].u_int;
+    o->inflight = m_new0(mqtt_inflight_t, o->window);
+    o->ack_rc = -1;
+    o->connack_rc = -1;
+    o->blocking = -1;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+// MQTTClient.connect(clean_session=True, sock=None)
+// A new sock replaces the stream, to reconnect without losing the messages
+// in flight.  Returns whether the broker kept the session.
+STATIC mp_obj_t mqtt_connect(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_clean_session, ARG_sock };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_clean_session, MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_sock, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_sock].u_obj != mp_const_none) {
+        mp_get_stream_raise(args[ARG_sock].u_obj, MP_STREAM_OP_READ | MP_STREAM_OP_WRITE);
+        self->sock = args[ARG_sock].u_obj;
+        self->blocking = -1;
+        self->rx_hdr_len = 0;
+    }
+
+    mp_buffer_info_t id, user = {0}, password = {0};
+    mqtt_get_str(self->client_id, &id);
+    byte flags = args[ARG_clean_session].u_bool ? 0x02 : 0;
+    size_t rem_len = 10 + 2 + id.len;
+    if (self->user != mp_const_none) {
+        mqtt_get_str(self->user, &user);
+        flags |= 0x80;
+        rem_len += 2 + user.len;
+    }
+    if (self->password != mp_const_none) {
+        mqtt_get_str(self->password, &password);
+        flags |= 0x40;
+        rem_len += 2 + password.len;
+    }
+
+    mqtt_tx_t tx;
+    mqtt_tx_start(&tx, self, MQTT_CONNECT, rem_len);
+    mqtt_tx_add(&tx, "\x00\x04MQTT\x04", 7);
+    mqtt_tx_add(&tx, &flags, 1);
+    mqtt_tx_u16(&tx, self->keepalive);
+    mqtt_tx_str(&tx, &id);
+    if (flags & 0x80) {
+        mqtt_tx_str(&tx, &user);
+    }
+    if (flags & 0x40) {
+        mqtt_tx_str(&tx, &password);
+    }
+    mqtt_tx_flush(&tx);
+
+    self->connack_rc = -1;
+    while (self->connack_rc < 0) {
+        mqtt_set_blocking(self, true);
+        mqtt_recv_packet(self, true);
+        mqtt_handle(self, true);
+    }
+    if (self->connack_rc & 0xff) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "MQTT connect refused (%d)", self->connack_rc & 0xff));
+    }
+
+    bool session_present = self->connack_rc & 0x100;
+    for (int i = 0; i < self->window; i++) {
+        mqtt_inflight_t *f = &self->inflight[i];
+        if (f->topic == MP_OBJ_NULL) {
+            continue;
+        }
+        if (session_present) {
+            mqtt_send_publish(self, f->topic, f->msg, 1, f->retain, f->pid, true);
+            f->sent_ms = mp_hal_ticks_ms();
+        } else {
+            f->topic = f->msg = MP_OBJ_NULL;
+            self->pending--;
+        }
+    }
+    return mp_obj_new_bool(session_present);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_connect_obj, 1, mqtt_connect);
+
+STATIC mp_obj_t mqtt_disconnect(mp_obj_t self_in) {
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(self_in);
+    mqtt_send_short(self, MQTT_DISCONNECT, -1);
+    return mp_stream_close(self->sock);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_disconnect_obj, mqtt_disconnect);
+
+STATIC mp_obj_t mqtt_ping(mp_obj_t self_in) {
+    mqtt_send_short(MP_OBJ_TO_PTR(self_in), MQTT_PINGREQ, -1);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_ping_obj, mqtt_ping);
+
+STATIC mp_obj_t mqtt_set_callback(mp_obj_t self_in, mp_obj_t callback) {
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(self_in);
+    self->callback = callback;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mqtt_set_callback_obj, mqtt_set_callback);
+
+// MQTTClient.publish(topic, msg, retain=False, qos=0)
+// Returns the packet id of a QoS 1 message, None for QoS 0.
+STATIC mp_obj_t mqtt_publish(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_topic, ARG_msg, ARG_retain, ARG_qos };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_topic, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_msg, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_retain, MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_qos, MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_obj_t topic = args[ARG_topic].u_obj;
+    mp_obj_t msg = args[ARG_msg].u_obj;
+    bool retain = args[ARG_retain].u_bool;
+    mp_int_t qos = args[ARG_qos].u_int;
+    if (qos != 0 && qos != 1) {
+        mp_raise_ValueError("qos must be 0 or 1");
+    }
+    if (qos == 0) {
+        mqtt_send_publish(self, topic, msg, 0, retain, 0, false);
+        return mp_const_none;
+    }
+
+    while (self->pending == self->window) {
+        mqtt_poll(self, true, true);
+    }
+    mqtt_inflight_t *f = self->inflight;
+    while (f->topic != MP_OBJ_NULL) {
+        f++;
+    }
+    uint16_t pid = mqtt_new_pid(self);
+    mqtt_send_publish(self, topic, msg, 1, retain, pid, false);
+    f->topic = topic;
+    f->msg = msg;
+    f->pid = pid;
+    f->retain = retain;
+    f->sent_ms = mp_hal_ticks_ms();
+    self->pending++;
+    return MP_OBJ_NEW_SMALL_INT(pid);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_publish_obj, 3, mqtt_publish);
+
+// sends a SUBSCRIBE or UNSUBSCRIBE and handles packets until it is acknowledged
+STATIC int mqtt_subscription(mp_obj_mqtt_t *self, byte type, mp_obj_t topic, int qos) {
+    mp_buffer_info_t t;
+    mqtt_get_str(topic, &t);
+    uint16_t pid = mqtt_new_pid(self);
+
+    mqtt_tx_t tx;
+    mqtt_tx_start(&tx, self, type | 0x02, 2 + 2 + t.len + (qos >= 0 ? 1 : 0));
+    mqtt_tx_u16(&tx, pid);
+    mqtt_tx_str(&tx, &t);
+    if (qos >= 0) {
+        byte q = qos;
+        mqtt_tx_add(&tx, &q, 1);
+    }
+    mqtt_tx_flush(&tx);
+
+    self->ack_rc = -1;
+    while (self->ack_rc < 0 || self->ack_pid != pid) {
+        mqtt_poll(self, true, true);
+    }
+    return self->ack_rc;
+}
+
+// MQTTClient.subscribe(topic, qos=0)
+// Returns the QoS granted by the broker.
+STATIC mp_obj_t mqtt_subscribe(size_t n_args, const mp_obj_t *args) {
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t qos = n_args > 2 ? mp_obj_get_int(args[2]) : 0;
+    if (qos != 0 && qos != 1) {
+        mp_raise_ValueError("qos must be 0 or 1");
+    }
+    int rc = mqtt_subscription(self, MQTT_SUBSCRIBE, args[1], qos);
+    if (rc & 0x80) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "MQTT subscribe refused (%d)", rc));
+    }
+    return MP_OBJ_NEW_SMALL_INT(rc);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mqtt_subscribe_obj, 2, 3, mqtt_subscribe);
+
+STATIC mp_obj_t mqtt_unsubscribe(mp_obj_t self_in, mp_obj_t topic) {
+    mqtt_subscription(MP_OBJ_TO_PTR(self_in), MQTT_UNSUBSCRIBE, topic, -1);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mqtt_unsubscribe_obj, mqtt_unsubscribe);
+
+STATIC mp_obj_t mqtt_poll_result(int type) {
+    return (type < 0) ? mp_const_none : MP_OBJ_NEW_SMALL_INT(type);
+}
+
+// MQTTClient.wait_msg()
+// Handles the next incoming packet, waiting for it, and returns its type.
+STATIC mp_obj_t mqtt_wait_msg(mp_obj_t self_in) {
+    return mqtt_poll_result(mqtt_poll(MP_OBJ_TO_PTR(self_in), true, false));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_wait_msg_obj, mqtt_wait_msg);
+
+// MQTTClient.check_msg()
+// As wait_msg(), but returns None at once if no whole packet has arrived.
+// Also sends any retransmissions and keepalive pings that are due.
+STATIC mp_obj_t mqtt_check_msg(mp_obj_t self_in) {
+    return mqtt_poll_result(mqtt_poll(MP_OBJ_TO_PTR(self_in), false, false));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_check_msg_obj, mqtt_check_msg);
+
+// MQTTClient.pending()
+// The number of QoS 1 messages waiting for their PUBACK.
+STATIC mp_obj_t mqtt_pending(mp_obj_t self_in) {
+    mp_obj_mqtt_t *self = MP_OBJ_TO_PTR(self_in);
+    return MP_OBJ_NEW_SMALL_INT(self->pending);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_pending_obj, mqtt_pending);
+
+STATIC const mp_rom_map_elem_t mqtt_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_connect), MP_ROM_PTR(&mqtt_connect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_disconnect), MP_ROM_PTR(&mqtt_disconnect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ping), MP_ROM_PTR(&mqtt_ping_obj) },
+    { MP_ROM_QSTR(MP_QSTR_set_callback), MP_ROM_PTR(&mqtt_set_callback_obj) },
+    { MP_ROM_QSTR(MP_QSTR_publish), MP_ROM_PTR(&mqtt_publish_obj) },
+    { MP_ROM_QSTR(MP_QSTR_subscribe), MP_ROM_PTR(&mqtt_subscribe_obj) },
+    { MP_ROM_QSTR(MP_QSTR_unsubscribe), MP_ROM_PTR(&mqtt_unsubscribe_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wait_msg), MP_ROM_PTR(&mqtt_wait_msg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_check_msg), MP_ROM_PTR(&mqtt_check_msg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pending), MP_ROM_PTR(&mqtt_pending_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(mqtt_locals_dict, mqtt_locals_dict_table);
+
+STATIC const mp_obj_type_t mqtt_client_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_MQTTClient,
+    .make_new = mqtt_make_new,
+    .locals_dict = (void*)&mqtt_locals_dict,
+};
+
+STATIC const mp_rom_map_elem_t umqtt_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__umqtt) },
+    { MP_ROM_QSTR(MP_QSTR_MQTTClient), MP_ROM_PTR(&mqtt_client_type) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(umqtt_module_globals, umqtt_module_globals_table);
+
+const mp_obj_module_t mp_module_umqtt = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&umqtt_module_globals,
+};
+
+#endif // MICROPY_PY_UMQTT
@@ -36,7 +36,10 @@
 
 enum { FRAME_HEADER, FRAME_OPT, PAYLOAD, CONTROL };
 
-enum { BLOCKING_WRITE = 0x80 };
+enum { TX_CONT = 0x20, BLOCKING_WRITE = 0x80 };
+
+// frames with a payload up to this size are written with the header in one go
+#define WEBSOCKET_WRITE_COALESCE (128)
 
 typedef struct _mp_obj_websocket_t {
     mp_obj_base_t base;
@@ -47,7 +50,7 @@ typedef struct _mp_obj_websocket_t {
     byte to_recv;
     byte mask_pos;
     byte buf_pos;
-    byte buf[6];
+    byte buf[12];
     byte opts;
     // Copy of last data frame flags
     byte ws_flags;
@@ -74,6 +77,32 @@ STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, siz
     return  MP_OBJ_FROM_PTR(o);
 }
 
+// XOR a run of payload bytes with the mask, starting at mask position *pos.
+// The aligned middle of the run is done a word at a time, with the mask
+// rotated to line up with it.
+STATIC void websocket_unmask(byte *p, size_t len, const byte *mask, byte *pos) {
+    byte i = *pos;
+    while (len != 0 && ((uintptr_t)p & 3) != 0) {
+        *p++ ^= mask[i++ & 3];
+        len--;
+    }
+    if (len >= 4) {
+        byte rot[4] = {mask[i & 3], mask[(i + 1) & 3], mask[(i + 2) & 3], mask[(i + 3) & 3]};
+        uint32_t m;
+        memcpy(&m, rot, 4);
+        uint32_t *w = (uint32_t*)p;
+        for (size_t n = len >> 2; n != 0; n--) {
+            *w++ ^= m;
+        }
+        p = (byte*)w;
+        len &= 3;
+    }
+    while (len-- != 0) {
+        *p++ ^= mask[i++ & 3];
+    }
+    *pos = i;
+}
+
 STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
     const mp_stream_p_t *stream_p = mp_get_stream(self->sock);
@@ -93,9 +122,6 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 
         switch (self->state) {
             case FRAME_HEADER: {
-                // TODO: Split frame handling below is untested so far, so conservatively disable it
-                assert(self->buf[0] & 0x80);
-
                 // "Control frames MAY be injected in the middle of a fragmented message."
                 // So, they must be processed before data frames (and not alter
                 // self->ws_flags)
@@ -103,10 +129,10 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                 self->last_flags = frame_type;
                 frame_type &= FRAME_OPCODE_MASK;
 
-                if ((self->buf[0] & FRAME_OPCODE_MASK) == FRAME_CONT) {
+                if (frame_type == FRAME_CONT) {
                     // Preserve previous frame type
                     self->ws_flags = (self->ws_flags & FRAME_OPCODE_MASK) | (self->buf[0] & ~FRAME_OPCODE_MASK);
-                } else {
+                } else if (frame_type < FRAME_CLOSE) {
                     self->ws_flags = self->buf[0];
                 }
 
@@ -121,7 +147,7 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                     to_recv += 2;
                 } else if (sz == 127) {
                     // Msg size is next 8 bytes
-                    assert(0);
+                    to_recv += 8;
                 }
                 if (self->buf[1] & 0x80) {
                     // Next 4 bytes is mask
@@ -144,11 +170,19 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
             }
 
             case FRAME_OPT: {
-                if ((self->buf_pos & 3) == 2) {
-                    // First two bytes are message length
+                // buf holds a 2 or 8 byte length (or none), then maybe the mask
+                byte len_sz = self->buf_pos >= 8 ? 8 : (self->buf_pos & 2);
+                if (len_sz == 2) {
                     self->msg_sz = (self->buf[0] << 8) | self->buf[1];
+                } else if (len_sz == 8) {
+                    if (self->buf[0] | self->buf[1] | self->buf[2] | self->buf[3]) {
+                        // frames of 4GB and up can't be tracked
+                        *errcode = MP_EIO;
+                        return MP_STREAM_ERROR;
+                    }
+                    self->msg_sz = ((uint32_t)self->buf[4] << 24) | (self->buf[5] << 16) | (self->buf[6] << 8) | self->buf[7];
                 }
-                if (self->buf_pos >= 4) {
+                if (self->buf_pos - len_sz == 4) {
                     // Last 4 bytes is mask
                     memcpy(self->mask, self->buf + self->buf_pos - 4, 4);
                 }
@@ -175,9 +209,10 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                     return out_sz;
                 }
 
-                sz = out_sz;
-                for (byte *p = buf; sz--; p++) {
-                    *p ^= self->mask[self->mask_pos++ & 3];
+                uint32_t mask;
+                memcpy(&mask, self->mask, 4);
+                if (mask != 0) {
+                    websocket_unmask(buf, out_sz, self->mask, &self->mask_pos);
                 }
 
                 self->msg_sz -= out_sz;
@@ -218,17 +253,34 @@ no_payload:
 
 STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
-    assert(size < 0x10000);
-    byte header[4] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
+    byte header[10 + WEBSOCKET_WRITE_COALESCE];
+    // with FRAME_MORE set the message is sent as fragments: the first frame
+    // carries the opcode, the rest are continuations and the write made after
+    // FRAME_MORE is cleared finishes the message
+    header[0] = (self->opts & TX_CONT) ? FRAME_CONT : (self->opts & FRAME_OPCODE_MASK);
+    if (self->opts & FRAME_MORE) {
+        self->opts |= TX_CONT;
+    } else {
+        header[0] |= 0x80;
+        self->opts &= ~TX_CONT;
+    }
     int hdr_sz;
     if (size < 126) {
         header[1] = size;
         hdr_sz = 2;
-    } else {
+    } else if (size < 0x10000) {
         header[1] = 126;
         header[2] = size >> 8;
         header[3] = size & 0xff;
         hdr_sz = 4;
+    } else {
+        header[1] = 127;
+        memset(header + 2, 0, 4);
+        header[6] = size >> 24;
+        header[7] = size >> 16;
+        header[8] = size >> 8;
+        header[9] = size & 0xff;
+        hdr_sz = 10;
     }
 
     mp_obj_t dest[3];
@@ -238,9 +290,18 @@ STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t si
         mp_call_method_n_kw(1, 0, dest);
     }
 
-    mp_uint_t out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
-    if (*errcode == 0) {
-        out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
+    mp_uint_t out_sz;
+    if (size <= WEBSOCKET_WRITE_COALESCE) {
+        // small frames go out as a single write, so they don't end up split
+        // across two packets
+        memcpy(header + hdr_sz, buf, size);
+        out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz + size, errcode);
+        out_sz -= MIN(out_sz, (mp_uint_t)hdr_sz);
+    } else {
+        out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
+        if (*errcode == 0) {
+            out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
+        }
     }
 
     if (self->opts & BLOCKING_WRITE) {
@@ -265,8 +326,8 @@ STATIC mp_uint_t websocket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t
         case MP_STREAM_GET_DATA_OPTS:
             return self->ws_flags & FRAME_OPCODE_MASK;
         case MP_STREAM_SET_DATA_OPTS: {
-            int cur = self->opts & FRAME_OPCODE_MASK;
-            self->opts = (self->opts & ~FRAME_OPCODE_MASK) | (arg & FRAME_OPCODE_MASK);
+            int cur = self->opts & (FRAME_OPCODE_MASK | FRAME_MORE);
+            self->opts = (self->opts & ~(FRAME_OPCODE_MASK | FRAME_MORE)) | (arg & (FRAME_OPCODE_MASK | FRAME_MORE));
             return cur;
         }
         default:
@@ -2,6 +2,8 @@
 #define MICROPY_INCLUDED_EXTMOD_MODUWEBSOCKET_H
 
 #define FRAME_OPCODE_MASK 0x0f
+// data option: writes are fragments of one message until it's cleared again
+#define FRAME_MORE 0x10
 enum {
     FRAME_CONT, FRAME_TXT, FRAME_BIN,
     FRAME_CLOSE = 0x8, FRAME_PING, FRAME_PONG
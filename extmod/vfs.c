@@ -42,6 +42,10 @@
 #include "extmod/vfs_posix.h"
 #endif
 
+#if MICROPY_VFS_ROM
+#include "extmod/vfs_rom.h"
+#endif
+
 // For mp_vfs_proxy_call, the maximum number of additional args that can be passed.
 // A fixed maximum size is used to avoid the need for a costly variable array.
 #define PROXY_MAX_ARGS (2)
@@ -52,6 +56,11 @@ FATFS *lookup_path_fatfs(const TCHAR *path, const TCHAR **path_out) {
     if (fs == MP_VFS_NONE || fs == MP_VFS_ROOT) {
         return NULL;
     }
+    #if MICROPY_VFS_ROM
+    if (mp_obj_is_type(fs->obj, &mp_type_vfs_rom)) {
+        return NULL;
+    }
+    #endif
     // here we assume that the mounted device is FATFS
     return &((fs_user_mount_t*)MP_OBJ_TO_PTR(fs->obj))->fs.fatfs;
 }
@@ -62,6 +71,11 @@ vfs_lfs_struct_t* lookup_path_littlefs(const TCHAR *path, const TCHAR **path_out
     if (fs == MP_VFS_NONE || fs == MP_VFS_ROOT) {
         return NULL;
     }
+    #if MICROPY_VFS_ROM
+    if (mp_obj_is_type(fs->obj, &mp_type_vfs_rom)) {
+        return NULL;
+    }
+    #endif
     // here we assume that the mounted device is LittleFs
     return &((fs_user_mount_t*)MP_OBJ_TO_PTR(fs->obj))->fs.littlefs;
 }
@@ -564,4 +578,46 @@ mp_obj_t mp_vfs_fsformat(mp_obj_t path_in)
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_fsformat_obj, mp_vfs_fsformat);
 
+#if MICROPY_VFS_STATS
+mp_obj_t mp_vfs_fsstats(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t path_out;
+    mp_vfs_mount_t *vfs = lookup_path(args[0], &path_out);
+    if (vfs == MP_VFS_ROOT) {
+        for (vfs = MP_STATE_VM(vfs_mount_table); vfs != NULL; vfs = vfs->next) {
+            if (vfs->len == 1) {
+                break;
+            }
+        }
+    }
+    if (vfs == NULL || vfs == MP_VFS_NONE) {
+        mp_raise_OSError(MP_ENODEV);
+    }
+    mp_obj_t meth[3];
+    mp_load_method_maybe(vfs->obj, MP_QSTR_stats, meth);
+    if (meth[0] == MP_OBJ_NULL) {
+        // filesystem has no block device to account
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+    meth[2] = n_args > 1 ? args[1] : mp_const_false;
+    return mp_call_method_n_kw(1, 0, meth);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_fsstats_obj, 1, 2, mp_vfs_fsstats);
+
+// fstrace(n) starts tracing block I/O of all mounts into a ring of n entries
+// (0 stops it); fstrace() returns the entries recorded so far, oldest first,
+// and empties the ring.
+mp_obj_t mp_vfs_fstrace(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_vfs_trace_drain();
+    }
+    mp_int_t len = mp_obj_get_int(args[0]);
+    if (len < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    mp_vfs_trace_enable(len);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_fstrace_obj, 0, 1, mp_vfs_fstrace);
+#endif
+
 #endif // MICROPY_VFS
@@ -30,6 +30,7 @@
 #include "py/obj.h"
 #include "lib/oofatfs/ff.h"
 #include "esp32/littlefs/vfs_littlefs.h"
+#include "extmod/vfs_stats.h"
 
 // return values of mp_vfs_lookup_path
 // ROOT is 0 so that the default current directory is the root directory
@@ -65,6 +66,9 @@ typedef struct _fs_user_mount_t {
         FATFS fatfs;
         vfs_lfs_struct_t littlefs;
     } fs;
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_t stats;
+    #endif
 } fs_user_mount_t;
 
 typedef struct _mp_vfs_proto_t {
@@ -99,6 +103,8 @@ mp_obj_t mp_vfs_stat(mp_obj_t path_in);
 mp_obj_t mp_vfs_statvfs(mp_obj_t path_in);
 mp_obj_t mp_vfs_getfree(mp_obj_t path_in);
 mp_obj_t mp_vfs_fsformat(mp_obj_t path_in);
+mp_obj_t mp_vfs_fsstats(size_t n_args, const mp_obj_t *args);
+mp_obj_t mp_vfs_fstrace(size_t n_args, const mp_obj_t *args);
 
 MP_DECLARE_CONST_FUN_OBJ_KW(mp_vfs_mount_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_umount_obj);
@@ -115,5 +121,7 @@ MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_stat_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_statvfs_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_getfree_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(mp_vfs_fsformat_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_fsstats_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_fstrace_obj);
 
 #endif // MICROPY_INCLUDED_EXTMOD_VFS_H
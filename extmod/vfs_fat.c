@@ -72,6 +72,9 @@ STATIC mp_obj_t fat_vfs_make_new(const mp_obj_type_t *type, size_t n_args, size_
     vfs->base.type = type;
     vfs->flags = FSUSER_FREE_OBJ;
     vfs->fs.fatfs.drv = vfs;
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_init(&vfs->stats);
+    #endif
 
     // load block protocol methods
     mp_load_method(args[0], MP_QSTR_readblocks, vfs->readblocks);
@@ -475,6 +478,14 @@ STATIC mp_obj_t fat_vfs_fsformat(mp_obj_t vfs_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(fat_vfs_fsformat_obj, fat_vfs_fsformat);
 
+#if MICROPY_VFS_STATS
+STATIC mp_obj_t fat_vfs_stats(size_t n_args, const mp_obj_t *args) {
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
+    return mp_vfs_stats_to_dict(&self->stats, n_args > 1 && mp_obj_is_true(args[1]));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_stats_obj, 1, 2, fat_vfs_stats);
+#endif
+
 STATIC const mp_rom_map_elem_t fat_vfs_locals_dict_table[] = {
     #if _FS_REENTRANT
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&fat_vfs_del_obj) },
@@ -494,6 +505,9 @@ STATIC const mp_rom_map_elem_t fat_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_mount), MP_ROM_PTR(&vfs_fat_mount_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount), MP_ROM_PTR(&fat_vfs_umount_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_fsformat), MP_ROM_PTR(&fat_vfs_fsformat_obj) },
+    #if MICROPY_VFS_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&fat_vfs_stats_obj) },
+    #endif
 };
 STATIC MP_DEFINE_CONST_DICT(fat_vfs_locals_dict, fat_vfs_locals_dict_table);
 
@@ -69,9 +69,16 @@ DRESULT disk_read (
         return RES_PARERR;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+
     if (vfs->flags & FSUSER_NATIVE) {
         mp_uint_t (*f)(uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->readblocks[2];
         if (f(buff, sector, count) != 0) {
+            #if MICROPY_VFS_STATS
+            mp_vfs_stats_record(&vfs->stats, MP_VFS_STATS_READ, sector, 0, start, true);
+            #endif
             return RES_ERROR;
         }
     } else {
@@ -82,6 +89,10 @@ DRESULT disk_read (
         // TODO handle error return
     }
 
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_record(&vfs->stats, MP_VFS_STATS_READ, sector, count * SECSIZE(&vfs->fs.fatfs), start, false);
+    #endif
+
     return RES_OK;
 }
 
@@ -106,9 +117,16 @@ DRESULT disk_write (
         return RES_WRPRT;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+
     if (vfs->flags & FSUSER_NATIVE) {
         mp_uint_t (*f)(const uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->writeblocks[2];
         if (f(buff, sector, count) != 0) {
+            #if MICROPY_VFS_STATS
+            mp_vfs_stats_record(&vfs->stats, MP_VFS_STATS_WRITE, sector, 0, start, true);
+            #endif
             return RES_ERROR;
         }
     } else {
@@ -119,6 +137,10 @@ DRESULT disk_write (
         // TODO handle error return
     }
 
+    #if MICROPY_VFS_STATS
+    mp_vfs_stats_record(&vfs->stats, MP_VFS_STATS_WRITE, sector, count * SECSIZE(&vfs->fs.fatfs), start, false);
+    #endif
+
     return RES_OK;
 }
 
@@ -138,6 +160,10 @@ DRESULT disk_ioctl (
         return RES_PARERR;
     }
 
+    #if MICROPY_VFS_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+
     // First part: call the relevant method of the underlying block device
     mp_obj_t ret = mp_const_none;
     if (vfs->flags & FSUSER_HAVE_IOCTL) {
@@ -180,6 +206,9 @@ DRESULT disk_ioctl (
     // Second part: convert the result for return
     switch (cmd) {
         case CTRL_SYNC:
+            #if MICROPY_VFS_STATS
+            mp_vfs_stats_record(&vfs->stats, MP_VFS_STATS_SYNC, 0, 0, start, false);
+            #endif
             return RES_OK;
 
         case GET_SECTOR_COUNT: {
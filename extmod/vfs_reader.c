@@ -70,9 +70,20 @@ STATIC void mp_reader_vfs_close(void *data) {
 }
 
 void mp_reader_new_file(mp_reader_t *reader, const char *filename) {
-    mp_reader_vfs_t *rf = m_new_obj(mp_reader_vfs_t);
     mp_obj_t arg = mp_obj_new_str(filename, strlen(filename));
-    rf->file = mp_vfs_open(1, &arg, (mp_map_t*)&mp_const_empty_map);
+    mp_obj_t file = mp_vfs_open(1, &arg, (mp_map_t*)&mp_const_empty_map);
+    #if MICROPY_VFS_ROM
+    // a file that exposes its contents in memory (eg on a ROM filesystem) is
+    // read in place, without buffering it through the stream protocol
+    mp_buffer_info_t bufinfo;
+    if (mp_get_buffer(file, &bufinfo, MP_BUFFER_READ)) {
+        mp_stream_close(file);
+        mp_reader_new_mem(reader, bufinfo.buf, bufinfo.len, 0);
+        return;
+    }
+    #endif
+    mp_reader_vfs_t *rf = m_new_obj(mp_reader_vfs_t);
+    rf->file = file;
     int errcode;
     rf->len = mp_stream_rw(rf->file, rf->buf, sizeof(rf->buf), &errcode, MP_STREAM_RW_READ | MP_STREAM_RW_ONCE);
     if (errcode != 0) {
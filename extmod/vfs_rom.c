@@ -0,0 +1,414 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/objstr.h"
+#include "py/mperrno.h"
+#include "extmod/vfs.h"
+#include "extmod/vfs_rom.h"
+
+#if MICROPY_VFS_ROM
+
+// The image is any object exporting a read-only buffer: a bytes object, a
+// frozen bytes constant (which lives in flash), or a memory-mapped region.
+// Nothing is copied out of it; file contents are handed out in place.
+
+STATIC inline uint32_t get_u16(const byte *p) {
+    return p[0] | p[1] << 8;
+}
+
+STATIC inline uint32_t get_u32(const byte *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+#define ENT_NAME(img, e)    get_u32((img) + (e))
+#define ENT_NAME_LEN(img, e) get_u16((img) + (e) + 4)
+#define ENT_KIND(img, e)    get_u16((img) + (e) + 6)
+#define ENT_DATA(img, e)    get_u32((img) + (e) + 8)
+#define ENT_SIZE(img, e)    get_u32((img) + (e) + 12)
+
+// Check every table, name and file body lies within the image, so that the
+// lookups below don't need to bounds check.  A table shared by several
+// directories is checked once for each of them, so *budget counts down the
+// entries checked: an image with more than it can hold is rejected, instead
+// of taking time exponential in its depth.
+STATIC bool vfs_rom_check_table(const byte *img, size_t size, uint32_t tbl, uint32_t n, uint32_t depth, uint32_t *budget) {
+    if (depth > MP_VFS_ROM_MAX_DEPTH || tbl > size || n > (size - tbl) / MP_VFS_ROM_ENTRY_SIZE || n > *budget) {
+        return false;
+    }
+    *budget -= n;
+    for (uint32_t e = tbl; e < tbl + n * MP_VFS_ROM_ENTRY_SIZE; e += MP_VFS_ROM_ENTRY_SIZE) {
+        uint32_t data = ENT_DATA(img, e);
+        uint32_t len = ENT_SIZE(img, e);
+        if (ENT_NAME(img, e) > size || ENT_NAME_LEN(img, e) > size - ENT_NAME(img, e)) {
+            return false;
+        }
+        switch (ENT_KIND(img, e)) {
+            case MP_VFS_ROM_KIND_FILE:
+                if (data > size || len > size - data) {
+                    return false;
+                }
+                break;
+            case MP_VFS_ROM_KIND_DIR:
+                if (data <= tbl || !vfs_rom_check_table(img, size, data, len, depth + 1, budget)) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Binary search the table of a directory for a name; returns the offset of
+// its entry or 0 if it's not there.
+STATIC uint32_t vfs_rom_find(mp_obj_vfs_rom_t *self, uint32_t tbl, uint32_t n, const char *name, size_t len) {
+    const byte *img = self->img;
+    uint32_t lo = 0;
+    uint32_t hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        uint32_t e = tbl + mid * MP_VFS_ROM_ENTRY_SIZE;
+        size_t elen = ENT_NAME_LEN(img, e);
+        int cmp = memcmp(name, img + ENT_NAME(img, e), MIN(len, elen));
+        if (cmp == 0) {
+            if (len == elen) {
+                return e;
+            }
+            cmp = len < elen ? -1 : 1;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return 0;
+}
+
+// Get the child table of the directory at the end of a resolved path.
+STATIC void vfs_rom_dir_table(mp_obj_vfs_rom_t *self, const mp_vfs_rom_path_t *p, uint32_t *tbl, uint32_t *n) {
+    if (p->depth == 0) {
+        *tbl = get_u32(self->img + 12);
+        *n = get_u32(self->img + 16);
+    } else {
+        *tbl = ENT_DATA(self->img, p->ent[p->depth - 1]);
+        *n = ENT_SIZE(self->img, p->ent[p->depth - 1]);
+    }
+}
+
+STATIC bool vfs_rom_is_dir(mp_obj_vfs_rom_t *self, const mp_vfs_rom_path_t *p) {
+    return p->depth == 0 || ENT_KIND(self->img, p->ent[p->depth - 1]) == MP_VFS_ROM_KIND_DIR;
+}
+
+// Resolve a path, relative to the current directory unless it starts with a
+// slash.  Returns 0 on success or an errno value.
+STATIC int vfs_rom_resolve(mp_obj_vfs_rom_t *self, const char *path, mp_vfs_rom_path_t *p) {
+    if (*path == '/') {
+        p->depth = 0;
+    } else {
+        *p = self->cwd;
+    }
+    while (*path != '\0') {
+        while (*path == '/') {
+            ++path;
+        }
+        const char *name = path;
+        while (*path != '\0' && *path != '/') {
+            ++path;
+        }
+        size_t len = path - name;
+        if (len == 0 || (len == 1 && name[0] == '.')) {
+            continue;
+        }
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            if (p->depth > 0) {
+                --p->depth;
+            }
+            continue;
+        }
+        if (!vfs_rom_is_dir(self, p)) {
+            return MP_ENOTDIR;
+        }
+        uint32_t tbl, n;
+        vfs_rom_dir_table(self, p, &tbl, &n);
+        uint32_t e = vfs_rom_find(self, tbl, n, name, len);
+        if (e == 0 || p->depth == MP_VFS_ROM_MAX_DEPTH) {
+            return MP_ENOENT;
+        }
+        p->ent[p->depth++] = e;
+    }
+    return 0;
+}
+
+STATIC void vfs_rom_resolve_raise(mp_obj_vfs_rom_t *self, mp_obj_t path_in, mp_vfs_rom_path_t *p) {
+    int err = vfs_rom_resolve(self, mp_obj_str_get_str(path_in), p);
+    if (err != 0) {
+        mp_raise_OSError(err);
+    }
+}
+
+STATIC mp_import_stat_t vfs_rom_import_stat(void *self_in, const char *path) {
+    mp_obj_vfs_rom_t *self = self_in;
+    mp_vfs_rom_path_t p;
+    if (vfs_rom_resolve(self, path, &p) != 0) {
+        return MP_IMPORT_STAT_NO_EXIST;
+    }
+    return vfs_rom_is_dir(self, &p) ? MP_IMPORT_STAT_DIR : MP_IMPORT_STAT_FILE;
+}
+
+STATIC mp_obj_t vfs_rom_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    const byte *img = bufinfo.buf;
+    uint32_t budget = bufinfo.len / MP_VFS_ROM_ENTRY_SIZE;
+    if (bufinfo.len < MP_VFS_ROM_HEADER_SIZE || memcmp(img, "MPRF", 4) != 0
+        || get_u16(img + 4) != MP_VFS_ROM_VERSION || get_u32(img + 8) > bufinfo.len
+        || !vfs_rom_check_table(img, get_u32(img + 8), get_u32(img + 12), get_u32(img + 16), 0, &budget)) {
+        mp_raise_ValueError("invalid ROM filesystem image");
+    }
+
+    mp_obj_vfs_rom_t *vfs = m_new_obj(mp_obj_vfs_rom_t);
+    vfs->base.type = type;
+    vfs->image = args[0];
+    vfs->img = img;
+    vfs->size = get_u32(img + 8);
+    vfs->cwd.depth = 0;
+    return MP_OBJ_FROM_PTR(vfs);
+}
+
+STATIC mp_obj_t vfs_rom_mount(mp_obj_t self_in, mp_obj_t readonly, mp_obj_t mkfs) {
+    (void)self_in;
+    (void)readonly;
+    if (mp_obj_is_true(mkfs)) {
+        mp_raise_OSError(MP_EPERM);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(vfs_rom_mount_obj, vfs_rom_mount);
+
+STATIC mp_obj_t vfs_rom_umount(mp_obj_t self_in) {
+    (void)self_in;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(vfs_rom_umount_obj, vfs_rom_umount);
+
+STATIC mp_obj_t vfs_rom_open(mp_obj_t self_in, mp_obj_t path_in, mp_obj_t mode_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    const mp_obj_type_t *type = &mp_type_vfs_rom_textio;
+    const char *mode = mp_obj_str_get_str(mode_in);
+    for (; *mode != '\0'; ++mode) {
+        switch (*mode) {
+            case 'w':
+            case 'a':
+            case 'x':
+            case '+':
+                mp_raise_OSError(MP_EROFS);
+            #if MICROPY_PY_IO_FILEIO
+            case 'b':
+                type = &mp_type_vfs_rom_fileio;
+                break;
+            case 't':
+                type = &mp_type_vfs_rom_textio;
+                break;
+            #endif
+        }
+    }
+
+    mp_vfs_rom_path_t p;
+    vfs_rom_resolve_raise(self, path_in, &p);
+    if (vfs_rom_is_dir(self, &p)) {
+        mp_raise_OSError(MP_EISDIR);
+    }
+    uint32_t e = p.ent[p.depth - 1];
+    return mp_vfs_rom_file_open(self, type, self->img + ENT_DATA(self->img, e), ENT_SIZE(self->img, e));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(vfs_rom_open_obj, vfs_rom_open);
+
+STATIC mp_obj_t vfs_rom_chdir(mp_obj_t self_in, mp_obj_t path_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_vfs_rom_path_t p;
+    vfs_rom_resolve_raise(self, path_in, &p);
+    if (!vfs_rom_is_dir(self, &p)) {
+        mp_raise_OSError(MP_ENOTDIR);
+    }
+    self->cwd = p;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_rom_chdir_obj, vfs_rom_chdir);
+
+STATIC mp_obj_t vfs_rom_getcwd(mp_obj_t self_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->cwd.depth == 0) {
+        return MP_OBJ_NEW_QSTR(MP_QSTR__slash_);
+    }
+    vstr_t vstr;
+    vstr_init(&vstr, 32);
+    for (uint32_t i = 0; i < self->cwd.depth; ++i) {
+        uint32_t e = self->cwd.ent[i];
+        vstr_add_char(&vstr, '/');
+        vstr_add_strn(&vstr, (const char*)self->img + ENT_NAME(self->img, e), ENT_NAME_LEN(self->img, e));
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(vfs_rom_getcwd_obj, vfs_rom_getcwd);
+
+typedef struct _vfs_rom_ilistdir_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_vfs_rom_t *vfs;
+    bool is_str;
+    uint32_t cur;
+    uint32_t end;
+} vfs_rom_ilistdir_it_t;
+
+STATIC mp_obj_t vfs_rom_ilistdir_it_iternext(mp_obj_t self_in) {
+    vfs_rom_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->cur >= self->end) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    const byte *img = self->vfs->img;
+    uint32_t e = self->cur;
+    self->cur += MP_VFS_ROM_ENTRY_SIZE;
+
+    // make 4-tuple with info about this entry
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(4, NULL));
+    t->items[0] = mp_obj_new_str_of_type(self->is_str ? &mp_type_str : &mp_type_bytes,
+        img + ENT_NAME(img, e), ENT_NAME_LEN(img, e));
+    if (ENT_KIND(img, e) == MP_VFS_ROM_KIND_DIR) {
+        t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR);
+        t->items[3] = MP_OBJ_NEW_SMALL_INT(0);
+    } else {
+        t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFREG);
+        t->items[3] = mp_obj_new_int_from_uint(ENT_SIZE(img, e));
+    }
+    t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
+    return MP_OBJ_FROM_PTR(t);
+}
+
+STATIC mp_obj_t vfs_rom_ilistdir(mp_obj_t self_in, mp_obj_t path_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_vfs_rom_path_t p;
+    vfs_rom_resolve_raise(self, path_in, &p);
+    if (!vfs_rom_is_dir(self, &p)) {
+        mp_raise_OSError(MP_ENOTDIR);
+    }
+    uint32_t tbl, n;
+    vfs_rom_dir_table(self, &p, &tbl, &n);
+
+    vfs_rom_ilistdir_it_t *iter = m_new_obj(vfs_rom_ilistdir_it_t);
+    iter->base.type = &mp_type_polymorph_iter;
+    iter->iternext = vfs_rom_ilistdir_it_iternext;
+    iter->vfs = self;
+    iter->is_str = mp_obj_get_type(path_in) == &mp_type_str;
+    iter->cur = tbl;
+    iter->end = tbl + n * MP_VFS_ROM_ENTRY_SIZE;
+    return MP_OBJ_FROM_PTR(iter);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_rom_ilistdir_obj, vfs_rom_ilistdir);
+
+// mkdir, remove, rename and rmdir
+STATIC mp_obj_t vfs_rom_readonly(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    (void)args;
+    mp_raise_OSError(MP_EROFS);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(vfs_rom_readonly_obj, 2, 3, vfs_rom_readonly);
+
+STATIC mp_obj_t vfs_rom_stat(mp_obj_t self_in, mp_obj_t path_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_vfs_rom_path_t p;
+    vfs_rom_resolve_raise(self, path_in, &p);
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(10, NULL));
+    if (vfs_rom_is_dir(self, &p)) {
+        t->items[0] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR); // st_mode
+        t->items[6] = MP_OBJ_NEW_SMALL_INT(0); // st_size
+    } else {
+        t->items[0] = MP_OBJ_NEW_SMALL_INT(MP_S_IFREG); // st_mode
+        t->items[6] = mp_obj_new_int_from_uint(ENT_SIZE(self->img, p.ent[p.depth - 1])); // st_size
+    }
+    for (size_t i = 1; i <= 9; ++i) {
+        if (i != 6) {
+            t->items[i] = MP_OBJ_NEW_SMALL_INT(0);
+        }
+    }
+    return MP_OBJ_FROM_PTR(t);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_rom_stat_obj, vfs_rom_stat);
+
+STATIC mp_obj_t vfs_rom_statvfs(mp_obj_t self_in, mp_obj_t path_in) {
+    mp_obj_vfs_rom_t *self = MP_OBJ_TO_PTR(self_in);
+    (void)path_in;
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(10, NULL));
+    t->items[0] = MP_OBJ_NEW_SMALL_INT(1); // f_bsize
+    t->items[1] = t->items[0]; // f_frsize
+    t->items[2] = mp_obj_new_int_from_uint(self->size); // f_blocks
+    t->items[3] = MP_OBJ_NEW_SMALL_INT(0); // f_bfree
+    t->items[4] = t->items[3]; // f_bavail
+    t->items[5] = MP_OBJ_NEW_SMALL_INT(0); // f_files
+    t->items[6] = MP_OBJ_NEW_SMALL_INT(0); // f_ffree
+    t->items[7] = MP_OBJ_NEW_SMALL_INT(0); // f_favail
+    t->items[8] = MP_OBJ_NEW_SMALL_INT(1); // f_flags, ST_RDONLY
+    t->items[9] = MP_OBJ_NEW_SMALL_INT(0xffff); // f_namemax
+    return MP_OBJ_FROM_PTR(t);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(vfs_rom_statvfs_obj, vfs_rom_statvfs);
+
+STATIC const mp_rom_map_elem_t vfs_rom_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_mount), MP_ROM_PTR(&vfs_rom_mount_obj) },
+    { MP_ROM_QSTR(MP_QSTR_umount), MP_ROM_PTR(&vfs_rom_umount_obj) },
+    { MP_ROM_QSTR(MP_QSTR_open), MP_ROM_PTR(&vfs_rom_open_obj) },
+
+    { MP_ROM_QSTR(MP_QSTR_chdir), MP_ROM_PTR(&vfs_rom_chdir_obj) },
+    { MP_ROM_QSTR(MP_QSTR_getcwd), MP_ROM_PTR(&vfs_rom_getcwd_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ilistdir), MP_ROM_PTR(&vfs_rom_ilistdir_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mkdir), MP_ROM_PTR(&vfs_rom_readonly_obj) },
+    { MP_ROM_QSTR(MP_QSTR_remove), MP_ROM_PTR(&vfs_rom_readonly_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rename), MP_ROM_PTR(&vfs_rom_readonly_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rmdir), MP_ROM_PTR(&vfs_rom_readonly_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stat), MP_ROM_PTR(&vfs_rom_stat_obj) },
+    { MP_ROM_QSTR(MP_QSTR_statvfs), MP_ROM_PTR(&vfs_rom_statvfs_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(vfs_rom_locals_dict, vfs_rom_locals_dict_table);
+
+STATIC const mp_vfs_proto_t vfs_rom_proto = {
+    .import_stat = vfs_rom_import_stat,
+};
+
+const mp_obj_type_t mp_type_vfs_rom = {
+    { &mp_type_type },
+    .name = MP_QSTR_VfsRom,
+    .make_new = vfs_rom_make_new,
+    .protocol = &vfs_rom_proto,
+    .locals_dict = (mp_obj_dict_t*)&vfs_rom_locals_dict,
+};
+
+#endif // MICROPY_VFS_ROM
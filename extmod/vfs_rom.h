@@ -0,0 +1,72 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_ROM_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_ROM_H
+
+#include "py/obj.h"
+
+// Read-only filesystem image, as built by tools/mkromfs.py.  All integers are
+// little endian and every table and file body is 4-byte aligned:
+//
+//   header  "MPRF" | u16 version | u16 flags | u32 image size
+//                  | u32 root table offset | u32 root entry count
+//   table   entry[count], sorted by name (plain byte order)
+//   entry   u32 name offset | u16 name length | u16 kind
+//                  | u32 data offset | u32 size
+//
+// For a file entry data/size locate its contents; for a directory entry they
+// locate its child table and give its entry count.  Child tables always come
+// after the table that refers to them.
+
+#define MP_VFS_ROM_VERSION      (1)
+#define MP_VFS_ROM_HEADER_SIZE  (20)
+#define MP_VFS_ROM_ENTRY_SIZE   (16)
+#define MP_VFS_ROM_KIND_FILE    (1)
+#define MP_VFS_ROM_KIND_DIR     (2)
+#define MP_VFS_ROM_MAX_DEPTH    (16)
+
+// A resolved path: the offsets of the entries walked from the root.  An empty
+// path (depth 0) is the root directory.
+typedef struct _mp_vfs_rom_path_t {
+    uint32_t depth;
+    uint32_t ent[MP_VFS_ROM_MAX_DEPTH];
+} mp_vfs_rom_path_t;
+
+typedef struct _mp_obj_vfs_rom_t {
+    mp_obj_base_t base;
+    mp_obj_t image;
+    const byte *img;
+    size_t size;
+    mp_vfs_rom_path_t cwd;
+} mp_obj_vfs_rom_t;
+
+extern const mp_obj_type_t mp_type_vfs_rom;
+extern const mp_obj_type_t mp_type_vfs_rom_fileio;
+extern const mp_obj_type_t mp_type_vfs_rom_textio;
+
+mp_obj_t mp_vfs_rom_file_open(mp_obj_vfs_rom_t *vfs, const mp_obj_type_t *type, const byte *data, size_t len);
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_ROM_H
@@ -0,0 +1,183 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "extmod/vfs_stats.h"
+
+#if MICROPY_VFS_STATS
+
+STATIC uint8_t vfs_stats_next_id;
+
+void mp_vfs_stats_init(mp_vfs_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->id = vfs_stats_next_id++;
+}
+
+STATIC size_t vfs_stats_bucket(mp_uint_t us) {
+    // buckets grow by a factor of 4, starting at 16us
+    size_t b = 0;
+    for (us >>= 4; us != 0 && b < MP_VFS_STATS_HIST_LEN - 1; us >>= 2) {
+        ++b;
+    }
+    return b;
+}
+
+void mp_vfs_stats_record(mp_vfs_stats_t *stats, int op, uint32_t block, uint32_t bytes, mp_uint_t start_us, bool error) {
+    if (stats == NULL) {
+        return;
+    }
+    mp_uint_t now = mp_hal_ticks_us();
+    mp_uint_t latency = now - start_us;
+    size_t bucket = vfs_stats_bucket(latency);
+
+    // Some filesystems do their block I/O with the GIL released, while
+    // mp_vfs_stats_to_dict may reset the counters, and the trace ring is
+    // shared by all mounts: update both under an atomic section.
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    mp_vfs_stats_op_t *s = &stats->op[op];
+    s->count++;
+    if (error) {
+        s->errors++;
+    } else {
+        s->bytes += bytes;
+    }
+    s->hist[bucket]++;
+
+    mp_vfs_trace_t *trace = MP_STATE_VM(vfs_trace);
+    if (trace != NULL) {
+        mp_vfs_trace_entry_t *e = &trace->entry[trace->head];
+        e->time_us = start_us;
+        e->block = block;
+        e->bytes = bytes;
+        e->latency_us = latency;
+        e->id = stats->id;
+        e->op = op;
+        e->error = error;
+        trace->head = (trace->head + 1) % trace->len;
+        if (trace->count < trace->len) {
+            trace->count++;
+        }
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+void mp_vfs_stats_cache(mp_vfs_stats_t *stats, bool hit) {
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    if (hit) {
+        stats->cache_hits++;
+    } else {
+        stats->cache_misses++;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+STATIC const qstr vfs_stats_op_names[MP_VFS_STATS_NUM_OPS] = {
+    MP_QSTR_read, MP_QSTR_write, MP_QSTR_erase, MP_QSTR_sync,
+};
+
+mp_obj_t mp_vfs_stats_to_dict(mp_vfs_stats_t *stats, bool reset) {
+    // take a copy first so the counters are consistent with each other
+    mp_vfs_stats_t s;
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    s = *stats;
+    if (reset) {
+        memset(stats->op, 0, sizeof(stats->op));
+        stats->cache_hits = 0;
+        stats->cache_misses = 0;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+
+    mp_obj_t dict = mp_obj_new_dict(MP_VFS_STATS_NUM_OPS + 2);
+    for (size_t i = 0; i < MP_VFS_STATS_NUM_OPS; ++i) {
+        mp_obj_t hist[MP_VFS_STATS_HIST_LEN];
+        for (size_t j = 0; j < MP_VFS_STATS_HIST_LEN; ++j) {
+            hist[j] = mp_obj_new_int_from_uint(s.op[i].hist[j]);
+        }
+        mp_obj_t items[4] = {
+            mp_obj_new_int_from_uint(s.op[i].count),
+            mp_obj_new_int_from_uint(s.op[i].bytes),
+            mp_obj_new_int_from_uint(s.op[i].errors),
+            mp_obj_new_tuple(MP_VFS_STATS_HIST_LEN, hist),
+        };
+        mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(vfs_stats_op_names[i]), mp_obj_new_tuple(4, items));
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_cache_hits), mp_obj_new_int_from_uint(s.cache_hits));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_cache_misses), mp_obj_new_int_from_uint(s.cache_misses));
+    return dict;
+}
+
+void mp_vfs_trace_enable(size_t len) {
+    mp_vfs_trace_t *trace = NULL;
+    if (len > 0) {
+        trace = m_new_obj_var(mp_vfs_trace_t, mp_vfs_trace_entry_t, len);
+        trace->len = len;
+        trace->head = 0;
+        trace->count = 0;
+    }
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    MP_STATE_VM(vfs_trace) = trace;
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+mp_obj_t mp_vfs_trace_drain(void) {
+    mp_vfs_trace_t *trace = MP_STATE_VM(vfs_trace);
+    if (trace == NULL) {
+        return mp_obj_new_list(0, NULL);
+    }
+
+    // copy the ring out atomically, then build the result from the copy
+    mp_vfs_trace_entry_t *copy = m_new(mp_vfs_trace_entry_t, trace->len);
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    size_t count = trace->count;
+    size_t start = (trace->head + trace->len - count) % trace->len;
+    for (size_t i = 0; i < count; ++i) {
+        copy[i] = trace->entry[(start + i) % trace->len];
+    }
+    trace->count = 0;
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < count; ++i) {
+        mp_vfs_trace_entry_t *e = &copy[i];
+        mp_obj_t items[7] = {
+            mp_obj_new_int_from_uint(e->time_us),
+            MP_OBJ_NEW_SMALL_INT(e->id),
+            MP_OBJ_NEW_QSTR(vfs_stats_op_names[e->op]),
+            mp_obj_new_int_from_uint(e->block),
+            mp_obj_new_int_from_uint(e->bytes),
+            mp_obj_new_int_from_uint(e->latency_us),
+            mp_obj_new_bool(!e->error),
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(7, items));
+    }
+    m_del(mp_vfs_trace_entry_t, copy, trace->len);
+    return list;
+}
+
+#endif // MICROPY_VFS_STATS
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_STATS_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_STATS_H
+
+#include "py/obj.h"
+
+// block device operations that are counted
+#define MP_VFS_STATS_READ       (0)
+#define MP_VFS_STATS_WRITE      (1)
+#define MP_VFS_STATS_ERASE      (2)
+#define MP_VFS_STATS_SYNC       (3)
+#define MP_VFS_STATS_NUM_OPS    (4)
+
+// latency histogram buckets: <16us, <64us, <256us, <1ms, <4ms, <16ms, <64ms, longer
+#define MP_VFS_STATS_HIST_LEN   (8)
+
+typedef struct _mp_vfs_stats_op_t {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t hist[MP_VFS_STATS_HIST_LEN];
+} mp_vfs_stats_op_t;
+
+// Per-mount block device counters.  They're updated and read under an
+// atomic section, as block I/O may run with the GIL released.
+typedef struct _mp_vfs_stats_t {
+    mp_vfs_stats_op_t op[MP_VFS_STATS_NUM_OPS];
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint8_t id; // identifies the mount in trace entries
+} mp_vfs_stats_t;
+
+// one entry of the optional trace ring, shared by all mounts
+typedef struct _mp_vfs_trace_entry_t {
+    uint32_t time_us;
+    uint32_t block;
+    uint32_t bytes;
+    uint32_t latency_us;
+    uint8_t id;
+    uint8_t op;
+    uint8_t error;
+} mp_vfs_trace_entry_t;
+
+typedef struct _mp_vfs_trace_t {
+    size_t len;
+    size_t head;
+    size_t count;
+    mp_vfs_trace_entry_t entry[];
+} mp_vfs_trace_t;
+
+void mp_vfs_stats_init(mp_vfs_stats_t *stats);
+void mp_vfs_stats_record(mp_vfs_stats_t *stats, int op, uint32_t block, uint32_t bytes, mp_uint_t start_us, bool error);
+void mp_vfs_stats_cache(mp_vfs_stats_t *stats, bool hit);
+mp_obj_t mp_vfs_stats_to_dict(mp_vfs_stats_t *stats, bool reset);
+void mp_vfs_trace_enable(size_t len);
+mp_obj_t mp_vfs_trace_drain(void);
+
+#define MP_VFS_STATS_CACHE(stats, hit) do { \
+        if ((stats) != NULL) { \
+            mp_vfs_stats_cache((stats), (hit)); \
+        } \
+    } while (0)
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_STATS_H
@@ -376,6 +376,12 @@ static bool AckTimeoutRetry = false;
  */
 TimerTime_t TxTimeOnAir = 0;
 
+/*!
+ * Number of transmissions and their time on air, per datarate
+ */
+static uint32_t TxDatarateCounts[16];
+static TimerTime_t TxDatarateTimeOnAir[16];
+
 /*!
  * Number of trials for the Join Request
  */
@@ -697,9 +703,16 @@ static IRAM_ATTR void OnRadioTxDone( void )
     txDone.Channel = Channel;
     txDone.Joined = IsLoRaMacNetworkJoined;
     txDone.LastTxDoneTime = curTime;
+    txDone.TxTimeOnAir = TxTimeOnAir;
     RegionSetBandTxDone( LoRaMacRegion, &txDone );
     // Update Aggregated last tx done time
     AggregatedLastTxDoneTime = curTime;
+    // Account the frame to its datarate, which can't change before the Rx windows
+    if( ( LoRaMacParams.ChannelsDatarate >= 0 ) && ( LoRaMacParams.ChannelsDatarate < 16 ) )
+    {
+        TxDatarateCounts[LoRaMacParams.ChannelsDatarate]++;
+        TxDatarateTimeOnAir[LoRaMacParams.ChannelsDatarate] += TxTimeOnAir;
+    }
 
     if( NodeAckRequested == false )
     {
@@ -2459,6 +2472,8 @@ LoRaMacStatus_t LoRaMacInitialization( LoRaMacPrimitives_t *primitives, LoRaMacC
     // Reset duty cycle times
     AggregatedLastTxDoneTime = 0;
     AggregatedTimeOff = 0;
+    memset1( ( uint8_t* )TxDatarateCounts, 0, sizeof( TxDatarateCounts ) );
+    memset1( ( uint8_t* )TxDatarateTimeOnAir, 0, sizeof( TxDatarateTimeOnAir ) );
 
     // Reset to defaults
     getPhy.Attribute = PHY_DUTY_CYCLE;
@@ -3644,3 +3659,30 @@ uint8_t * LoRaMacGetMacCmdBufferRepeat(void) {
 uint32_t * LoRaMacGetAdrAckCounter(void) {
     return &AdrAckCounter;
 }
+
+void LoRaMacGetBands(Band_t **bands, uint32_t *size) {
+    GetPhyParams_t getPhy;
+
+    getPhy.Attribute = PHY_BANDS;
+    *bands = RegionGetPhyParam(LoRaMacRegion, &getPhy).Bands;
+    getPhy.Attribute = PHY_MAX_NB_BANDS;
+    *size = RegionGetPhyParam(LoRaMacRegion, &getPhy).Value;
+}
+
+bool LoRaMacGetDutyCycleOn(void) {
+    return DutyCycleOn;
+}
+
+TimerTime_t LoRaMacGetAggregatedTimeOff(void) {
+    TimerTime_t elapsed = TimerGetElapsedTime(AggregatedLastTxDoneTime);
+
+    if (MaxDCycle == 0 || AggregatedTimeOff <= elapsed) {
+        return 0;
+    }
+    return AggregatedTimeOff - elapsed;
+}
+
+void LoRaMacGetDatarateStats(uint32_t **txCounts, TimerTime_t **txTimeOnAir) {
+    *txCounts = TxDatarateCounts;
+    *txTimeOnAir = TxDatarateTimeOnAir;
+}
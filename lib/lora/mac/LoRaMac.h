@@ -194,6 +194,16 @@ typedef union uDrRange
     }Fields;
 }DrRange_t;
 
+/*!
+ * Number of slots the time on air of the last hour is accounted in
+ */
+#define BAND_AIRTIME_SLOTS                          12
+
+/*!
+ * Duration of an airtime slot, in ms
+ */
+#define BAND_AIRTIME_SLOT_DURATION                  300000
+
 /*!
  * LoRaMAC band parameters definition
  */
@@ -219,6 +229,18 @@ typedef struct sBand
      * Holds the time where the device is off
      */
     TimerTime_t TimeOff;
+    /*!
+     * Total time on air of the band, in ms
+     */
+    TimerTime_t TimeOnAir;
+    /*!
+     * Time on air of the band in each slot of the last hour, in ms
+     */
+    uint32_t SlotTimeOnAir[BAND_AIRTIME_SLOTS];
+    /*!
+     * Slot of the last Tx frame, counted from the start of the timer
+     */
+    uint32_t LastTxSlot;
 }Band_t;
 
 /*!
@@ -2083,6 +2105,14 @@ uint8_t * LoRaMacGetMacCmdBufferRepeat(void);
 
 uint32_t * LoRaMacGetAdrAckCounter(void);
 
+void LoRaMacGetBands(Band_t **bands, uint32_t *size);
+
+bool LoRaMacGetDutyCycleOn(void);
+
+TimerTime_t LoRaMacGetAggregatedTimeOff(void);
+
+void LoRaMacGetDatarateStats(uint32_t **txCounts, TimerTime_t **txTimeOnAir);
+
 /*! \} defgroup LORAMAC */
 
 #endif // __LORAMAC_H__
@@ -19,18 +19,194 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 */
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include "utilities.h"
 
-#include "lora/system/crypto/aes.h"
-#include "lora/system/crypto/cmac.h"
-
 #include "LoRaMacCrypto.h"
 
+/*!
+ * AES implementations the LoRaMAC cryptography can run on, selected with
+ * LORAMAC_CRYPTO_BACKEND
+ */
+#define LORAMAC_CRYPTO_BACKEND_SOFT                 0   // lib/lora/system/crypto/aes32.c
+#define LORAMAC_CRYPTO_BACKEND_MBEDTLS              1   // mbedTLS AES
+#define LORAMAC_CRYPTO_BACKEND_ESP32_AES            2   // ESP32 AES peripheral
+
+#ifndef LORAMAC_CRYPTO_BACKEND
+#define LORAMAC_CRYPTO_BACKEND                      LORAMAC_CRYPTO_BACKEND_SOFT
+#endif
+
+/*!
+ * AES block size
+ */
+#define LORAMAC_AES_BLOCK_SIZE                      16
+
+/*!
+ * Number of expanded keys kept: the network and application session keys,
+ * the application key and a multicast key pair fit
+ */
+#define LORAMAC_CRYPTO_KEY_CACHE_SIZE               5
+
+/*!
+ * Largest input to a MIC or an encryption, a full LoRa frame
+ */
+#define LORAMAC_CRYPTO_BUFFER_SIZE                  256
+
 /*!
  * CMAC/AES Message Integrity Code (MIC) Block B0 size
  */
 #define LORAMAC_MIC_BLOCK_B0_SIZE                   16
 
+/*
+ * Each backend defines LoRaMacAesContext_t, an expanded key, and:
+ *  - LoRaMacAesSetKey expands a 128 bit key
+ *  - LoRaMacAesEncrypt encrypts a block
+ *  - LoRaMacAesCbcMac chains whole blocks into x, as CBC-MAC does
+ *  - LoRaMacAesCtr encrypts a buffer in counter mode, from the counter block
+ */
+#if ( LORAMAC_CRYPTO_BACKEND == LORAMAC_CRYPTO_BACKEND_ESP32_AES )
+
+#include "hwcrypto/aes.h"
+
+typedef esp_aes_context LoRaMacAesContext_t;
+
+/*!
+ * Output of the CBC-MAC computations, of which only the last block is used
+ */
+static uint8_t CbcBuffer[LORAMAC_CRYPTO_BUFFER_SIZE];
+
+static void LoRaMacAesSetKey( LoRaMacAesContext_t *ctx, const uint8_t *key )
+{
+    esp_aes_init( ctx );
+    esp_aes_setkey( ctx, key, 128 );
+}
+
+static void LoRaMacAesEncrypt( LoRaMacAesContext_t *ctx, const uint8_t *in, uint8_t *out )
+{
+    esp_aes_crypt_ecb( ctx, ESP_AES_ENCRYPT, in, out );
+}
+
+static void LoRaMacAesCbcMac( LoRaMacAesContext_t *ctx, uint8_t *x, const uint8_t *in, uint16_t blocks )
+{
+    // the peripheral is taken once for all the blocks
+    esp_aes_crypt_cbc( ctx, ESP_AES_ENCRYPT, blocks * LORAMAC_AES_BLOCK_SIZE, x, in, CbcBuffer );
+}
+
+static void LoRaMacAesCtr( LoRaMacAesContext_t *ctx, uint8_t *counter, const uint8_t *in, uint8_t *out, uint16_t size )
+{
+    uint8_t stream[LORAMAC_AES_BLOCK_SIZE];
+    size_t offset = 0;
+
+    esp_aes_crypt_ctr( ctx, size, &offset, counter, stream, in, out );
+}
+
+#elif ( LORAMAC_CRYPTO_BACKEND == LORAMAC_CRYPTO_BACKEND_MBEDTLS )
+
+#include "mbedtls/aes.h"
+
+typedef mbedtls_aes_context LoRaMacAesContext_t;
+
+static uint8_t CbcBuffer[LORAMAC_CRYPTO_BUFFER_SIZE];
+
+static void LoRaMacAesSetKey( LoRaMacAesContext_t *ctx, const uint8_t *key )
+{
+    mbedtls_aes_init( ctx );
+    mbedtls_aes_setkey_enc( ctx, key, 128 );
+}
+
+static void LoRaMacAesEncrypt( LoRaMacAesContext_t *ctx, const uint8_t *in, uint8_t *out )
+{
+    mbedtls_aes_crypt_ecb( ctx, MBEDTLS_AES_ENCRYPT, in, out );
+}
+
+static void LoRaMacAesCbcMac( LoRaMacAesContext_t *ctx, uint8_t *x, const uint8_t *in, uint16_t blocks )
+{
+    mbedtls_aes_crypt_cbc( ctx, MBEDTLS_AES_ENCRYPT, blocks * LORAMAC_AES_BLOCK_SIZE, x, in, CbcBuffer );
+}
+
+static void LoRaMacAesCtr( LoRaMacAesContext_t *ctx, uint8_t *counter, const uint8_t *in, uint8_t *out, uint16_t size )
+{
+    uint8_t stream[LORAMAC_AES_BLOCK_SIZE];
+    size_t offset = 0;
+
+    mbedtls_aes_crypt_ctr( ctx, size, &offset, counter, stream, in, out );
+}
+
+#else
+
+#include "lora/system/crypto/aes32.h"
+
+typedef aes32_context LoRaMacAesContext_t;
+
+static void LoRaMacAesSetKey( LoRaMacAesContext_t *ctx, const uint8_t *key )
+{
+    aes32_set_key( key, ctx );
+}
+
+static void LoRaMacAesEncrypt( LoRaMacAesContext_t *ctx, const uint8_t *in, uint8_t *out )
+{
+    aes32_encrypt( in, out, ctx );
+}
+
+static void LoRaMacAesCbcMac( LoRaMacAesContext_t *ctx, uint8_t *x, const uint8_t *in, uint16_t blocks )
+{
+    while( blocks-- > 0 )
+    {
+        for( uint8_t i = 0; i < LORAMAC_AES_BLOCK_SIZE; i++ )
+        {
+            x[i] ^= in[i];
+        }
+        aes32_encrypt( x, x, ctx );
+        in += LORAMAC_AES_BLOCK_SIZE;
+    }
+}
+
+static void LoRaMacAesCtr( LoRaMacAesContext_t *ctx, uint8_t *counter, const uint8_t *in, uint8_t *out, uint16_t size )
+{
+    uint8_t stream[LORAMAC_AES_BLOCK_SIZE];
+
+    while( size > 0 )
+    {
+        uint16_t len = MIN( size, LORAMAC_AES_BLOCK_SIZE );
+
+        aes32_encrypt( counter, stream, ctx );
+        // LoRaWAN frames are short enough for the counter to stay in the last byte
+        counter[15]++;
+        for( uint8_t i = 0; i < len; i++ )
+        {
+            out[i] = in[i] ^ stream[i];
+        }
+        in += len;
+        out += len;
+        size -= len;
+    }
+}
+
+#endif
+
+/*!
+ * An expanded key and its CMAC subkeys
+ */
+typedef struct LoRaMacCryptoKey_s
+{
+    uint8_t Key[16];
+    LoRaMacAesContext_t Aes;
+    uint8_t K1[LORAMAC_AES_BLOCK_SIZE];
+    uint8_t K2[LORAMAC_AES_BLOCK_SIZE];
+    bool IsValid;
+}LoRaMacCryptoKey_t;
+
+/*!
+ * Keys expanded so far, the session keys stay there as long as they are used
+ */
+static LoRaMacCryptoKey_t KeyCache[LORAMAC_CRYPTO_KEY_CACHE_SIZE];
+
+/*!
+ * Next cache entry to replace
+ */
+static uint8_t KeyCacheVictim = 0;
+
 /*!
  * MIC field computation initial data
  */
@@ -46,24 +222,122 @@ static uint8_t MicBlockB0[] = { 0x49, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 static uint8_t Mic[16];
 
 /*!
- * Encryption aBlock and sBlock
+ * Encryption aBlock
  */
 static uint8_t aBlock[] = { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
                             0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
                           };
-static uint8_t sBlock[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-                          };
 
 /*!
- * AES computation context variable
+ * \brief Doubles a value in GF(2^128), as the CMAC subkey derivation does
+ *
+ * \param [IN]  in              Value to double
+ * \param [OUT] out             Doubled value
  */
-static aes_context AesContext;
+static void LoRaMacCmacDouble( const uint8_t *in, uint8_t *out )
+{
+    uint8_t carry = in[0] >> 7;
+
+    for( uint8_t i = 0; i < LORAMAC_AES_BLOCK_SIZE - 1; i++ )
+    {
+        out[i] = ( in[i] << 1 ) | ( in[i + 1] >> 7 );
+    }
+    out[LORAMAC_AES_BLOCK_SIZE - 1] = ( in[LORAMAC_AES_BLOCK_SIZE - 1] << 1 ) ^ ( carry * 0x87 );
+}
 
 /*!
- * CMAC computation context variable
+ * \brief Returns the expanded key, expanding it if it isn't cached yet
+ *
+ * \param [IN]  key             AES key
+ * \retval The cache entry of the key
  */
-static AES_CMAC_CTX AesCmacCtx[1];
+static LoRaMacCryptoKey_t *LoRaMacCryptoGetKey( const uint8_t *key )
+{
+    LoRaMacCryptoKey_t *entry;
+    uint8_t zero[LORAMAC_AES_BLOCK_SIZE];
+
+    for( uint8_t i = 0; i < LORAMAC_CRYPTO_KEY_CACHE_SIZE; i++ )
+    {
+        entry = &KeyCache[i];
+        if( ( entry->IsValid == true ) && ( memcmp( entry->Key, key, 16 ) == 0 ) )
+        {
+            return entry;
+        }
+    }
+
+    entry = &KeyCache[KeyCacheVictim];
+    KeyCacheVictim = ( KeyCacheVictim + 1 ) % LORAMAC_CRYPTO_KEY_CACHE_SIZE;
+
+    memcpy1( entry->Key, key, 16 );
+    LoRaMacAesSetKey( &entry->Aes, key );
+
+    // CMAC subkeys, see RFC 4493
+    memset1( zero, 0, sizeof( zero ) );
+    LoRaMacAesEncrypt( &entry->Aes, zero, entry->K1 );
+    LoRaMacCmacDouble( entry->K1, entry->K1 );
+    LoRaMacCmacDouble( entry->K1, entry->K2 );
+    entry->IsValid = true;
+
+    return entry;
+}
+
+/*!
+ * \brief Computes the AES-CMAC of a first block followed by a buffer
+ *
+ * \param [IN]  entry           Expanded key
+ * \param [IN]  b0              Block to compute the CMAC of before the buffer, or NULL
+ * \param [IN]  buffer          Data buffer
+ * \param [IN]  size            Data buffer size
+ * \param [OUT] cmac            Computed CMAC
+ */
+static void LoRaMacCmac( LoRaMacCryptoKey_t *entry, const uint8_t *b0, const uint8_t *buffer, uint16_t size, uint8_t *cmac )
+{
+    uint8_t last[LORAMAC_AES_BLOCK_SIZE];
+    const uint8_t *subkey;
+    uint16_t blocks;
+    uint16_t remainder;
+    uint8_t i;
+
+    memset1( cmac, 0, LORAMAC_AES_BLOCK_SIZE );
+
+    if( ( b0 != NULL ) && ( size == 0 ) )
+    {
+        // the first block is the last one
+        buffer = b0;
+        size = LORAMAC_AES_BLOCK_SIZE;
+    }
+    else if( b0 != NULL )
+    {
+        LoRaMacAesCbcMac( &entry->Aes, cmac, b0, 1 );
+    }
+
+    // every block but the last one, which is padded and masked with a subkey
+    blocks = ( size > 0 ) ? ( size - 1 ) / LORAMAC_AES_BLOCK_SIZE : 0;
+    if( blocks > 0 )
+    {
+        LoRaMacAesCbcMac( &entry->Aes, cmac, buffer, blocks );
+        buffer += blocks * LORAMAC_AES_BLOCK_SIZE;
+    }
+    remainder = size - ( blocks * LORAMAC_AES_BLOCK_SIZE );
+
+    if( remainder == LORAMAC_AES_BLOCK_SIZE )
+    {
+        subkey = entry->K1;
+        memcpy1( last, buffer, LORAMAC_AES_BLOCK_SIZE );
+    }
+    else
+    {
+        subkey = entry->K2;
+        memset1( last, 0, sizeof( last ) );
+        memcpy1( last, buffer, remainder );
+        last[remainder] = 0x80;
+    }
+    for( i = 0; i < LORAMAC_AES_BLOCK_SIZE; i++ )
+    {
+        last[i] ^= subkey[i];
+    }
+    LoRaMacAesCbcMac( &entry->Aes, cmac, last, 1 );
+}
 
 /*!
  * \brief Computes the LoRaMAC frame MIC field
@@ -92,28 +366,13 @@ void LoRaMacComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key
 
     MicBlockB0[15] = size & 0xFF;
 
-    AES_CMAC_Init( AesCmacCtx );
-
-    AES_CMAC_SetKey( AesCmacCtx, key );
-
-    AES_CMAC_Update( AesCmacCtx, MicBlockB0, LORAMAC_MIC_BLOCK_B0_SIZE );
-
-    AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
-
-    AES_CMAC_Final( Mic, AesCmacCtx );
+    LoRaMacCmac( LoRaMacCryptoGetKey( key ), MicBlockB0, buffer, size & 0xFF, Mic );
 
     *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
 }
 
 void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer )
 {
-    uint16_t i;
-    uint8_t bufferIndex = 0;
-    uint16_t ctr = 1;
-
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
-
     aBlock[5] = dir;
 
     aBlock[6] = ( address ) & 0xFF;
@@ -126,28 +385,10 @@ void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t
     aBlock[12] = ( sequenceCounter >> 16 ) & 0xFF;
     aBlock[13] = ( sequenceCounter >> 24 ) & 0xFF;
 
-    while( size >= 16 )
-    {
-        aBlock[15] = ( ( ctr ) & 0xFF );
-        ctr++;
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
-        for( i = 0; i < 16; i++ )
-        {
-            encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
-        }
-        size -= 16;
-        bufferIndex += 16;
-    }
+    aBlock[14] = 0;
+    aBlock[15] = 1;
 
-    if( size > 0 )
-    {
-        aBlock[15] = ( ( ctr ) & 0xFF );
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
-        for( i = 0; i < size; i++ )
-        {
-            encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
-        }
-    }
+    LoRaMacAesCtr( &LoRaMacCryptoGetKey( key )->Aes, aBlock, buffer, encBuffer, size );
 }
 
 void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer )
@@ -157,26 +398,20 @@ void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t
 
 void LoRaMacJoinComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t *mic )
 {
-    AES_CMAC_Init( AesCmacCtx );
-
-    AES_CMAC_SetKey( AesCmacCtx, key );
-
-    AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
-
-    AES_CMAC_Final( Mic, AesCmacCtx );
+    LoRaMacCmac( LoRaMacCryptoGetKey( key ), NULL, buffer, size & 0xFF, Mic );
 
     *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
 }
 
 void LoRaMacJoinDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint8_t *decBuffer )
 {
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
-    aes_encrypt_lora( buffer, decBuffer, &AesContext );
+    LoRaMacAesContext_t *aes = &LoRaMacCryptoGetKey( key )->Aes;
+
+    LoRaMacAesEncrypt( aes, buffer, decBuffer );
     // Check if optional CFList is included
     if( size >= 16 )
     {
-        aes_encrypt_lora( buffer + 16, decBuffer + 16, &AesContext );
+        LoRaMacAesEncrypt( aes, buffer + 16, decBuffer + 16 );
     }
 }
 
@@ -184,19 +419,17 @@ void LoRaMacJoinComputeSKeys( const uint8_t *key, const uint8_t *appNonce, uint1
 {
     uint8_t nonce[16];
     uint8_t *pDevNonce = ( uint8_t * )&devNonce;
-
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
+    LoRaMacAesContext_t *aes = &LoRaMacCryptoGetKey( key )->Aes;
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x01;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, nwkSKey, &AesContext );
+    LoRaMacAesEncrypt( aes, nonce, nwkSKey );
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x02;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, appSKey, &AesContext );
+    LoRaMacAesEncrypt( aes, nonce, appSKey );
 }
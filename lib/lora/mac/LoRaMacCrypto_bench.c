@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host check and benchmark of the LoRaMAC cryptography, with the
+    software AES backend (aes32.c). The MIC and the payload encryption
+    are checked against the RFC 4493 AES-CMAC test vectors and against
+    the former implementation (aes.c and cmac.c, with the key schedule
+    and the CMAC subkeys computed on every call), for every frame size.
+    Then both are timed per frame: encryption and MIC of an uplink of
+    each size, with the application and network session keys, as
+    LoRaMac.c does.
+
+    LoRaMacCrypto.c is included here, the AES sources are built as they
+    are:
+
+        cc -O2 -I. -I../.. -I../system/crypto -I../../../esp32/lora \
+            LoRaMacCrypto_bench.c ../system/crypto/aes32.c \
+            ../system/crypto/aes.c ../system/crypto/cmac.c -o /tmp/LoRaMacCrypto_bench
+        /tmp/LoRaMacCrypto_bench
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "LoRaMacCrypto.c"
+
+#include "cmac.h"
+
+/* host replacements of esp32/lora/utilities.c */
+void memcpy1( uint8_t *dst, const uint8_t *src, uint16_t size ) {
+    memcpy(dst, src, size);
+}
+
+void memset1( uint8_t *dst, uint8_t value, uint16_t size ) {
+    memset(dst, value, size);
+}
+
+/******************************************************************************
+ The former implementation, for comparison
+ ******************************************************************************/
+static AES_CMAC_CTX RefCmacCtx[1];
+static aes_context RefAesContext;
+
+static void block_header( uint8_t *block, uint8_t first, uint32_t address, uint8_t dir, uint32_t sequenceCounter ) {
+    memset(block, 0, 16);
+    block[0] = first;
+    block[5] = dir;
+    for (int i = 0; i < 4; i++) {
+        block[6 + i] = (address >> (8 * i)) & 0xFF;
+        block[10 + i] = (sequenceCounter >> (8 * i)) & 0xFF;
+    }
+}
+
+static void RefComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint32_t *mic ) {
+    uint8_t b0[16];
+    uint8_t digest[16];
+
+    block_header(b0, 0x49, address, dir, sequenceCounter);
+    b0[15] = size & 0xFF;
+    AES_CMAC_Init(RefCmacCtx);
+    AES_CMAC_SetKey(RefCmacCtx, key);
+    AES_CMAC_Update(RefCmacCtx, b0, 16);
+    AES_CMAC_Update(RefCmacCtx, buffer, size & 0xFF);
+    AES_CMAC_Final(digest, RefCmacCtx);
+    *mic = (uint32_t)digest[3] << 24 | (uint32_t)digest[2] << 16 | (uint32_t)digest[1] << 8 | (uint32_t)digest[0];
+}
+
+static void RefPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer ) {
+    uint8_t a[16];
+    uint8_t s[16];
+    uint16_t index = 0;
+    uint16_t ctr = 1;
+
+    memset(RefAesContext.ksch, 0, 240);
+    aes_set_key_lora(key, 16, &RefAesContext);
+    block_header(a, 0x01, address, dir, sequenceCounter);
+    while (size > 0) {
+        uint16_t len = size < 16 ? size : 16;
+        a[15] = ctr++ & 0xFF;
+        aes_encrypt_lora(a, s, &RefAesContext);
+        for (uint16_t i = 0; i < len; i++) {
+            encBuffer[index + i] = buffer[index + i] ^ s[i];
+        }
+        size -= len;
+        index += len;
+    }
+}
+
+/******************************************************************************
+ Checks
+ ******************************************************************************/
+static const uint8_t Rfc4493Key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const uint8_t Rfc4493Message[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+// the examples' message sizes, and the first 4 bytes of their CMAC
+static const uint16_t Rfc4493Sizes[4] = { 0, 16, 40, 64 };
+
+static const uint8_t Rfc4493Cmacs[4][4] = {
+    { 0xbb, 0x1d, 0x69, 0x29 },
+    { 0x07, 0x0a, 0x16, 0xb4 },
+    { 0xdf, 0xa6, 0x67, 0x47 },
+    { 0x51, 0xf0, 0xbe, 0xbf },
+};
+
+static void check_rfc4493( void ) {
+    // the join MIC is a bare AES-CMAC
+    for (int i = 0; i < 4; i++) {
+        uint32_t mic;
+        LoRaMacJoinComputeMic(Rfc4493Message, Rfc4493Sizes[i], Rfc4493Key, &mic);
+        const uint8_t *cmac = Rfc4493Cmacs[i];
+        assert(mic == ((uint32_t)cmac[3] << 24 | (uint32_t)cmac[2] << 16 | (uint32_t)cmac[1] << 8 | cmac[0]));
+    }
+}
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd( void ) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static void random_bytes( uint8_t *buf, uint16_t len ) {
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = rnd();
+    }
+}
+
+static void check_reference( void ) {
+    uint8_t keys[8][16];
+    uint8_t frame[255];
+    uint8_t out[255];
+    uint8_t ref[255];
+
+    random_bytes(&keys[0][0], sizeof(keys));
+    // more keys than the cache holds, so entries get replaced
+    for (int round = 0; round < 20; round++) {
+        for (uint16_t size = 0; size <= 255; size++) {
+            const uint8_t *key = keys[rnd() % 8];
+            uint32_t address = rnd(), counter = rnd();
+            uint8_t dir = rnd() & 1;
+            uint32_t mic, ref_mic;
+
+            random_bytes(frame, size);
+            LoRaMacComputeMic(frame, size, key, address, dir, counter, &mic);
+            RefComputeMic(frame, size, key, address, dir, counter, &ref_mic);
+            assert(mic == ref_mic);
+
+            LoRaMacPayloadEncrypt(frame, size, key, address, dir, counter, out);
+            RefPayloadEncrypt(frame, size, key, address, dir, counter, ref);
+            assert(memcmp(out, ref, size) == 0);
+            LoRaMacPayloadDecrypt(out, size, key, address, dir, counter, ref);
+            assert(memcmp(frame, ref, size) == 0);
+        }
+    }
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+#define FRAMES                  (20000)
+
+static double now_us( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double bench( bool reference, uint16_t size ) {
+    static uint8_t nwkSKey[16], appSKey[16];
+    uint8_t frame[255];
+    uint8_t out[255];
+    uint32_t mic;
+
+    random_bytes(nwkSKey, 16);
+    random_bytes(appSKey, 16);
+    random_bytes(frame, size);
+    double t0 = now_us();
+    for (uint32_t n = 0; n < FRAMES; n++) {
+        // as LoRaMac.c sends an uplink: encrypt, then the MIC over the whole frame
+        if (reference) {
+            RefPayloadEncrypt(frame, size, appSKey, 0x26011234, 0, n, out);
+            RefComputeMic(out, size, nwkSKey, 0x26011234, 0, n, &mic);
+        } else {
+            LoRaMacPayloadEncrypt(frame, size, appSKey, 0x26011234, 0, n, out);
+            LoRaMacComputeMic(out, size, nwkSKey, 0x26011234, 0, n, &mic);
+        }
+        frame[0] ^= mic;
+    }
+    return (now_us() - t0) / FRAMES;
+}
+
+int main( void ) {
+    static const uint16_t sizes[] = { 13, 16, 32, 51, 64, 115, 128, 222, 242 };
+
+    check_rfc4493();
+    check_reference();
+
+    printf("frame size    former    cached   speedup   (us per frame, MIC and encryption)\n");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double ref = bench(true, sizes[i]);
+        double now = bench(false, sizes[i]);
+        printf("%10u %9.2f %9.2f %8.1fx\n", sizes[i], ref, now, ref / now);
+    }
+    printf("LoRaMacCrypto: OK\n");
+    return 0;
+}
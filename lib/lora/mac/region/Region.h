@@ -630,6 +630,14 @@ typedef enum ePhyAttribute
      * Channels.
      */
     PHY_CHANNELS,
+    /*!
+     * Number of bands.
+     */
+    PHY_MAX_NB_BANDS,
+    /*!
+     * Bands.
+     */
+    PHY_BANDS,
     /*!
      * Default value of the uplink dwell time.
      */
@@ -708,6 +716,10 @@ typedef union uPhyParam
      * Pointer to the channels.
      */
     ChannelParams_t* Channels;
+    /*!
+     * Pointer to the bands.
+     */
+    Band_t* Bands;
 }PhyParam_t;
 
 /*!
@@ -756,6 +768,10 @@ typedef struct sSetBandTxDoneParams
      * Last TX done time.
      */
     TimerTime_t LastTxDoneTime;
+    /*!
+     * Time on air of the last TX frame.
+     */
+    TimerTime_t TxTimeOnAir;
 }SetBandTxDoneParams_t;
 
 /*!
@@ -306,6 +306,16 @@ PhyParam_t RegionAS923GetPhyParam( GetPhyParams_t* getPhy )
             phyParam.Channels = Channels;
             break;
         }
+        case PHY_MAX_NB_BANDS:
+        {
+            phyParam.Value = AS923_MAX_NB_BANDS;
+            break;
+        }
+        case PHY_BANDS:
+        {
+            phyParam.Bands = Bands;
+            break;
+        }
         case PHY_DEF_UPLINK_DWELL_TIME:
         {
             phyParam.Value = AS923_DEFAULT_UPLINK_DWELL_TIME;
@@ -343,7 +353,7 @@ PhyParam_t RegionAS923GetPhyParam( GetPhyParams_t* getPhy )
 
 IRAM_ATTR void RegionAS923SetBandTxDone( SetBandTxDoneParams_t* txDone )
 {
-    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime );
+    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime, txDone->TxTimeOnAir );
 }
 
 void RegionAS923InitDefaults( InitType_t type )
@@ -64,6 +64,11 @@ static uint16_t ChannelsMaskRemaining[CHANNELS_MASK_SIZE];
  */
 static uint16_t ChannelsDefaultMask[CHANNELS_MASK_SIZE];
 
+/*!
+ * Channels supporting each datarate
+ */
+static RegionCommonChanPlan_t ChannelPlan;
+
 // Static functions
 static int8_t GetNextLowerTxDr( int8_t dr, int8_t minDr )
 {
@@ -104,40 +109,6 @@ static int8_t LimitTxPower( int8_t txPower, int8_t maxBandTxPower, int8_t datara
     return txPowerResult;
 }
 
-static uint8_t CountNbOfEnabledChannels( uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx )
-{
-    uint8_t nbEnabledChannels = 0;
-    uint8_t delayTransmission = 0;
-
-    for( uint8_t i = 0, k = 0; i < AU915_MAX_NB_CHANNELS; i += 16, k++ )
-    {
-        for( uint8_t j = 0; j < 16; j++ )
-        {
-            if( ( channelsMask[k] & ( 1 << j ) ) != 0 )
-            {
-                if( channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( RegionCommonValueInRange( datarate, channels[i + j].DrRange.Fields.Min,
-                                              channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( bands[channels[i + j].Band].TimeOff > 0 )
-                { // Check if the band is available for transmission
-                    delayTransmission++;
-                    continue;
-                }
-                enabledChannels[nbEnabledChannels++] = i + j;
-            }
-        }
-    }
-
-    *delayTx = delayTransmission;
-    return nbEnabledChannels;
-}
-
 PhyParam_t RegionAU915GetPhyParam( GetPhyParams_t* getPhy )
 {
     PhyParam_t phyParam = { 0 };
@@ -254,6 +225,16 @@ PhyParam_t RegionAU915GetPhyParam( GetPhyParams_t* getPhy )
             phyParam.Channels = Channels;
             break;
         }
+        case PHY_MAX_NB_BANDS:
+        {
+            phyParam.Value = AU915_MAX_NB_BANDS;
+            break;
+        }
+        case PHY_BANDS:
+        {
+            phyParam.Bands = Bands;
+            break;
+        }
         case PHY_DEF_UPLINK_DWELL_TIME:
         case PHY_DEF_DOWNLINK_DWELL_TIME:
         {
@@ -287,7 +268,7 @@ PhyParam_t RegionAU915GetPhyParam( GetPhyParams_t* getPhy )
 
 IRAM_ATTR void RegionAU915SetBandTxDone( SetBandTxDoneParams_t* txDone )
 {
-    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime );
+    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime, txDone->TxTimeOnAir );
 }
 
 void RegionAU915InitDefaults( InitType_t type )
@@ -296,6 +277,8 @@ void RegionAU915InitDefaults( InitType_t type )
     {
         case INIT_TYPE_INIT:
         {
+            ChannelPlan.IsValid = false;
+
             // Channels
             // 125 kHz channels
             for( uint8_t i = 0; i < AU915_MAX_NB_CHANNELS - 8; i++ )
@@ -765,7 +748,7 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
 {
     uint8_t nbEnabledChannels = 0;
     uint8_t delayTx = 0;
-    uint8_t enabledChannels[AU915_MAX_NB_CHANNELS] = { 0 };
+    uint16_t enabledMask[CHANNELS_MASK_SIZE] = { 0 };
     TimerTime_t nextTxDelay = 0;
 
     // Count 125kHz channels
@@ -791,9 +774,9 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
         nextTxDelay = RegionCommonUpdateBandTimeOff( nextChanParams->Joined, nextChanParams->DutyCycleEnabled, Bands, AU915_MAX_NB_BANDS );
 
         // Search how many channels are enabled
-        nbEnabledChannels = CountNbOfEnabledChannels( nextChanParams->Datarate,
-                                                      ChannelsMaskRemaining, Channels,
-                                                      Bands, enabledChannels, &delayTx );
+        nbEnabledChannels = RegionCommonChanPlanEnabled( &ChannelPlan, Channels, AU915_MAX_NB_CHANNELS, Bands,
+                                                         nextChanParams->Datarate, ChannelsMaskRemaining,
+                                                         enabledMask, &delayTx );
     }
     else
     {
@@ -804,7 +787,7 @@ bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     if( nbEnabledChannels > 0 )
     {
         // We found a valid channel
-        *channel = enabledChannels[randr( 0, nbEnabledChannels - 1 )];
+        *channel = RegionCommonChanPick( enabledMask, nbEnabledChannels );
         // Disable the channel in the mask
         RegionCommonChanDisable( ChannelsMaskRemaining, *channel, AU915_MAX_NB_CHANNELS - 8 );
 
@@ -875,6 +858,7 @@ LoRaMacStatus_t RegionAU915ChannelManualAdd( ChannelAddParams_t* channelAdd )
 
     memcpy( &(Channels[id]), channelAdd->NewChannel, sizeof( Channels[id] ) );
     Channels[id].Band = band;
+    ChannelPlan.IsValid = false;
     ChannelsMask[ (id / 16) ] |= (1 << (id % 16));
     // activate the channel in the remaining ones
     ChannelsMaskRemaining[id / 16] |= ChannelsMask[id / 16];
@@ -898,6 +882,7 @@ bool RegionAU915ChannelsManualRemove( ChannelRemoveParams_t* channelRemove  )
 
     // Remove the channel from the list of channels
     Channels[id] = ( ChannelParams_t ){ 0, 0, { 0 }, 0 };
+    ChannelPlan.IsValid = false;
 
     // Set the channel mask remaining accordingly
     ChannelsMaskRemaining[id / 16] &= ChannelsMask[id / 16];
@@ -932,6 +917,8 @@ bool RegionAU915GetChannels( ChannelParams_t** channels, uint32_t *size )
 {
     *channels = Channels;
     *size = sizeof(Channels);
+    // the channels may be written through the pointer
+    ChannelPlan.IsValid = false;
     return true;
 }
 
@@ -271,6 +271,16 @@ PhyParam_t RegionCN779GetPhyParam( GetPhyParams_t* getPhy )
             phyParam.Channels = Channels;
             break;
         }
+        case PHY_MAX_NB_BANDS:
+        {
+            phyParam.Value = CN779_MAX_NB_BANDS;
+            break;
+        }
+        case PHY_BANDS:
+        {
+            phyParam.Bands = Bands;
+            break;
+        }
         case PHY_DEF_UPLINK_DWELL_TIME:
         case PHY_DEF_DOWNLINK_DWELL_TIME:
         {
@@ -304,7 +314,7 @@ PhyParam_t RegionCN779GetPhyParam( GetPhyParams_t* getPhy )
 
 IRAM_ATTR void RegionCN779SetBandTxDone( SetBandTxDoneParams_t* txDone )
 {
-    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime );
+    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime, txDone->TxTimeOnAir );
 }
 
 void RegionCN779InitDefaults( InitType_t type )
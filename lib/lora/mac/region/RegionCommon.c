@@ -39,16 +39,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 
 static uint8_t CountChannels( uint16_t mask, uint8_t nbBits )
 {
-    uint8_t nbActiveBits = 0;
-
-    for( uint8_t j = 0; j < nbBits; j++ )
-    {
-        if( ( mask & ( 1 << j ) ) == ( 1 << j ) )
-        {
-            nbActiveBits++;
-        }
-    }
-    return nbActiveBits;
+    return __builtin_popcount( mask & ( ( 1UL << nbBits ) - 1 ) );
 }
 
 
@@ -138,6 +129,75 @@ uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uin
     return nbChannels;
 }
 
+uint8_t RegionCommonChanPlanEnabled( RegionCommonChanPlan_t* plan, ChannelParams_t* channels, uint8_t nbChannels, Band_t* bands,
+                                     uint8_t datarate, uint16_t* channelsMask, uint16_t* enabledMask, uint8_t* delayTx )
+{
+    uint8_t nbWords = ( nbChannels + 15 ) / 16;
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTransmission = 0;
+
+    if( plan->IsValid == false )
+    {
+        memset( plan->DrMask, 0, sizeof( plan->DrMask ) );
+        for( uint8_t i = 0; i < nbChannels; i++ )
+        {
+            if( channels[i].Frequency == 0 )
+            { // Check if the channel is enabled
+                continue;
+            }
+            for( uint8_t dr = 0; dr < REGION_COMMON_NB_DATARATES; dr++ )
+            {
+                if( RegionCommonValueInRange( dr, channels[i].DrRange.Fields.Min, channels[i].DrRange.Fields.Max ) == true )
+                {
+                    plan->DrMask[dr][i / 16] |= 1 << ( i % 16 );
+                }
+            }
+        }
+        plan->IsValid = true;
+    }
+
+    for( uint8_t k = 0; k < nbWords; k++ )
+    {
+        uint16_t mask = ( datarate < REGION_COMMON_NB_DATARATES ) ? ( channelsMask[k] & plan->DrMask[datarate][k] ) : 0;
+
+        // Check if the bands are available for transmission, only the channels left need a look
+        for( uint16_t bits = mask; bits != 0; bits &= bits - 1 )
+        {
+            uint8_t id = ( k * 16 ) + __builtin_ctz( bits );
+            if( bands[channels[id].Band].TimeOff > 0 )
+            {
+                mask &= ~( 1 << ( id % 16 ) );
+                delayTransmission++;
+            }
+        }
+        enabledMask[k] = mask;
+        nbEnabledChannels += CountChannels( mask, 16 );
+    }
+
+    *delayTx = delayTransmission;
+    return nbEnabledChannels;
+}
+
+uint8_t RegionCommonChanPick( uint16_t* enabledMask, uint8_t nbEnabledChannels )
+{
+    // The n-th channel of the mask, as the n-th entry of the list of enabled channels used to be
+    uint8_t n = randr( 0, nbEnabledChannels - 1 );
+    uint8_t k = 0;
+
+    while( n >= CountChannels( enabledMask[k], 16 ) )
+    {
+        n -= CountChannels( enabledMask[k], 16 );
+        k++;
+    }
+
+    uint16_t mask = enabledMask[k];
+    while( n-- > 0 )
+    {
+        mask &= mask - 1;
+    }
+    return ( k * 16 ) + __builtin_ctz( mask );
+}
+
 void RegionCommonChanMaskCopy( uint16_t* channelsMaskDest, uint16_t* channelsMaskSrc, uint8_t len )
 {
     if( ( channelsMaskDest != NULL ) && ( channelsMaskSrc != NULL ) )
@@ -149,8 +209,10 @@ void RegionCommonChanMaskCopy( uint16_t* channelsMaskDest, uint16_t* channelsMas
     }
 }
 
-IRAM_ATTR void RegionCommonSetBandTxDone( bool joined, Band_t* band, TimerTime_t lastTxDone )
+IRAM_ATTR void RegionCommonSetBandTxDone( bool joined, Band_t* band, TimerTime_t lastTxDone, TimerTime_t timeOnAir )
 {
+    uint32_t slot = lastTxDone / BAND_AIRTIME_SLOT_DURATION;
+
     if( joined == true )
     {
         band->LastTxDoneTime = lastTxDone;
@@ -160,6 +222,52 @@ IRAM_ATTR void RegionCommonSetBandTxDone( bool joined, Band_t* band, TimerTime_t
         band->LastTxDoneTime = lastTxDone;
         band->LastJoinTxDoneTime = lastTxDone;
     }
+
+    // Clear the slots passed since the last Tx, all of them if the timer wrapped
+    for( uint32_t i = MIN( slot - band->LastTxSlot, BAND_AIRTIME_SLOTS ); i > 0; i-- )
+    {
+        band->SlotTimeOnAir[( band->LastTxSlot + i ) % BAND_AIRTIME_SLOTS] = 0;
+    }
+    band->LastTxSlot = slot;
+    band->SlotTimeOnAir[slot % BAND_AIRTIME_SLOTS] += timeOnAir;
+    band->TimeOnAir += timeOnAir;
+}
+
+void RegionCommonGetBandStats( bool joined, bool dutyCycle, Band_t* band, TimerTime_t now, RegionCommonBandStats_t* stats )
+{
+    uint32_t slot = now / BAND_AIRTIME_SLOT_DURATION;
+    uint32_t budget = 3600000 / MAX( band->DCycle, 1 );
+    uint32_t txDoneTime = 0;
+
+    stats->TimeOnAir = band->TimeOnAir;
+
+    // Sum the slots of the last hour, counted back from the slot of the last Tx
+    stats->HourTimeOnAir = 0;
+    for( uint32_t i = 0; ( i < BAND_AIRTIME_SLOTS ) && ( i <= band->LastTxSlot ); i++ )
+    {
+        uint32_t txSlot = band->LastTxSlot - i;
+
+        if( ( slot - txSlot ) < BAND_AIRTIME_SLOTS )
+        {
+            stats->HourTimeOnAir += band->SlotTimeOnAir[txSlot % BAND_AIRTIME_SLOTS];
+        }
+    }
+    stats->HourBudget = ( stats->HourTimeOnAir < budget ) ? budget - stats->HourTimeOnAir : 0;
+
+    // Same as RegionCommonUpdateBandTimeOff, without clearing the time-off
+    if( joined == false )
+    {
+        txDoneTime = MAX( now - band->LastJoinTxDoneTime, ( dutyCycle == true ) ? now - band->LastTxDoneTime : 0 );
+    }
+    else if( dutyCycle == true )
+    {
+        txDoneTime = now - band->LastTxDoneTime;
+    }
+    else
+    {
+        txDoneTime = band->TimeOff;
+    }
+    stats->TimeOff = ( band->TimeOff > txDoneTime ) ? band->TimeOff - txDoneTime : 0;
 }
 
 TimerTime_t RegionCommonUpdateBandTimeOff( bool joined, bool dutyCycle, Band_t* bands, uint8_t nbBands )
@@ -159,6 +159,48 @@ typedef struct sRegionCommonCalcBackOffParams
     TimerTime_t TxTimeOnAir;
 }RegionCommonCalcBackOffParams_t;
 
+/*!
+ * Largest channels mask, in 16 bit words.
+ */
+#define REGION_COMMON_CHANNELS_MASK_SIZE            6
+
+/*!
+ * Number of datarates a channel's datarate range can hold.
+ */
+#define REGION_COMMON_NB_DATARATES                  16
+
+typedef struct sRegionCommonChanPlan
+{
+    /*!
+     * For each datarate, the mask of the defined channels supporting it.
+     */
+    uint16_t DrMask[REGION_COMMON_NB_DATARATES][REGION_COMMON_CHANNELS_MASK_SIZE];
+    /*!
+     * Cleared when the channels change, the masks are then rebuilt on their next use.
+     */
+    bool IsValid;
+}RegionCommonChanPlan_t;
+
+typedef struct sRegionCommonBandStats
+{
+    /*!
+     * Time on air of the band since the start, in ms.
+     */
+    TimerTime_t TimeOnAir;
+    /*!
+     * Time on air of the band in the last hour, in ms.
+     */
+    uint32_t HourTimeOnAir;
+    /*!
+     * Time on air the duty cycle of the band leaves over the last hour, in ms.
+     */
+    uint32_t HourBudget;
+    /*!
+     * Time which must be waited before the band can be used again, in ms.
+     */
+    TimerTime_t TimeOff;
+}RegionCommonBandStats_t;
+
 /*!
  * \brief Calculates the join duty cycle.
  *        This is a generic function and valid for all regions.
@@ -232,6 +274,43 @@ bool RegionCommonChanDisable( uint16_t* channelsMask, uint8_t id, uint8_t maxCha
  */
 uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uint8_t stopIdx );
 
+/*!
+ * \brief Finds the channels an uplink can use.
+ *        This is a generic function and valid for all regions.
+ *
+ * \param [IN] plan The channel plan of the region, rebuilt from the channels if needed.
+ *
+ * \param [IN] channels The channels of the region.
+ *
+ * \param [IN] nbChannels Number of channels.
+ *
+ * \param [IN] bands The bands of the region.
+ *
+ * \param [IN] datarate The datarate of the uplink.
+ *
+ * \param [IN] channelsMask The channels mask to choose from.
+ *
+ * \param [OUT] enabledMask The mask of the channels the uplink can use.
+ *
+ * \param [OUT] delayTx Number of channels left out because their band is in its time off.
+ *
+ * \retval Returns the number of channels the uplink can use.
+ */
+uint8_t RegionCommonChanPlanEnabled( RegionCommonChanPlan_t* plan, ChannelParams_t* channels, uint8_t nbChannels, Band_t* bands,
+                                     uint8_t datarate, uint16_t* channelsMask, uint16_t* enabledMask, uint8_t* delayTx );
+
+/*!
+ * \brief Picks one of the channels of a mask at random.
+ *        This is a generic function and valid for all regions.
+ *
+ * \param [IN] enabledMask The mask of the channels to choose from.
+ *
+ * \param [IN] nbEnabledChannels Number of channels in the mask, at least one.
+ *
+ * \retval Returns the id of the channel.
+ */
+uint8_t RegionCommonChanPick( uint16_t* enabledMask, uint8_t nbEnabledChannels );
+
 /*!
  * \brief Copy a channels mask.
  *        This is a generic function and valid for all regions.
@@ -245,7 +324,7 @@ uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uin
 void RegionCommonChanMaskCopy( uint16_t* channelsMaskDest, uint16_t* channelsMaskSrc, uint8_t len );
 
 /*!
- * \brief Sets the last tx done property.
+ * \brief Sets the last tx done property and accounts the time on air of the band.
  *        This is a generic function and valid for all regions.
  *
  * \param [IN] joined Set to true, if the node has joined the network
@@ -253,8 +332,27 @@ void RegionCommonChanMaskCopy( uint16_t* channelsMaskDest, uint16_t* channelsMas
  * \param [IN] band The band to be updated.
  *
  * \param [IN] lastTxDone The time of the last TX done.
+ *
+ * \param [IN] timeOnAir The time on air of the last TX frame.
+ */
+void RegionCommonSetBandTxDone( bool joined, Band_t* band, TimerTime_t lastTxDone, TimerTime_t timeOnAir );
+
+/*!
+ * \brief Gets the airtime statistics of a band. The band isn't modified, this
+ *        may be called from outside of the MAC.
+ *        This is a generic function and valid for all regions.
+ *
+ * \param [IN] joined Set to true, if the node has joined the network
+ *
+ * \param [IN] dutyCycle Set to true, if the duty cycle is enabled.
+ *
+ * \param [IN] band The band.
+ *
+ * \param [IN] now The current time.
+ *
+ * \param [OUT] stats The statistics of the band.
  */
-void RegionCommonSetBandTxDone( bool joined, Band_t* band, TimerTime_t lastTxDone );
+void RegionCommonGetBandStats( bool joined, bool dutyCycle, Band_t* band, TimerTime_t now, RegionCommonBandStats_t* stats );
 
 /*!
  * \brief Updates the time-offs of the bands.
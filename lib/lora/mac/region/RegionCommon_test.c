@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host test of the airtime accounting of the bands. Random uplinks are
+    accounted with RegionCommonSetBandTxDone and the statistics of
+    RegionCommonGetBandStats are checked against a plain list of the
+    uplinks: the time on air of the last hour and what is left of the
+    duty cycle, across the wrap of the timer too. The time-off must be
+    the one RegionCommonUpdateBandTimeOff gives, without the band being
+    touched. Then a device sending as often as a 1% band allows is
+    simulated for a day, as LoRaMac.c backs off after each uplink.
+
+    RegionCommon.c is built as it is, with the board.h and esp_attr.h of
+    /tmp/region_bench (see RegionUS915_bench.c):
+
+        cc -O2 -I/tmp/region_bench -I../../.. -I../../../../esp32/lora \
+            -I../../../../drivers/sx127x RegionCommon_test.c RegionCommon.c \
+            -lm -o /tmp/RegionCommon_test
+        /tmp/RegionCommon_test
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "board.h"
+#include "lora/mac/LoRaMac.h"
+#include "RegionCommon.h"
+
+/* host replacements of the firmware */
+static TimerTime_t SimTime = 0;
+
+TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime ) {
+    return SimTime - savedTime;
+}
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd( void ) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+int32_t randr( int32_t min, int32_t max ) {
+    return (int32_t)(rnd() % (max - min + 1)) + min;
+}
+
+/******************************************************************************
+ Accounting against a list of the uplinks
+ ******************************************************************************/
+#define MAX_UPLINKS             (4096)
+
+typedef struct {
+    TimerTime_t time;
+    TimerTime_t time_on_air;
+} uplink_t;
+
+static uplink_t Uplinks[MAX_UPLINKS];
+static uint32_t NbUplinks;
+
+// the slots of the band are 5 minutes long, the last hour is the slot of now
+// and the 11 before it
+static uint32_t ref_hour_time_on_air( TimerTime_t now ) {
+    uint32_t slot = now / BAND_AIRTIME_SLOT_DURATION;
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < NbUplinks; i++) {
+        uint32_t tx_slot = Uplinks[i].time / BAND_AIRTIME_SLOT_DURATION;
+        if (tx_slot <= slot && slot - tx_slot < BAND_AIRTIME_SLOTS) {
+            sum += Uplinks[i].time_on_air;
+        }
+    }
+    return sum;
+}
+
+static void check_accounting( TimerTime_t start ) {
+    Band_t band = { 100, 14, 0, 0 };
+    TimerTime_t total = 0;
+    RegionCommonBandStats_t stats;
+
+    NbUplinks = 0;
+    SimTime = start;
+    while (NbUplinks < MAX_UPLINKS) {
+        // bursts and long silences, some of them longer than the hour
+        uint32_t r = rnd() % 100;
+        SimTime += (r < 70) ? rnd() % 20000 : (r < 95) ? rnd() % 600000 : rnd() % 7200000;
+        if (SimTime < start) {
+            // the timer wrapped, the uplinks before don't count any more
+            NbUplinks = 0;
+            start = SimTime;
+        }
+        TimerTime_t time_on_air = 20 + rnd() % 3000;
+        RegionCommonSetBandTxDone( true, &band, SimTime, time_on_air );
+        Uplinks[NbUplinks++] = (uplink_t){ SimTime, time_on_air };
+        total += time_on_air;
+
+        // looked at right after the uplink and a while after it
+        for (int i = 0; i < 4; i++) {
+            TimerTime_t now = SimTime + (i == 0 ? 0 : rnd() % (i * 1800000));
+            if (now < SimTime) {
+                continue;
+            }
+            Band_t copy = band;
+            RegionCommonGetBandStats( true, true, &band, now, &stats );
+            assert(memcmp(&copy, &band, sizeof(band)) == 0);
+            assert(stats.TimeOnAir == total);
+            assert(stats.HourTimeOnAir == ref_hour_time_on_air(now));
+            assert(stats.HourBudget == (stats.HourTimeOnAir < 36000 ? 36000 - stats.HourTimeOnAir : 0));
+        }
+    }
+}
+
+static void check_time_off( void ) {
+    Band_t bands[2];
+    RegionCommonBandStats_t stats;
+
+    for (int n = 0; n < 100000; n++) {
+        bool joined = rnd() & 1;
+        bool duty_cycle = rnd() & 1;
+
+        SimTime = rnd();
+        memset(bands, 0, sizeof(bands));
+        bands[0].DCycle = 1 + rnd() % 1000;
+        bands[0].LastTxDoneTime = SimTime - rnd() % 100000;
+        bands[0].LastJoinTxDoneTime = SimTime - rnd() % 100000;
+        bands[0].TimeOff = (rnd() & 1) ? rnd() % 100000 : 0;
+
+        RegionCommonGetBandStats( joined, duty_cycle, &bands[0], SimTime, &stats );
+        // a band with no time-off, so that the delay is the one of the first band
+        bands[1].TimeOff = 0;
+        bands[1].LastTxDoneTime = SimTime;
+        bands[1].LastJoinTxDoneTime = SimTime;
+        TimerTime_t delay = RegionCommonUpdateBandTimeOff( joined, duty_cycle, bands, 1 );
+        assert(stats.TimeOff == (delay == (TimerTime_t)-1 ? 0 : delay));
+    }
+}
+
+/******************************************************************************
+ Simulation
+ ******************************************************************************/
+static void run_simulation( void ) {
+    ChannelParams_t channel = { 868100000, 0, { 0x50 }, 0 };
+    Band_t band = { 100, 14, 0, 0 };
+    RegionCommonCalcBackOffParams_t backOff;
+    RegionCommonBandStats_t stats;
+    // SF12, 125 kHz, 51 bytes of payload and 13 of LoRaWAN
+    const TimerTime_t time_on_air = 2793;
+    TimerTime_t max_hour = 0;
+    uint32_t uplinks = 0;
+
+    memset(&backOff, 0, sizeof(backOff));
+    backOff.Channels = &channel;
+    backOff.Bands = &band;
+    backOff.Joined = true;
+    backOff.DutyCycleEnabled = true;
+    backOff.TxTimeOnAir = time_on_air;
+
+    printf("a 1%% band used as often as it allows, for a day\n");
+    printf("hour  uplinks  time on air ms  budget left ms\n");
+    for (SimTime = 0; SimTime < 24 * 3600000; SimTime += 100) {
+        RegionCommonGetBandStats( true, true, &band, SimTime, &stats );
+        if (stats.TimeOff == 0) {
+            // the time-off counts from the end of the uplink
+            SimTime += time_on_air;
+            RegionCommonSetBandTxDone( true, &band, SimTime, time_on_air );
+            RegionCommonCalcBackOff( &backOff );
+            uplinks++;
+            RegionCommonGetBandStats( true, true, &band, SimTime, &stats );
+            // the slots don't start on the uplinks, so an hour can hold one more
+            assert(stats.HourTimeOnAir <= 36000 + time_on_air);
+            if (stats.HourTimeOnAir > max_hour) {
+                max_hour = stats.HourTimeOnAir;
+            }
+        }
+        if (SimTime / 3600000 != (SimTime + 100) / 3600000 && SimTime < 6 * 3600000) {
+            printf("%4u  %7u  %14u  %14u\n", SimTime / 3600000 + 1, uplinks, stats.HourTimeOnAir, stats.HourBudget);
+        }
+    }
+    printf("%u uplinks, at most %u ms in an hour, %u ms in total\n", uplinks, max_hour, stats.TimeOnAir);
+    assert(stats.TimeOnAir == uplinks * time_on_air);
+}
+
+int main( void ) {
+    check_accounting( 0 );
+    check_accounting( UINT32_MAX - 10 * 3600000 );
+    check_time_off();
+    run_simulation();
+    printf("RegionCommon: OK\n");
+    return 0;
+}
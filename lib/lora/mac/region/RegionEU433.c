@@ -271,6 +271,16 @@ PhyParam_t RegionEU433GetPhyParam( GetPhyParams_t* getPhy )
             phyParam.Channels = Channels;
             break;
         }
+        case PHY_MAX_NB_BANDS:
+        {
+            phyParam.Value = EU433_MAX_NB_BANDS;
+            break;
+        }
+        case PHY_BANDS:
+        {
+            phyParam.Bands = Bands;
+            break;
+        }
         case PHY_DEF_UPLINK_DWELL_TIME:
         case PHY_DEF_DOWNLINK_DWELL_TIME:
         {
@@ -304,7 +314,7 @@ PhyParam_t RegionEU433GetPhyParam( GetPhyParams_t* getPhy )
 
 IRAM_ATTR void RegionEU433SetBandTxDone( SetBandTxDoneParams_t* txDone )
 {
-    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime );
+    RegionCommonSetBandTxDone( txDone->Joined, &Bands[Channels[txDone->Channel].Band], txDone->LastTxDoneTime, txDone->TxTimeOnAir );
 }
 
 void RegionEU433InitDefaults( InitType_t type )
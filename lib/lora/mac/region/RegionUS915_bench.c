@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host check and benchmark of the US915 channel selection (or AU915,
+    with -DBENCH_AU915). RegionUS915NextChannel, which takes its channels
+    from the datarate masks of the channel plan, is run against a copy of
+    the former selection, which went through every channel for each
+    uplink, from the same state and with the same random numbers: the
+    channel, the delay and the remaining channels must be the same. The
+    channels masks, the datarates, the duty cycle and the channels
+    themselves change randomly in between. Then both are timed.
+
+    The region is included here, RegionCommon.c is built as it is. The
+    board.h and esp_attr.h of the firmware are replaced by the ones below
+    in /tmp/region_bench:
+
+        board.h:        #include <stdint.h>
+                        #include <stdbool.h>
+                        #include "lora/system/timer.h"
+                        #include "radio.h"
+                        #define RADIO_WAKEUP_TIME 1
+        esp_attr.h:     #define IRAM_ATTR
+
+        cc -O2 -I/tmp/region_bench -I../../.. -I../../../../esp32/lora \
+            -I../../../../drivers/sx127x RegionUS915_bench.c RegionCommon.c \
+            -o /tmp/RegionUS915_bench
+        /tmp/RegionUS915_bench
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#ifdef BENCH_AU915
+#include "RegionAU915.c"
+#define REGION_NAME                 "AU915"
+#define REGION_MAX_NB_CHANNELS      AU915_MAX_NB_CHANNELS
+#define REGION_MAX_NB_BANDS         AU915_MAX_NB_BANDS
+#define REGION_TX_MAX_DATARATE      AU915_TX_MAX_DATARATE
+#define REGION_500KHZ_DATARATE      DR_6
+#define RegionInitDefaults          RegionAU915InitDefaults
+#define RegionNextChannel           RegionAU915NextChannel
+#define RegionChannelManualAdd      RegionAU915ChannelManualAdd
+#define RegionChannelsManualRemove  RegionAU915ChannelsManualRemove
+#else
+#include "RegionUS915.c"
+#define REGION_NAME                 "US915"
+#define REGION_MAX_NB_CHANNELS      US915_MAX_NB_CHANNELS
+#define REGION_MAX_NB_BANDS         US915_MAX_NB_BANDS
+#define REGION_TX_MAX_DATARATE      US915_TX_MAX_DATARATE
+#define REGION_500KHZ_DATARATE      DR_4
+#define RegionInitDefaults          RegionUS915InitDefaults
+#define RegionNextChannel           RegionUS915NextChannel
+#define RegionChannelManualAdd      RegionUS915ChannelManualAdd
+#define RegionChannelsManualRemove  RegionUS915ChannelsManualRemove
+#endif
+
+/* host replacements of the firmware */
+const struct Radio_s Radio;
+
+static TimerTime_t SimTime = 0;
+
+TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime ) {
+    return SimTime - savedTime;
+}
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd( void ) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+int32_t randr( int32_t min, int32_t max ) {
+    return (int32_t)(rnd() % (max - min + 1)) + min;
+}
+
+/******************************************************************************
+ The former selection, for comparison
+ ******************************************************************************/
+static uint8_t RefCountNbOfEnabledChannels( uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx ) {
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTransmission = 0;
+
+    for (uint8_t i = 0, k = 0; i < REGION_MAX_NB_CHANNELS; i += 16, k++) {
+        for (uint8_t j = 0; j < 16; j++) {
+            // the last word holds 8 channels, no more are looked at now
+            if ((channelsMask[k] & (1 << j)) == 0 || i + j >= REGION_MAX_NB_CHANNELS) {
+                continue;
+            }
+            if (channels[i + j].Frequency == 0) {
+                continue;
+            }
+            if (RegionCommonValueInRange(datarate, channels[i + j].DrRange.Fields.Min, channels[i + j].DrRange.Fields.Max) == false) {
+                continue;
+            }
+            if (bands[channels[i + j].Band].TimeOff > 0) {
+                delayTransmission++;
+                continue;
+            }
+            enabledChannels[nbEnabledChannels++] = i + j;
+        }
+    }
+    *delayTx = delayTransmission;
+    return nbEnabledChannels;
+}
+
+static bool RefNextChannel( NextChanParams_t* nextChanParams, uint8_t* channel, TimerTime_t* time, TimerTime_t* aggregatedTimeOff ) {
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTx = 0;
+    uint8_t enabledChannels[REGION_MAX_NB_CHANNELS] = { 0 };
+    TimerTime_t nextTxDelay = 0;
+
+    if (RegionCommonCountChannels(ChannelsMaskRemaining, 0, 4) == 0) {
+        RegionCommonChanMaskCopy(ChannelsMaskRemaining, ChannelsMask, 4);
+    }
+    if (nextChanParams->Datarate >= REGION_500KHZ_DATARATE) {
+        if ((ChannelsMaskRemaining[4] & 0x00FF) == 0) {
+            ChannelsMaskRemaining[4] = ChannelsMask[4];
+        }
+    }
+    if (nextChanParams->AggrTimeOff <= TimerGetElapsedTime(nextChanParams->LastAggrTx)) {
+        *aggregatedTimeOff = 0;
+        nextTxDelay = RegionCommonUpdateBandTimeOff(nextChanParams->Joined, nextChanParams->DutyCycleEnabled, Bands, REGION_MAX_NB_BANDS);
+        nbEnabledChannels = RefCountNbOfEnabledChannels(nextChanParams->Datarate, ChannelsMaskRemaining, Channels, Bands, enabledChannels, &delayTx);
+    } else {
+        delayTx++;
+        nextTxDelay = nextChanParams->AggrTimeOff - TimerGetElapsedTime(nextChanParams->LastAggrTx);
+    }
+    if (nbEnabledChannels > 0) {
+        *channel = enabledChannels[randr(0, nbEnabledChannels - 1)];
+        RegionCommonChanDisable(ChannelsMaskRemaining, *channel, REGION_MAX_NB_CHANNELS - 8);
+        *time = 0;
+        return true;
+    }
+    if (delayTx > 0) {
+        *time = nextTxDelay;
+        return true;
+    }
+    *time = 0;
+    return false;
+}
+
+/******************************************************************************
+ Checks
+ ******************************************************************************/
+typedef struct {
+    bool found;
+    uint8_t channel;
+    TimerTime_t time;
+    TimerTime_t aggrTimeOff;
+    Band_t bands[REGION_MAX_NB_BANDS];
+    uint16_t remaining[CHANNELS_MASK_SIZE];
+} selection_t;
+
+static void select_channel( bool reference, NextChanParams_t *params, uint32_t seed, selection_t *sel ) {
+    rnd_state = seed;
+    sel->channel = 0xFF;
+    sel->time = 0xDEADBEEF;
+    sel->aggrTimeOff = 0xDEADBEEF;
+    if (reference) {
+        sel->found = RefNextChannel(params, &sel->channel, &sel->time, &sel->aggrTimeOff);
+    } else {
+        sel->found = RegionNextChannel(params, &sel->channel, &sel->time, &sel->aggrTimeOff);
+    }
+    memcpy(sel->bands, Bands, sizeof(Bands));
+    memcpy(sel->remaining, ChannelsMaskRemaining, sizeof(ChannelsMaskRemaining));
+}
+
+static void change_channels( void ) {
+    uint8_t id = rnd() % REGION_MAX_NB_CHANNELS;
+
+    switch (rnd() % 4) {
+        case 0: {
+            ChannelParams_t channel = { 0 };
+            ChannelAddParams_t add = { &channel, id };
+            channel.Frequency = 902300000 + (rnd() % 128) * 200000;
+            channel.DrRange.Fields.Min = DR_0;
+            channel.DrRange.Fields.Max = rnd() % (REGION_TX_MAX_DATARATE + 1);
+            RegionChannelManualAdd(&add);
+            break;
+        }
+        case 1: {
+            ChannelRemoveParams_t remove = { id };
+            RegionChannelsManualRemove(&remove);
+            break;
+        }
+        case 2:
+            ChannelsMask[rnd() % 5] = rnd();
+            ChannelsMask[4] &= 0x00FF;
+            break;
+        default:
+            ChannelsMaskRemaining[rnd() % 5] &= rnd();
+            break;
+    }
+}
+
+static void check_reference( void ) {
+    uint32_t selections = 0, delays = 0;
+
+    RegionInitDefaults(INIT_TYPE_INIT);
+    for (uint32_t round = 0; round < 2000000; round++) {
+        NextChanParams_t params;
+        selection_t ref, now;
+        Band_t bands[REGION_MAX_NB_BANDS];
+        uint16_t remaining[CHANNELS_MASK_SIZE];
+        uint32_t seed = rnd() | 1;
+
+        if (rnd() % 16 == 0) {
+            change_channels();
+        }
+        SimTime += rnd() % 2000;
+        params.Datarate = (rnd() % 4 == 0) ? (int8_t)(rnd() % 20) - 2 : (int8_t)(rnd() % (REGION_TX_MAX_DATARATE + 1));
+        params.Joined = rnd() % 8 != 0;
+        params.DutyCycleEnabled = rnd() % 2;
+        params.LastAggrTx = SimTime - rnd() % 1000;
+        params.AggrTimeOff = (rnd() % 8 == 0) ? rnd() % 2000 : 0;
+        if (rnd() % 4 == 0) {
+            Bands[0].LastTxDoneTime = SimTime - rnd() % 1000;
+            Bands[0].LastJoinTxDoneTime = SimTime - rnd() % 1000;
+            Bands[0].TimeOff = rnd() % 2000;
+        }
+
+        memcpy(bands, Bands, sizeof(Bands));
+        memcpy(remaining, ChannelsMaskRemaining, sizeof(ChannelsMaskRemaining));
+        select_channel(true, &params, seed, &ref);
+        memcpy(Bands, bands, sizeof(Bands));
+        memcpy(ChannelsMaskRemaining, remaining, sizeof(ChannelsMaskRemaining));
+        select_channel(false, &params, seed, &now);
+
+        assert(now.found == ref.found);
+        assert(now.channel == ref.channel);
+        assert(now.time == ref.time);
+        assert(now.aggrTimeOff == ref.aggrTimeOff);
+        assert(memcmp(now.bands, ref.bands, sizeof(ref.bands)) == 0);
+        assert(memcmp(now.remaining, ref.remaining, sizeof(ref.remaining)) == 0);
+        selections += ref.channel != 0xFF;
+        delays += ref.found && ref.channel == 0xFF;
+        rnd_state = seed;
+    }
+    printf("%u channels and %u delays checked\n", selections, delays);
+}
+
+/******************************************************************************
+ Benchmark
+ ******************************************************************************/
+#define UPLINKS                     (2000000)
+
+static double now_us( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double bench( bool reference, int8_t datarate, const uint16_t *mask ) {
+    NextChanParams_t params = { 0, 0, datarate, true, false };
+    uint32_t sum = 0;
+
+    RegionInitDefaults(INIT_TYPE_INIT);
+    memcpy(ChannelsMask, mask, 5 * sizeof(uint16_t));
+    memcpy(ChannelsMaskRemaining, mask, 5 * sizeof(uint16_t));
+    double t0 = now_us();
+    for (uint32_t n = 0; n < UPLINKS; n++) {
+        uint8_t channel;
+        TimerTime_t time, aggrTimeOff;
+        if (reference) {
+            RefNextChannel(&params, &channel, &time, &aggrTimeOff);
+        } else {
+            RegionNextChannel(&params, &channel, &time, &aggrTimeOff);
+        }
+        sum += channel;
+    }
+    double t = (now_us() - t0) / UPLINKS;
+    assert(sum != 0);
+    return t;
+}
+
+int main( void ) {
+    static const struct {
+        const char *name;
+        int8_t datarate;
+        uint16_t mask[5];
+    } cases[] = {
+        { "64+8 channels, DR_0", DR_0, { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0x00FF } },
+        // a single sub-band, as most gateways listen to
+        { "sub-band 2, DR_0", DR_0, { 0xFF00, 0, 0, 0, 0x0002 } },
+        { "sub-band 2, 500 kHz", REGION_500KHZ_DATARATE, { 0xFF00, 0, 0, 0, 0x0002 } },
+    };
+
+    check_reference();
+
+    printf(REGION_NAME "                  former      mask   speedup   (us per uplink)\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double ref = bench(true, cases[i].datarate, cases[i].mask);
+        double now = bench(false, cases[i].datarate, cases[i].mask);
+        printf("%-22s %9.3f %9.3f %8.1fx\n", cases[i].name, ref, now, ref / now);
+    }
+    printf("RegionNextChannel: OK\n");
+    return 0;
+}
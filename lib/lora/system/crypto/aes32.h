@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef AES32_H_
+#define AES32_H_
+
+#include <stdint.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define AES32_BLOCK_SIZE                                        (16)
+#define AES32_ROUNDS                                            (10)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// expanded AES-128 encryption key
+typedef struct {
+    uint32_t    rk[4 * (AES32_ROUNDS + 1)];
+} aes32_context;
+
+/******************************************************************************
+ DECLARE FUNCTIONS
+ ******************************************************************************/
+// AES-128 encryption on 32 bit words, with a single 1 kB table: four table
+// lookups per column and round instead of the byte operations of aes.c
+extern void aes32_set_key(const uint8_t key[16], aes32_context *ctx);
+// in and out may be the same buffer
+extern void aes32_encrypt(const uint8_t in[AES32_BLOCK_SIZE], uint8_t out[AES32_BLOCK_SIZE], const aes32_context *ctx);
+
+#endif  // AES32_H_
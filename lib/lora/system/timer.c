@@ -22,53 +22,85 @@ Maintainer: Miguel Luis and Gregory Cristian
 volatile uint8_t HasLoopedThroughMain = 0;
 
 /*!
- * Timers list head pointer
+ * The running timers are kept in a hierarchical timing wheel. The expiry
+ * times are split in digits of TIMER_WHEEL_BITS bits, and a timer sits at
+ * the level of the highest digit in which its expiry time differs from the
+ * wheel time, in the slot given by that digit. When the wheel time reaches
+ * the start of an occupied slot, its timers move to lower levels, or expire
+ * if the slot is at level 0. Timers expiring after the tick counter wraps
+ * around wait in a list of their own until it does.
+ *
+ * A bitmap of the occupied slots of each level gives the next slot to
+ * process without scanning, so starting, stopping and finding the next
+ * expiry take constant time, whatever the number of running timers.
  */
-static TimerEvent_t *TimerListHead = NULL;
+#define TIMER_WHEEL_BITS                            6
+#define TIMER_WHEEL_SLOTS                           ( 1 << TIMER_WHEEL_BITS )
+#define TIMER_WHEEL_LEVELS                          6   // enough digits for 32 bit times
+#define TIMER_WHEEL_WRAPPED                         ( TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS )
 
 /*!
- * \brief Adds or replace the head timer of the list.
- *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
- *
- * \param [IN]  obj Timer object to be become the new head
- * \param [IN]  remainingTime Remaining time of the previous head to be replaced
+ * Slot lists, the list of wrapped timers last
+ */
+static TimerEvent_t *TimerWheel[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS + 1];
+
+/*!
+ * Occupied slots of each level, 32 slots per word
+ */
+static uint32_t TimerWheelMap[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS / 32];
+
+/*!
+ * Wheel time, in timer ticks: the timers expiring up to it have been processed
  */
-static void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime );
+static uint32_t TimerWheelTime = 0;
 
 /*!
- * \brief Adds a timer to the list.
+ * Tick the hardware timer has been set for, if TimerWheelArmed
+ */
+static uint32_t TimerWheelNext = 0;
+static bool TimerWheelArmed = false;
+
+/*!
+ * \brief Adds a timer to the wheel, in the slot its expiry time maps to
  *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
+ * \param [IN]  obj Timer object to be added, with its expiry time set
+ */
+static void TimerWheelInsert( TimerEvent_t *obj );
+
+/*!
+ * \brief Removes a timer from its slot
  *
- * \param [IN]  obj Timer object to be added to the list
- * \param [IN]  remainingTime Remaining time of the running head after which the object may be added
+ * \param [IN]  obj Timer object to be removed
  */
-static void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime );
+static void TimerWheelRemove( TimerEvent_t *obj );
 
 /*!
- * \brief Sets a timeout with the duration "timestamp"
+ * \brief Finds the first tick after the wheel time at which a slot has to be processed
  *
- * \param [IN] timestamp Delay duration
+ * \param [OUT] next That tick
+ * \param [OUT] slot The slot to process then
+ * \retval true if there is one, false if no timer is running
  */
-static void TimerSetTimeout( TimerEvent_t *obj );
+static bool TimerWheelNextEvent( uint32_t *next, uint32_t *slot );
 
 /*!
- * \brief Check if the Object to be added is not already in the list
+ * \brief Moves the wheel time forward, expiring the timers due up to it
  *
- * \param [IN] timestamp Delay duration
- * \retval true (the object is already in the list) or false
+ * \param [IN]  now Current timer tick
  */
-static bool TimerExists( TimerEvent_t *obj );
+static void TimerWheelAdvance( uint32_t now );
 
 /*!
- * \brief Read the timer value of the currently running timer
+ * \brief Sets the hardware timer for the next slot to process
+ */
+static void TimerWheelArm( void );
+
+/*!
+ * \brief Sets a timeout with the duration "timestamp"
  *
- * \retval value current timer value
+ * \param [IN] timestamp Delay duration
  */
-TimerTime_t TimerGetValue( void );
+static void TimerSetTimeout( uint32_t timestamp );
 
 
 void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) )
@@ -76,274 +108,224 @@ void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) )
     obj->Timestamp = 0;
     obj->ReloadValue = 0;
     obj->IsRunning = false;
+    obj->Slot = 0;
     obj->Callback = callback;
     obj->Next = NULL;
+    obj->Prev = NULL;
 }
 
 IRAM_ATTR void TimerStart( TimerEvent_t *obj )
 {
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
+    uint32_t now;
+    uint32_t delay;
 
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
 
-    if( ( obj == NULL ) || ( TimerExists( obj ) == true ) )
+    if( ( obj == NULL ) || ( obj->IsRunning == true ) )
     {
         MICROPY_END_ATOMIC_SECTION(ilevel);
         return;
     }
 
-    obj->Timestamp = obj->ReloadValue;
-    obj->IsRunning = false;
+    now = TimerHwGetTimerValue( );
+    TimerWheelAdvance( now );
 
-    if( TimerListHead == NULL )
-    {
-        TimerInsertNewHeadTimer( obj, obj->Timestamp );
-    }
-    else
+    // the hardware timer can't fire sooner than that
+    delay = obj->ReloadValue;
+    if( delay <= TimerHwGetMinimumTimeout( ) )
     {
-        if( TimerListHead->IsRunning == true )
-        {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > TimerListHead->Timestamp )
-            {
-                elapsedTime = TimerListHead->Timestamp; // security but should never occur
-            }
-            remainingTime = TimerListHead->Timestamp - elapsedTime;
-        }
-        else
-        {
-            remainingTime = TimerListHead->Timestamp;
-        }
-
-        if( obj->Timestamp < remainingTime )
-        {
-            TimerInsertNewHeadTimer( obj, remainingTime );
-        }
-        else
-        {
-             TimerInsertTimer( obj, remainingTime );
-        }
+        delay = TimerHwGetMinimumTimeout( ) * 2;
     }
-    MICROPY_END_ATOMIC_SECTION(ilevel);
-}
-
-static IRAM_ATTR void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime )
-{
-    uint32_t aggregatedTimestamp = 0;      // hold the sum of timestamps
-    uint32_t aggregatedTimestampNext = 0;  // hold the sum of timestamps up to the next event
-
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead->Next;
 
-    if( cur == NULL )
-    { // obj comes just after the head
-        obj->Timestamp -= remainingTime;
-        prev->Next = obj;
-        obj->Next = NULL;
-    }
-    else
-    {
-        aggregatedTimestamp = remainingTime;
-        aggregatedTimestampNext = remainingTime + cur->Timestamp;
+    obj->Timestamp = now + delay;
+    obj->IsRunning = true;
+    TimerWheelInsert( obj );
+    TimerWheelArm( );
 
-        while( prev != NULL )
-        {
-            if( aggregatedTimestampNext > obj->Timestamp )
-            {
-                obj->Timestamp -= aggregatedTimestamp;
-                if( cur != NULL )
-                {
-                    cur->Timestamp -= obj->Timestamp;
-                }
-                prev->Next = obj;
-                obj->Next = cur;
-                break;
-            }
-            else
-            {
-                prev = cur;
-                cur = cur->Next;
-                if( cur == NULL )
-                { // obj comes at the end of the list
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    obj->Timestamp -= aggregatedTimestamp;
-                    prev->Next = obj;
-                    obj->Next = NULL;
-                    break;
-                }
-                else
-                {
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    aggregatedTimestampNext = aggregatedTimestampNext + cur->Timestamp;
-                }
-            }
-        }
-    }
+    MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
-static IRAM_ATTR void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime )
+static IRAM_ATTR void TimerWheelInsert( TimerEvent_t *obj )
 {
-    TimerEvent_t* cur = TimerListHead;
+    uint32_t slot;
 
-    if( cur != NULL )
+    if( obj->Timestamp < TimerWheelTime )
     {
-        cur->Timestamp = remainingTime - obj->Timestamp;
-        cur->IsRunning = false;
+        slot = TIMER_WHEEL_WRAPPED;
     }
-
-    obj->Next = cur;
-    obj->IsRunning = true;
-    TimerListHead = obj;
-    TimerSetTimeout( TimerListHead );
-}
-
-IRAM_ATTR void TimerIrqHandler( void )
-{
-    uint32_t elapsedTime = 0;
-
-    // when all timers are stopped or expired, TimerListHead is NULL
-    if( TimerListHead == NULL )
+    else
     {
-        return;
+        // Timestamp > TimerWheelTime, the timers due now have expired
+        uint32_t level = ( 31 - __builtin_clz( obj->Timestamp ^ TimerWheelTime ) ) / TIMER_WHEEL_BITS;
+        uint32_t digit = ( obj->Timestamp >> ( level * TIMER_WHEEL_BITS ) ) & ( TIMER_WHEEL_SLOTS - 1 );
+        TimerWheelMap[level][digit >> 5] |= 1 << ( digit & 31 );
+        slot = level * TIMER_WHEEL_SLOTS + digit;
     }
+    obj->Slot = slot;
 
-    elapsedTime = TimerGetValue( );
-
-    if( elapsedTime >= TimerListHead->Timestamp )
+    // append, the first timer of a slot points back to the last one
+    TimerEvent_t *first = TimerWheel[slot];
+    obj->Next = NULL;
+    if( first == NULL )
     {
-        TimerListHead->Timestamp = 0;
+        obj->Prev = obj;
+        TimerWheel[slot] = obj;
     }
     else
     {
-        TimerListHead->Timestamp -= elapsedTime;
+        obj->Prev = first->Prev;
+        first->Prev->Next = obj;
+        first->Prev = obj;
     }
+}
 
-    TimerListHead->IsRunning = false;
+static IRAM_ATTR void TimerWheelRemove( TimerEvent_t *obj )
+{
+    uint32_t slot = obj->Slot;
+    TimerEvent_t *first = TimerWheel[slot];
 
-    while( ( TimerListHead != NULL ) && ( TimerListHead->Timestamp == 0 ) )
+    if( obj == first )
     {
-        TimerEvent_t* elapsedTimer = TimerListHead;
-        TimerListHead = TimerListHead->Next;
-
-        if( elapsedTimer->Callback != NULL )
+        TimerWheel[slot] = obj->Next;
+        if( obj->Next != NULL )
         {
-            // Callback will be processed out of the Interrupt context in a Thread
-            modlora_set_timer_callback(elapsedTimer->Callback);
+            obj->Next->Prev = obj->Prev;
+        }
+        else if( slot != TIMER_WHEEL_WRAPPED )
+        {
+            TimerWheelMap[slot / TIMER_WHEEL_SLOTS][( slot / 32 ) & 1] &= ~( 1 << ( slot & 31 ) );
         }
     }
-
-    // start the next TimerListHead if it exists
-    if( TimerListHead != NULL )
+    else
     {
-        if( TimerListHead->IsRunning != true )
+        obj->Prev->Next = obj->Next;
+        if( obj->Next != NULL )
         {
-            TimerListHead->IsRunning = true;
-            TimerSetTimeout( TimerListHead );
+            obj->Next->Prev = obj->Prev;
+        }
+        else
+        {
+            first->Prev = obj->Prev;
         }
     }
+    obj->Next = NULL;
+    obj->Prev = NULL;
 }
 
-IRAM_ATTR void TimerStop( TimerEvent_t *obj )
+static IRAM_ATTR bool TimerWheelNextEvent( uint32_t *next, uint32_t *slot )
 {
-    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
-
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
-
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead;
-
-    // List is empty or the Obj to stop does not exist
-    if( ( TimerListHead == NULL ) || ( obj == NULL ) )
+    for( uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++ )
     {
-        MICROPY_END_ATOMIC_SECTION(ilevel);
-        return;
-    }
-
-    if( TimerListHead == obj ) // Stop the Head
-    {
-        if( TimerListHead->IsRunning == true ) // The head is already running
-        {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > obj->Timestamp )
-            {
-                elapsedTime = obj->Timestamp;
-            }
-
-            remainingTime = obj->Timestamp - elapsedTime;
+        uint32_t shift = level * TIMER_WHEEL_BITS;
+        uint32_t digit = ( ( TimerWheelTime >> shift ) & ( TIMER_WHEEL_SLOTS - 1 ) ) + 1;
 
-            if( TimerListHead->Next != NULL )
-            {
-                TimerListHead->IsRunning = false;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
-                TimerListHead->IsRunning = true;
-                TimerSetTimeout( TimerListHead );
-            }
-            else
-            {
-                TimerListHead = NULL;
-            }
-        }
-        else // Stop the head before it is started
+        // the slots up to the wheel time's digit are empty, look past it
+        for( uint32_t word = digit >> 5; word < TIMER_WHEEL_SLOTS / 32; word++ )
         {
-            if( TimerListHead->Next != NULL )
+            uint32_t bits = TimerWheelMap[level][word];
+            if( word == ( digit >> 5 ) )
             {
-                remainingTime = obj->Timestamp;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
+                bits &= ~0U << ( digit & 31 );
             }
-            else
+            if( bits != 0 )
             {
-                TimerListHead = NULL;
+                // the first slot found is the earliest, as each level is coarser than the one below
+                digit = word * 32 + 31 - __builtin_clz( bits & -bits );
+                *slot = level * TIMER_WHEEL_SLOTS + digit;
+                shift += TIMER_WHEEL_BITS;
+                *next = ( ( shift < 32 ) ? ( TimerWheelTime >> shift ) << shift : 0 ) | ( digit << ( shift - TIMER_WHEEL_BITS ) );
+                return true;
             }
         }
     }
-    else // Stop an object within the list
+    if( TimerWheel[TIMER_WHEEL_WRAPPED] != NULL )
+    {
+        // the wrapped timers are looked at when the counter wraps around
+        *next = 0;
+        *slot = TIMER_WHEEL_WRAPPED;
+        return true;
+    }
+    return false;
+}
+
+static IRAM_ATTR void TimerWheelAdvance( uint32_t now )
+{
+    uint32_t next;
+    uint32_t slot;
+
+    while( TimerWheelNextEvent( &next, &slot ) && ( ( next - TimerWheelTime ) <= ( now - TimerWheelTime ) ) )
     {
-        remainingTime = obj->Timestamp;
+        TimerWheelTime = next;
 
-        while( cur != NULL )
+        // move the slot's timers down, or expire them
+        TimerEvent_t *obj = TimerWheel[slot];
+        TimerWheel[slot] = NULL;
+        if( slot != TIMER_WHEEL_WRAPPED )
         {
-            if( cur == obj )
+            TimerWheelMap[slot / TIMER_WHEEL_SLOTS][( slot / 32 ) & 1] &= ~( 1 << ( slot & 31 ) );
+        }
+        while( obj != NULL )
+        {
+            TimerEvent_t *elapsedTimer = obj;
+            obj = obj->Next;
+            if( elapsedTimer->Timestamp != next )
             {
-                if( cur->Next != NULL )
-                {
-                    cur = cur->Next;
-                    prev->Next = cur;
-                    cur->Timestamp += remainingTime;
-                }
-                else
-                {
-                    cur = NULL;
-                    prev->Next = cur;
-                }
-                break;
+                TimerWheelInsert( elapsedTimer );
             }
             else
             {
-                prev = cur;
-                cur = cur->Next;
+                elapsedTimer->Next = NULL;
+                elapsedTimer->Prev = NULL;
+                elapsedTimer->IsRunning = false;
+                if( elapsedTimer->Callback != NULL )
+                {
+                    // Callback will be processed out of the Interrupt context in a Thread
+                    modlora_set_timer_callback( elapsedTimer->Callback );
+                }
             }
         }
     }
-    MICROPY_END_ATOMIC_SECTION(ilevel);
+    TimerWheelTime = now;
 }
 
-static IRAM_ATTR bool TimerExists( TimerEvent_t *obj )
+static IRAM_ATTR void TimerWheelArm( void )
 {
-    TimerEvent_t* cur = TimerListHead;
+    uint32_t next;
+    uint32_t slot;
 
-    while( cur != NULL )
+    if( TimerWheelNextEvent( &next, &slot ) == false )
     {
-        if( cur == obj )
-        {
-            return true;
-        }
-        cur = cur->Next;
+        TimerWheelArmed = false;
     }
-    return false;
+    else if( ( TimerWheelArmed == false ) || ( next != TimerWheelNext ) )
+    {
+        TimerWheelArmed = true;
+        TimerWheelNext = next;
+        // a timeout on tick 0 never fires, take the wrapped timers a tick later
+        TimerSetTimeout( ( ( next == 0 ) ? 1 : next ) - TimerWheelTime );
+    }
+}
+
+IRAM_ATTR void TimerIrqHandler( void )
+{
+    TimerWheelArmed = false;
+    TimerWheelAdvance( TimerHwGetTimerValue( ) );
+    TimerWheelArm( );
+}
+
+IRAM_ATTR void TimerStop( TimerEvent_t *obj )
+{
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+
+    // the hardware timer stays set, if nothing is due by then the
+    // interrupt handler just sets it again
+    if( ( obj != NULL ) && ( obj->IsRunning == true ) )
+    {
+        TimerWheelRemove( obj );
+        obj->IsRunning = false;
+    }
+
+    MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
 void TimerReset( TimerEvent_t *obj )
@@ -359,20 +341,15 @@ void IRAM_ATTR TimerSetValue( TimerEvent_t *obj, uint32_t value )
     obj->ReloadValue = value;
 }
 
-IRAM_ATTR TimerTime_t TimerGetValue( void )
-{
-    return TimerHwGetElapsedTime( );
-}
-
 IRAM_ATTR TimerTime_t TimerGetCurrentTime( void )
 {
     return TimerHwGetTime( );
 }
 
-static IRAM_ATTR void TimerSetTimeout( TimerEvent_t *obj )
+static IRAM_ATTR void TimerSetTimeout( uint32_t timestamp )
 {
     HasLoopedThroughMain = 0;
-    TimerHwStart( obj->Timestamp );
+    TimerHwStart( timestamp );
 }
 
 IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
@@ -382,7 +359,7 @@ IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
 
 void TimerLowPowerHandler( void )
 {
-    if( ( TimerListHead != NULL ) && ( TimerListHead->IsRunning == true ) )
+    if( TimerWheelArmed == true )
     {
         if( HasLoopedThroughMain < 5 )
         {
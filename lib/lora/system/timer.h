@@ -20,11 +20,13 @@ Maintainer: Miguel Luis and Gregory Cristian
  */
 typedef struct TimerEvent_s
 {
-    uint32_t Timestamp;         //! Current timer value
+    uint32_t Timestamp;         //! Expiry time, in timer ticks
     uint32_t ReloadValue;       //! Timer delay value
-    bool IsRunning;             //! Is the timer currently running
+    bool IsRunning;             //! Is the timer started and not yet expired
+    uint16_t Slot;              //! Timer wheel slot holding the timer
     void ( *Callback )( void ); //! Timer IRQ callback function
-    struct TimerEvent_s *Next;  //! Pointer to the next Timer object.
+    struct TimerEvent_s *Next;  //! Pointer to the next Timer object in the slot.
+    struct TimerEvent_s *Prev;  //! Pointer to the previous one, or to the last one for the first.
 }TimerEvent_t;
 
 /*!
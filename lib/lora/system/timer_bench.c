@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+/*
+Description:
+    Host stress test and benchmark of the LoRaMAC timers. timer.c is
+    included here and runs on a simulated 1 ms tick that behaves like
+    esp32/lora/timer-board.c: the interrupt handler is called on the tick
+    the hardware timer was set for, and never on tick 0.
+
+    The stress test starts, stops and restarts timers at random with the
+    delays the MAC uses (receive windows, ping slots, duty cycle back offs
+    of up to hours) across a wrap of the tick counter. Every timer must
+    fire once, on its expiry tick or the one after when the hardware
+    timer couldn't be set that close, and a stopped timer never.
+
+    The jitter benchmark times TimerStart, TimerStop and the interrupt
+    handler with 8 to 128 running timers, against a condensed copy of the
+    former implementation (a list sorted by expiry, holding the delays
+    between consecutive timers).
+
+    timer.c includes the firmware's board headers, empty ones will do:
+
+        mkdir -p /tmp/timer_bench
+        touch /tmp/timer_bench/board.h /tmp/timer_bench/timer-board.h /tmp/timer_bench/modlora.h
+        cc -O2 -I/tmp/timer_bench timer_bench.c -o /tmp/timer_bench/timer_bench
+        /tmp/timer_bench/timer_bench
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "timer.h"
+
+/* host replacements of the firmware definitions */
+#define IRAM_ATTR
+#define MICROPY_BEGIN_ATOMIC_SECTION()      (0)
+#define MICROPY_END_ATOMIC_SECTION(state)   (void)(state)
+
+/* simulated tick, as in timer-board.c */
+static uint32_t sim_tick = 1;
+static uint32_t sim_timeout = 0;
+static uint32_t sim_context = 0;
+static void ( *sim_irq )( void );
+
+static uint32_t TimerHwGetMinimumTimeout( void ) {
+    return 1;
+}
+
+static void TimerHwStart( uint32_t val ) {
+    sim_context = sim_tick;
+    sim_timeout = sim_tick + ((val <= 1) ? 2 : val);
+}
+
+static uint32_t TimerHwGetTimerValue( void ) {
+    return sim_tick;
+}
+
+static uint32_t TimerHwGetTime( void ) {
+    return sim_tick;
+}
+
+static uint32_t TimerHwGetElapsedTime( void ) {
+    return (sim_tick - sim_context) + 1;
+}
+
+static uint32_t TimerHwComputeTimeDifference( uint32_t eventInTime ) {
+    return sim_tick - eventInTime;
+}
+
+static void TimerHwEnterLowPowerStopMode( void ) {
+}
+
+static void sim_step( void ) {
+    sim_tick++;
+    if (sim_timeout > 0 && sim_tick == sim_timeout) {
+        sim_irq();
+    }
+}
+
+/* the callbacks run in place instead of being posted to the timer task */
+static void modlora_set_timer_callback( void ( *callback )( void ) ) {
+    callback();
+}
+
+#include "timer.c"
+
+/******************************************************************************
+ The former implementation, for comparison
+ ******************************************************************************/
+typedef struct ListEvent_s {
+    uint32_t Timestamp;
+    uint32_t ReloadValue;
+    bool IsRunning;
+    void ( *Callback )( void );
+    struct ListEvent_s *Next;
+} ListEvent_t;
+
+static ListEvent_t *ListHead = NULL;
+
+static void ListSetTimeout( ListEvent_t *obj ) {
+    TimerHwStart( obj->Timestamp );
+}
+
+static bool ListExists( ListEvent_t *obj ) {
+    for (ListEvent_t *cur = ListHead; cur != NULL; cur = cur->Next) {
+        if (cur == obj) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ListInsertNewHeadTimer( ListEvent_t *obj, uint32_t remainingTime ) {
+    ListEvent_t *cur = ListHead;
+    if (cur != NULL) {
+        cur->Timestamp = remainingTime - obj->Timestamp;
+        cur->IsRunning = false;
+    }
+    obj->Next = cur;
+    obj->IsRunning = true;
+    ListHead = obj;
+    ListSetTimeout( ListHead );
+}
+
+static void ListInsertTimer( ListEvent_t *obj, uint32_t remainingTime ) {
+    uint32_t aggregated = remainingTime;
+    ListEvent_t *prev = ListHead;
+    ListEvent_t *cur = ListHead->Next;
+
+    while (cur != NULL && aggregated + cur->Timestamp <= obj->Timestamp) {
+        aggregated += cur->Timestamp;
+        prev = cur;
+        cur = cur->Next;
+    }
+    obj->Timestamp -= aggregated;
+    if (cur != NULL) {
+        cur->Timestamp -= obj->Timestamp;
+    }
+    prev->Next = obj;
+    obj->Next = cur;
+}
+
+static void ListStart( ListEvent_t *obj ) {
+    uint32_t remainingTime;
+
+    if (obj == NULL || ListExists( obj )) {
+        return;
+    }
+    obj->Timestamp = obj->ReloadValue;
+    obj->IsRunning = false;
+    if (ListHead == NULL) {
+        ListInsertNewHeadTimer( obj, obj->Timestamp );
+        return;
+    }
+    if (ListHead->IsRunning) {
+        uint32_t elapsedTime = TimerHwGetElapsedTime( );
+        if (elapsedTime > ListHead->Timestamp) {
+            elapsedTime = ListHead->Timestamp;
+        }
+        remainingTime = ListHead->Timestamp - elapsedTime;
+    } else {
+        remainingTime = ListHead->Timestamp;
+    }
+    if (obj->Timestamp < remainingTime) {
+        ListInsertNewHeadTimer( obj, remainingTime );
+    } else {
+        ListInsertTimer( obj, remainingTime );
+    }
+}
+
+static void ListIrqHandler( void ) {
+    if (ListHead == NULL) {
+        return;
+    }
+    uint32_t elapsedTime = TimerHwGetElapsedTime( );
+    ListHead->Timestamp = (elapsedTime >= ListHead->Timestamp) ? 0 : ListHead->Timestamp - elapsedTime;
+    ListHead->IsRunning = false;
+    while (ListHead != NULL && ListHead->Timestamp == 0) {
+        ListEvent_t *elapsedTimer = ListHead;
+        ListHead = ListHead->Next;
+        if (elapsedTimer->Callback != NULL) {
+            modlora_set_timer_callback( elapsedTimer->Callback );
+        }
+    }
+    if (ListHead != NULL && !ListHead->IsRunning) {
+        ListHead->IsRunning = true;
+        ListSetTimeout( ListHead );
+    }
+}
+
+static void ListStop( ListEvent_t *obj ) {
+    if (ListHead == NULL || obj == NULL) {
+        return;
+    }
+    if (ListHead == obj) {
+        if (ListHead->IsRunning) {
+            uint32_t elapsedTime = TimerHwGetElapsedTime( );
+            if (elapsedTime > obj->Timestamp) {
+                elapsedTime = obj->Timestamp;
+            }
+            ListHead->IsRunning = false;
+            ListHead = ListHead->Next;
+            if (ListHead != NULL) {
+                ListHead->Timestamp += obj->Timestamp - elapsedTime;
+                ListHead->IsRunning = true;
+                ListSetTimeout( ListHead );
+            }
+        } else {
+            ListHead = ListHead->Next;
+            if (ListHead != NULL) {
+                ListHead->Timestamp += obj->Timestamp;
+            }
+        }
+        return;
+    }
+    for (ListEvent_t *prev = ListHead, *cur = ListHead->Next; cur != NULL; prev = cur, cur = cur->Next) {
+        if (cur == obj) {
+            if (cur->Next != NULL) {
+                cur->Next->Timestamp += obj->Timestamp;
+            }
+            prev->Next = cur->Next;
+            return;
+        }
+    }
+}
+
+/******************************************************************************
+ Timers and their callbacks
+ ******************************************************************************/
+#define TIMERS                  (128)
+
+static TimerEvent_t timers[TIMERS];
+static ListEvent_t list_timers[TIMERS];
+
+// what each timer should do, according to the test
+static bool expected_running[TIMERS];
+static uint32_t expected_expiry[TIMERS];
+
+static uint64_t fired_count;
+static uint64_t fired_late;
+static uint32_t errors;
+
+static void fired( int n ) {
+    if (sim_irq != TimerIrqHandler) {
+        return;
+    }
+    fired_count++;
+    if (!expected_running[n]) {
+        if (errors++ < 10) {
+            printf("tick %u: timer %d fired while stopped\n", sim_tick, n);
+        }
+        return;
+    }
+    uint32_t late = sim_tick - expected_expiry[n];
+    if (late > 1) {
+        if (errors++ < 10) {
+            printf("tick %u: timer %d due on %u fired %d ticks off\n", sim_tick, n, expected_expiry[n], (int32_t)late);
+        }
+    }
+    fired_late += late;
+    if (timers[n].IsRunning) {
+        if (errors++ < 10) {
+            printf("tick %u: timer %d still running once fired\n", sim_tick, n);
+        }
+    }
+    expected_running[n] = false;
+}
+
+#define CB(n)       static void cb_##n( void ) { fired( n ); }
+#define CB16(h)     CB(h##0) CB(h##1) CB(h##2) CB(h##3) CB(h##4) CB(h##5) CB(h##6) CB(h##7) \
+                    CB(h##8) CB(h##9) CB(h##a) CB(h##b) CB(h##c) CB(h##d) CB(h##e) CB(h##f)
+CB16(0x0) CB16(0x1) CB16(0x2) CB16(0x3) CB16(0x4) CB16(0x5) CB16(0x6) CB16(0x7)
+
+#define REF(n)      cb_##n,
+#define REF16(h)    REF(h##0) REF(h##1) REF(h##2) REF(h##3) REF(h##4) REF(h##5) REF(h##6) REF(h##7) \
+                    REF(h##8) REF(h##9) REF(h##a) REF(h##b) REF(h##c) REF(h##d) REF(h##e) REF(h##f)
+static void ( *const callbacks[TIMERS] )( void ) = {
+    REF16(0x0) REF16(0x1) REF16(0x2) REF16(0x3) REF16(0x4) REF16(0x5) REF16(0x6) REF16(0x7)
+};
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd( void ) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+// a delay in ms, in the proportions the MAC uses them
+static uint32_t random_delay( void ) {
+    uint32_t kind = rnd() % 16;
+    if (kind < 4) {
+        // receive windows, RX1 and RX2 with their offsets
+        return (kind & 1 ? 2000 : 1000) + rnd() % 40 - 20;
+    } else if (kind < 8) {
+        // class B ping slots and beacon guard
+        return 30 * (1 + rnd() % 4096);
+    } else if (kind < 10) {
+        // short ones: ack timeouts, radio timeouts, the minimum
+        return rnd() % 8;
+    } else if (kind < 14) {
+        // application timers, up to a minute
+        return rnd() % 60000;
+    } else {
+        // duty cycle back off, up to two hours
+        return rnd() % 7200000;
+    }
+}
+
+static void reset( void ) {
+    memset(TimerWheel, 0, sizeof(TimerWheel));
+    memset(TimerWheelMap, 0, sizeof(TimerWheelMap));
+    TimerWheelTime = sim_tick;
+    TimerWheelArmed = false;
+    ListHead = NULL;
+    sim_timeout = 0;
+    for (int n = 0; n < TIMERS; n++) {
+        TimerInit(&timers[n], callbacks[n]);
+        memset(&list_timers[n], 0, sizeof(list_timers[n]));
+        list_timers[n].Callback = callbacks[n];
+        expected_running[n] = false;
+    }
+}
+
+/******************************************************************************
+ Stress test
+ ******************************************************************************/
+static void stress( uint32_t start, uint32_t ticks, int active ) {
+    sim_tick = start;
+    sim_irq = TimerIrqHandler;
+    reset();
+    fired_count = fired_late = 0;
+    errors = 0;
+
+    for (uint32_t t = 0; t < ticks; t++) {
+        // a few operations on each tick, on the first active timers
+        while ((rnd() & 3) == 0) {
+            int n = rnd() % active;
+            switch (rnd() % 4) {
+                case 0:
+                    TimerStop(&timers[n]);
+                    expected_running[n] = false;
+                    break;
+                case 1:
+                    // restart, as TimerReset and TimerSetValue callers do
+                    TimerSetValue(&timers[n], random_delay());
+                    expected_running[n] = false;
+                    // fall through
+                default:
+                    if (!timers[n].IsRunning) {
+                        uint32_t delay = timers[n].ReloadValue;
+                        TimerStart(&timers[n]);
+                        expected_running[n] = true;
+                        expected_expiry[n] = sim_tick + (delay <= 1 ? 2 : delay);
+                    }
+                    break;
+            }
+            if (!!timers[n].IsRunning != expected_running[n]) {
+                if (errors++ < 10) {
+                    printf("tick %u: timer %d IsRunning %d\n", sim_tick, n, timers[n].IsRunning);
+                }
+            }
+        }
+        sim_step();
+        if ((t & 0xFFFF) == 0) {
+            // nothing overdue
+            for (int n = 0; n < active; n++) {
+                if (expected_running[n] && (int32_t)(sim_tick - expected_expiry[n]) > 1) {
+                    if (errors++ < 10) {
+                        printf("tick %u: timer %d due on %u never fired\n", sim_tick, n, expected_expiry[n]);
+                    }
+                    expected_running[n] = false;
+                }
+            }
+        }
+    }
+    printf("stress from tick %10u, %9u ticks, %3d timers: %9llu fired, %.4f ticks late on average, %u errors\n",
+           start, ticks, active, (unsigned long long)fired_count,
+           fired_count ? (double)fired_late / fired_count : 0.0, errors);
+    assert(errors == 0);
+}
+
+/******************************************************************************
+ Jitter benchmark
+ ******************************************************************************/
+#define SAMPLES                 (200000)
+
+typedef struct {
+    const char *name;
+    void ( *start )( int n, uint32_t delay );
+    void ( *stop )( int n );
+    void ( *irq )( void );
+} impl_t;
+
+static void wheel_start( int n, uint32_t delay ) {
+    timers[n].ReloadValue = delay;
+    TimerStart(&timers[n]);
+}
+
+static void wheel_stop( int n ) {
+    TimerStop(&timers[n]);
+}
+
+static void list_start( int n, uint32_t delay ) {
+    list_timers[n].ReloadValue = delay;
+    ListStart(&list_timers[n]);
+}
+
+static void list_stop( int n ) {
+    ListStop(&list_timers[n]);
+}
+
+static const impl_t impls[] = {
+    { "list",  list_start,  list_stop,  ListIrqHandler },
+    { "wheel", wheel_start, wheel_stop, TimerIrqHandler },
+};
+
+static uint32_t samples[3][SAMPLES];
+static uint32_t nsamples[3];
+
+static uint32_t now_ns( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+static int cmp_u32( const void *a, const void *b ) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report( const char *name, const char *op, uint32_t *s, uint32_t count ) {
+    if (count == 0) {
+        return;
+    }
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += s[i];
+    }
+    qsort(s, count, sizeof(*s), cmp_u32);
+    printf("    %-5s %-5s mean %6.0f ns, p99 %6u ns, max %7u ns\n", name, op,
+           (double)sum / count, s[count * 99 / 100], s[count - 1]);
+}
+
+static void ( *bench_irq )( void );
+
+static void bench_irq_timed( void ) {
+    uint32_t t0 = now_ns();
+    bench_irq();
+    uint32_t t1 = now_ns();
+    if (nsamples[2] < SAMPLES) {
+        samples[2][nsamples[2]++] = t1 - t0;
+    }
+}
+
+static void jitter( const impl_t *impl, int pending ) {
+    sim_tick = 1;
+    reset();
+    bench_irq = impl->irq;
+    sim_irq = bench_irq_timed;
+    memset(nsamples, 0, sizeof(nsamples));
+    rnd_state = 12345;
+
+    // long running ones, all of them pending
+    for (int n = 0; n < pending; n++) {
+        impl->start(n, 1000 + rnd() % 3600000);
+    }
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        int n = rnd() % pending;
+        uint32_t t0 = now_ns();
+        impl->stop(n);
+        uint32_t t1 = now_ns();
+        impl->start(n, 1000 + rnd() % 3600000);
+        uint32_t t2 = now_ns();
+        samples[0][nsamples[0]++] = t1 - t0;
+        samples[1][nsamples[1]++] = t2 - t1;
+        // a short one coming and going, as the receive windows do
+        impl->start(TIMERS - 1, 1 + rnd() % 20);
+        for (int k = rnd() % 40; k > 0; k--) {
+            sim_step();
+        }
+    }
+    report(impl->name, "stop", samples[0], nsamples[0]);
+    report(impl->name, "start", samples[1], nsamples[1]);
+    report(impl->name, "irq", samples[2], nsamples[2]);
+}
+
+int main( void ) {
+    (void)TimerLowPowerHandler;
+    (void)TimerGetCurrentTime;
+    (void)TimerGetElapsedTime;
+    (void)TimerReset;
+
+    stress(1, 20000000, 8);
+    stress(1, 20000000, TIMERS);
+    // across the wrap of the tick counter
+    stress(UINT32_MAX - 10000000, 20000000, 32);
+    stress(UINT32_MAX - 8000000, 10000000, TIMERS);
+
+    // the last timer is the short one
+    for (int pending = 8; pending <= TIMERS; pending *= 2) {
+        printf("jitter with %d pending timers:\n", pending);
+        for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+            jitter(&impls[i], pending - 1);
+        }
+    }
+    printf("timer: OK\n");
+    return 0;
+}
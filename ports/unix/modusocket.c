@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -69,6 +70,9 @@ typedef struct _mp_obj_socket_t {
 
 const mp_obj_type_t mp_type_socket;
 
+// most buffers accepted by sendv()/recvv() in one call
+#define SOCKET_IOV_MAX (16)
+
 // Helper functions
 static inline mp_obj_t mp_obj_from_sockaddr(const struct sockaddr *addr, socklen_t len) {
     return mp_obj_new_bytes((const byte *)addr, len);
@@ -229,6 +233,104 @@ STATIC mp_obj_t socket_recvfrom(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvfrom_obj, 2, 3, socket_recvfrom);
 
+// Gets the buffer of recv_into()/recvfrom_into(), limited to nbytes if given.
+STATIC int socket_get_recv_buffer(size_t n_args, const mp_obj_t *args, mp_buffer_info_t *bufinfo) {
+    mp_get_buffer_raise(args[1], bufinfo, MP_BUFFER_WRITE);
+    int flags = 0;
+    if (n_args > 2) {
+        mp_int_t nbytes = mp_obj_get_int(args[2]);
+        if (nbytes < 0) {
+            mp_raise_ValueError("negative buffersize");
+        }
+        if (nbytes > 0 && (size_t)nbytes < bufinfo->len) {
+            bufinfo->len = nbytes;
+        }
+        if (n_args > 3) {
+            flags = MP_OBJ_SMALL_INT_VALUE(args[3]);
+        }
+    }
+    return flags;
+}
+
+STATIC mp_obj_t socket_recv_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_socket_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t bufinfo;
+    int flags = socket_get_recv_buffer(n_args, args, &bufinfo);
+    int out_sz = recv(self->fd, bufinfo.buf, bufinfo.len, flags);
+    RAISE_ERRNO(out_sz, errno);
+    return MP_OBJ_NEW_SMALL_INT(out_sz);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recv_into_obj, 2, 4, socket_recv_into);
+
+STATIC mp_obj_t socket_recvfrom_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_socket_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t bufinfo;
+    int flags = socket_get_recv_buffer(n_args, args, &bufinfo);
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int out_sz = recvfrom(self->fd, bufinfo.buf, bufinfo.len, flags, (struct sockaddr*)&addr, &addr_len);
+    RAISE_ERRNO(out_sz, errno);
+
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(2, NULL));
+    t->items[0] = MP_OBJ_NEW_SMALL_INT(out_sz);
+    t->items[1] = mp_obj_from_sockaddr((struct sockaddr*)&addr, addr_len);
+    return MP_OBJ_FROM_PTR(t);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvfrom_into_obj, 2, 4, socket_recvfrom_into);
+
+// Fills iov from a list or tuple of buffers and returns the number of entries.
+STATIC size_t socket_get_iov(mp_obj_t bufs_in, struct iovec *iov, mp_uint_t flags) {
+    size_t n_bufs;
+    mp_obj_t *bufs;
+    mp_obj_get_array(bufs_in, &n_bufs, &bufs);
+    if (n_bufs > SOCKET_IOV_MAX) {
+        mp_raise_ValueError("too many buffers");
+    }
+    for (size_t i = 0; i < n_bufs; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, flags);
+        iov[i].iov_base = bufinfo.buf;
+        iov[i].iov_len = bufinfo.len;
+    }
+    return n_bufs;
+}
+
+STATIC mp_obj_t socket_sendv(size_t n_args, const mp_obj_t *args) {
+    mp_obj_socket_t *self = MP_OBJ_TO_PTR(args[0]);
+    int flags = 0;
+
+    if (n_args > 2) {
+        flags = MP_OBJ_SMALL_INT_VALUE(args[2]);
+    }
+
+    struct iovec iov[SOCKET_IOV_MAX];
+    struct msghdr msg = { .msg_iov = iov };
+    msg.msg_iovlen = socket_get_iov(args[1], iov, MP_BUFFER_READ);
+    ssize_t out_sz = sendmsg(self->fd, &msg, flags);
+    RAISE_ERRNO(out_sz, errno);
+
+    return mp_obj_new_int_from_uint(out_sz);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_sendv_obj, 2, 3, socket_sendv);
+
+STATIC mp_obj_t socket_recvv(size_t n_args, const mp_obj_t *args) {
+    mp_obj_socket_t *self = MP_OBJ_TO_PTR(args[0]);
+    int flags = 0;
+
+    if (n_args > 2) {
+        flags = MP_OBJ_SMALL_INT_VALUE(args[2]);
+    }
+
+    struct iovec iov[SOCKET_IOV_MAX];
+    struct msghdr msg = { .msg_iov = iov };
+    msg.msg_iovlen = socket_get_iov(args[1], iov, MP_BUFFER_WRITE);
+    ssize_t out_sz = recvmsg(self->fd, &msg, flags);
+    RAISE_ERRNO(out_sz, errno);
+
+    return mp_obj_new_int_from_uint(out_sz);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvv_obj, 2, 3, socket_recvv);
+
 // Note: besides flag param, this differs from write() in that
 // this does not swallow blocking errors (EAGAIN, EWOULDBLOCK) -
 // these would be thrown as exceptions.
@@ -361,9 +463,13 @@ STATIC const mp_rom_map_elem_t usocket_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_listen), MP_ROM_PTR(&socket_listen_obj) },
     { MP_ROM_QSTR(MP_QSTR_accept), MP_ROM_PTR(&socket_accept_obj) },
     { MP_ROM_QSTR(MP_QSTR_recv), MP_ROM_PTR(&socket_recv_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recv_into), MP_ROM_PTR(&socket_recv_into_obj) },
     { MP_ROM_QSTR(MP_QSTR_recvfrom), MP_ROM_PTR(&socket_recvfrom_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recvfrom_into), MP_ROM_PTR(&socket_recvfrom_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recvv), MP_ROM_PTR(&socket_recvv_obj) },
     { MP_ROM_QSTR(MP_QSTR_send), MP_ROM_PTR(&socket_send_obj) },
     { MP_ROM_QSTR(MP_QSTR_sendto), MP_ROM_PTR(&socket_sendto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sendv), MP_ROM_PTR(&socket_sendv_obj) },
     { MP_ROM_QSTR(MP_QSTR_setsockopt), MP_ROM_PTR(&socket_setsockopt_obj) },
     { MP_ROM_QSTR(MP_QSTR_setblocking), MP_ROM_PTR(&socket_setblocking_obj) },
     { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
@@ -45,5 +45,7 @@
 #define MICROPY_PY_IO_RESOURCE_STREAM (1)
 #undef MICROPY_VFS_FAT
 #define MICROPY_VFS_FAT                (1)
+#define MICROPY_VFS_ROM                (1)
+#define MICROPY_VFS_STATS              (1)
 #define MICROPY_PY_FRAMEBUF            (1)
 #define MICROPY_PY_COLLECTIONS_NAMEDTUPLE__ASDICT (1)
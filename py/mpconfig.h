@@ -758,6 +758,16 @@ typedef double mp_float_t;
 #define MICROPY_VFS_FAT (0)
 #endif
 
+// Support for VFS ROM component, to mount a read-only image held in memory
+#ifndef MICROPY_VFS_ROM
+#define MICROPY_VFS_ROM (0)
+#endif
+
+// Whether to keep per-mount block device I/O counters and an optional trace
+#ifndef MICROPY_VFS_STATS
+#define MICROPY_VFS_STATS (0)
+#endif
+
 /*****************************************************************************/
 /* Fine control over Python builtins, classes, modules, etc                  */
 
@@ -1266,6 +1276,16 @@ typedef double mp_float_t;
 #define MICROPY_PY_UTIMEQ (0)
 #endif
 
+// Append-only time-series log of fixed-size records on top of the filesystem
+#ifndef MICROPY_PY_ULOG
+#define MICROPY_PY_ULOG (0)
+#endif
+
+// Log-structured key-value store on top of the filesystem
+#ifndef MICROPY_PY_UKV
+#define MICROPY_PY_UKV (0)
+#endif
+
 #ifndef MICROPY_PY_UHASHLIB
 #define MICROPY_PY_UHASHLIB (0)
 #endif
@@ -1340,6 +1360,16 @@ typedef double mp_float_t;
 #define MICROPY_PY_UWEBSOCKET (0)
 #endif
 
+// MQTT 3.1.1 client over a stream
+#ifndef MICROPY_PY_UMQTT
+#define MICROPY_PY_UMQTT (0)
+#endif
+
+// HTTP/1.1 server core over a stream
+#ifndef MICROPY_PY_UHTTPD
+#define MICROPY_PY_UHTTPD (0)
+#endif
+
 #ifndef MICROPY_PY_FRAMEBUF
 #define MICROPY_PY_FRAMEBUF (0)
 #endif
@@ -190,6 +190,12 @@ STATIC const mp_rom_map_elem_t mp_builtin_module_table[] = {
 #if MICROPY_PY_UTIMEQ
     { MP_ROM_QSTR(MP_QSTR_utimeq), MP_ROM_PTR(&mp_module_utimeq) },
 #endif
+#if MICROPY_PY_ULOG
+    { MP_ROM_QSTR(MP_QSTR_ulog), MP_ROM_PTR(&mp_module_ulog) },
+#endif
+#if MICROPY_PY_UKV
+    { MP_ROM_QSTR(MP_QSTR_ukv), MP_ROM_PTR(&mp_module_ukv) },
+#endif
 #if MICROPY_PY_UHASHLIB
     { MP_ROM_QSTR(MP_QSTR_uhashlib), MP_ROM_PTR(&mp_module_uhashlib) },
 #endif
@@ -214,6 +220,12 @@ STATIC const mp_rom_map_elem_t mp_builtin_module_table[] = {
 #if MICROPY_PY_UWEBSOCKET
     { MP_ROM_QSTR(MP_QSTR_uwebsocket), MP_ROM_PTR(&mp_module_uwebsocket) },
 #endif
+#if MICROPY_PY_UMQTT
+    { MP_ROM_QSTR(MP_QSTR__umqtt), MP_ROM_PTR(&mp_module_umqtt) },
+#endif
+#if MICROPY_PY_UHTTPD
+    { MP_ROM_QSTR(MP_QSTR__uhttpd), MP_ROM_PTR(&mp_module_uhttpd) },
+#endif
 #if MICROPY_PY_WEBREPL
     { MP_ROM_QSTR(MP_QSTR__webrepl), MP_ROM_PTR(&mp_module_webrepl) },
 #endif
@@ -270,6 +270,8 @@ PY_EXTMOD_O_BASENAME = \
 	extmod/moduzlib.o \
 	extmod/moduheapq.o \
 	extmod/modutimeq.o \
+	extmod/modulog.o \
+	extmod/modukv.o \
 	extmod/moduhashlib.o \
 	extmod/moducryptolib.o \
 	extmod/modubinascii.o \
@@ -285,6 +287,8 @@ PY_EXTMOD_O_BASENAME = \
 	extmod/modurandom.o \
 	extmod/moduselect.o \
 	extmod/moduwebsocket.o \
+	extmod/modumqtt.o \
+	extmod/moduhttpd.o \
 	extmod/modwebrepl.o \
 	extmod/modframebuf.o \
 	extmod/vfs.o \
@@ -294,6 +298,9 @@ PY_EXTMOD_O_BASENAME = \
 	extmod/vfs_fat.o \
 	extmod/vfs_fat_diskio.o \
 	extmod/vfs_fat_file.o \
+	extmod/vfs_rom.o \
+	extmod/vfs_rom_file.o \
+	extmod/vfs_stats.o \
 	extmod/utime_mphal.o \
 	extmod/uos_dupterm.o \
 	lib/embed/abort_.o \
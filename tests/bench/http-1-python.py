@@ -0,0 +1,54 @@
+import bench
+import usocket as socket
+
+# GET requests answered by a request loop written in Python, the way a
+# small usocket based web server does it; the client side is the same
+# for both tests: a batch of pipelined requests per connection
+REQ = b"GET /api/status HTTP/1.1\r\nHost: device\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n"
+BATCH = 50
+
+def status(path):
+    return '{"ok": true}'
+
+ROUTES = {"/api/status": status}
+
+def serve(s):
+    f = s.makefile("rwb", 0)
+    while True:
+        line = f.readline()
+        if not line:
+            return
+        method, path, proto = line.split()
+        headers = {}
+        while True:
+            h = f.readline()
+            if h == b"\r\n":
+                break
+            k, v = h.split(b":", 1)
+            headers[k.strip().lower()] = v.strip()
+        body = ROUTES[path.decode()](path)
+        s.write(b"HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: %d\r\n\r\n" % len(body))
+        s.write(body)
+        if headers.get(b"connection") == b"close":
+            return
+
+def test(num):
+    addr = socket.getaddrinfo("127.0.0.1", 8127)[0][-1]
+    l = socket.socket()
+    l.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    l.bind(addr)
+    l.listen(1)
+    batch = REQ * (BATCH - 1) + REQ.replace(b"\r\n\r\n", b"\r\nConnection: close\r\n\r\n")
+    for i in range(num // 20000 // BATCH):
+        c = socket.socket()
+        c.connect(addr)
+        c.send(batch)
+        s = l.accept()[0]
+        serve(s)
+        s.close()
+        while c.recv(4096):
+            pass
+        c.close()
+    l.close()
+
+bench.run(test)
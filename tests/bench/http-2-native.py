@@ -0,0 +1,32 @@
+import bench
+import usocket as socket
+import _uhttpd
+
+REQ = b"GET /api/status HTTP/1.1\r\nHost: device\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n"
+BATCH = 50
+
+def status(req):
+    return '{"ok": true}'
+
+def test(num):
+    addr = socket.getaddrinfo("127.0.0.1", 8127)[0][-1]
+    l = socket.socket()
+    l.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    l.bind(addr)
+    l.listen(1)
+    srv = _uhttpd.Server()
+    srv.route("/api/status", status)
+    batch = REQ * (BATCH - 1) + REQ.replace(b"\r\n\r\n", b"\r\nConnection: close\r\n\r\n")
+    for i in range(num // 20000 // BATCH):
+        c = socket.socket()
+        c.connect(addr)
+        c.send(batch)
+        s = l.accept()[0]
+        srv.serve(s)
+        s.close()
+        while c.recv(4096):
+            pass
+        c.close()
+    l.close()
+
+bench.run(test)
@@ -0,0 +1,20 @@
+import bench
+import btree
+import uos
+
+def test(num):
+    n = num // 20000
+    f = open("bench_kvstore.db", "w+b")
+    db = btree.open(f)
+    for i in range(n):
+        db[b"key%d" % i] = b"value%d" % i
+    db.flush()
+    for i in range(n):
+        db[b"key%d" % i]
+    for k, v in db.items():
+        pass
+    db.close()
+    f.close()
+    uos.unlink("bench_kvstore.db")
+
+bench.run(test)
@@ -0,0 +1,17 @@
+import bench
+import ukv
+import uos
+
+def test(num):
+    n = num // 20000
+    db = ukv.open("bench_kvstore.db")
+    for i in range(0, n, 50):
+        db.batch([(b"key%d" % j, b"value%d" % j) for j in range(i, i + 50)])
+    for i in range(n):
+        db[b"key%d" % i]
+    for k, v in db.items():
+        pass
+    db.close()
+    uos.unlink("bench_kvstore.db")
+
+bench.run(test)
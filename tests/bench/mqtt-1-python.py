@@ -0,0 +1,28 @@
+import bench
+import uio
+import ustruct
+
+# QoS 0 PUBLISH packets built the way the pure-Python client does it
+def varlen(n):
+    buf = bytearray()
+    while True:
+        b = n & 0x7f
+        n >>= 7
+        buf.append(b | (0x80 if n else 0))
+        if not n:
+            return buf
+
+def publish(s, topic, msg):
+    pkt = bytearray([0x30])
+    pkt.extend(varlen(2 + len(topic) + len(msg)))
+    pkt.extend(ustruct.pack("!H", len(topic)) + topic)
+    s.write(pkt + msg)
+
+def test(num):
+    s = uio.BytesIO()
+    for i in range(num // 2000):
+        publish(s, b"sensors/temp", b"21.5")
+        if i & 255 == 0:
+            s.seek(0)
+
+bench.run(test)
@@ -0,0 +1,13 @@
+import bench
+import uio
+import _umqtt
+
+def test(num):
+    s = uio.BytesIO()
+    m = _umqtt.MQTTClient(s, "bench")
+    for i in range(num // 2000):
+        m.publish(b"sensors/temp", b"21.5")
+        if i & 255 == 0:
+            s.seek(0)
+
+bench.run(test)
@@ -0,0 +1,81 @@
+# Block-wise GET of a resource served from a file, over the WLAN AP's own address
+from network import WLAN
+from network import Coap
+import socket
+import select
+import os
+
+wlan = WLAN(mode=WLAN.AP)
+ip = wlan.ifconfig()[0]
+
+with open('/flash/coap_big.txt', 'w') as f:
+    for i in range(40):
+        f.write('line %02d of the block-wise test file\n' % i)
+
+Coap.init(ip)
+Coap.add_resource('big', media_type=Coap.MEDIATYPE_TEXT_PLAIN, file='/flash/coap_big.txt')
+Coap.add_resource('obs', value='x', observable=True)
+
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.settimeout(2)
+
+def get_block(num, szx):
+    # CON GET, Uri-Path "big", Block2 (num, szx)
+    req = bytes([0x40, 0x01, 0x12, num, 0xB3]) + b'big' + bytes([0xC1, (num << 4) | szx])
+    s.sendto(req, (ip, 5683))
+    p = select.poll()
+    p.register(Coap.socket(), select.POLLIN)
+    p.poll(1000)
+    Coap.read()
+    resp = s.recv(1200)
+    payload = resp[resp.index(b'\xff') + 1:] if b'\xff' in resp else b''
+    return resp[1], payload
+
+data = b''
+num = 0
+while True:
+    code, chunk = get_block(num, 2)
+    if code != 0x45:
+        break
+    data += chunk
+    num += 1
+print(code == 0x82, num)
+with open('/flash/coap_big.txt', 'rb') as f:
+    print(data == f.read())
+
+print(Coap.get_resource('obs') is not None)
+
+def request(req):
+    s.sendto(req, (ip, 5683))
+    p = select.poll()
+    p.register(Coap.socket(), select.POLLIN)
+    p.poll(1000)
+    Coap.read()
+
+def recv_all():
+    msgs = []
+    try:
+        while True:
+            msgs.append(s.recv(1200))
+    except OSError:
+        pass
+    return msgs
+
+# CON GET, token 0x7A, Observe (register), Uri-Path "obs"
+request(bytes([0x41, 0x01, 0x20, 0x00, 0x7A, 0x60, 0x53]) + b'obs')
+msgs = recv_all()
+print(len(msgs), msgs[0][1] == 0x45, msgs[0][-2:])
+
+# three changes between two reads reach the observer as one notification of
+# the last value, sent when a plain GET (no token) drives the next read
+obs = Coap.get_resource('obs')
+for v in ('a', 'b', 'c'):
+    obs.value(v)
+request(bytes([0x40, 0x01, 0x20, 0x01, 0xB3]) + b'obs')
+notes = [m for m in recv_all() if m[0] & 0x0f == 1 and m[4] == 0x7A]
+print(len(notes), notes[0][-2:])
+Coap.remove_resource('big')
+Coap.remove_resource('obs')
+print(Coap.get_resource('big'))
+os.remove('/flash/coap_big.txt')
+s.close()
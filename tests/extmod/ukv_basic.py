@@ -0,0 +1,80 @@
+# Test for ukv module, a log-structured key-value store
+try:
+    import ukv
+    import uos
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+DB = "ukv_test.db"
+
+def cleanup():
+    for name in (DB, DB + ".tmp"):
+        try:
+            uos.unlink(name)
+        except OSError:
+            pass
+
+def size():
+    return uos.stat(DB)[6]
+
+cleanup()
+
+db = ukv.open(DB)
+db[b"one"] = b"1"
+db["two"] = b"22"
+db.put(b"three", b"333")
+print(len(db), b"one" in db, b"four" in db)
+print(db[b"one"], db[b"two"], db.get(b"three"), db.get(b"four"), db.get(b"four", b"-"))
+print(sorted(db), sorted(db.values()))
+
+db[b"one"] = b"uno"
+del db[b"two"]
+try:
+    db[b"two"]
+except KeyError:
+    print("KeyError")
+try:
+    del db[b"two"]
+except KeyError:
+    print("KeyError")
+
+# a batch of puts and deletes is written as one frame
+db.batch([(b"a", b"A"), (b"b", b"B"), (b"three", None)])
+db.batch({b"c": b"C"})
+print(sorted(db.items()))
+db.close()
+
+# reopen: the index is rebuilt by replaying the log
+with ukv.open(DB) as db:
+    print(sorted(db.items()))
+
+# a torn frame at the end of the log is dropped on open
+with open(DB, "ab") as f:
+    f.write(b"\x10\x00\x00\x00\x00\x00\x00\x00abc")
+with ukv.open(DB) as db:
+    print(sorted(db.items()))
+    db[b"d"] = b"D"
+with ukv.open(DB) as db:
+    print(sorted(db.items()))
+
+# compaction only keeps the live entries
+with ukv.open(DB) as db:
+    for i in range(10):
+        db[b"k"] = bytes([i])
+    del db[b"k"]
+    before = size()
+    db.compact()
+    print(size() < before, sorted(db.items()))
+
+# leftover of a compaction interrupted after the database was removed
+uos.rename(DB, DB + ".tmp")
+with ukv.open(DB) as db:
+    print(sorted(db.keys()))
+
+try:
+    db[b"x"] = b"y"
+except OSError:
+    print("OSError")
+
+cleanup()
@@ -0,0 +1,108 @@
+# Test for ulog module, an append-only log of fixed-size timestamped records
+try:
+    import ulog
+    import uos
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+DIR = "ulog_test.dir"
+
+def segments():
+    return sorted(e[0] for e in uos.ilistdir(DIR) if e[0] not in (".", ".."))
+
+def cleanup():
+    try:
+        names = segments()
+    except OSError:
+        return
+    for name in names:
+        uos.unlink(DIR + "/" + name)
+    try:
+        uos.rmdir(DIR)
+    except OSError:
+        pass
+
+cleanup()
+
+# 4 records per segment, at most 3 segments, commit every 2 records
+log = ulog.Log(DIR, 4, segment_records=4, segments=3, page=24)
+for t in range(10):
+    log.append(t * 10, bytes([t, t + 1]))
+
+# records are zero padded to record_size
+print(list(log.query(0, 25)))
+print([t for t, d in log.query(35)])
+print([t for t, d in log.query(100, 200)])
+
+# too long record and decreasing timestamp are rejected
+try:
+    log.append(100, b"12345")
+except ValueError:
+    print("ValueError")
+try:
+    log.append(50, b"1")
+except ValueError:
+    print("ValueError")
+
+# oldest segment is dropped once more than 3 segments exist
+for t in range(10, 14):
+    log.append(t * 10, b"x")
+log.close()
+print(segments())
+
+# reopen: appending resumes after the last stored timestamp
+with ulog.Log(DIR, 4, segment_records=4, segments=3) as log:
+    log.append(140, b"y")
+    print([t for t, d in log.query()])
+    print(next(log.query(140)))
+
+# a partial record at the end of the last segment is skipped
+with open(DIR + "/00000003", "ab") as f:
+    f.write(b"\x01\x02\x03")
+with ulog.Log(DIR, 4, segment_records=4, segments=3) as log:
+    log.append(150, b"z")
+    print([t for t, d in log.query(130)])
+
+# a corrupted record fails its CRC check and is not returned
+with open(DIR + "/00000004", "rb") as f:
+    data = bytearray(f.read())
+data[5] ^= 0xff
+with open(DIR + "/00000004", "wb") as f:
+    f.write(data)
+with ulog.Log(DIR, 4, segment_records=4, segments=3) as log:
+    print([t for t, d in log.query(130)])
+
+try:
+    log.append(200, b"")
+except OSError:
+    print("OSError")
+
+# right after a rotation the last segment is empty, the last timestamp is
+# taken from the segment before it
+cleanup()
+with ulog.Log(DIR, 4, segment_records=4, segments=3, page=24) as log:
+    for t in range(4):
+        log.append(t * 10, b"a")
+print(segments())
+with ulog.Log(DIR, 4, segment_records=4, segments=3) as log:
+    try:
+        log.append(10, b"b")
+    except ValueError:
+        print("ValueError")
+    log.append(30, b"c")
+    print([t for t, d in log.query()])
+
+# reopening onto a full last segment starts a new one, and still drops the
+# oldest to stay within the segment limit
+cleanup()
+with ulog.Log(DIR, 4, segment_records=4, segments=2, page=24) as log:
+    for t in range(6):
+        log.append(t * 10, b"d")
+print(segments())
+with ulog.Log(DIR, 4, segment_records=2, segments=2) as log:
+    print(segments())
+    log.append(60, b"e")
+    print([t for t, d in log.query()])
+
+cleanup()
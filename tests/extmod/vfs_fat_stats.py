@@ -0,0 +1,86 @@
+# test per-mount block device statistics and the I/O trace
+
+try:
+    import uos
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+try:
+    uos.VfsFat
+    uos.mount
+    uos.fsstats
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+
+class RAMFS:
+
+    SEC_SIZE = 512
+
+    def __init__(self, blocks):
+        self.data = bytearray(blocks * self.SEC_SIZE)
+
+    def readblocks(self, n, buf):
+        for i in range(len(buf)):
+            buf[i] = self.data[n * self.SEC_SIZE + i]
+
+    def writeblocks(self, n, buf):
+        for i in range(len(buf)):
+            self.data[n * self.SEC_SIZE + i] = buf[i]
+
+    def ioctl(self, op, arg):
+        if op == 4:  # BP_IOCTL_SEC_COUNT
+            return len(self.data) // self.SEC_SIZE
+        if op == 5:  # BP_IOCTL_SEC_SIZE
+            return self.SEC_SIZE
+
+
+try:
+    bdev = RAMFS(50)
+except MemoryError:
+    print("SKIP")
+    raise SystemExit
+
+uos.VfsFat.mkfs(bdev)
+vfs = uos.VfsFat(bdev)
+uos.mount(vfs, "/ramdisk")
+
+# start from zero
+vfs.stats(True)
+s = vfs.stats()
+print(sorted(s.keys()))
+print(s["read"][:3], s["write"][:3], len(s["read"][3]))
+
+uos.fstrace(16)
+with open("/ramdisk/test.txt", "w") as f:
+    f.write("hello" * 200)
+with open("/ramdisk/test.txt") as f:
+    data = f.read()
+
+s = uos.fsstats("/ramdisk")
+for op in ("read", "write"):
+    count, nbytes, errors, hist = s[op]
+    print(op, count > 0, nbytes >= count * 512 and nbytes % 512 == 0, errors, sum(hist) == count)
+print("sync", s["sync"][0] > 0)
+
+# the trace holds the most recent entries, oldest first
+trace = uos.fstrace()
+print(0 < len(trace) <= 16)
+print(all(e[2] in ("read", "write", "sync") for e in trace))
+print(all(e[6] for e in trace))
+print(uos.fstrace())
+uos.fstrace(0)
+print(uos.fstrace())
+
+# reset returns the old values and clears the counters
+print(vfs.stats(True)["write"][0] > 0)
+print(vfs.stats()["write"][:3])
+
+try:
+    uos.fsstats("/nonexistent")
+except OSError as e:
+    print("OSError")
+
+uos.umount("/ramdisk")
@@ -0,0 +1,125 @@
+# test VfsRom, the read-only filesystem over an in-memory image
+
+try:
+    import uos
+    uos.VfsRom
+except (ImportError, AttributeError):
+    try:
+        import uos_vfs as uos
+        uos.VfsRom
+    except (ImportError, AttributeError):
+        print("SKIP")
+        raise SystemExit
+
+# built by tools/mkromfs.py from:
+#   data.txt, lib/romtest1.py, lib/romtest2.py, lib/rompkg/__init__.py, www/index.html
+IMAGE = (
+    b'MPRF\x01\x00\x00\x00`\x01\x00\x00\x14\x00\x00\x00\x03\x00\x00\x00\x94\x00\x00\x00\x08\x00\x01\x00\xd4\x00\x00\x00'
+    b'$\x00\x00\x00\x9c\x00\x00\x00\x03\x00\x02\x00D\x00\x00\x00\x03\x00\x00\x00\x9f\x00\x00\x00\x03\x00\x02\x00t\x00\x00\x00'
+    b'\x01\x00\x00\x00\xa2\x00\x00\x00\x06\x00\x02\x00\x84\x00\x00\x00\x01\x00\x00\x00\xa8\x00\x00\x00\x0b\x00\x01\x00\xf8\x00\x00\x00'
+    b'%\x00\x00\x00\xb3\x00\x00\x00\x0b\x00\x01\x00 \x01\x00\x00\x1c\x00\x00\x00\xbe\x00\x00\x00\n\x00\x01\x00<\x01\x00\x00'
+    b'\r\x00\x00\x00\xc8\x00\x00\x00\x0b\x00\x01\x00L\x01\x00\x00\x13\x00\x00\x00data.txtlibw'
+    b'wwrompkgromtest1.pyromtest2.pyin'
+    b'dex.html__init__.py\x00some data in'
+    b" a ROM file\nsecond line\nprint('i"
+    b"n romtest1')\nimport romtest2\n\x00\x00\x00"
+    b"print('in romtest2')\nx = 42\n<p>h"
+    b"ello</p>\n\x00\x00\x00print('in rompkg')\n\x00"
+)
+
+fs = uos.VfsRom(IMAGE)
+
+# directory listings come out sorted, with sizes for files
+print(list(fs.ilistdir('/')))
+print(list(fs.ilistdir('/lib')))
+print(list(fs.ilistdir(b'/www')))
+
+# stat
+print(fs.stat('/data.txt')[0] == 0x8000, fs.stat('/data.txt')[6])
+print(fs.stat('/lib')[0] == 0x4000)
+print(fs.stat('/lib/rompkg/')[0] == 0x4000)
+for path in ('/missing', '/data.txt/x', '/lib/romtest'):
+    try:
+        fs.stat(path)
+    except OSError as er:
+        print(path, repr(er))
+
+# reading, seeking and iterating
+f = fs.open('/data.txt', 'r')
+print(f.read(4), f.read(5))
+print(f.tell(), f.seek(-5, 2), f.read())
+f.seek(0)
+print(list(f))
+f.close()
+try:
+    f.read()
+except OSError as er:
+    print(repr(er))
+
+with fs.open('/www/index.html', 'rb') as f:
+    buf = bytearray(6)
+    print(f.readinto(buf), buf)
+    # the contents are available in place, without a copy
+    m = memoryview(f)
+    print(len(m), bytes(m[-5:]))
+    try:
+        m[0] = 0
+    except TypeError:
+        print('TypeError')
+
+# relative paths and the current directory
+print(fs.getcwd())
+fs.chdir('lib/rompkg')
+print(fs.getcwd())
+print(fs.open('__init__.py', 'r').read())
+print(fs.open('../romtest2.py', 'r').readline())
+fs.chdir('..')
+print(fs.getcwd())
+fs.chdir('/')
+print(fs.getcwd())
+try:
+    fs.chdir('/data.txt')
+except OSError as er:
+    print(repr(er))
+
+# everything that modifies the filesystem fails
+for op, args in (('open', ('/data.txt', 'w')), ('open', ('/new', 'a')), ('mkdir', ('/d',)),
+        ('remove', ('/data.txt',)), ('rename', ('/data.txt', '/x')), ('rmdir', ('/lib',))):
+    try:
+        getattr(fs, op)(*args)
+    except OSError as er:
+        print(op, repr(er))
+try:
+    fs.open('/lib', 'r')
+except OSError as er:
+    print(repr(er))
+
+print(fs.statvfs('/')[2] == len(IMAGE))
+
+# invalid images are rejected
+for img in (b'', b'MPRF' + bytes(16), IMAGE[:100], IMAGE[:16] + b'\xff' + IMAGE[17:]):
+    try:
+        uos.VfsRom(img)
+    except ValueError:
+        print('ValueError')
+
+# every entry of a table is a directory sharing the next table: all within
+# the image, but 8 ** 12 paths to walk, which must be rejected at once
+try:
+    import ustruct as struct
+except ImportError:
+    import struct
+levels, k = 12, 8
+size = 20 + (levels + 1) * k * 16 + 1
+img = b'MPRF' + struct.pack('<HHIII', 1, 0, size, 20, k)
+for i in range(levels + 1):
+    for j in range(k):
+        if i < levels:
+            img += struct.pack('<IHHII', size - 1, 1, 2, 20 + (i + 1) * k * 16, k)
+        else:
+            img += struct.pack('<IHHII', size - 1, 1, 1, size - 1, 0)
+img += b'a'
+try:
+    uos.VfsRom(img)
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,43 @@
+# test mounting a VfsRom and importing from it
+
+import sys
+
+try:
+    import uos
+    uos.mount
+    uos.VfsRom
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+# built by tools/mkromfs.py from:
+#   data.txt, lib/romtest1.py, lib/romtest2.py, lib/rompkg/__init__.py, www/index.html
+IMAGE = (
+    b'MPRF\x01\x00\x00\x00`\x01\x00\x00\x14\x00\x00\x00\x03\x00\x00\x00\x94\x00\x00\x00\x08\x00\x01\x00\xd4\x00\x00\x00'
+    b'$\x00\x00\x00\x9c\x00\x00\x00\x03\x00\x02\x00D\x00\x00\x00\x03\x00\x00\x00\x9f\x00\x00\x00\x03\x00\x02\x00t\x00\x00\x00'
+    b'\x01\x00\x00\x00\xa2\x00\x00\x00\x06\x00\x02\x00\x84\x00\x00\x00\x01\x00\x00\x00\xa8\x00\x00\x00\x0b\x00\x01\x00\xf8\x00\x00\x00'
+    b'%\x00\x00\x00\xb3\x00\x00\x00\x0b\x00\x01\x00 \x01\x00\x00\x1c\x00\x00\x00\xbe\x00\x00\x00\n\x00\x01\x00<\x01\x00\x00'
+    b'\r\x00\x00\x00\xc8\x00\x00\x00\x0b\x00\x01\x00L\x01\x00\x00\x13\x00\x00\x00data.txtlibw'
+    b'wwrompkgromtest1.pyromtest2.pyin'
+    b'dex.html__init__.py\x00some data in'
+    b" a ROM file\nsecond line\nprint('i"
+    b"n romtest1')\nimport romtest2\n\x00\x00\x00"
+    b"print('in romtest2')\nx = 42\n<p>h"
+    b"ello</p>\n\x00\x00\x00print('in rompkg')\n\x00"
+)
+
+uos.mount(uos.VfsRom(IMAGE), '/rom')
+print(uos.listdir('/rom'))
+print(uos.stat('/rom/lib/romtest2.py')[6])
+with open('/rom/data.txt') as f:
+    print(f.readline())
+
+# import modules and a package straight out of the image
+sys.path.insert(0, '/rom/lib')
+import romtest1
+import romtest2
+print(romtest2.x)
+import rompkg
+
+uos.umount('/rom')
+sys.path.pop(0)
@@ -0,0 +1,59 @@
+try:
+    import uio
+    import uwebsocket
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+# put raw data in the stream and do a websocket read
+def ws_read(msg, sz):
+    ws = uwebsocket.websocket(uio.BytesIO(msg))
+    return ws.read(sz)
+
+def mask(data, key, start=0):
+    return bytes(b ^ key[(start + i) & 3] for i, b in enumerate(data))
+
+# fragmented message, with a control frame in the middle
+print(ws_read(b"\x01\x04ping\x89\x00\x80\x04pong", 8))
+
+# the ping doesn't change the type of the message being read
+ws = uwebsocket.websocket(uio.BytesIO(b"\x02\x02ab\x89\x00\x80\x02cd"))
+print(ws.read(2), ws.ioctl(8)) # GET_DATA_OPTS
+print(ws.read(2), ws.ioctl(8))
+
+# masked payloads of every length around a word, read in uneven pieces
+key = b"\x12\x34\x56\x78"
+for n in range(1, 12):
+    data = bytes(range(n))
+    ws = uwebsocket.websocket(uio.BytesIO(bytes([0x82, 0x80 | n]) + key + mask(data, key)))
+    out = ws.read(1) + ws.read(3) + ws.read(n)
+    print(n, out == data)
+
+# 64-bit payload length
+data = b"0123456789" * 7000
+s = uio.BytesIO(b"\x82\x7f" + bytes(4) + len(data).to_bytes(4, "big") + data)
+ws = uwebsocket.websocket(s)
+print(ws.read(len(data)) == data)
+
+# write with a 64-bit length header
+s = uio.BytesIO()
+ws = uwebsocket.websocket(s)
+ws.ioctl(9, 2)
+ws.write(data)
+print(s.getvalue()[:10], len(s.getvalue()) == len(data) + 10)
+
+# write a message as fragments
+s = uio.BytesIO()
+ws = uwebsocket.websocket(s)
+print(ws.ioctl(9, 1 | 0x10)) # SET_DATA_OPTS, FRAME_TXT | FRAME_MORE
+ws.write(b"ab")
+ws.write(b"cd")
+print(ws.ioctl(9, 1))
+ws.write(b"ef")
+ws.write(b"gh") # a new, unfragmented message
+print(s.getvalue())
+
+# and read both messages back
+s.seek(0)
+ws = uwebsocket.websocket(s)
+print(ws.read(8))
@@ -0,0 +1,60 @@
+# test connects with a deadline, several in flight at once: a listener that
+# doesn't accept lets the first connects through, the others must time out
+# after their own timeout, all together rather than one after the other
+
+try:
+    import usocket as socket, utime as time, _thread
+    socket.socket.settimeout
+except (ImportError, AttributeError):
+    # needs blocking connects with a timeout, run from several threads
+    print('SKIP')
+    raise SystemExit
+
+N = 6
+TIMEOUT_MS = 500
+
+addr = socket.getaddrinfo('127.0.0.1', 8125)[0][-1]
+server = socket.socket()
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind(addr)
+server.listen(1)
+
+
+def connect_threads():
+    lock = _thread.allocate_lock()
+    results = []
+
+    def client():
+        s = socket.socket()
+        s.settimeout(TIMEOUT_MS / 1000)
+        try:
+            s.connect(addr)
+            r = 'ok'
+        except OSError:
+            # TimeoutError on the device, which closed the socket
+            r = 'timeout'
+        with lock:
+            results.append((r, s))
+
+    for i in range(N):
+        _thread.start_new_thread(client, ())
+    while True:
+        with lock:
+            if len(results) == N:
+                return results
+        time.sleep_ms(10)
+
+
+t0 = time.ticks_ms()
+results = connect_threads()
+elapsed = time.ticks_diff(time.ticks_ms(), t0)
+
+outcomes = [r for r, s in results]
+print(len(outcomes) == N)
+print(outcomes.count('ok') >= 1, outcomes.count('timeout') >= 1)
+# the timeouts ran in parallel, each connect waited its own TIMEOUT_MS
+print(TIMEOUT_MS <= elapsed < 2 * TIMEOUT_MS)
+
+for r, s in results:
+    s.close()
+server.close()
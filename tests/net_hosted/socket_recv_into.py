@@ -0,0 +1,36 @@
+# test recv_into, recvfrom_into and the vectored sendv/recvv on a UDP socket
+
+try:
+    import usocket as socket
+except:
+    import socket
+
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+addr = socket.getaddrinfo('127.0.0.1', 8124)[0][-1]
+s.bind(addr)
+s.connect(addr)
+
+buf = bytearray(16)
+s.send(b'hello')
+print(s.recv_into(buf), buf[:5])
+
+# nbytes limits the read
+s.send(b'world')
+print(s.recv_into(buf, 3), buf[:5])
+
+s.send(b'abc')
+n, a = s.recvfrom_into(buf)
+print(n, buf[:n], a == addr)
+
+# a datagram is gathered from, and scattered over, several buffers
+print(s.sendv([b'12', b'', memoryview(b'345'), bytearray(b'6789')]))
+b1 = bytearray(4)
+b2 = bytearray(8)
+print(s.recvv([b1, b2]), b1, b2)
+
+try:
+    s.recv_into(buf, -1)
+except ValueError:
+    print('ValueError')
+
+s.close()
@@ -0,0 +1,112 @@
+# test the native HTTP server core against requests sent over a loopback TCP connection
+
+try:
+    import usocket as socket
+    import uos
+    import _uhttpd
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+
+# static files
+try:
+    uos.mkdir('uhttpd_www')
+except OSError:
+    pass
+with open('uhttpd_www/index.html', 'w') as f:
+    f.write('<h1>hi</h1>\n')
+with open('uhttpd_www/app.css', 'w') as f:
+    f.write('body{}' * 100)
+with open('uhttpd_www/app.css.gz', 'wb') as f:
+    f.write(b'\x1f\x8bGZ')
+
+addr = socket.getaddrinfo('127.0.0.1', 8126)[0][-1]
+lsock = socket.socket()
+lsock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+lsock.bind(addr)
+lsock.listen(1)
+
+srv = _uhttpd.Server(root='uhttpd_www', buf_size=256, max_body=64)
+
+def hello(req):
+    return 'hello ' + req.method
+
+def echo(req):
+    return (201, req.body, {'Content-Type': 'application/octet-stream', 'X-Query': req.query})
+
+def hdrs(req):
+    return req.headers['x-test']
+
+def gen(req):
+    for i in range(3):
+        yield b'part%d;' % i
+
+def fail(req):
+    raise ValueError('handler failed')
+
+srv.route('/hello', hello)
+srv.route('/echo', echo)
+srv.route('/hdrs', hdrs)
+srv.route('/gen', gen)
+srv.route('/fail', fail)
+
+# the requests are all queued before the server answers them, then the
+# responses are read back in one go
+def exchange(reqs):
+    c = socket.socket()
+    c.connect(addr)
+    c.send(reqs)
+    s = lsock.accept()[0]
+    n = srv.serve(s)
+    s.close()
+    resp = b''
+    while True:
+        d = c.recv(4096)
+        if not d:
+            break
+        resp += d
+    c.close()
+    return n, resp
+
+def show(r):
+    n, resp = r
+    print(n)
+    for line in resp.split(b'\r\n'):
+        print(line)
+
+# keep-alive with pipelined requests, the last one closes the connection
+show(exchange(
+    b'GET /hello HTTP/1.1\r\nHost: x\r\n\r\n'
+    b'POST /echo?a=1 HTTP/1.1\r\nContent-Length: 5\r\n\r\nabcde'
+    b'PUT /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2;x=y\r\nde\r\n0\r\n\r\n'
+    b'GET /hdrs HTTP/1.1\r\nX-Test: value 1\r\n\r\n'
+    b'GET /gen HTTP/1.1\r\nConnection: close\r\n\r\n'
+))
+
+# HTTP/1.0 closes after each request unless asked not to, and gets a generated body unchunked
+show(exchange(b'HEAD /hello HTTP/1.0\r\nConnection: keep-alive\r\n\r\nGET /gen HTTP/1.0\r\n\r\n'))
+
+# static files, gzip passthrough, and the errors
+show(exchange(
+    b'GET / HTTP/1.1\r\n\r\n'
+    b'GET /app.css HTTP/1.1\r\nAccept-Encoding: deflate, gzip\r\n\r\n'
+    b'HEAD /app.css HTTP/1.1\r\n\r\n'
+    b'GET /missing.txt HTTP/1.1\r\n\r\n'
+    b'GET /../secret HTTP/1.1\r\n\r\n'
+    b'BREW /hello HTTP/1.1\r\n\r\n'
+    b'POST /echo HTTP/1.1\r\nContent-Length: 100\r\n\r\n'
+))
+show(exchange(b'GET /fail HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\n\r\n'))
+show(exchange(b'garbage\r\n\r\n'))
+# headers that don't fit in the buffer; exactly as many bytes as it holds are
+# sent so the server reads them all before closing
+show(exchange((b'GET /hello HTTP/1.1\r\nX-Long: ' + b'x' * 256)[:256]))
+
+print(sorted(srv.stats(True).items()))
+print(sorted(srv.stats().items()))
+
+lsock.close()
+rm = getattr(uos, 'remove', None) or uos.unlink
+for f in ('index.html', 'app.css', 'app.css.gz'):
+    rm('uhttpd_www/' + f)
+uos.rmdir('uhttpd_www')
@@ -0,0 +1,71 @@
+# test the native MQTT client against a broker stand-in on a loopback TCP connection
+
+try:
+    import usocket as socket
+    import _umqtt
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+
+addr = socket.getaddrinfo('127.0.0.1', 8125)[0][-1]
+srv = socket.socket()
+srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+srv.bind(addr)
+srv.listen(1)
+s = socket.socket()
+s.connect(addr)
+b = srv.accept()[0]
+
+def broker():
+    return b.recv(256)
+
+m = _umqtt.MQTTClient(s, 'dev1', window=2, retry_ms=60000)
+
+# the broker's answers are queued before the call that waits for them
+b.send(b'\x20\x02\x00\x00')
+print(m.connect())
+print(broker())
+
+m.publish(b't', b'hi')
+m.publish('t/x', b'x' * 200, True)
+print(broker())
+
+# QoS 1 fills the in-flight window, a PUBACK frees a slot
+print(m.publish(b'q', b'1', qos=1), m.publish(b'q', b'2', False, 1), m.pending())
+print(broker())
+b.send(b'\x40\x02\x00\x01')
+print(m.publish(b'q', b'3', False, 1), m.pending())
+print(broker())
+
+b.send(b'\x90\x03\x00\x04\x01')
+print(m.subscribe(b'a/#', 1))
+print(broker())
+
+# a QoS 1 PUBLISH from the broker is acknowledged and handed to the callback
+def cb(topic, msg):
+    print('cb', topic, msg)
+m.set_callback(cb)
+b.send(b'\x32\x08\x00\x03a/b\x00\x07z')
+print(m.wait_msg())
+print(broker())
+
+print(m.check_msg())
+
+# a lost PUBACK: the message goes out again with DUP set
+m2 = _umqtt.MQTTClient(s, 'dev1', retry_ms=0)
+m2.publish(b'r', b'', False, 1)
+print(broker())
+print(m2.check_msg())
+print(broker())
+
+b.send(b'\x20\x02\x00\x05')
+try:
+    m.connect()
+except OSError as e:
+    print(e)
+print(broker())
+
+m.disconnect()
+print(broker())
+b.close()
+srv.close()
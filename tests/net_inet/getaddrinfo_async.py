@@ -0,0 +1,47 @@
+# test usocket.getaddrinfo_async, on the device
+try:
+    import usocket as socket, uselect as select, uerrno as errno
+    socket.getaddrinfo_async
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def wait(q, timeout_ms=15000):
+    p = select.poll()
+    p.register(q, select.POLLIN)
+    return len(p.poll(timeout_ms)) == 1
+
+
+# a literal address needs no DNS server, but is still answered by the lwIP thread
+q = socket.getaddrinfo_async("127.0.0.1", 80)
+print(wait(q, 1000), q.result()[0][-1])
+
+# a name: poll until done, then the same answer as getaddrinfo
+q = socket.getaddrinfo_async("micropython.org", 80)
+try:
+    q.result()
+except OSError as e:
+    if e.args[0] != errno.EINPROGRESS:
+        raise
+print(wait(q))
+print(q.result() == socket.getaddrinfo("micropython.org", 80))
+
+# several queries in flight at once
+qs = [socket.getaddrinfo_async(h, 443) for h in ("google.com", "api.telegram.org", "micropython.org")]
+print([wait(q) for q in qs])
+print([len(q.result()) for q in qs])
+
+# a name that doesn't resolve fails from result(), not from the poll
+q = socket.getaddrinfo_async("no-such-host.invalid", 80)
+print(wait(q, 30000))
+try:
+    q.result()
+except OSError:
+    print("OSError")
+
+# and is remembered for a moment, so a retry fails at once
+try:
+    socket.getaddrinfo("no-such-host.invalid", 80)
+except OSError:
+    print("OSError")
@@ -0,0 +1,71 @@
+# test the ussl session cache and its counters, on the device
+try:
+    import usocket as socket, ussl as ssl
+    ssl.stats
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+try:
+    import _thread
+except ImportError:
+    _thread = None
+
+# one more host than the cache holds, so that entries get evicted
+HOSTS = ["google.com", "www.google.com", "api.telegram.org", "api.pushbullet.com", "micropython.org"]
+
+
+def handshake(host):
+    addr = socket.getaddrinfo(host, 443)[0][-1]
+    s = socket.socket()
+    try:
+        s.connect(addr)
+        s = ssl.wrap_socket(s, server_hostname=host)
+    finally:
+        s.close()
+
+
+ssl.clear_sessions()
+ssl.stats(True)
+
+# the second handshake offers the session of the first
+handshake(HOSTS[0])
+handshake(HOSTS[0])
+st = ssl.stats(True)
+print(st["full"], st["resumed"], st["failed"])
+print(st["resumed_us"] < st["full_us"])
+
+# reset
+st = ssl.stats()
+print(st["full"], st["resumed"], st["failed"], st["full_us"], st["resumed_us"])
+
+# handshakes to every host from two threads at once: entries are evicted
+# while others are offered, every handshake must still be counted once
+if _thread:
+    lock = _thread.allocate_lock()
+    done = [0]
+
+    def worker(hosts):
+        for h in hosts:
+            try:
+                handshake(h)
+            except OSError:
+                pass
+        with lock:
+            done[0] += 1
+
+    _thread.start_new_thread(worker, (HOSTS,))
+    _thread.start_new_thread(worker, (HOSTS[::-1],))
+    while True:
+        with lock:
+            if done[0] == 2:
+                break
+    st = ssl.stats(True)
+    print(st["full"] + st["resumed"] + st["failed"] == 2 * len(HOSTS))
+else:
+    print(True)
+
+ssl.clear_sessions()
+handshake(HOSTS[0])
+st = ssl.stats(True)
+print(st["full"], st["resumed"])
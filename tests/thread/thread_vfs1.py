@@ -0,0 +1,48 @@
+# test concurrent access to the filesystem from multiple threads, each thread
+# writing, reading back and removing its own file
+
+import _thread
+import time
+try:
+    import uos as os
+except ImportError:
+    import os
+
+n_thread = 4
+n_write = 16
+chunk = b'0123456789abcdef' * 8
+
+def thread_entry(n):
+    fname = 'thread_vfs1_{}.dat'.format(n)
+    ok = True
+    try:
+        with open(fname, 'wb') as f:
+            for i in range(n_write):
+                f.write(chunk)
+        with open(fname, 'rb') as f:
+            for i in range(n_write):
+                if f.read(len(chunk)) != chunk:
+                    ok = False
+            if f.read(1) != b'':
+                ok = False
+        os.remove(fname)
+    except OSError:
+        ok = False
+    with lock:
+        global n_finished, n_ok
+        n_finished += 1
+        if ok:
+            n_ok += 1
+
+lock = _thread.allocate_lock()
+n_finished = 0
+n_ok = 0
+
+# spawn threads
+for i in range(n_thread):
+    _thread.start_new_thread(thread_entry, (i,))
+
+# busy wait for threads to finish
+while n_finished < n_thread:
+    time.sleep(0.01)
+print(n_ok == n_thread)
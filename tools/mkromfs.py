@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+# This file is part of the MicroPython project, http://micropython.org/
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2021 Pycom Limited
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+# Build a read-only filesystem image for uos.VfsRom from a directory tree.
+# The image layout is described in extmod/vfs_rom.h.
+#
+# Usage:
+#
+#   mkromfs.py -o rom.img lib/
+#   mkromfs.py --mpy-cross ../mpy-cross/mpy-cross --py romfs.py lib/
+#
+# The second form precompiles .py files to .mpy and writes the image as a
+# bytes constant in a Python module.  Freezing that module puts the image in
+# flash, where it can be mounted without copying it to RAM:
+#
+#   import uos, romfs
+#   uos.mount(uos.VfsRom(romfs.IMAGE), '/rom')
+
+from __future__ import print_function
+import os
+import shlex
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = b'MPRF'
+VERSION = 1
+HEADER_SIZE = 20
+ENTRY_SIZE = 16
+KIND_FILE = 1
+KIND_DIR = 2
+MAX_DEPTH = 16
+
+def align4(n):
+    return (n + 3) & ~3
+
+def load_tree(path, mpy_cross, depth=0):
+    if depth >= MAX_DEPTH:
+        raise SystemExit('%s: directories nested too deeply' % path)
+    tree = {}
+    for name in sorted(os.listdir(path)):
+        full = os.path.join(path, name)
+        if os.path.isdir(full):
+            tree[name.encode('utf-8')] = load_tree(full, mpy_cross, depth + 1)
+            continue
+        if mpy_cross and name.endswith('.py') and name not in ('boot.py', 'main.py'):
+            with tempfile.TemporaryDirectory() as tmp:
+                out = os.path.join(tmp, name[:-3] + '.mpy')
+                subprocess.check_call(shlex.split(mpy_cross) + ['-o', out, '-s', name, full])
+                with open(out, 'rb') as f:
+                    data = f.read()
+            name = name[:-3] + '.mpy'
+        else:
+            with open(full, 'rb') as f:
+                data = f.read()
+        tree[name.encode('utf-8')] = data
+    return tree
+
+def build_image(tree):
+    # Lay the tables out breadth first, so every child table follows its
+    # parent's, then the names, then the file bodies.
+    tables = []
+    queue = [tree]
+    offset = HEADER_SIZE
+    table_off = {}
+    while queue:
+        d = queue.pop(0)
+        table_off[id(d)] = offset
+        tables.append(d)
+        offset += ENTRY_SIZE * len(d)
+        for name in sorted(d):
+            if isinstance(d[name], dict):
+                queue.append(d[name])
+
+    names = bytearray()
+    name_off = {}
+    for d in tables:
+        for name in d:
+            if name not in name_off:
+                name_off[name] = offset + len(names)
+                names += name
+    offset = align4(offset + len(names))
+
+    body = bytearray()
+    entries = bytearray()
+    for d in tables:
+        for name in sorted(d):
+            item = d[name]
+            if isinstance(item, dict):
+                entries += struct.pack('<IHHII', name_off[name], len(name), KIND_DIR,
+                    table_off[id(item)], len(item))
+            else:
+                entries += struct.pack('<IHHII', name_off[name], len(name), KIND_FILE,
+                    offset + len(body), len(item))
+                body += item
+                body += bytes(align4(len(body)) - len(body))
+
+    size = offset + len(body)
+    header = MAGIC + struct.pack('<HHIII', VERSION, 0, size, HEADER_SIZE, len(tree))
+    image = header + entries + names
+    image += bytes(align4(len(image)) - len(image))
+    image += body
+    assert len(image) == size
+    return bytes(image)
+
+def write_py(f, image):
+    f.write('# ROM filesystem image generated by mkromfs.py\n')
+    f.write('IMAGE = (\n')
+    for i in range(0, len(image), 32):
+        f.write('    %r\n' % image[i:i + 32])
+    f.write(')\n')
+
+def main():
+    import argparse
+    cmd_parser = argparse.ArgumentParser(description='Build a ROM filesystem image for uos.VfsRom.')
+    cmd_parser.add_argument('-o', '--output', help='write the raw image to this file')
+    cmd_parser.add_argument('--py', help='write the image as a Python module, for freezing')
+    cmd_parser.add_argument('--mpy-cross', help='compile .py files to .mpy with this mpy-cross command (may include options)')
+    cmd_parser.add_argument('dir', help='directory to pack')
+    args = cmd_parser.parse_args()
+
+    if not args.output and not args.py:
+        cmd_parser.error('at least one of -o and --py is required')
+
+    image = build_image(load_tree(args.dir, args.mpy_cross))
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(image)
+    if args.py:
+        with open(args.py, 'w') as f:
+            write_py(f, image)
+    print('%s: %u bytes' % (args.dir, len(image)), file=sys.stderr)
+
+if __name__ == '__main__':
+    main()